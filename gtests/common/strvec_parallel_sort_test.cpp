@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "terark/radix_sort.hpp"
+#include "terark/util/sortable_strvec.hpp"
+
+namespace terark {
+
+  /**
+   * keys with many duplicates, long equal prefixes, empty keys, keys
+   * which are prefix of other keys, and bytes 0x00/0xFF
+   */
+  static std::vector<std::string> gen_keys(size_t num, std::mt19937_64& rnd) {
+    std::vector<std::string> keys;
+    keys.reserve(num);
+    std::string prefix(40, 'p');
+    for (size_t i = 0; i < num; ++i) {
+      std::string key;
+      switch (rnd() % 6) {
+      case 0: // duplicates
+        key = "dup" + std::to_string(rnd() % 64);
+        break;
+      case 1: // equal prefix
+        key = prefix + std::to_string(rnd() % 100000);
+        break;
+      case 2: // prefix of other keys
+        key = prefix.substr(0, rnd() % prefix.size());
+        break;
+      case 3:
+        key.resize(rnd() % 3);
+        for (char& c : key) c = (rnd() % 2) ? '\0' : '\xFF';
+        break;
+      default:
+        key.resize(rnd() % 24);
+        for (char& c : key) c = char(rnd() % 256);
+        break;
+      }
+      keys.push_back(key);
+    }
+    return keys;
+  }
+
+  template<class StrVec>
+  void check_sort(const std::vector<std::string>& keys) {
+    StrVec strVec;
+    for (auto& key : keys) {
+      strVec.push_back(key);
+    }
+    std::vector<size_t> offsetToKey(strVec.str_size() + 1, size_t(-1));
+    for (size_t i = 0; i < keys.size(); ++i) {
+      offsetToKey[strVec.nth_offset(i)] = i;
+    }
+    strVec.sort();
+    std::vector<std::string> expect(keys);
+    std::sort(expect.begin(), expect.end());
+    ASSERT_EQ(strVec.size(), expect.size());
+    std::vector<bool> seen(keys.size(), false);
+    for (size_t i = 0; i < expect.size(); ++i) {
+      ASSERT_EQ(strVec[i].str(), expect[i]) << "i = " << i;
+      // entries are moved as a whole, none is lost or duplicated,
+      // empty keys share offset with the next key, skip them
+      if (!expect[i].empty()) {
+        size_t orig = offsetToKey[strVec.nth_offset(i)];
+        ASSERT_EQ(keys[orig], expect[i]);
+        ASSERT_FALSE(seen[orig]);
+        seen[orig] = true;
+      }
+    }
+  }
+
+  // SortableStrVec and SortThinStrVec use parallel radix sort iff
+  // size() >= <Class>_parallelSortMinNum
+  TEST(STRVEC_PARALLEL_SORT_TEST, AROUND_THRESHOLD) {
+    const size_t minNum = 20000;
+    setenv("SortableStrVec_parallelSortMinNum", std::to_string(minNum).c_str(), 1);
+    setenv("SortThinStrVec_parallelSortMinNum", std::to_string(minNum).c_str(), 1);
+    setenv("SortableStrVec_sortThreads", "4", 1);
+    setenv("SortThinStrVec_sortThreads", "4", 1);
+    std::mt19937_64 rnd(minNum);
+    for (size_t num : {minNum - 1, minNum, minNum + 1, 300000 + minNum}) {
+      auto keys = gen_keys(num, rnd);
+      check_sort<SortableStrVec>(keys);
+      check_sort<SortThinStrVec>(keys);
+    }
+    unsetenv("SortableStrVec_parallelSortMinNum");
+    unsetenv("SortThinStrVec_parallelSortMinNum");
+    unsetenv("SortableStrVec_sortThreads");
+    unsetenv("SortThinStrVec_sortThreads");
+  }
+
+  TEST(STRVEC_PARALLEL_SORT_TEST, RADIX_SORT_TPL) {
+    std::mt19937_64 rnd(1);
+    auto getData = [](const fstring& x) { return (const byte_t*)x.data(); };
+    auto getSize = [](const fstring& x) { return size_t(x.size()); };
+    for (size_t num : {0, 1, 2, 63, 64, 65, 1000, 100000, 600000}) {
+      auto keys = gen_keys(num, rnd);
+      std::vector<std::string> expect(keys);
+      std::sort(expect.begin(), expect.end());
+      for (size_t threads : {1, 2, 3, 8}) {
+        std::vector<fstring> vec(keys.begin(), keys.end());
+        parallel_radix_sort_tpl(vec.data(), vec.size(), getData, getSize, threads);
+        for (size_t i = 0; i < num; ++i) {
+          ASSERT_EQ(vec[i].str(), expect[i])
+              << "num = " << num << ", threads = " << threads << ", i = " << i;
+        }
+      }
+    }
+  }
+
+}
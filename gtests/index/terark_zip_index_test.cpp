@@ -0,0 +1,478 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <set>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "terark/entropy/entropy_base.hpp"
+#include "terark/idx/terark_zip_index.hpp"
+#include "terark/io/FileStream.hpp"
+#include "terark/util/mmap.hpp"
+#include "terark/util/slab_alloc.hpp"
+#include "terark/zbs/dict_zip_blob_store.hpp"
+#include "terark/zbs/plain_blob_store.hpp"
+
+namespace terark {
+
+  static std::unique_ptr<TerarkIndex>
+  build_index(const std::vector<std::string>& keys, const TerarkIndexOptions& tiopt,
+              std::string* mem) {
+    TerarkKeyExternalSorter sorter(tiopt);
+    for (auto& key : keys) {
+      sorter.Add(key);
+    }
+    TerarkIndex::KeyStat ks;
+    std::unique_ptr<TerarkKeyReader> reader(sorter.Finish(&ks));
+    std::unique_ptr<TerarkIndex> index(
+        TerarkIndex::Factory::Build(reader.get(), tiopt, ks, nullptr));
+    // reload, the same as a real table
+    mem->clear();
+    index->SaveMmap([&](const void* d, size_t n) { mem->append((const char*)d, n); });
+    return TerarkIndex::LoadMemory(*mem);
+  }
+
+  static size_t find_id(const TerarkIndex* index, fstring key) {
+    std::unique_ptr<TerarkIndex::Iterator> iter(index->NewIterator());
+    if (iter->Seek(key) && iter->key() == key) {
+      return iter->id();
+    }
+    return size_t(-1);
+  }
+
+  static std::string merge_value(size_t part, const std::string& key) {
+    return "part" + std::to_string(part) + "-value-of-" + key + "-" + key;
+  }
+
+  static std::string str_key(size_t n) {
+    return "key" + std::to_string(n);
+  }
+
+  static std::string uint_key(size_t n) {
+    uint64_t be = __builtin_bswap64(n * 3);
+    return std::string((const char*)&be, sizeof be);
+  }
+
+  // mergeMemory is smallTaskMemory of merge, keys are spilled beyond it
+  void merge_test(std::string (*gen_key)(size_t), bool reordered,
+                  size_t mergeMemory = 1200 << 20) {
+    const std::string prefix = "/tmp/terark_zip_index_test-merge";
+    std::string dict;
+    for (int i = 0; i < 2000; ++i) {
+      dict += "value-of-key" + std::to_string(i);
+    }
+    std::vector<std::vector<std::string> > keys(3);
+    std::map<std::string, size_t> winner; // key -> first part having it
+    std::mt19937 rnd(3);
+    for (size_t i = 0; i < 6000; ++i) {
+      std::string key = gen_key(rnd() % 4000);
+      size_t part = rnd() % 3;
+      if (std::count(keys[part].begin(), keys[part].end(), key)) {
+        continue;
+      }
+      keys[part].push_back(key);
+    }
+    size_t total = 0;
+    for (size_t p = keys.size(); p-- > 0; ) {
+      for (auto& key : keys[p]) {
+        winner[key] = p;
+      }
+      total += keys[p].size();
+    }
+    std::vector<std::string> mems(keys.size());
+    std::vector<std::unique_ptr<TerarkIndex> > indexes;
+    std::vector<std::unique_ptr<AbstractBlobStore> > stores;
+    valvec<TerarkZipMerger::Part> parts;
+    for (size_t p = 0; p < keys.size(); ++p) {
+      TerarkIndexOptions tiopt;
+      indexes.push_back(build_index(keys[p], tiopt, &mems[p]));
+      std::vector<std::string> byId(keys[p].size());
+      for (auto& key : keys[p]) {
+        size_t id = find_id(indexes.back().get(), key);
+        ASSERT_LT(id, byId.size());
+        byId[id] = key;
+      }
+      DictZipBlobStore::Options opt;
+      opt.checksumLevel = 2;
+      std::unique_ptr<DictZipBlobStore::ZipBuilder>
+          builder(DictZipBlobStore::createZipBuilder(opt));
+      builder->addSample(dict);
+      builder->finishSample();
+      std::string fname = prefix + std::to_string(p) + ".zbs";
+      builder->prepare(byId.size(), fname);
+      for (auto& key : byId) {
+        builder->addRecord(merge_value(p, key));
+      }
+      builder->finish(DictZipBlobStore::ZipBuilder::FinishWriteDictFile);
+      stores.emplace_back(AbstractBlobStore::load_from_mmap(fname, false));
+      parts.push_back({indexes.back().get(),
+                       dynamic_cast<const DictZipBlobStore*>(stores.back().get())});
+      ASSERT_TRUE(parts.back().store != nullptr);
+    }
+    ASSERT_TRUE(TerarkZipMerger::CanMerge(parts));
+    std::string indexMem;
+    {
+      TerarkIndexOptions tiopt;
+      tiopt.smallTaskMemory = mergeMemory;
+      FileStream fp(prefix + ".zbs", "wb");
+      auto stat = TerarkZipMerger::Merge(parts, tiopt,
+          [&](const void* d, size_t n) { indexMem.append((const char*)d, n); },
+          [&](const void* d, size_t n) { fp.ensureWrite(d, n); });
+      ASSERT_EQ(stat.keyCount, winner.size());
+      ASSERT_EQ(stat.dupCount, total - winner.size());
+      ASSERT_EQ(stat.reordered, reordered);
+    }
+    // merged store shares the dict of parts
+    {
+      MmapWholeFile src(prefix + "0.zbs-dict");
+      FileStream fp(prefix + ".zbs-dict", "wb");
+      fp.ensureWrite(src.base, src.size);
+    }
+    auto index = TerarkIndex::LoadMemory(indexMem);
+    std::unique_ptr<AbstractBlobStore> store(
+        AbstractBlobStore::load_from_mmap(prefix + ".zbs", false));
+    ASSERT_EQ(index->NumKeys(), winner.size());
+    ASSERT_EQ(store->num_records(), winner.size());
+    for (auto& kv : winner) {
+      size_t id = find_id(index.get(), kv.first);
+      ASSERT_LT(id, store->num_records());
+      auto rec = store->get_record(id);
+      ASSERT_EQ(std::string((const char*)rec.data(), rec.size()),
+                merge_value(kv.second, kv.first));
+    }
+    store.reset();
+    stores.clear();
+    for (std::string suffix : {"", "0", "1", "2"}) {
+      ::remove((prefix + suffix + ".zbs").c_str());
+      ::remove((prefix + suffix + ".zbs-dict").c_str());
+    }
+  }
+
+  TEST(TERARK_ZIP_INDEX_TEST, MERGE) {
+    merge_test(&str_key, true); // nest louds trie, ids are not in key order
+    merge_test(&str_key, true, 4 << 10); // keys are spilled
+  }
+
+  TEST(TERARK_ZIP_INDEX_TEST, MERGE_NO_REORDER) {
+    merge_test(&uint_key, false); // uint index, ids are in key order
+  }
+
+  // sort in memory and by spilled runs, read twice to check rewind
+  void external_sort_test(size_t memLimit, bool spilled) {
+    std::mt19937 rnd(memLimit);
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 20000; ++i) {
+      keys.push_back(str_key(rnd() % 15000));
+    }
+    keys.push_back(""); // empty key
+    std::set<std::string> expect(keys.begin(), keys.end());
+    TerarkIndexOptions tiopt;
+    tiopt.smallTaskMemory = memLimit;
+    TerarkKeyExternalSorter sorter(tiopt);
+    for (auto& key : keys) {
+      sorter.Add(key);
+    }
+    ASSERT_EQ(sorter.NumRuns() > 1, spilled);
+    TerarkIndex::KeyStat ks;
+    std::unique_ptr<TerarkKeyReader> reader(sorter.Finish(&ks));
+    ASSERT_EQ(ks.keyCount, expect.size());
+    ASSERT_EQ(sorter.NumDupKeys(), keys.size() - expect.size());
+    ASSERT_EQ(fstring(ks.minKey), fstring(*expect.begin()));
+    ASSERT_EQ(fstring(ks.maxKey), fstring(*expect.rbegin()));
+    for (int pass = 0; pass < 2; ++pass) {
+      reader->rewind();
+      for (auto& key : expect) {
+        ASSERT_EQ(reader->next().str(), key);
+      }
+    }
+  }
+
+  TEST(TERARK_ZIP_INDEX_TEST, EXTERNAL_SORT) {
+    external_sort_test(size_t(1) << 30, false);
+    external_sort_test(16 << 10, true);
+  }
+
+  // NextBatch must yield the same (key, id) sequence as repeated Next()
+  void next_batch_test(std::string (*gen_key)(size_t), size_t num) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < num; ++i) {
+      keys.push_back(gen_key(i));
+    }
+    std::string mem;
+    auto index = build_index(keys, TerarkIndexOptions(), &mem);
+    ASSERT_EQ(index->NumKeys(), num);
+    std::unique_ptr<TerarkIndex::Iterator> iter(index->NewIterator());
+    std::vector<std::pair<std::string, size_t> > expect;
+    for (bool ok = iter->SeekToFirst(); ok; ok = iter->Next()) {
+      expect.emplace_back(iter->key().str(), iter->id());
+    }
+    ASSERT_EQ(expect.size(), num);
+    TerarkIndex::KeyBatch batch;
+    // batch sizes around 1, the index size and beyond the end
+    for (size_t n : {size_t(1), size_t(2), size_t(7), num - 1, num, num + 1, size_t(100000)}) {
+      if (0 == n) {
+        continue;
+      }
+      iter->SeekToFirst();
+      size_t total = 0;
+      while (iter->Valid()) {
+        batch.clear();
+        size_t got = iter->NextBatch(n, &batch);
+        ASSERT_EQ(got, batch.size());
+        ASSERT_EQ(got, std::min(n, num - total));
+        for (size_t i = 0; i < got; ++i) {
+          ASSERT_EQ(batch.key(i).str(), expect[total + i].first);
+          ASSERT_EQ(batch.id(i), expect[total + i].second);
+        }
+        total += got;
+        // iterator is positioned at the key after the batch
+        if (iter->Valid()) {
+          ASSERT_LT(total, num);
+          ASSERT_EQ(iter->key().str(), expect[total].first);
+          ASSERT_EQ(iter->id(), expect[total].second);
+        }
+      }
+      ASSERT_EQ(total, num);
+      // at end of index, nothing is appended
+      ASSERT_EQ(iter->NextBatch(n, &batch), 0);
+      ASSERT_EQ(batch.size(), std::min(n, num - (num - 1) / n * n));
+    }
+    if (0 == num) {
+      return;
+    }
+    // batches are appended, and may start after a seek
+    size_t mid = num / 2;
+    ASSERT_TRUE(iter->Seek(expect[mid].first));
+    batch.clear();
+    ASSERT_EQ(iter->NextBatch(3, &batch), std::min<size_t>(3, num - mid));
+    size_t first = batch.size();
+    iter->NextBatch(5, &batch);
+    ASSERT_EQ(batch.size(), std::min(first + 5, num - mid));
+    for (size_t i = 0; i < batch.size(); ++i) {
+      ASSERT_EQ(batch.key(i).str(), expect[mid + i].first);
+      ASSERT_EQ(batch.id(i), expect[mid + i].second);
+    }
+  }
+
+  TEST(TERARK_ZIP_INDEX_TEST, NEXT_BATCH) {
+    next_batch_test(&str_key, 20000); // nest louds trie
+    next_batch_test(&uint_key, 20000); // uint index
+    next_batch_test(&str_key, 1);
+  }
+
+  // sorted keys in memory, ids are positions, to test the default NextBatch
+  class VecKeyIterator : public TerarkIndex::Iterator {
+    const std::vector<std::string>& m_keys;
+    bool set(size_t id) {
+      m_id = id < m_keys.size() ? id : size_t(-1);
+      return Valid();
+    }
+   public:
+    explicit VecKeyIterator(const std::vector<std::string>& keys) : m_keys(keys) {}
+    bool SeekToFirst() override { return set(0); }
+    bool SeekToLast() override { return set(m_keys.size() - 1); }
+    bool Seek(fstring target) override {
+      return set(std::lower_bound(m_keys.begin(), m_keys.end(), target.str()) - m_keys.begin());
+    }
+    bool Next() override { return set(m_id + 1); }
+    bool Prev() override { return set(m_id - 1); }
+    size_t DictRank() const override { return Valid() ? m_id : m_keys.size(); }
+    fstring key() const override { return m_keys[m_id]; }
+  };
+
+  // an index can not be empty (Factory::Build requires keys), empty ranges
+  // of an index and the default NextBatch on an empty key set are tested
+  TEST(TERARK_ZIP_INDEX_TEST, NEXT_BATCH_EMPTY) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 100; ++i) {
+      keys.push_back(str_key(i));
+    }
+    std::sort(keys.begin(), keys.end());
+    std::string mem;
+    auto index = build_index(keys, TerarkIndexOptions(), &mem);
+    std::unique_ptr<TerarkIndex::Iterator> iter(index->NewIterator());
+    TerarkIndex::KeyBatch batch;
+    ASSERT_EQ(iter->NextBatch(10, &batch), 0); // not positioned
+    ASSERT_FALSE(iter->Seek(keys.back() + "\xff")); // after last key
+    ASSERT_EQ(iter->NextBatch(10, &batch), 0);
+    ASSERT_TRUE(iter->SeekToFirst());
+    ASSERT_EQ(iter->NextBatch(0, &batch), 0);
+    ASSERT_TRUE(batch.empty());
+    ASSERT_EQ(batch.offsets.size(), 1);
+
+    std::vector<std::string> none;
+    VecKeyIterator empty(none);
+    ASSERT_FALSE(empty.SeekToFirst());
+    ASSERT_EQ(empty.NextBatch(10, &batch), 0);
+    ASSERT_TRUE(batch.empty());
+    ASSERT_EQ(batch.offsets.size(), 1);
+
+    // default NextBatch gives the same as the IndexIterator override
+    VecKeyIterator viter(keys);
+    for (size_t n : {1, 7, 99, 100, 101}) {
+      TerarkIndex::KeyBatch b1, b2;
+      iter->SeekToFirst();
+      viter.SeekToFirst();
+      while (iter->Valid()) {
+        ASSERT_EQ(iter->NextBatch(n, &b1), viter.NextBatch(n, &b2));
+        ASSERT_EQ(iter->Valid(), viter.Valid());
+      }
+      ASSERT_EQ(b1.size(), keys.size());
+      ASSERT_EQ(b2.size(), keys.size());
+      ASSERT_EQ(b1.keys, b2.keys);
+      ASSERT_EQ(b1.offsets, b2.offsets);
+      for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(b1.id(i), find_id(index.get(), keys[i]));
+        ASSERT_EQ(b2.id(i), i);
+      }
+    }
+  }
+
+  static std::string uint_group_key(size_t n) {
+    return uint_key(n / 5) + "s" + std::to_string(n % 5); // non-descending uint
+  }
+
+  // exact RangeCount against sorted keys, approximate rank is bounded by
+  // half of the sample step of nest louds trie, or the group of uint prefix
+  void range_count_test(std::string (*gen_key)(size_t), size_t num,
+                        bool cache = true) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < num; ++i) {
+      keys.push_back(gen_key(i));
+    }
+    std::sort(keys.begin(), keys.end());
+    std::string mem;
+    auto index = build_index(keys, TerarkIndexOptions(), &mem);
+    ASSERT_EQ(index->NumKeys(), num);
+    if (cache) {
+      index->BuildCache(0); // builds rank sample of nest louds trie
+    }
+    if (gen_key == &str_key) {
+      ASSERT_EQ(index->HeapMemSize() != 0, cache);
+    }
+    auto rank = [&](const std::string& key) {
+      return size_t(std::lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+    };
+    auto ctx = GetTlsTerarkContext();
+    const size_t max_err = num / 8192 + 3;
+    std::mt19937 rnd(num);
+    for (size_t t = 0; t < 3000; ++t) {
+      std::string lo = keys[rnd() % num], hi = keys[rnd() % num];
+      if (t % 3 == 0) { // keys not in index
+        lo.pop_back();
+        hi += "x";
+      }
+      size_t cnt = lo < hi ? rank(hi) - rank(lo) : 0;
+      ASSERT_EQ(index->RangeCount(lo, hi, ctx), cnt);
+      size_t approx = index->ApproximateRangeCount(lo, hi, ctx);
+      ASSERT_LE(approx, cnt + 2 * max_err);
+      ASSERT_GE(approx + 2 * max_err, cnt);
+      size_t r = index->ApproximateDictRank(lo, ctx);
+      ASSERT_LE(r, rank(lo) + max_err);
+      ASSERT_GE(r + max_err, rank(lo));
+    }
+    ASSERT_EQ(index->ApproximateDictRank(keys.front(), ctx), 0);
+    ASSERT_EQ(index->ApproximateDictRank(keys.back() + "\xff", ctx), num);
+    ASSERT_EQ(index->RangeCount("", keys.back() + "\xff", ctx), num);
+    ASSERT_EQ(index->RangeCount(keys.back(), keys.front(), ctx), 0);
+  }
+
+  TEST(TERARK_ZIP_INDEX_TEST, RANGE_COUNT) {
+    range_count_test(&str_key, 20000); // nest louds trie, sampled
+    range_count_test(&str_key, 1000);  // nest louds trie, all keys sampled
+    range_count_test(&str_key, 20000, false); // nest louds trie, no sample
+    range_count_test(&uint_key, 20000);
+    range_count_test(&uint_group_key, 20000);
+  }
+
+  // records of different size, ids of uint index are in key order, so the
+  // offset is the zip offset of the record of the key
+  TEST(TERARK_ZIP_INDEX_TEST, APPROXIMATE_OFFSET) {
+    const std::string fname = "/tmp/terark_zip_index_test-offset.zbs";
+    const size_t num = 10000;
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < num; ++i) {
+      keys.push_back(uint_key(i));
+    }
+    auto record = [](size_t i) { return std::string(i % 3 ? 10 : 1000, 'r'); };
+    std::vector<uint64_t> offsets(1, 0);
+    for (size_t i = 0; i < num; ++i) {
+      offsets.push_back(offsets.back() + record(i).size());
+    }
+    {
+      PlainBlobStore::MyBuilder builder(offsets.back(), num, fname, 0, 1);
+      for (size_t i = 0; i < num; ++i) {
+        builder.addRecord(record(i));
+      }
+      builder.finish();
+    }
+    std::unique_ptr<AbstractBlobStore> store(AbstractBlobStore::load_from_mmap(fname, false));
+    ASSERT_EQ(store->get_zip_offset(num), offsets.back());
+    std::string mem;
+    auto index = build_index(keys, TerarkIndexOptions(), &mem);
+    ASSERT_FALSE(index->NeedsReorder());
+    auto ctx = GetTlsTerarkContext();
+    for (size_t i = 0; i < num; i += 7) {
+      ASSERT_EQ(index->ApproximateOffsetOf(keys[i], store.get(), ctx), offsets[i]);
+    }
+    ASSERT_EQ(index->ApproximateOffsetOf(keys.back() + "x", store.get(), ctx), offsets.back());
+
+    // ids of nest louds trie are not in key order, offset is by rank ratio
+    std::vector<std::string> skeys;
+    for (size_t i = 0; i < num; ++i) {
+      skeys.push_back(str_key(i));
+    }
+    std::sort(skeys.begin(), skeys.end());
+    auto sindex = build_index(skeys, TerarkIndexOptions(), &mem);
+    ASSERT_TRUE(sindex->NeedsReorder());
+    uint64_t last = 0;
+    for (size_t i = 0; i < num; i += 7) {
+      uint64_t off = sindex->ApproximateOffsetOf(skeys[i], store.get(), ctx);
+      ASSERT_GE(off, last);
+      ASSERT_LE(off, offsets.back());
+      last = off;
+    }
+    store.reset();
+    ::remove(fname.c_str());
+  }
+
+  // iterator memory of Find and DictRank is from SlabAllocator when slab
+  // alloc of the context is on, suffix keys are still malloc valvec
+  TEST(TERARK_ZIP_INDEX_TEST, SLAB_CONTEXT) {
+    setenv("Terark_slabAlloc", "1", 0); // read on first use
+    auto suffix_key = [](size_t n) {
+      return str_key(n) + "-suffix-" + std::to_string(n * 7919 % 1000);
+    };
+    for (auto gen_key : {+suffix_key, &str_key}) {
+      const size_t num = 20000;
+      std::vector<std::string> keys;
+      for (size_t i = 0; i < num; ++i) {
+        keys.push_back(gen_key(i));
+      }
+      std::sort(keys.begin(), keys.end());
+      std::string mem;
+      auto index = build_index(keys, TerarkIndexOptions(), &mem);
+      TerarkContext ctx;
+      ctx.set_slab_alloc(true);
+      for (size_t i = 0; i < num; i += 3) {
+        ASSERT_EQ(index->Find(keys[i], &ctx), find_id(index.get(), keys[i]));
+        ASSERT_EQ(index->DictRank(keys[i], &ctx), i);
+        ASSERT_EQ(index->DictRank(keys[i] + "\x01", &ctx), i + 1);
+      }
+      ASSERT_EQ(index->Find(keys[0] + "\x01", &ctx), size_t(-1));
+    }
+    TerarkContext ctx;
+    ctx.set_slab_alloc(true);
+    {
+      ContextBuffer raw = ctx.alloc_raw(100);
+      ASSERT_EQ(SlabAllocator::owns(raw.data()), SlabAllocator::enabled());
+      raw.resize(1000); // grows by SlabAllocator::realloc
+      ASSERT_EQ(SlabAllocator::owns(raw.data()), SlabAllocator::enabled());
+    }
+    ContextBuffer buf = ctx.alloc(100);
+    ASSERT_FALSE(SlabAllocator::owns(buf.data())); // valvec exposed
+    ctx.set_slab_alloc(false);
+    ContextBuffer raw = ctx.alloc_raw(100);
+    ASSERT_FALSE(SlabAllocator::owns(raw.data()));
+  }
+}
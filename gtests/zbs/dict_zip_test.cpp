@@ -0,0 +1,100 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <terark/io/FileStream.hpp>
+#include <terark/util/mmap.hpp>
+#include <terark/zbs/dict_zip_blob_store.hpp>
+#include <terark/zbs/zip_reorder_map.hpp>
+
+using namespace terark;
+
+namespace terark {
+int DictZipBlobStore_setReorderThreads(int threads);
+size_t DictZipBlobStore_parallelReorderNum();
+}
+
+static const std::string g_prefix = "/tmp/dict_zip_test";
+
+static std::string dict_zip_record(size_t i) {
+  std::mt19937_64 rnd(i);
+  std::string rec = "value-of-key" + std::to_string(i) + "-";
+  rec.resize(rec.size() + 100 + i % 97);
+  for (size_t j = 16; j < rec.size(); ++j) {
+    rec[j] = char(rnd() % 256); // hard to compress, to get a big store
+  }
+  return rec;
+}
+
+static void build_dict_zip(const std::string& fname, size_t num) {
+  std::string dict;
+  for (size_t i = 0; i < 2000; ++i) {
+    dict += "value-of-key" + std::to_string(i);
+  }
+  DictZipBlobStore::Options opt;
+  opt.checksumLevel = 2;
+  std::unique_ptr<DictZipBlobStore::ZipBuilder>
+      builder(DictZipBlobStore::createZipBuilder(opt));
+  builder->addSample(dict);
+  builder->finishSample();
+  builder->prepare(num, fname);
+  for (size_t i = 0; i < num; ++i) {
+    builder->addRecord(dict_zip_record(i));
+  }
+  builder->finish(DictZipBlobStore::ZipBuilder::FinishWriteDictFile);
+}
+
+static void copy_file(const std::string& src, const std::string& dst) {
+  MmapWholeFile mm(src);
+  FileStream fp(dst, "wb");
+  fp.ensureWrite(mm.base, mm.size);
+}
+
+/**
+ * reorder with gather pipeline, zipped data must be larger than
+ * 4 * DictZipBlobStore_reorderBatchBytes(default 1M)
+ */
+TEST(DICT_ZIP_TEST, PARALLEL_REORDER) {
+  // forced, not capped by cpu count, so 1 cpu runners also take pipeline
+  int oldThreads = DictZipBlobStore_setReorderThreads(3);
+  size_t oldParallelNum = DictZipBlobStore_parallelReorderNum();
+  const size_t num = 50000;
+  std::string src = g_prefix + "-reorder.zbs", dst = g_prefix + "-reorder2.zbs";
+  build_dict_zip(src, num);
+  std::unique_ptr<AbstractBlobStore> store(AbstractBlobStore::load_from_mmap(src, false));
+  ASSERT_GT(store->mem_size(), 4u << 20);
+  std::vector<size_t> newToOld(num);
+  for (size_t i = 0; i < num; ++i) {
+    newToOld[i] = i * 7919 % num;
+  }
+  std::string mapFile = g_prefix + "-reorder.map";
+  {
+    ZReorderMap::Builder builder(num, 1, mapFile, "wb");
+    for (size_t oldId : newToOld) {
+      builder.push_back(oldId);
+    }
+    builder.finish();
+  }
+  {
+    ZReorderMap reorder(mapFile);
+    FileStream fp(dst, "wb");
+    store->reorder_zip_data(reorder,
+        [&](const void* d, size_t n) { fp.ensureWrite(d, n); }, dst + ".tmp");
+  }
+  DictZipBlobStore_setReorderThreads(oldThreads);
+  ASSERT_EQ(DictZipBlobStore_parallelReorderNum(), oldParallelNum + 1);
+  copy_file(src + "-dict", dst + "-dict");
+  store.reset(AbstractBlobStore::load_from_mmap(dst, false));
+  ASSERT_EQ(store->num_records(), num);
+  for (size_t i = 0; i < num; ++i) {
+    auto rec = store->get_record(i);
+    ASSERT_EQ(std::string((const char*)rec.data(), rec.size()),
+              dict_zip_record(newToOld[i]));
+  }
+  store.reset();
+  for (auto& f : {src, src + "-dict", dst, dst + "-dict", mapFile}) {
+    ::remove(f.c_str());
+  }
+}
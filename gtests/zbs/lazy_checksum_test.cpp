@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <terark/util/checksum_exception.hpp>
+#include <terark/zbs/blob_store_file_header.hpp>
+#include <terark/zbs/plain_blob_store.hpp>
+
+using namespace terark;
+
+static const std::string g_fname = "/tmp/lazy_checksum_test.plain";
+static const size_t g_num = 200000;
+
+static std::string lazy_record(size_t i) {
+  return "record-" + std::to_string(i) + std::string(i % 50, 'x');
+}
+
+// PlainBlobStore with checksumLevel 3 has a XXHash64 of the whole file
+static void build_plain(const std::string& fname) {
+  size_t total = 0;
+  for (size_t i = 0; i < g_num; ++i) {
+    total += lazy_record(i).size();
+  }
+  PlainBlobStore::MyBuilder builder(total, g_num, fname, 0, 3);
+  for (size_t i = 0; i < g_num; ++i) {
+    builder.addRecord(lazy_record(i));
+  }
+  builder.finish();
+}
+
+static AbstractBlobStore* load(const std::string& fname) {
+  return AbstractBlobStore::load_from_mmap(fname, false);
+}
+
+TEST(LAZY_CHECKSUM_TEST, PASSED) {
+  build_plain(g_fname);
+  enableLazyChecksumVerify(true);
+  // many stores share the bounded background worker, half of them are
+  // destroyed while being verified or still queued
+  std::vector<std::unique_ptr<AbstractBlobStore> > stores;
+  for (size_t i = 0; i < 8; ++i) {
+    stores.emplace_back(load(g_fname));
+    ASSERT_EQ(stores.back()->get_record(i).size(), lazy_record(i).size());
+  }
+  for (size_t i = 0; i < stores.size(); i += 2) {
+    stores[i].reset();
+  }
+  for (size_t i = 1; i < stores.size(); i += 2) {
+    stores[i]->wait_checksum_verify();
+    auto st = stores[i]->checksum_verify_status();
+    ASSERT_EQ(st.state, AbstractBlobStore::ChecksumVerifyStatus::kPassed);
+    ASSERT_EQ(st.verifiedBytes, st.totalBytes);
+  }
+  stores.clear();
+  enableLazyChecksumVerify(false);
+  ::remove(g_fname.c_str());
+}
+
+TEST(LAZY_CHECKSUM_TEST, CORRUPTED) {
+  build_plain(g_fname);
+  {
+    FILE* fp = fopen(g_fname.c_str(), "r+b");
+    ASSERT_TRUE(fp != nullptr);
+    fseek(fp, 5000, SEEK_SET); // in record data
+    int c = fgetc(fp);
+    fseek(fp, 5000, SEEK_SET);
+    fputc(c ^ 1, fp);
+    fclose(fp);
+  }
+  // eager verify throws on load
+  ASSERT_THROW(delete load(g_fname), BadChecksumException);
+
+  enableLazyChecksumVerify(true);
+  std::unique_ptr<AbstractBlobStore> store(load(g_fname)); // does not throw
+  ASSERT_THROW(store->wait_checksum_verify(), BadChecksumException);
+  auto st = store->checksum_verify_status();
+  ASSERT_EQ(st.state, AbstractBlobStore::ChecksumVerifyStatus::kFailed);
+  ASSERT_EQ(st.verifiedBytes, st.totalBytes);
+  // all reads throw after the failure is detected
+  ASSERT_THROW(store->get_record(0), BadChecksumException);
+  valvec<byte_t> rec;
+  ASSERT_THROW(store->get_record(1, &rec), BadChecksumException);
+  store.reset();
+  enableLazyChecksumVerify(false);
+  ::remove(g_fname.c_str());
+}
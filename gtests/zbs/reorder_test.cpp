@@ -0,0 +1,159 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <terark/io/FileStream.hpp>
+#include <terark/zbs/plain_blob_store.hpp>
+#include <terark/zbs/zip_offset_blob_store.hpp>
+#include <terark/zbs/zip_reorder_map.hpp>
+
+using namespace terark;
+
+static const std::string g_prefix = "/tmp/reorder_test";
+
+static std::string reorder_record(size_t i) {
+  return "record-" + std::to_string(i) + std::string(i % 13, 'x');
+}
+
+/**
+ * newToOld of num, runs of random length (some longer than a read batch)
+ * going up for sign = 1 or down for sign = -1, with single values between
+ */
+static std::vector<size_t> gen_new_to_old(size_t num, int sign) {
+  std::mt19937_64 rnd(num);
+  std::vector<size_t> oldIds(num);
+  for (size_t i = 0; i < num; ++i) {
+    oldIds[i] = i;
+  }
+  std::shuffle(oldIds.begin(), oldIds.end(), rnd);
+  std::vector<size_t> newToOld;
+  for (size_t i = 0; newToOld.size() < num; ++i) {
+    size_t len = rnd() % 4 == 0 ? rnd() % 300 + 2 : 1;
+    size_t base = oldIds[i];
+    newToOld.push_back(base);
+    for (size_t j = 1; j < len && newToOld.size() < num; ++j) {
+      if (sign > 0 ? base + j >= num : base < j) break;
+      newToOld.push_back(base + sign * j);
+    }
+  }
+  // a permutation is not required by ZReorderMap, but is by stores
+  std::vector<bool> used(num);
+  std::vector<size_t> result;
+  for (size_t x : newToOld) {
+    if (!used[x]) {
+      used[x] = true;
+      result.push_back(x);
+    }
+  }
+  for (size_t x = 0; x < num; ++x) {
+    if (!used[x]) result.push_back(x);
+  }
+  return result;
+}
+
+static void build_map(const std::string& fname, const std::vector<size_t>& newToOld, int sign) {
+  ZReorderMap::Builder builder(newToOld.size(), sign, fname, "wb");
+  for (size_t oldId : newToOld) {
+    builder.push_back(oldId);
+  }
+  builder.finish();
+}
+
+TEST(REORDER_TEST, REORDER_MAP_READ) {
+  std::string mapFile = g_prefix + ".map";
+  for (int sign : {1, -1}) {
+    for (size_t num : {1, 127, 128, 256, 1000, 1024}) {
+      std::vector<size_t> newToOld = gen_new_to_old(num, sign);
+      build_map(mapFile, newToOld, sign);
+      ZReorderMap rm(mapFile);
+      ASSERT_EQ(rm.size(), num);
+      for (size_t batch : {1, 2, 7, 128, 2000}) {
+        std::vector<size_t> got, buf(batch);
+        rm.rewind();
+        while (size_t cnt = rm.read(buf.data(), batch)) {
+          ASSERT_LE(cnt, batch);
+          if (cnt < batch) { // only the last read is short
+            ASSERT_TRUE(rm.eof());
+          }
+          got.insert(got.end(), buf.begin(), buf.begin() + cnt);
+        }
+        ASSERT_TRUE(rm.eof());
+        ASSERT_EQ(got, newToOld) << "sign = " << sign << ", num = " << num
+                                 << ", batch = " << batch;
+      }
+      // read mixed with operator++
+      rm.rewind();
+      size_t buf[5], i = 0;
+      while (!rm.eof()) {
+        ASSERT_EQ(*rm, newToOld[i]);
+        ++rm, ++i;
+        size_t cnt = rm.read(buf, 5);
+        for (size_t j = 0; j < cnt; ++j, ++i) {
+          ASSERT_EQ(buf[j], newToOld[i]);
+        }
+      }
+      ASSERT_EQ(i, num);
+    }
+  }
+  ::remove(mapFile.c_str());
+}
+
+static void check_reorder(AbstractBlobStore::Builder* builder, const std::string& src,
+                          const std::vector<size_t>& newToOld, int sign) {
+  size_t num = newToOld.size();
+  for (size_t i = 0; i < num; ++i) {
+    builder->addRecord(reorder_record(i));
+  }
+  builder->finish();
+  std::string dst = src + ".reorder", mapFile = src + ".map";
+  build_map(mapFile, newToOld, sign);
+  std::unique_ptr<AbstractBlobStore> store(AbstractBlobStore::load_from_mmap(src, false));
+  ASSERT_EQ(store->num_records(), num);
+  {
+    ZReorderMap reorder(mapFile);
+    FileStream fp(dst, "wb");
+    store->reorder_zip_data(reorder,
+        [&](const void* d, size_t n) { fp.ensureWrite(d, n); }, dst + ".tmp");
+  }
+  store.reset(AbstractBlobStore::load_from_mmap(dst, false));
+  ASSERT_EQ(store->num_records(), num);
+  for (size_t i = 0; i < num; ++i) {
+    auto rec = store->get_record(i);
+    ASSERT_EQ(std::string((const char*)rec.data(), rec.size()),
+              reorder_record(newToOld[i]));
+  }
+  store.reset();
+  for (auto& f : {src, dst, mapFile}) {
+    ::remove(f.c_str());
+  }
+}
+
+/**
+ * PlainBlobStore flushes new offsets every 128 records, num of exact
+ * multiple of 128 leaves only the end offset in the last flush
+ */
+TEST(REORDER_TEST, PLAIN_BLOB_STORE) {
+  std::string src = g_prefix + "-plain.zbs";
+  for (int sign : {1, -1}) {
+    for (size_t num : {1, 127, 128, 129, 256, 1000, 1024}) {
+      size_t contentSize = 0;
+      for (size_t i = 0; i < num; ++i) {
+        contentSize += reorder_record(i).size();
+      }
+      PlainBlobStore::MyBuilder builder(contentSize, num, src);
+      check_reorder(&builder, src, gen_new_to_old(num, sign), sign);
+    }
+  }
+}
+
+TEST(REORDER_TEST, ZIP_OFFSET_BLOB_STORE) {
+  std::string src = g_prefix + "-zip-offset.zbs";
+  for (int sign : {1, -1}) {
+    for (size_t num : {1, 127, 128, 129, 256, 1000, 1024}) {
+      ZipOffsetBlobStore::MyBuilder builder(src);
+      check_reorder(&builder, src, gen_new_to_old(num, sign), sign);
+    }
+  }
+}
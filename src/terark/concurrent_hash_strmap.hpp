@@ -0,0 +1,206 @@
+#ifndef __terark_concurrent_hash_strmap__
+#define __terark_concurrent_hash_strmap__
+
+#include <terark/hash_strmap.hpp>
+#include <terark/heap_ext.hpp>
+#include <terark/bitmanip.hpp>
+#include <terark/valvec.hpp>
+#include <terark/util/throw.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace terark {
+
+//
+// insert only hash_strmap for multi thread ingestion, such as key dedup and
+// frequency count before building NestLoudsTrie
+//
+// keys are striped into 2^shardBits shards by hash, each shard is a plain
+// hash_strmap with its own strpool and mutex, so threads inserting different
+// keys rarely contend, and for_each/sort_fast run shards in parallel
+//
+// concurrent_hash_strmap<> cset; // just a set
+// concurrent_hash_strmap<size_t> freq;
+// freq.upsert(key, 1, [](size_t& cnt) { cnt++; });
+//
+template< class Value = ValueOut
+		, class HashFunc = fstring_func::IF_SP_ALIGN(hash_align, hash)
+		, class KeyEqual = fstring_func::IF_SP_ALIGN(equal_align, equal)
+		>
+class concurrent_hash_strmap : HashFunc
+{
+public:
+	typedef hash_strmap<Value, HashFunc, KeyEqual> shard_t;
+	typedef Value  mapped_type;
+
+private:
+	struct alignas(64) Shard {
+		mutable std::mutex mtx; // exists() is const
+		shard_t    map;
+	};
+	std::unique_ptr<Shard[]> m_shards;
+	size_t m_shardBits;
+	std::atomic<size_t> m_size;
+
+	size_t shard_of(fstring key) const {
+		// high bits of a multiplicative mix, shard map uses h % nBucket
+		uint64_t h = (uint64_t)HashFunc::operator()(key);
+		return size_t((h * 0x9E3779B97F4A7C15ull) >> (64 - m_shardBits));
+	}
+	template<class Func>
+	void parallel_shards(size_t threads, Func f) {
+		const size_t n = shard_num();
+		if (0 == threads)
+			threads = std::thread::hardware_concurrency();
+		threads = std::max<size_t>(1, std::min(threads, n));
+		std::atomic<size_t> next(0);
+		auto run = [&]() {
+			for (size_t i; (i = next.fetch_add(1)) < n; )
+				f(m_shards[i].map);
+		};
+		std::vector<std::thread> thr;
+		thr.reserve(threads - 1);
+		for (size_t i = 1; i < threads; ++i)
+			thr.emplace_back(run);
+		run();
+		for (auto& t : thr)
+			t.join();
+	}
+
+public:
+	/// @param shardBits 0 for auto: 4 shards per hardware thread, at least 16
+	explicit concurrent_hash_strmap(size_t shardBits = 0) : m_size(0) {
+		if (0 == shardBits) {
+			size_t hw = std::max<size_t>(std::thread::hardware_concurrency(), 4);
+			shardBits = terark_bsr_u64(hw * 4 - 1) + 1;
+		}
+		TERARK_VERIFY_F(shardBits >= 1 && shardBits <= 16, "%zd", shardBits);
+		m_shardBits = shardBits;
+		m_shards.reset(new Shard[size_t(1) << shardBits]);
+	}
+
+	size_t shard_num() const { return size_t(1) << m_shardBits; }
+	const shard_t& shard(size_t i) const { return m_shards[i].map; }
+	      shard_t& shard(size_t i)       { return m_shards[i].map; }
+
+	/// approximate when called concurrently with insert
+	size_t size() const { return m_size.load(std::memory_order_relaxed); }
+	bool  empty() const { return size() == 0; }
+	size_t total_key_size() const {
+		size_t sum = 0;
+		for (size_t i = 0, n = shard_num(); i < n; ++i)
+			sum += m_shards[i].map.total_key_size();
+		return sum;
+	}
+
+	/// thread safe
+	void reserve(size_t cap, size_t poolcap) {
+		const size_t n = shard_num();
+		for (size_t i = 0; i < n; ++i) {
+			Shard& s = m_shards[i];
+			std::lock_guard<std::mutex> lock(s.mtx);
+			s.map.reserve((cap + n - 1) / n, (poolcap + n - 1) / n);
+		}
+	}
+
+	/// thread safe, @returns true if key is newly inserted
+	bool insert(fstring key, const Value& val = Value()) {
+		Shard& s = m_shards[shard_of(key)];
+		bool inserted;
+		{
+			std::lock_guard<std::mutex> lock(s.mtx);
+			inserted = s.map.insert_i(key, val).second;
+		}
+		if (inserted)
+			m_size.fetch_add(1, std::memory_order_relaxed);
+		return inserted;
+	}
+
+	/// thread safe, insert key with init, or call op(Value&) if key exists,
+	/// op is called under shard lock
+	/// @returns true if key is newly inserted
+	template<class Op>
+	bool upsert(fstring key, const Value& init, Op op) {
+		Shard& s = m_shards[shard_of(key)];
+		bool inserted;
+		{
+			std::lock_guard<std::mutex> lock(s.mtx);
+			auto ib = s.map.insert_i(key, init);
+			if (!ib.second)
+				op(s.map.val(ib.first));
+			inserted = ib.second;
+		}
+		if (inserted)
+			m_size.fetch_add(1, std::memory_order_relaxed);
+		return inserted;
+	}
+
+	/// thread safe
+	bool exists(fstring key) const {
+		const Shard& s = m_shards[shard_of(key)];
+		std::lock_guard<std::mutex> lock(s.mtx);
+		return s.map.exists(key);
+	}
+
+	/// not thread safe, call f(kv) of each shard in parallel,
+	/// f must be thread safe, kv is hash_strmap::iterator::value_type
+	template<class Func>
+	void for_each(Func f, size_t threads = 0) {
+		parallel_shards(threads, [&](shard_t& m) { m.for_each(f); });
+	}
+
+	/// not thread safe, sort each shard in parallel by bytewise key order,
+	/// should not insert after sort_fast, until clear()
+	void sort_fast(size_t threads = 0) {
+		parallel_shards(threads, [](shard_t& m) { m.sort_fast(); });
+	}
+
+	/// must be called after sort_fast, call f(key, shardIdx, idxInShard) in
+	/// bytewise key order by merging shards, shard(shardIdx).val(idxInShard)
+	/// is the value of key
+	template<class Func>
+	void for_each_sorted(Func f) const {
+		struct Cursor {
+			fstring key;
+			size_t  shard;
+			size_t  idx;
+		};
+		auto greater = [](const Cursor& x, const Cursor& y) {
+			return y.key < x.key;
+		};
+		valvec<Cursor> heap;
+		heap.reserve(shard_num());
+		for (size_t i = 0, n = shard_num(); i < n; ++i) {
+			const shard_t& m = m_shards[i].map;
+			if (m.end_i())
+				heap.push_back({m.key(0), i, 0});
+		}
+		std::make_heap(heap.begin(), heap.end(), greater);
+		while (!heap.empty()) {
+			Cursor& top = heap.front();
+			f(top.key, top.shard, top.idx);
+			const shard_t& m = m_shards[top.shard].map;
+			if (++top.idx < m.end_i()) {
+				top.key = m.key(top.idx);
+				adjust_heap_top(heap.begin(), heap.size(), greater);
+			} else {
+				pop_heap_ignore_top(heap.begin(), heap.size(), greater);
+				heap.pop_back();
+			}
+		}
+	}
+
+	void clear() {
+		for (size_t i = 0, n = shard_num(); i < n; ++i)
+			m_shards[i].map.clear();
+		m_size = 0;
+	}
+};
+
+} // namespace terark
+
+#endif // __terark_concurrent_hash_strmap__
@@ -3,6 +3,7 @@
 #include <cmath>
 #include <numeric>
 #include <terark/bitmanip.hpp>
+#include <terark/util/slab_alloc.hpp>
 
 namespace terark {
 
@@ -17,7 +18,11 @@ struct TerarkContext::BufferList {
 
 ContextBuffer::~ContextBuffer() {
     assert(c_ == nullptr || c_->tls_ == nullptr || c_ == GetTlsTerarkContext());
-    if (c_ != nullptr && c_->list_size_ < TerarkContext::max_list_size_ &&
+    if (slab_) {
+        // SlabAllocator caches blocks per thread, context list is not needed
+        SlabAllocator::free(b_.risk_release_ownership());
+    }
+    else if (c_ != nullptr && c_->list_size_ < TerarkContext::max_list_size_ &&
         b_.capacity() >= sizeof(TerarkContext::BufferList) &&
         b_.capacity() < (1ull << 20) &&
         c_->context_size_ + b_.capacity() < TerarkContext::capacity_) {
@@ -32,6 +37,16 @@ ContextBuffer::~ContextBuffer() {
     }
 }
 
+void ContextBuffer::slab_grow(size_t cap) {
+    size_t newcap = std::max(larger_capacity(b_.capacity()), cap);
+    auto p = (byte_t*)SlabAllocator::realloc(b_.data(), newcap);
+    if (nullptr == p) {
+        throw std::bad_alloc();
+    }
+    b_.risk_set_data(p);
+    b_.risk_set_capacity(std::max(SlabAllocator::usable_size(p), newcap));
+}
+
 TerarkContext::~TerarkContext() {
     while (list_ != nullptr) {
         auto l = list_->next;
@@ -70,6 +85,23 @@ ContextBuffer TerarkContext::alloc(size_t size) {
     return ContextBuffer(std::move(b), this);
 }
 
+ContextBuffer TerarkContext::alloc_raw(size_t size) {
+    assert(tls_ == nullptr || this == GetTlsTerarkContext());
+    if (!slab_alloc_ || size == 0) {
+        return alloc(size);
+    }
+    auto p = (byte_t*)SlabAllocator::alloc(size);
+    if (nullptr == p) {
+        throw std::bad_alloc();
+    }
+    ContextBuffer b;
+    b.b_.risk_set_data(p);
+    b.b_.risk_set_capacity(std::max(SlabAllocator::usable_size(p), size));
+    b.c_ = this;
+    b.slab_ = true;
+    return b;
+}
+
 TerarkContext* GetTlsTerarkContext() {
     TerarkContext::TlsTerarkContext tls_flag;
     static thread_local TerarkContext tls_terark_ctx(tls_flag);
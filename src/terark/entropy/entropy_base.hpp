@@ -23,15 +23,20 @@ class TerarkContext;
 
 class ContextBuffer {
 private:
+    friend class TerarkContext;
     valvec<byte_t> b_;
     TerarkContext *c_;
+    bool slab_; // from TerarkContext::alloc_raw, never exposed as valvec
+
+    void slab_grow(size_t cap);
 
 public:
-    ContextBuffer() : c_(nullptr) {}
-    ContextBuffer(valvec<byte_t> &&b, TerarkContext* c) : b_(std::move(b)), c_(c) {
+    ContextBuffer() : c_(nullptr), slab_(false) {}
+    ContextBuffer(valvec<byte_t> &&b, TerarkContext* c) : b_(std::move(b)), c_(c), slab_(false) {
     }
-    ContextBuffer(ContextBuffer&& other) : b_(std::move(other.b_)), c_(other.c_) {
+    ContextBuffer(ContextBuffer&& other) : b_(std::move(other.b_)), c_(other.c_), slab_(other.slab_) {
         other.c_ = nullptr;
+        other.slab_ = false;
     }
     ContextBuffer& operator = (ContextBuffer&& other) {
         assert(this != &other);
@@ -46,17 +51,22 @@ public:
 
     TerarkContext* owner() const { return c_; }
 
-    operator valvec<byte_t>&() noexcept { return b_; }
+    operator valvec<byte_t>&() noexcept { assert(!slab_); return b_; }
     operator fstring() const noexcept { return b_; }
-    valvec<byte_t>& get() noexcept { return b_; }
+    valvec<byte_t>& get() noexcept { assert(!slab_); return b_; }
 
     byte_t* data() noexcept { return b_.data(); }
     size_t size() noexcept { return b_.size(); }
     size_t capacity() noexcept { return b_.capacity(); }
 
-    void resize(size_t s, byte_t v = 0) { b_.resize(s, v); }
-    void resize_no_init(size_t s) { b_.resize_no_init(s); }
-    void ensure_capacity(size_t cap) { b_.ensure_capacity(cap); }
+    void resize(size_t s, byte_t v = 0) { ensure_capacity(s); b_.resize(s, v); }
+    void resize_no_init(size_t s) { ensure_capacity(s); b_.risk_set_size(s); }
+    void ensure_capacity(size_t cap) {
+        if (terark_unlikely(slab_) && cap > b_.capacity())
+            slab_grow(cap);
+        else
+            b_.ensure_capacity(cap);
+    }
 };
 
 class TerarkContext {
@@ -67,6 +77,7 @@ private:
     TerarkContext* tls_ = nullptr;
     size_t list_size_ = 0;
     uint64_t context_size_ = 0;
+    bool slab_alloc_ = false;
 
     static uint64_t capacity_;
     static size_t max_list_size_;
@@ -83,6 +94,16 @@ public:
 
     ContextBuffer alloc(size_t size = 0);
 
+    /// for memory only accessed by data(), such as memory of user mem
+    /// iterators, get() and valvec conversion are not allowed on it.
+    /// it is SlabAllocator memory if slab alloc of this context is on and
+    /// is released to SlabAllocator instead of recycled, else as alloc()
+    ContextBuffer alloc_raw(size_t size);
+
+    /// valvec grows and frees by realloc/free, so buffers exposed as valvec,
+    /// such as decoder outputs, are always malloc memory
+    void set_slab_alloc(bool enable) { slab_alloc_ = enable; }
+
     static void set_capacity(uint64_t new_capacity, size_t new_list_size) {
       capacity_ = new_capacity;
       max_list_size_ = new_list_size;
@@ -780,6 +780,9 @@ void PatriciaMem<Align>::mem_get_stat(MemStat* ms) const {
     ms->capacity  = m_mempool.capacity();
     ms->lazy_free_cnt = 0;
     ms->lazy_free_sum = 0;
+    ms->remote_free_cnt = 0;
+    ms->remote_free_sum = 0;
+    ms->remote_drain_cnt = 0;
     int thread_idx = 0;
     auto get_lzf = [&,ms](const LazyFreeList* lzf) {
         if (csppDebugLevel >= 2) {
@@ -804,6 +807,13 @@ void PatriciaMem<Align>::mem_get_stat(MemStat* ms) const {
           });
         ms->huge_cnt  = m_mempool_lock_free.get_huge_stat(&ms->huge_size);
         ms->frag_size = m_mempool_lock_free.frag_size();
+        {
+            typename ThreadCacheMemPool<AlignSize>::RemoteFreeStat rf;
+            m_mempool_lock_free.get_remote_free_stat(&rf);
+            ms->remote_free_cnt  = rf.free_cnt;
+            ms->remote_free_sum  = rf.free_size;
+            ms->remote_drain_cnt = rf.drain_cnt;
+        }
         break;
     case   OneWriteMultiRead:
         m_mempool_fixed_cap.get_fastbin(&ms->fastbin);
@@ -189,6 +189,9 @@ public:
         size_t huge_cnt;
         size_t lazy_free_sum;
         size_t lazy_free_cnt;
+        size_t remote_free_cnt;  // freed by a thread other than allocator
+        size_t remote_free_sum;
+        size_t remote_drain_cnt; // returned to the allocator thread
     };
     static Patricia* create(size_t valsize,
                             size_t maxMem = 512<<10,
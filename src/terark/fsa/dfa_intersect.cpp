@@ -0,0 +1,538 @@
+#include "dfa_intersect.hpp"
+#include <terark/util/throw.hpp>
+#include <bitset>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace terark {
+
+ByteAutomaton::~ByteAutomaton() {}
+
+namespace {
+
+// Thompson nfa, a node has a byte class edge or at most 2 epsilon edges
+struct NfaNode {
+    std::bitset<256> cls;
+    int cls_to = -1;
+    int eps[2] = {-1, -1};
+};
+
+struct Frag {
+    int beg;
+    int end; // end has no out edges
+};
+
+class RegexParser {
+    fstring m_re;
+    size_t  m_pos = 0;
+    bool    m_glob;
+public:
+    std::vector<NfaNode> nodes;
+
+    RegexParser(fstring re, bool glob) : m_re(re), m_glob(glob) {}
+
+    Frag parse() {
+        Frag f = m_glob ? parse_glob() : parse_alt();
+        if (m_pos != m_re.size())
+            syntax_error("unexpected char");
+        return f;
+    }
+
+private:
+    terark_no_return
+    void syntax_error(const char* msg) const {
+        THROW_STD(invalid_argument, "%s: %s at pos %zd of \"%.*s\"",
+                  m_glob ? "glob" : "regex", msg, m_pos, m_re.ilen(), m_re.data());
+    }
+    bool eof() const { return m_pos == m_re.size(); }
+    byte_t peek() const { return m_re.uch(m_pos); }
+
+    int new_node() {
+        nodes.emplace_back();
+        return int(nodes.size() - 1);
+    }
+    void add_eps(int from, int to) {
+        NfaNode& n = nodes[from];
+        assert(n.cls_to < 0);
+        if (n.eps[0] < 0)
+            n.eps[0] = to;
+        else {
+            assert(n.eps[1] < 0);
+            n.eps[1] = to;
+        }
+    }
+    Frag make_class(const std::bitset<256>& cls) {
+        int b = new_node(), e = new_node();
+        nodes[b].cls = cls;
+        nodes[b].cls_to = e;
+        return {b, e};
+    }
+    Frag make_empty() {
+        int b = new_node();
+        return {b, b};
+    }
+    Frag concat(Frag x, Frag y) {
+        add_eps(x.end, y.beg);
+        return {x.beg, y.end};
+    }
+    Frag star(Frag f) {
+        int b = new_node(), e = new_node();
+        add_eps(b, f.beg);
+        add_eps(b, e);
+        add_eps(f.end, f.beg);
+        add_eps(f.end, e);
+        return {b, e};
+    }
+    Frag plus(Frag f) {
+        int e = new_node();
+        add_eps(f.end, f.beg);
+        add_eps(f.end, e);
+        return {f.beg, e};
+    }
+    Frag optional(Frag f) {
+        int b = new_node(), e = new_node();
+        add_eps(b, f.beg);
+        add_eps(b, e);
+        add_eps(f.end, e);
+        return {b, e};
+    }
+    Frag any_byte() {
+        std::bitset<256> cls;
+        cls.set();
+        return make_class(cls);
+    }
+    Frag literal(byte_t c) {
+        std::bitset<256> cls;
+        cls.set(c);
+        return make_class(cls);
+    }
+
+    byte_t escaped() {
+        assert('\\' == m_re[m_pos]);
+        if (++m_pos == m_re.size())
+            syntax_error("trailing backslash");
+        return m_re.uch(m_pos++);
+    }
+
+    // m_pos is after '['
+    Frag parse_class() {
+        std::bitset<256> cls;
+        bool negate = false;
+        if (!eof() && '^' == peek()) {
+            negate = true;
+            m_pos++;
+        }
+        bool first = true;
+        for (;;) {
+            if (eof())
+                syntax_error("missing ']'");
+            if (']' == peek() && !first) {
+                m_pos++;
+                break;
+            }
+            first = false;
+            byte_t lo = '\\' == peek() ? escaped() : m_re.uch(m_pos++);
+            byte_t hi = lo;
+            if (m_pos + 1 < m_re.size() && '-' == peek() && ']' != m_re[m_pos+1]) {
+                m_pos++;
+                hi = '\\' == peek() ? escaped() : m_re.uch(m_pos++);
+                if (hi < lo)
+                    syntax_error("bad range");
+            }
+            for (size_t c = lo; c <= hi; ++c)
+                cls.set(c);
+        }
+        if (negate)
+            cls.flip();
+        return make_class(cls);
+    }
+
+    Frag parse_alt() {
+        Frag f = parse_concat();
+        while (!eof() && '|' == peek()) {
+            m_pos++;
+            Frag g = parse_concat();
+            int b = new_node(), e = new_node();
+            add_eps(b, f.beg);
+            add_eps(b, g.beg);
+            add_eps(f.end, e);
+            add_eps(g.end, e);
+            f = {b, e};
+        }
+        return f;
+    }
+
+    Frag parse_concat() {
+        Frag f = make_empty();
+        while (!eof() && '|' != peek() && ')' != peek())
+            f = concat(f, parse_repeat());
+        return f;
+    }
+
+    Frag parse_repeat() {
+        Frag f = parse_atom();
+        while (!eof()) {
+            switch (peek()) {
+            default: return f;
+            case '*': f = star(f);     break;
+            case '+': f = plus(f);     break;
+            case '?': f = optional(f); break;
+            }
+            m_pos++;
+        }
+        return f;
+    }
+
+    Frag parse_atom() {
+        byte_t c = peek();
+        switch (c) {
+        case '(': {
+            m_pos++;
+            Frag f = parse_alt();
+            if (eof() || ')' != peek())
+                syntax_error("missing ')'");
+            m_pos++;
+            return f; }
+        case '[':
+            m_pos++;
+            return parse_class();
+        case '.':
+            m_pos++;
+            return any_byte();
+        case '\\':
+            return literal(escaped());
+        case '*': case '+': case '?':
+            syntax_error("nothing to repeat");
+        default:
+            m_pos++;
+            return literal(c);
+        }
+    }
+
+    Frag parse_glob() {
+        Frag f = make_empty();
+        while (!eof()) {
+            byte_t c = peek();
+            switch (c) {
+            case '*': m_pos++; f = concat(f, star(any_byte())); break;
+            case '?': m_pos++; f = concat(f, any_byte()); break;
+            case '[': m_pos++; f = concat(f, parse_class()); break;
+            case '\\': f = concat(f, literal(escaped())); break;
+            default: m_pos++; f = concat(f, literal(c)); break;
+            }
+        }
+        return f;
+    }
+};
+
+void eps_closure(const std::vector<NfaNode>& nodes, std::vector<int>* set,
+                 std::vector<byte_t>* mark) {
+    std::vector<int> stack(*set);
+    for (int x : *set) (*mark)[x] = 1;
+    while (!stack.empty()) {
+        int x = stack.back(); stack.pop_back();
+        for (int y : nodes[x].eps) {
+            if (y >= 0 && !(*mark)[y]) {
+                (*mark)[y] = 1;
+                set->push_back(y);
+                stack.push_back(y);
+            }
+        }
+    }
+    for (int x : *set) (*mark)[x] = 0;
+    std::sort(set->begin(), set->end());
+}
+
+} // namespace
+
+RegexAutomaton::RegexAutomaton() {
+    m_initial = dead_state;
+}
+
+RegexAutomaton*
+RegexAutomaton::compile(fstring re, bool glob, size_t max_states) {
+    std::unique_ptr<RegexAutomaton> au(new RegexAutomaton());
+    valvec<uint32_t>* trans = &au->m_trans;
+    valvec<byte_t>* accept = &au->m_accept;
+    RegexParser parser(re, glob);
+    Frag top = parser.parse();
+    const std::vector<NfaNode>& nodes = parser.nodes;
+    std::vector<byte_t> mark(nodes.size(), 0);
+    std::map<std::vector<int>, uint32_t> set2id;
+    std::vector<std::vector<int> > dstates;
+    std::vector<int> cur(1, top.beg);
+    eps_closure(nodes, &cur, &mark);
+    set2id[cur] = 0;
+    dstates.push_back(cur);
+    std::vector<int> next[256];
+    for (size_t i = 0; i < dstates.size(); ++i) {
+        for (auto& x : next) x.clear();
+        for (int x : dstates[i]) {
+            const NfaNode& n = nodes[x];
+            if (n.cls_to < 0) continue;
+            for (size_t c = 0; c < 256; ++c)
+                if (n.cls[c]) next[c].push_back(n.cls_to);
+        }
+        trans->resize(256 * dstates.size(), UINT32_MAX);
+        for (size_t c = 0; c < 256; ++c) {
+            if (next[c].empty()) continue;
+            std::vector<int>& set = next[c];
+            eps_closure(nodes, &set, &mark);
+            auto ib = set2id.emplace(set, uint32_t(dstates.size()));
+            if (ib.second) {
+                if (dstates.size() >= max_states)
+                    THROW_STD(invalid_argument, "\"%.*s\": too many dfa states > %zd",
+                              re.ilen(), re.data(), max_states);
+                dstates.push_back(set);
+                trans->resize(256 * dstates.size(), UINT32_MAX);
+            }
+            (*trans)[256 * i + c] = ib.first->second;
+        }
+    }
+    size_t num = dstates.size();
+    accept->resize(num, 0);
+    for (size_t i = 0; i < num; ++i)
+        accept->at(i) = std::binary_search(dstates[i].begin(), dstates[i].end(), top.end);
+
+    // states can not reach an accept state are dead, BFS from accept
+    // states on reverse edges, O(states * 256)
+    // byte ranges mostly go to one state, skip repeated targets
+    auto for_each_edge = [&](auto fn) {
+        for (size_t i = 0; i < num; ++i) {
+            uint32_t prev = UINT32_MAX;
+            for (size_t c = 0; c < 256; ++c) {
+                uint32_t t = (*trans)[256 * i + c];
+                if (UINT32_MAX != t && prev != t) fn(uint32_t(i), t);
+                prev = t;
+            }
+        }
+    };
+    valvec<uint32_t> rbeg(num + 1, 0), rpos, redge;
+    for_each_edge([&](uint32_t, uint32_t t) { rbeg[t + 1]++; });
+    for (size_t i = 0; i < num; ++i) rbeg[i + 1] += rbeg[i];
+    rpos.assign(rbeg.data(), num);
+    redge.resize_no_init(rbeg[num]);
+    for_each_edge([&](uint32_t s, uint32_t t) { redge[rpos[t]++] = s; });
+    valvec<byte_t> alive(num, 0);
+    valvec<uint32_t> queue(num, valvec_reserve());
+    for (size_t i = 0; i < num; ++i) {
+        if ((*accept)[i]) alive[i] = 1, queue.push_back(uint32_t(i));
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t t = queue[head];
+        for (size_t j = rbeg[t]; j < rbeg[t + 1]; ++j) {
+            uint32_t s = redge[j];
+            if (!alive[s]) alive[s] = 1, queue.push_back(s);
+        }
+    }
+    for (uint32_t& t : *trans) {
+        if (UINT32_MAX != t && !alive[t])
+            t = UINT32_MAX;
+    }
+    au->m_initial = alive[0] ? 0 : dead_state;
+    return au.release();
+}
+
+RegexAutomaton* RegexAutomaton::compile_regex(fstring regex, size_t max_states) {
+    return compile(regex, false, max_states);
+}
+
+RegexAutomaton* RegexAutomaton::compile_glob(fstring glob, size_t max_states) {
+    return compile(glob, true, max_states);
+}
+
+size_t RegexAutomaton::initial() const {
+    return m_initial;
+}
+
+size_t RegexAutomaton::step(size_t s, byte_t ch) const {
+    assert(s < m_accept.size());
+    uint32_t t = m_trans[256 * s + ch];
+    return UINT32_MAX == t ? dead_state : t;
+}
+
+bool RegexAutomaton::is_accept(size_t s) const {
+    assert(s < m_accept.size());
+    return 0 != m_accept[s];
+}
+
+bool RegexAutomaton::match(fstring key) const {
+    size_t s = m_initial;
+    for (size_t i = 0; i < key.size() && dead_state != s; ++i)
+        s = step(s, key.uch(i));
+    return dead_state != s && is_accept(s);
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+BaseDFA_Automaton::BaseDFA_Automaton(const BaseDFA* dfa, size_t root) {
+    m_dfa = dfa;
+    m_root = root;
+}
+
+size_t BaseDFA_Automaton::initial() const {
+    return m_root;
+}
+
+size_t BaseDFA_Automaton::step(size_t s, byte_t ch) const {
+    if (m_dfa->v_is_pzip(s)) {
+        THROW_STD(invalid_argument, "path zipped state %zd is not supported", s);
+    }
+    size_t t = m_dfa->v_state_move(s, ch);
+    return m_dfa->v_nil_state() == t ? dead_state : t;
+}
+
+bool BaseDFA_Automaton::is_accept(size_t s) const {
+    return m_dfa->v_is_term(s);
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+DFA_IntersectIterator::DFA_IntersectIterator(const BaseDFA* trie,
+                                             const ByteAutomaton* au,
+                                             size_t root) {
+    m_trie = trie;
+    m_au = au;
+    m_root = root;
+    m_word_state = size_t(-1);
+    m_key.reserve(256);
+}
+
+DFA_IntersectIterator::~DFA_IntersectIterator() {
+}
+
+void DFA_IntersectIterator::reset() {
+    m_key.erase_all();
+    m_moves.erase_all();
+    m_stack.erase_all();
+    m_word_state = size_t(-1);
+}
+
+bool DFA_IntersectIterator::consume_zpath(size_t s, size_t* as) {
+    if (m_trie->v_is_pzip(s)) {
+        fstring zp = m_trie->v_get_zpath_data(s, &m_ctx);
+        size_t a = *as;
+        for (size_t i = 0; i < zp.size(); ++i) {
+            a = m_au->step(a, zp.uch(i));
+            if (ByteAutomaton::dead_state == a)
+                return false;
+        }
+        m_key.append(zp.udata(), zp.size());
+        *as = a;
+    }
+    return true;
+}
+
+// @returns index of new frame, or size_t(-1) if s has no children
+size_t DFA_IntersectIterator::push_children(size_t s, size_t as) {
+    size_t beg = m_moves.size();
+    m_moves.grow_no_init(m_trie->get_sigma());
+    size_t n = m_trie->get_all_move(s, m_moves.data() + beg);
+    m_moves.risk_set_size(beg + n);
+    if (0 == n)
+        return size_t(-1);
+    m_stack.push_back({beg, beg, beg + n, m_key.size(), as});
+    return m_stack.size() - 1;
+}
+
+// @returns true if s is a matched word, its children are pushed anyway
+bool DFA_IntersectIterator::enter(size_t s, size_t as) {
+    if (!consume_zpath(s, &as))
+        return false;
+    push_children(s, as);
+    if (m_trie->v_is_term(s) && m_au->is_accept(as)) {
+        m_word_state = s;
+        return true;
+    }
+    return false;
+}
+
+bool DFA_IntersectIterator::next_match() {
+    while (!m_stack.empty()) {
+        Frame& f = m_stack.back();
+        if (f.pos == f.end) {
+            m_moves.risk_set_size(f.beg);
+            m_stack.pop_back();
+            continue;
+        }
+        CharTarget<size_t> ct = m_moves[f.pos++];
+        assert(ct.ch < 256);
+        size_t as = m_au->step(f.as, byte_t(ct.ch));
+        if (ByteAutomaton::dead_state == as)
+            continue; // prune the subtree
+        m_key.risk_set_size(f.depth);
+        m_key.push_back(byte_t(ct.ch));
+        if (enter(ct.target, as))
+            return true;
+    }
+    m_key.erase_all();
+    m_word_state = size_t(-1);
+    return false;
+}
+
+bool DFA_IntersectIterator::seek_begin() {
+    reset();
+    size_t as = m_au->initial();
+    if (ByteAutomaton::dead_state == as)
+        return false;
+    return enter(m_root, as) || next_match();
+}
+
+bool DFA_IntersectIterator::seek_lower_bound(fstring target) {
+    reset();
+    size_t as = m_au->initial();
+    if (ByteAutomaton::dead_state == as)
+        return false;
+    size_t s = m_root;
+    for (;;) {
+        // now m_key == target[0, m_key.size())
+        size_t d = m_key.size();
+        if (m_trie->v_is_pzip(s)) {
+            fstring zp = m_trie->v_get_zpath_data(s, &m_ctx);
+            size_t n = std::min(zp.size(), target.size() - d);
+            int cmp = memcmp(zp.data(), target.data() + d, n);
+            if (cmp > 0 || (0 == cmp && zp.size() > n))
+                return enter(s, as) || next_match(); // whole subtree > target
+            if (cmp < 0)
+                return next_match(); // whole subtree < target
+            if (!consume_zpath(s, &as))
+                return next_match();
+            d = m_key.size();
+        }
+        if (target.size() == d) {
+            push_children(s, as);
+            if (m_trie->v_is_term(s) && m_au->is_accept(as)) {
+                m_word_state = s;
+                return true;
+            }
+            return next_match();
+        }
+        size_t top = push_children(s, as);
+        if (size_t(-1) == top)
+            return next_match();
+        byte_t c = target.uch(d);
+        Frame& f = m_stack[top];
+        while (f.pos < f.end && m_moves[f.pos].ch < c)
+            f.pos++;
+        if (f.pos == f.end || m_moves[f.pos].ch != c)
+            return next_match(); // all children > target[d] are from f.pos
+        size_t child = m_moves[f.pos++].target;
+        as = m_au->step(as, c);
+        if (ByteAutomaton::dead_state == as)
+            return next_match();
+        m_key.push_back(c);
+        s = child;
+    }
+}
+
+bool DFA_IntersectIterator::incr() {
+    return next_match();
+}
+
+size_t DFA_IntersectIterator::word_id() const {
+    const BaseDAWG* dawg = m_trie->get_dawg();
+    return dawg ? dawg->v_state_to_word_id(m_word_state) : m_word_state;
+}
+
+} // namespace terark
@@ -0,0 +1,112 @@
+#pragma once
+#include "fsa.hpp"
+#include <boost/noncopyable.hpp>
+
+namespace terark {
+
+/// deterministic automaton on bytes, for intersecting with a trie
+class TERARK_DLL_EXPORT ByteAutomaton : boost::noncopyable {
+public:
+    static const size_t dead_state = size_t(-1);
+    virtual ~ByteAutomaton();
+    virtual size_t initial() const = 0;
+    /// @returns dead_state if no key can be accepted after ch
+    virtual size_t step(size_t s, byte_t ch) const = 0;
+    virtual bool is_accept(size_t s) const = 0;
+};
+
+/// restricted regular expression compiled to a dense dfa, the whole key
+/// must match (implicitly anchored at both ends).
+///
+/// regex syntax: concatenation, alternation a|b, group (...), repeat
+/// * + ?, any byte '.', byte class [a-z0-9] [^...], escape \c.
+/// glob syntax: '*' any bytes, '?' any byte, [...] class, escape \c,
+/// e.g. "user:*:2024-*".
+///
+/// states from which no key can be accepted are mapped to dead_state, so
+/// a walker prunes them immediately
+class TERARK_DLL_EXPORT RegexAutomaton : public ByteAutomaton {
+public:
+    static const size_t default_max_states = 10000;
+
+    /// throw invalid_argument on syntax error or too many dfa states
+    static RegexAutomaton* compile_regex(fstring regex, size_t max_states = default_max_states);
+    static RegexAutomaton* compile_glob(fstring glob, size_t max_states = default_max_states);
+
+    size_t initial() const override;
+    size_t step(size_t s, byte_t ch) const override;
+    bool is_accept(size_t s) const override;
+
+    size_t num_states() const { return m_accept.size(); }
+    bool match(fstring key) const;
+
+protected:
+    RegexAutomaton();
+    static RegexAutomaton* compile(fstring re, bool glob, size_t max_states);
+    valvec<uint32_t> m_trans;  // num_states * 256
+    valvec<byte_t>   m_accept;
+    size_t           m_initial;
+};
+
+/// adapt a user supplied BaseDFA, path zipped states are not supported,
+/// nil state of dfa is dead_state
+class TERARK_DLL_EXPORT BaseDFA_Automaton : public ByteAutomaton {
+public:
+    explicit BaseDFA_Automaton(const BaseDFA* dfa, size_t root = initial_state);
+    size_t initial() const override;
+    size_t step(size_t s, byte_t ch) const override;
+    bool is_accept(size_t s) const override;
+protected:
+    const BaseDFA* m_dfa;
+    size_t m_root;
+};
+
+/// iterates keys of a trie which are accepted by an automaton, in
+/// lexicographic order, trie is any dfa acyclic from root.
+///
+/// the intersection is lazy: it descends the trie and steps the automaton
+/// together, and skips a subtree once the automaton dies, so only matching
+/// subtrees are touched.
+///
+/// for Patricia with concurrent writers, caller should hold a ReaderToken
+class TERARK_DLL_EXPORT DFA_IntersectIterator : boost::noncopyable {
+public:
+    DFA_IntersectIterator(const BaseDFA* trie, const ByteAutomaton* au,
+                          size_t root = initial_state);
+    ~DFA_IntersectIterator();
+
+    bool seek_begin();
+    /// position to the first matching key >= target
+    bool seek_lower_bound(fstring target);
+    bool incr();
+
+    fstring word() const { return m_key; }
+    size_t  word_state() const { return m_word_state; }
+    /// word id if trie is a dawg, else word_state()
+    size_t  word_id() const;
+
+private:
+    struct Frame {
+        size_t beg;   // children of this frame is m_moves[beg, end)
+        size_t pos;   // next child
+        size_t end;
+        size_t depth; // key len at this state, zpath included
+        size_t as;    // automaton state at this state
+    };
+    bool consume_zpath(size_t s, size_t* as);
+    size_t push_children(size_t s, size_t as);
+    bool enter(size_t s, size_t as);
+    bool next_match();
+    void reset();
+
+    const BaseDFA*       m_trie;
+    const ByteAutomaton* m_au;
+    size_t               m_root;
+    size_t               m_word_state;
+    valvec<byte_t>       m_key;
+    valvec<CharTarget<size_t> > m_moves; // children of all frames
+    valvec<Frame>        m_stack;
+    MatchContext         m_ctx;
+};
+
+} // namespace terark
@@ -859,7 +859,7 @@ BaseDFA* BaseDFA::load_mmap_fmt(const DFA_MmapHeader* base) {
 	}
 	if (base->crc32cLevel >= 2 && g_enableChecksumVerify) {
 		size_t  content_len = base->file_size - sizeof(*base);
-		uint32_t file_crc32 = Crc32c_update(0, base+1, content_len);
+		uint32_t file_crc32 = Crc32c_update_parallel(0, base+1, content_len);
 		if (base->file_crc32 != file_crc32) {
 			throw BadCrc32cException("BaseDFA::load_mmap_fmt(): file_crc32"
 				, base->file_crc32, file_crc32);
@@ -0,0 +1,174 @@
+#include "fuzzy_match.hpp"
+#include <terark/util/sortable_strvec.hpp>
+#include <terark/util/throw.hpp>
+
+namespace terark {
+
+LevenshteinAutomaton::LevenshteinAutomaton(fstring pattern, size_t max_dist,
+                                           bool damerau) {
+    if (max_dist >= 255) {
+        THROW_STD(invalid_argument, "max_dist = %zd is too large", max_dist);
+    }
+    m_pattern.assign(pattern.udata(), pattern.size());
+    m_max_dist = max_dist;
+    m_damerau = damerau;
+}
+
+void LevenshteinAutomaton::init(byte_t* row) const {
+    size_t m = m_pattern.size(), k1 = m_max_dist + 1;
+    for (size_t j = 0; j <= m; ++j)
+        row[j] = byte_t(std::min(j, k1));
+}
+
+size_t LevenshteinAutomaton::step(const byte_t* row2, byte_t ch2,
+                                  const byte_t* prev, byte_t ch,
+                                  byte_t* next) const {
+    const byte_t* p = m_pattern.data();
+    size_t m = m_pattern.size(), k1 = m_max_dist + 1;
+    size_t x = std::min<size_t>(prev[0] + 1, k1);
+    size_t minval = x;
+    next[0] = byte_t(x);
+    bool transpose = m_damerau && NULL != row2;
+    for (size_t j = 1; j <= m; ++j) {
+        x = prev[j-1] + (p[j-1] != ch);    // replace or keep
+        x = std::min<size_t>(x, prev[j] + 1);   // insert ch
+        x = std::min<size_t>(x, next[j-1] + 1); // delete p[j-1]
+        if (transpose && j >= 2 && ch == p[j-2] && ch2 == p[j-1])
+            x = std::min<size_t>(x, row2[j-2] + 1);
+        x = std::min(x, k1);
+        next[j] = byte_t(x);
+        minval = std::min(minval, x);
+    }
+    return minval;
+}
+
+size_t LevenshteinAutomaton::distance(fstring str) const {
+    size_t rsize = row_size();
+    valvec<byte_t> rows(rsize * (str.size() + 1), valvec_no_init());
+    init(rows.data());
+    for (size_t d = 0; d < str.size(); ++d) {
+        const byte_t* prev = rows.data() + rsize * d;
+        const byte_t* row2 = d ? prev - rsize : NULL;
+        byte_t ch2 = d ? str.uch(d-1) : 0;
+        if (step(row2, ch2, prev, str.uch(d), rows.data() + rsize * (d+1)) > m_max_dist)
+            return m_max_dist + 1;
+    }
+    return rows[rsize * str.size() + m_pattern.size()];
+}
+
+namespace {
+class FuzzyWalker {
+    const BaseDFA* m_dfa;
+    const LevenshteinAutomaton& m_la;
+    const OnFuzzyMatch& m_onMatch;
+    size_t m_limit;
+    size_t m_rsize;
+    valvec<byte_t> m_key;
+    valvec<byte_t> m_rows; // m_rows[rsize*d, rsize*(d+1)) is row of depth d
+    valvec<CharTarget<size_t> > m_moves; // children of all frames
+    struct Frame {
+        size_t beg;   // children of this frame is m_moves[beg, end)
+        size_t pos;   // next child
+        size_t end;
+        size_t depth; // key len at this state, zpath included
+    };
+    valvec<Frame> m_stack;
+    MatchContext m_ctx;
+
+    bool push_byte(byte_t ch) {
+        size_t d = m_key.size();
+        m_rows.grow_no_init(m_rsize);
+        byte_t* prev = m_rows.data() + m_rsize * d;
+        const byte_t* row2 = d ? prev - m_rsize : NULL;
+        byte_t ch2 = d ? m_key[d-1] : 0;
+        m_key.push_back(ch);
+        return m_la.step(row2, ch2, prev, ch, prev + m_rsize) <= m_la.max_dist();
+    }
+
+    // return false if search is stopped
+    bool enter(size_t s) {
+        if (m_dfa->v_is_pzip(s)) {
+            fstring zp = m_dfa->v_get_zpath_data(s, &m_ctx);
+            for (size_t i = 0; i < zp.size(); ++i) {
+                if (!push_byte(zp.uch(i)))
+                    return true; // dead, prune
+            }
+        }
+        const byte_t* row = m_rows.data() + m_rsize * m_key.size();
+        if (m_dfa->v_is_term(s) && m_la.is_match(row)) {
+            matched++;
+            if (!m_onMatch(m_key, s, m_la.distance(row)) || matched >= m_limit)
+                return false;
+        }
+        size_t beg = m_moves.size();
+        m_moves.grow_no_init(m_dfa->get_sigma());
+        size_t n = m_dfa->get_all_move(s, m_moves.data() + beg);
+        m_moves.risk_set_size(beg + n);
+        if (n)
+            m_stack.push_back({beg, beg, beg + n, m_key.size()});
+        return true;
+    }
+
+public:
+    size_t matched = 0;
+
+    FuzzyWalker(const BaseDFA* dfa, const LevenshteinAutomaton& la,
+                size_t limit, const OnFuzzyMatch& onMatch)
+      : m_dfa(dfa), m_la(la), m_onMatch(onMatch) {
+        m_limit = limit;
+        m_rsize = la.row_size();
+        m_key.reserve(256);
+        m_rows.reserve(m_rsize * 256);
+    }
+
+    void run(size_t root) {
+        m_rows.resize_no_init(m_rsize);
+        m_la.init(m_rows.data());
+        if (!enter(root))
+            return;
+        while (!m_stack.empty()) {
+            Frame& f = m_stack.back();
+            if (f.pos == f.end) {
+                m_moves.risk_set_size(f.beg);
+                m_stack.pop_back();
+                continue;
+            }
+            CharTarget<size_t> ct = m_moves[f.pos++];
+            m_key.risk_set_size(f.depth);
+            m_rows.risk_set_size(m_rsize * (f.depth + 1));
+            assert(ct.ch < 256);
+            if (!push_byte(byte_t(ct.ch)))
+                continue; // dead, prune
+            if (!enter(ct.target))
+                return;
+        }
+    }
+};
+} // namespace
+
+size_t dfa_fuzzy_match(const BaseDFA* dfa, const LevenshteinAutomaton& la,
+                       size_t limit, const OnFuzzyMatch& onMatch, size_t root) {
+    if (0 == limit)
+        return 0;
+    FuzzyWalker walker(dfa, la, limit, onMatch);
+    walker.run(root);
+    return walker.matched;
+}
+
+size_t dfa_fuzzy_match(const BaseDFA* dfa, fstring pattern,
+                       size_t max_dist, size_t limit,
+                       valvec<FuzzyMatchResult>* out,
+                       SortableStrVec* keys, bool damerau) {
+    LevenshteinAutomaton la(pattern, max_dist, damerau);
+    const BaseDAWG* dawg = dfa->get_dawg();
+    return dfa_fuzzy_match(dfa, la, limit,
+    [&](fstring key, size_t state, size_t distance) {
+        size_t word_id = dawg ? dawg->v_state_to_word_id(state) : state;
+        out->push_back({state, word_id, distance});
+        if (keys)
+            keys->push_back(key);
+        return true;
+    });
+}
+
+} // namespace terark
@@ -0,0 +1,75 @@
+#pragma once
+#include "fsa.hpp"
+
+namespace terark {
+
+/// Levenshtein automaton of a pattern for max distance k.
+/// An automaton state is a row of the edit distance matrix, row[j] is the
+/// distance between the input consumed so far and pattern[0, j), values are
+/// saturated at k + 1. The automaton dies when all values of a row are
+/// greater than k, so the walker prunes the subtree.
+/// Distance is counted by bytes, with damerau, a transposition of adjacent
+/// bytes costs 1 (optimal string alignment distance).
+class TERARK_DLL_EXPORT LevenshteinAutomaton {
+public:
+    LevenshteinAutomaton(fstring pattern, size_t max_dist, bool damerau = false);
+
+    size_t row_size() const { return m_pattern.size() + 1; }
+    size_t max_dist() const { return m_max_dist; }
+    bool   damerau() const { return m_damerau; }
+    fstring pattern() const { return m_pattern; }
+
+    /// row of empty input
+    void init(byte_t* row) const;
+
+    /// consume ch, row2/ch2 is the state before prev and its input byte,
+    /// they are only used by damerau, row2 may be NULL at depth 0.
+    /// @returns min value of next, next is dead if return > max_dist()
+    size_t step(const byte_t* row2, byte_t ch2, const byte_t* prev,
+                byte_t ch, byte_t* next) const;
+
+    size_t distance(const byte_t* row) const { return row[m_pattern.size()]; }
+    bool is_match(const byte_t* row) const { return distance(row) <= m_max_dist; }
+
+    /// distance of str to pattern, returns max_dist() + 1 if it exceeds
+    size_t distance(fstring str) const;
+
+protected:
+    valvec<byte_t> m_pattern;
+    size_t m_max_dist;
+    bool   m_damerau;
+};
+
+struct FuzzyMatchResult {
+    size_t state;
+    size_t word_id;  ///< dawg word id, or state if dfa is not a dawg
+    size_t distance;
+};
+
+/// @returns false to stop the search
+typedef function<bool(fstring key, size_t state, size_t distance)> OnFuzzyMatch;
+
+/// dfa must be acyclic from root, such as NestLoudsTrieDAWG, Patricia and
+/// DoubleArrayTrie.
+/// intersect la with dfa from root, call onMatch for each key in dfa whose
+/// distance to la.pattern() <= la.max_dist(), keys are in lexicographic
+/// order, at most limit keys are visited.
+/// subtrees are pruned as soon as the automaton dies, so it only touches
+/// states reachable within the edit distance.
+/// for Patricia with concurrent writers, caller should hold a ReaderToken
+/// @returns number of matched keys
+TERARK_DLL_EXPORT
+size_t dfa_fuzzy_match(const BaseDFA* dfa, const LevenshteinAutomaton& la,
+                       size_t limit, const OnFuzzyMatch& onMatch,
+                       size_t root = initial_state);
+
+/// convenient wrapper, results are appended to out in lexicographic order,
+/// keys are appended to keys if it is not NULL
+TERARK_DLL_EXPORT
+size_t dfa_fuzzy_match(const BaseDFA* dfa, fstring pattern,
+                       size_t max_dist, size_t limit,
+                       valvec<FuzzyMatchResult>* out,
+                       SortableStrVec* keys = NULL,
+                       bool damerau = false);
+
+} // namespace terark
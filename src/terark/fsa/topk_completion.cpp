@@ -0,0 +1,207 @@
+#include "topk_completion.hpp"
+#include <terark/util/sortable_strvec.hpp>
+#include <terark/util/throw.hpp>
+#include <algorithm>
+#include <typeinfo>
+
+namespace terark {
+
+TopkCompletionTrie::TopkCompletionTrie() : m_trie(new trie_t) {
+}
+
+TopkCompletionTrie::~TopkCompletionTrie() {
+}
+
+void TopkCompletionTrie::build_from(SortableStrVec& keys,
+                                    const valvec<uint64_t>& weights,
+                                    const NestLoudsTrieConfig& conf) {
+    if (keys.size() != weights.size()) {
+        THROW_STD(invalid_argument, "keys.size() = %zd != weights.size() = %zd",
+                  keys.size(), weights.size());
+    }
+    m_weights = weights;
+    std::sort(m_weights.begin(), m_weights.end());
+    m_weights.trim(std::unique(m_weights.begin(), m_weights.end()));
+    m_weights.shrink_to_fit();
+    auto rank_of = [this](uint64_t w) {
+        return size_t(std::lower_bound(m_weights.begin(), m_weights.end(), w)
+                      - m_weights.begin());
+    };
+    size_t max_rank = m_weights.empty() ? 0 : m_weights.size() - 1;
+
+    // keys is consumed by the trie builder, instead of keeping a copy of
+    // keys for word ids, rank of each distinct key is collected in sorted
+    // order, which is the lexicographic order of words in the trie
+    keys.make_ascending_seq_id(); // seq_id is index of weights
+    keys.sort();
+    valvec<size_t> lex_rank(keys.size(), valvec_reserve());
+    for (size_t i = 0; i < keys.size(); ) {
+        fstring key = keys[i];
+        size_t r = rank_of(weights[keys.nth_seq_id(i)]);
+        for (++i; i < keys.size() && keys[i] == key; ++i)
+            r = std::max(r, rank_of(weights[keys.nth_seq_id(i)]));
+        lex_rank.push_back(r);
+    }
+    m_trie_mem.clear();
+    m_trie.reset(new trie_t);
+    m_trie->build_from(keys, conf);
+    keys.clear();
+
+    size_t nw = m_trie->num_words();
+    TERARK_VERIFY_EQ(nw, lex_rank.size());
+    valvec<size_t> word_rank(nw, valvec_no_init());
+    ADFA_LexIteratorUP iter(m_trie->adfa_make_iter(initial_state));
+    size_t lex_id = 0;
+    for (bool ok = iter->seek_begin(); ok; ok = iter->incr()) {
+        size_t wid = m_trie->state_to_word_id(iter->word_state());
+        assert(wid < nw);
+        word_rank[wid] = lex_rank[lex_id++];
+    }
+    TERARK_VERIFY_EQ(lex_id, nw);
+    lex_rank.clear();
+
+    // LOUDS states are in BFS order, a child is after its parent, so all
+    // subtree max are known when a state is visited in reverse order
+    size_t ns = m_trie->total_states();
+    valvec<size_t> node_rank(ns, size_t(0));
+    for (size_t s = ns; s-- > 0; ) {
+        size_t r = m_trie->is_term(s) ? word_rank[m_trie->state_to_word_id(s)] : 0;
+        m_trie->for_each_dest(s, [&](size_t child) {
+            assert(child > s);
+            r = std::max(r, node_rank[child]);
+        });
+        node_rank[s] = r;
+    }
+    m_word_rank.resize_with_wire_max_val(nw, max_rank);
+    for (size_t i = 0; i < nw; ++i)
+        m_word_rank.set_wire(i, word_rank[i]);
+    m_node_rank.resize_with_wire_max_val(ns, max_rank);
+    for (size_t s = 0; s < ns; ++s)
+        m_node_rank.set_wire(s, node_rank[s]);
+}
+
+void TopkCompletionTrie::save_trie_mem(valvec<byte_t>* mem) const {
+    mem->erase_all();
+    m_trie->save_mmap([mem](const void* data, size_t len) {
+        mem->append((const byte_t*)data, len);
+    });
+}
+
+void TopkCompletionTrie::load_trie_mem(valvec<byte_t>& mem) {
+    std::unique_ptr<BaseDFA> dfa(BaseDFA::load_mmap_user_mem(mem.data(), mem.size()));
+    trie_t* trie = dynamic_cast<trie_t*>(dfa.get());
+    if (NULL == trie) {
+        THROW_STD(invalid_argument, "trie is not NestLoudsTrieDAWG_SE_512, but is %s",
+                  typeid(*dfa).name());
+    }
+    if (trie->total_states() != m_node_rank.size() ||
+        trie->num_words() != m_word_rank.size()) {
+        THROW_STD(invalid_argument, "states = %zd, words = %zd mismatch ranks %zd %zd",
+                  trie->total_states(), trie->num_words(),
+                  m_node_rank.size(), m_word_rank.size());
+    }
+    dfa.release();
+    m_trie.reset(trie); // destroyed before the old m_trie_mem
+    m_trie_mem.swap(mem);
+}
+
+bool TopkCompletionTrie::ranks_in_range() const {
+    if (m_weights.empty()) {
+        return 0 == num_words() && 0 == m_node_rank.uintbits()
+                                && 0 == m_word_rank.uintbits();
+    }
+    size_t max_rank = m_weights.size() - 1;
+    size_t max_bits = UintVecMin0::compute_uintbits(max_rank);
+    if (m_node_rank.uintbits() > max_bits || m_word_rank.uintbits() > max_bits)
+        return false;
+    if (m_weights.size() == size_t(1) << max_bits)
+        return true; // any rank of max_bits is in range
+    for (size_t i = 0, n = m_node_rank.size(); i < n; ++i)
+        if (m_node_rank[i] > max_rank) return false;
+    for (size_t i = 0, n = m_word_rank.size(); i < n; ++i)
+        if (m_word_rank[i] > max_rank) return false;
+    return true;
+}
+
+size_t TopkCompletionTrie::prefix_state(fstring prefix) const {
+    MatchContext ctx;
+    size_t s = initial_state;
+    size_t i = 0;
+    for (;;) {
+        if (m_trie->is_pzip(s)) {
+            fstring zp = m_trie->get_zpath_data(s, &ctx);
+            size_t n = std::min(zp.size(), prefix.size() - i);
+            if (memcmp(zp.data(), prefix.data() + i, n) != 0)
+                return trie_t::nil_state;
+            i += n;
+        }
+        if (prefix.size() == i)
+            return s;
+        s = m_trie->state_move(s, prefix.uch(i++));
+        if (trie_t::nil_state == s)
+            return s;
+    }
+}
+
+void TopkCompletionTrie::topk(fstring prefix, size_t k, valvec<Item>* out) const {
+    topk(prefix, k, out, NULL);
+}
+
+void TopkCompletionTrie::topk(fstring prefix, size_t k, valvec<Item>* out,
+                              SortableStrVec* keys) const {
+    if (0 == k || m_trie->total_states() == 0)
+        return;
+    size_t root = prefix_state(prefix);
+    if (trie_t::nil_state == root)
+        return;
+    // best first: pop max rank, a word entry is a final result, a node
+    // entry is expanded to its own word and its children
+    struct Entry {
+        size_t rank;
+        size_t state : 63;
+        size_t is_word : 1;
+        bool operator<(const Entry& y) const {
+            if (rank != y.rank)
+                return rank < y.rank;
+            if (is_word != y.is_word)
+                return is_word < y.is_word; // word first
+            return state > y.state; // smaller state first
+        }
+    };
+    valvec<Entry> heap(64, valvec_reserve());
+    auto push = [&](size_t rank, size_t state, bool is_word) {
+        heap.push_back({rank, state, is_word});
+        std::push_heap(heap.begin(), heap.end());
+    };
+    push(m_node_rank[root], root, false);
+    std::string word;
+    size_t found = 0;
+    while (!heap.empty() && found < k) {
+        std::pop_heap(heap.begin(), heap.end());
+        Entry e = heap.pop_val();
+        if (e.is_word) {
+            size_t wid = m_trie->state_to_word_id(e.state);
+            out->push_back({wid, m_weights[e.rank]});
+            if (keys) {
+                m_trie->nth_word(wid, &word);
+                keys->push_back(word);
+            }
+            found++;
+            continue;
+        }
+        if (m_trie->is_term(e.state)) {
+            size_t wid = m_trie->state_to_word_id(e.state);
+            push(m_word_rank[wid], e.state, true);
+        }
+        m_trie->for_each_dest(e.state, [&](size_t child) {
+            push(m_node_rank[child], child, false);
+        });
+    }
+}
+
+size_t TopkCompletionTrie::mem_size() const {
+    return m_trie->mem_size() + m_node_rank.mem_size() + m_word_rank.mem_size()
+         + m_weights.used_mem_size();
+}
+
+} // namespace terark
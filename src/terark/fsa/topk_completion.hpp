@@ -0,0 +1,114 @@
+#pragma once
+#include "nest_trie_dawg.hpp"
+#include <terark/int_vector.hpp>
+#include <boost/noncopyable.hpp>
+#include <memory>
+
+namespace terark {
+
+/// top-k weighted prefix completion on NestLoudsTrieDAWG.
+///
+/// each LOUDS node keeps the max weight of its subtree, so a best first
+/// search from the state of the prefix pops the heaviest words first and
+/// stops after k words, without visiting the whole subtree.
+///
+/// weights are stored as ranks of distinct weights in UintVecMin0, both
+/// per node (subtree max) and per word, ranks keep the order of weights
+class TERARK_DLL_EXPORT TopkCompletionTrie : boost::noncopyable {
+public:
+    typedef NestLoudsTrieDAWG_SE_512 trie_t;
+    struct Item {
+        size_t   word_id;
+        uint64_t weight;
+    };
+
+    TopkCompletionTrie();
+    ~TopkCompletionTrie();
+
+    /// weights[i] is the weight of keys[i], keys is consumed,
+    /// weight of duplicate keys is the max of them
+    void build_from(SortableStrVec& keys, const valvec<uint64_t>& weights,
+                    const NestLoudsTrieConfig&);
+
+    enum { SERIALIZATION_VERSION = 1 };
+
+    template<class DataIO>
+    friend void DataIO_loadObject(DataIO& dio, TopkCompletionTrie& self) {
+        typename DataIO::my_var_uint64_t version, size;
+        dio >> version;
+        if (version > SERIALIZATION_VERSION) {
+            typedef typename DataIO::my_BadVersionException bad_ver;
+            throw bad_ver(unsigned(version.t), SERIALIZATION_VERSION, "TopkCompletionTrie");
+        }
+        valvec<byte_t> mem;
+        dio >> size;
+        mem.resize_no_init(size_t(size.t));
+        dio.ensureRead(mem.data(), mem.size());
+        load_rank(dio, self.m_node_rank);
+        load_rank(dio, self.m_word_rank);
+        dio >> self.m_weights;
+        self.load_trie_mem(mem);
+        if (!self.ranks_in_range()) {
+            typedef typename DataIO::my_DataFormatException bad_format;
+            throw bad_format("TopkCompletionTrie: rank out of weights");
+        }
+    }
+    template<class DataIO>
+    friend void DataIO_saveObject(DataIO& dio, const TopkCompletionTrie& self) {
+        valvec<byte_t> mem;
+        self.save_trie_mem(&mem);
+        dio << typename DataIO::my_var_uint64_t(SERIALIZATION_VERSION);
+        dio << typename DataIO::my_var_uint64_t(mem.size());
+        dio.ensureWrite(mem.data(), mem.size());
+        save_rank(dio, self.m_node_rank);
+        save_rank(dio, self.m_word_rank);
+        dio << self.m_weights;
+    }
+
+    /// append at most k completions of prefix to out, in descending weight
+    void topk(fstring prefix, size_t k, valvec<Item>* out) const;
+    /// and also append keys of the completions to keys
+    void topk(fstring prefix, size_t k, valvec<Item>* out,
+              SortableStrVec* keys) const;
+
+    /// state of prefix, prefix may end inside a zpath, nil_state if none
+    size_t prefix_state(fstring prefix) const;
+
+    uint64_t word_weight(size_t word_id) const {
+        return m_weights[m_word_rank[word_id]];
+    }
+    size_t num_words() const { return m_trie->num_words(); }
+    size_t mem_size() const;
+    const trie_t& trie() const { return *m_trie; }
+
+protected:
+    void save_trie_mem(valvec<byte_t>* mem) const;
+    void load_trie_mem(valvec<byte_t>& mem); // mem is consumed
+    bool ranks_in_range() const; // ranks index m_weights
+
+    template<class DataIO>
+    static void load_rank(DataIO& dio, UintVecMin0& vec) {
+        typename DataIO::my_var_uint64_t bits, size;
+        dio >> bits >> size;
+        if (bits.t > 64) {
+            typedef typename DataIO::my_DataFormatException bad_format;
+            throw bad_format("TopkCompletionTrie: bad rank bits");
+        }
+        vec.resize_with_uintbits(size_t(size.t), size_t(bits.t));
+        dio.ensureRead((byte_t*)vec.data(), vec.mem_size());
+    }
+    template<class DataIO>
+    static void save_rank(DataIO& dio, const UintVecMin0& vec) {
+        dio << typename DataIO::my_var_uint64_t(vec.uintbits());
+        dio << typename DataIO::my_var_uint64_t(vec.size());
+        dio.ensureWrite(vec.data(), vec.mem_size());
+    }
+
+    valvec<byte_t> m_trie_mem; // loaded trie refers to it
+    std::unique_ptr<trie_t> m_trie;
+    UintVecMin0    m_node_rank; // max weight rank in subtree, by state
+    UintVecMin0    m_word_rank; // weight rank, by word id
+    valvec<uint64_t> m_weights; // sorted distinct weights
+};
+
+} // namespace terark
@@ -24,6 +24,7 @@
 #include "hash_common.hpp"
 #include <utility> // for std::identity
 #include <terark/util/function.hpp> // for reference_wrapper
+#include <terark/util/cpu_prefetch.hpp>
 #include <boost/current_function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/type_traits/has_trivial_constructor.hpp>
@@ -399,6 +400,15 @@ public:
 	}
 
 	void rehash(size_t newBucketSize) {
+		if (realloc_bucket(newBucketSize))
+			relink();
+	}
+
+private:
+	template<class Tab> friend struct gold_hash_tab_parallel;
+
+	// @returns true if bucket is reallocated and elements need relink
+	bool realloc_bucket(size_t newBucketSize) {
 		newBucketSize = __hsm_stl_next_prime(newBucketSize);
 		if (newBucketSize != nBucket) {
 			// shrink or enlarge
@@ -418,10 +428,13 @@ public:
 				throw std::runtime_error("rehash failed, unrecoverable");
 			}
 			nBucket = newBucketSize;
-			relink();
 			maxload = LinkTp(newBucketSize * load_factor);
+			return true;
 		}
+		return false;
 	}
+
+public:
 //	void resize(size_t n) { rehash(n); }
 
 	void reserve(size_t cap) {
@@ -763,7 +776,53 @@ public:
 	template<class CompatibleObject>
 	std::pair<size_t, bool> insert_i(const CompatibleObject& obj) {
 		const Key& key = getKeyExtractor()(obj);
-		const HashTp h = HashTp(HashEqual::hash(key));
+		return insert_i_h(obj, HashTp(HashEqual::hash(key)));
+	}
+
+	/// insert objs[0, num), table is sized once for all of them, bucket
+	/// heads and chain heads of later objs are prefetched ahead.
+	/// hashes[i] is hash of key of objs[i], if NULL, hashes are computed
+	/// @returns number of inserted, existing keys are skipped
+	template<class CompatibleObject>
+	size_t bulk_insert(const CompatibleObject* objs, size_t num,
+					   const HashTp* hashes = NULL) {
+		size_t cap = nElem - freelist_size + num;
+		if (cap > maxload || &tail == bucket) {
+			reserve_nodes(std::max<size_t>(cap, nElem));
+			rehash(size_t(cap / load_factor + 1));
+		}
+		const size_t Batch = 256, Ahead = 8;
+		HashTp hbuf[Batch];
+		size_t inserted = 0;
+		for (size_t beg = 0; beg < num; beg += Batch) {
+			size_t n = std::min(Batch, num - beg);
+			const HashTp* hb = hashes ? hashes + beg : hbuf;
+			if (!hashes) {
+				for (size_t k = 0; k < n; ++k)
+					hbuf[k] = HashTp(HashEqual::hash(getKeyExtractor()(objs[beg + k])));
+			}
+			for (size_t k = 0; k < std::min(2*Ahead, n); ++k)
+				TERARK_CPU_PREFETCH(&bucket[hb[k] % nBucket]);
+			for (size_t k = 0; k < n; ++k) {
+				if (k + 2*Ahead < n)
+					TERARK_CPU_PREFETCH(&bucket[hb[k + 2*Ahead] % nBucket]);
+				if (k + Ahead < n) {
+					LinkTp p = bucket[hb[k + Ahead] % nBucket];
+					if (tail != p)
+						TERARK_CPU_PREFETCH(&m_nl.data(p));
+				}
+				assert(hb[k] == HashTp(HashEqual::hash(getKeyExtractor()(objs[beg + k]))));
+				inserted += insert_i_h(objs[beg + k], hb[k]).second;
+			}
+		}
+		return inserted;
+	}
+
+private:
+	template<class CompatibleObject>
+	std::pair<size_t, bool>
+	insert_i_h(const CompatibleObject& obj, const HashTp h) {
+		const Key& key = getKeyExtractor()(obj);
 		size_t i = h % nBucket;
 		for (LinkTp p = bucket[i]; tail != p; p = m_nl.link(p)) {
 			HSM_SANITY(p < nElem);
@@ -784,6 +843,7 @@ public:
 		return std::make_pair(slot, true);
 	}
 
+public:
 	///@{ low level operations
 	/// the caller should pay the risk for gain
 	///
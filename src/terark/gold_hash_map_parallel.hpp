@@ -0,0 +1,77 @@
+#ifndef __terark_gold_hash_map_parallel_hpp__
+#define __terark_gold_hash_map_parallel_hpp__
+
+#include "gold_hash_map.hpp"
+#include <terark/util/atomic.hpp>
+#include <thread>
+#include <vector>
+
+namespace terark {
+
+template<class Tab>
+struct gold_hash_tab_parallel {
+	typedef typename Tab::LinkTp LinkTp;
+
+	static void rehash(Tab& tab, size_t newBucketSize, size_t nthr) {
+		if (tab.realloc_bucket(newBucketSize)) {
+			if (nthr > 1 && tab.nElem >= 64*1024)
+				relink(tab, nthr);
+			else
+				tab.relink();
+		}
+	}
+
+	// each thread links a range of elements, bucket heads are set by CAS,
+	// so order of elements in a bucket is not deterministic
+	static void relink(Tab& tab, size_t nthr) {
+		LinkTp* pb = tab.bucket;
+		size_t  nb = tab.nBucket;
+		auto    nl = tab.m_nl;
+		const LinkTp delmark = Tab::delmark;
+		assert(&Tab::tail != pb && nb > 1);
+		std::fill_n(pb, nb, (LinkTp)Tab::tail);
+		{ // set delmark
+			LinkTp i = tab.freelist_head;
+			while (i < delmark) {
+				nl.link(i) = delmark;
+				i = reinterpret_cast<LinkTp&>(nl.data(i));
+			}
+		}
+		const bool has_del = 0 != tab.freelist_size;
+		auto link_range = [&](size_t beg, size_t end) {
+			for (size_t j = beg; j < end; ++j) {
+				if (has_del && delmark == nl.link(j))
+					continue;
+				size_t i = tab.hash_i(j) % nb;
+				LinkTp head = as_atomic(pb[i]).load(std::memory_order_relaxed);
+				do nl.link(j) = head;
+				while (!as_atomic(pb[i]).compare_exchange_weak(head, LinkTp(j),
+							std::memory_order_relaxed));
+			}
+		};
+		size_t n = tab.nElem;
+		std::vector<std::thread> thrVec;
+		thrVec.reserve(nthr - 1);
+		for (size_t t = 0; t + 1 < nthr; ++t) {
+			thrVec.emplace_back(link_range, n * t / nthr, n * (t+1) / nthr);
+		}
+		link_range(n * (nthr-1) / nthr, n); // last partition
+		for (auto& t : thrVec) {
+			t.join();
+		}
+	}
+};
+
+/// rehash with nthr threads, tables of less than 64K elements are rehashed
+/// by one thread, gold_hash_map/gold_hash_set are also accepted
+template<class Key, class Elem, class HashEqual, class KeyExtractor, class NodeLayout, class HashTp>
+void gold_hash_rehash_parallel(
+		gold_hash_tab<Key, Elem, HashEqual, KeyExtractor, NodeLayout, HashTp>& tab,
+		size_t newBucketSize, size_t nthr) {
+	typedef gold_hash_tab<Key, Elem, HashEqual, KeyExtractor, NodeLayout, HashTp> Tab;
+	gold_hash_tab_parallel<Tab>::rehash(tab, newBucketSize, nthr);
+}
+
+} // namespace terark
+
+#endif // __terark_gold_hash_map_parallel_hpp__
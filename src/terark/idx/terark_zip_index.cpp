@@ -6,6 +6,7 @@
 #endif
 
 #include "terark_zip_index.hpp"
+#include <mutex>
 #include <typeindex>
 #include <terark/io/DataIO.hpp>
 #include <terark/io/FileStream.hpp>
@@ -22,6 +23,8 @@
 #include <terark/fsa/crit_bit_trie.hpp>
 #include <terark/util/tmpfile.hpp>
 #include <terark/util/crc.hpp>
+#include <terark/util/fstrvec.hpp>
+#include <terark/util/metrics.hpp>
 #include <terark/util/mmap.hpp>
 #include <terark/zbs/blob_store_file_header.hpp>
 #include <terark/zbs/zip_reorder_map.hpp>
@@ -30,6 +33,7 @@
 #include <terark/zbs/dict_zip_blob_store.hpp>
 #include <terark/zbs/xxhash_helper.hpp>
 #include <terark/num_to_str.hpp>
+#include <terark/set_op.hpp>
 
 #if __clang__
 # pragma clang diagnostic push
@@ -257,6 +261,60 @@ TerarkIndex::~TerarkIndex() {}
 TerarkIndex::Factory::~Factory() {}
 TerarkIndex::Iterator::~Iterator() {}
 
+size_t TerarkIndex::Iterator::NextBatch(size_t n, KeyBatch* out) {
+  size_t i = 0;
+  for (; i < n && Valid(); ++i) {
+    out->keys.append(key());
+    out->offsets.push_back(out->keys.size());
+    out->ids.push_back(m_id);
+    Next();
+  }
+  return i;
+}
+
+size_t TerarkIndex::ApproximateDictRank(fstring key, TerarkContext* ctx) const {
+  return DictRank(key, ctx);
+}
+
+size_t TerarkIndex::RangeCount(fstring lo, fstring hi, TerarkContext* ctx) const {
+  if (!(lo < hi)) {
+    return 0;
+  }
+  size_t hi_rank = DictRank(hi, ctx);
+  if (hi_rank == 0) {
+    return 0;
+  }
+  size_t lo_rank = DictRank(lo, ctx);
+  return hi_rank - lo_rank;
+}
+
+size_t TerarkIndex::ApproximateRangeCount(fstring lo, fstring hi,
+                                          TerarkContext* ctx) const {
+  if (!(lo < hi)) {
+    return 0;
+  }
+  size_t hi_rank = ApproximateDictRank(hi, ctx);
+  if (hi_rank == 0) {
+    return 0;
+  }
+  size_t lo_rank = ApproximateDictRank(lo, ctx);
+  return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+}
+
+uint64_t TerarkIndex::ApproximateOffsetOf(fstring key, const BlobStore* store,
+                                          TerarkContext* ctx) const {
+  size_t num = store->num_records();
+  if (num == 0) {
+    return 0;
+  }
+  size_t rank = std::min(ApproximateDictRank(key, ctx), num);
+  if (NeedsReorder()) {
+    // ids are not in key order, records of a key range are scattered
+    return uint64_t(double(store->get_zip_offset(num)) * rank / num);
+  }
+  return store->get_zip_offset(rank);
+}
+
 using PrefixBuildInfo = TerarkIndex::PrefixBuildInfo;
 
 namespace index_detail {
@@ -348,6 +406,8 @@ struct PrefixBase {
 
   virtual bool Load(fstring mem, SuffixBase* suffix) = 0;
   virtual void Save(std::function<void(const void*, size_t)> append) const = 0;
+  // heap memory out of the loaded mem, such as caches built by BuildCache
+  virtual size_t HeapMemSize() const { return 0; }
 };
 
 template<class B, class T>
@@ -379,6 +439,7 @@ struct VirtualPrefixBase : public PrefixBase {
   virtual size_t TotalKeySize() const = 0;
   virtual size_t Find(fstring key, const SuffixBase* suffix, TerarkContext* ctx) const = 0;
   virtual size_t DictRank(fstring key, const SuffixBase* suffix, TerarkContext* ctx) const = 0;
+  virtual size_t ApproxDictRank(fstring key, TerarkContext* ctx) const = 0;
   virtual size_t AppendMinKey(valvec<byte_t>* buffer, TerarkContext* ctx) const = 0;
   virtual size_t AppendMaxKey(valvec<byte_t>* buffer, TerarkContext* ctx) const = 0;
 
@@ -443,6 +504,9 @@ struct VirtualPrefix : public PrefixBase {
   size_t DictRank(fstring key, const SuffixBase* suffix, TerarkContext* ctx) const {
     return prefix->DictRank(key, suffix, ctx);
   }
+  size_t ApproxDictRank(fstring key, TerarkContext* ctx) const {
+    return prefix->ApproxDictRank(key, ctx);
+  }
   size_t AppendMinKey(valvec<byte_t>* buffer, TerarkContext* ctx) const {
     return prefix->AppendMinKey(buffer, ctx);
   }
@@ -459,6 +523,9 @@ struct VirtualPrefix : public PrefixBase {
   void BuildCache(double cacheRatio) {
     prefix->BuildCache(cacheRatio);
   }
+  size_t HeapMemSize() const override {
+    return prefix->HeapMemSize();
+  }
 
   bool IterSeekToFirst(size_t& id, size_t& count, void* iter) const {
     return prefix->IterSeekToFirst(id, count, iter);
@@ -585,6 +652,62 @@ struct VirtualSuffix : public SuffixBase {
   }
 };
 
+#if TERARK_ENABLE_METRICS && TERARK_ENABLE_CYCLE_PROFILE
+// forwards to the real suffix and sums cycles spent in it, so prefix search
+// cycles is the total minus suffix cycles
+struct CycleProfileSuffix : public SuffixBase {
+  const SuffixBase* suffix;
+  mutable uint64_t cycles = 0;
+
+  explicit CycleProfileSuffix(const SuffixBase* s) : suffix(s) {
+    flags = s->flags;
+  }
+  LowerBoundResult LowerBound(fstring target, size_t suffix_id, size_t suffix_count, TerarkContext* ctx) const final {
+    uint64_t t0 = cpu_cycles();
+    auto result = suffix->LowerBound(target, suffix_id, suffix_count, ctx);
+    cycles += cpu_cycles() - t0;
+    return result;
+  }
+  void AppendKey(size_t suffix_id, valvec<byte_t>* buffer, TerarkContext* ctx) const final {
+    uint64_t t0 = cpu_cycles();
+    suffix->AppendKey(suffix_id, buffer, ctx);
+    cycles += cpu_cycles() - t0;
+  }
+  bool Load(fstring) final {
+    THROW_STD(invalid_argument, "Unsupported");
+  }
+  void Save(std::function<void(const void*, size_t)>) const final {
+    THROW_STD(invalid_argument, "Unsupported");
+  }
+  void Reorder(ZReorderMap&, std::function<void(const void*, size_t)>, fstring) const final {
+    THROW_STD(invalid_argument, "Unsupported");
+  }
+};
+
+template<class Func>
+size_t CycleProfileSearch(const SuffixBase* suffix, Func search) {
+  if (!Metrics::enabled()) {
+    return search(suffix);
+  }
+  if (nullptr == suffix) {
+    TERARK_CYCLE_SCOPE(kCycleIndexDescent);
+    return search(suffix);
+  }
+  CycleProfileSuffix profile(suffix);
+  uint64_t t0 = cpu_cycles();
+  size_t result = search(&profile);
+  uint64_t total = cpu_cycles() - t0;
+  Metrics::add(Metrics::kCycleIndexDescent, total - std::min(total, profile.cycles));
+  Metrics::add(Metrics::kCycleSuffixDecode, profile.cycles);
+  return result;
+}
+#else
+template<class Func>
+inline size_t CycleProfileSearch(const SuffixBase* suffix, Func search) {
+  return search(suffix);
+}
+#endif
+
 template<class Prefix, class Suffix>
 struct IndexParts {
   IndexParts() {}
@@ -957,6 +1080,34 @@ public:
     }
   }
 
+  // key_ is only updated for the final position, batch keys are written
+  // to the arena directly
+  size_t NextBatch(size_t n, TerarkIndex::KeyBatch* out) final {
+    if (m_id == size_t(-1) || n == 0) {
+      return 0;
+    }
+    out->offsets.reserve(out->offsets.size() + n);
+    out->ids.reserve(out->ids.size() + n);
+    auto& keys = out->keys;
+    keys.append(key_);
+    out->offsets.push_back(keys.size());
+    out->ids.push_back(m_id);
+    for (size_t i = 1; i < n; ++i) {
+      if (!prefix().IterNext(m_id, 1, prefix_storage_)) {
+        m_id = size_t(-1);
+        return i;
+      }
+      suffix().IterSet(m_id, suffix_storage_);
+      keys.append(common_);
+      keys.append(prefix().IterGetKey(m_id, prefix_storage_));
+      keys.append(suffix().IterGetKey(m_id, suffix_storage_));
+      out->offsets.push_back(keys.size());
+      out->ids.push_back(m_id);
+    }
+    Next();
+    return n;
+  }
+
   bool Prev() final {
     if (prefix().IterPrev(m_id, nullptr, prefix_storage_)) {
       suffix().IterSet(m_id, suffix_storage_);
@@ -1070,14 +1221,17 @@ public:
   }
 
   size_t Find(fstring key, TerarkContext* ctx) const final {
+    TERARK_METRICS_TIMER(kIndexFind);
     if (!key.startsWith(common_)) {
       return size_t(-1);
     }
     key = key.substr(common_.size());
-    return prefix_.Find(key, suffix_.TotalKeySize() != 0 ? &suffix_ : nullptr, ctx);
+    return CycleProfileSearch(suffix_.TotalKeySize() != 0 ? &suffix_ : nullptr,
+        [&](const SuffixBase* suffix) { return prefix_.Find(key, suffix, ctx); });
   }
 
-  size_t DictRank(fstring key, TerarkContext* ctx) const final {
+  template<class RankFunc>
+  size_t RankWithCommon(fstring key, RankFunc rank) const {
     size_t cplen = key.commonPrefixLen(common_);
     if (cplen != common_.size()) {
       assert(key.size() >= cplen);
@@ -1088,8 +1242,21 @@ public:
         return NumKeys();
       }
     }
-    key = key.substr(common_.size());
-    return prefix_.DictRank(key, suffix_.TotalKeySize() != 0 ? &suffix_ : nullptr, ctx);
+    return rank(key.substr(common_.size()));
+  }
+
+  size_t DictRank(fstring key, TerarkContext* ctx) const final {
+    TERARK_METRICS_TIMER(kIndexDictRank);
+    return RankWithCommon(key, [&](fstring key) {
+      return CycleProfileSearch(suffix_.TotalKeySize() != 0 ? &suffix_ : nullptr,
+          [&](const SuffixBase* suffix) { return prefix_.DictRank(key, suffix, ctx); });
+    });
+  }
+
+  size_t ApproximateDictRank(fstring key, TerarkContext* ctx) const final {
+    return RankWithCommon(key, [&](fstring key) {
+      return prefix_.ApproxDictRank(key, ctx);
+    });
   }
 
   void MinKey(valvec<byte_t>* key, TerarkContext* ctx) const final {
@@ -1121,6 +1288,10 @@ public:
     return index_size == 0 ? fstring() : fstring((byte_t*)footer_ - index_size, index_size + f->footer_size);
   }
 
+  size_t HeapMemSize() const final {
+    return prefix_.HeapMemSize();
+  }
+
   valvec<fstring> GetMetaData() const final {
     assert(footer_ != nullptr);
     auto f = footer_;
@@ -1153,6 +1324,7 @@ public:
         "    prefix: raw-key =%9.4f GB  zip-key =%9.4f GB  avg-key =%7.2f  avg-zkey =%7.2f\n"
         "    suffix: raw-key =%9.4f GB  zip-key =%9.4f GB  avg-key =%7.2f  avg-zkey =%7.2f\n"
         "    index : raw-key =%9.4f GB  zip-key =%9.4f GB  avg-key =%7.2f  avg-zkey =%7.2f\n"
+        "    heap  : %9.4f MB\n"
         , prefix_.KeyCount() * common_.size() + prefix_.TotalKeySize() + suffix_.TotalKeySize()
         , common_.size(), prefix_.KeyCount()
         , prefix_.TotalKeySize() / r, (f ? f->prefix_size : 0) / r
@@ -1160,6 +1332,7 @@ public:
         , suffix_.TotalKeySize() / r, (f ? f->suffix_size : 0) / r
         , suffix_.TotalKeySize() / c, (f ? f->suffix_size : 0) / c
         , t / r, index_size / r , t / c, index_size / c
+        , HeapMemSize() / 1e6
     );
     return buffer;
   }
@@ -1376,6 +1549,10 @@ struct IndexAscendingUintPrefix : public UintPrefixBase<RankSelect> {
       return id + (key.substr(key_length) > suffix_key);
     }
   }
+  // suffix is not compared, error is at most 1
+  size_t ApproxDictRank(fstring key, TerarkContext* ctx) const {
+    return DictRank(key, nullptr, ctx);
+  }
   size_t AppendMinKey(valvec<byte_t>* buffer, TerarkContext* ctx) const {
     size_t pos = buffer->size();
     buffer->resize_no_init(pos + key_length);
@@ -1647,6 +1824,21 @@ struct IndexNonDescendingUintPrefix : public UintPrefixBase<RankSelect> {
       return suffix->LowerBound(key.substr(key_length), id, count, ctx).id;
     }
   }
+  // suffix is not compared, a key in the middle of a same prefix group is
+  // taken as the middle of the group
+  size_t ApproxDictRank(fstring key, TerarkContext* ctx) const {
+    size_t id, count, pos, hint = 0;
+    bool seek_result, is_find;
+    std::tie(seek_result, is_find) =
+        SeekImpl(key.size() > key_length ? key.substr(0, key_length) : key, id, count, pos, &hint);
+    if (!seek_result) {
+      return rank_select.max_rank1();
+    } else if (key.size() <= key_length || !is_find) {
+      return id;
+    } else {
+      return id + (count + 1) / 2;
+    }
+  }
   size_t AppendMinKey(valvec<byte_t>* buffer, TerarkContext* ctx) const {
     size_t pos = buffer->size();
     buffer->resize_no_init(pos + key_length);
@@ -1936,6 +2128,9 @@ struct IndexNestLoudsTriePrefix : public VirtualPrefixBase {
   IndexNestLoudsTriePrefix& operator = (IndexNestLoudsTriePrefix&&) = default;
 
   unique_ptr<NestLoudsTrieDAWG> trie_;
+  // keys at evenly spaced dict ranks for ApproxDictRank, built by BuildCache
+  static const size_t max_sample_num = 4096;
+  fstrvec sample_;
 
   size_t IteratorStorageSize() const {
     return sizeof(IteratorStorage);
@@ -1968,7 +2163,7 @@ struct IndexNestLoudsTriePrefix : public VirtualPrefixBase {
     if (suffix == nullptr && flags.is_bfs_suffix) {
       return trie_->index(key);
     }
-    auto buffer = ctx->alloc(trie_->iterator_max_mem_size());
+    auto buffer = ctx->alloc_raw(trie_->iterator_max_mem_size());
     typename NestLoudsTrieDAWG::UserMemIterator iter(trie_.get(), buffer.data());
     if (iter.seek_lower_bound(key)) {
       if (iter.word() != key) {
@@ -1989,6 +2184,9 @@ struct IndexNestLoudsTriePrefix : public VirtualPrefixBase {
     } else {
       suffix_id = trie_->state_to_dict_rank(iter.word_state());
     }
+    if (suffix == nullptr) {
+      return key.empty() ? suffix_id : size_t(-1);
+    }
     ContextBuffer suffix_key = ctx->alloc();
     suffix->AppendKey(suffix_id, &suffix_key.get(), ctx);
     return key == suffix_key ? suffix_id : size_t(-1);
@@ -1999,7 +2197,7 @@ struct IndexNestLoudsTriePrefix : public VirtualPrefixBase {
       trie_->lower_bound(key, nullptr, &rank);
       return rank;
     }
-    auto buffer = ctx->alloc(trie_->iterator_max_mem_size());
+    auto buffer = ctx->alloc_raw(trie_->iterator_max_mem_size());
     typename NestLoudsTrieDAWG::UserMemIterator iter(trie_.get(), buffer.data());
     if (iter.seek_lower_bound(key)) {
       if (iter.word() != key) {
@@ -2025,6 +2223,56 @@ struct IndexNestLoudsTriePrefix : public VirtualPrefixBase {
     suffix->AppendKey(suffix_id, &suffix_key.get(), ctx);
     return rank + (key > suffix_key);
   }
+  // binary search in the sample, trie is not touched, a key between two
+  // samples is taken as the middle of them, so error is at most half of the
+  // sample step, that is about num / 8192 keys (max_sample_num samples), 0
+  // if key is a sample. without BuildCache, the prefix trie is searched and
+  // suffix is not compared, error is at most 1
+  size_t ApproxDictRank(fstring key, TerarkContext* ctx) const {
+    const fstrvec& keys = sample_;
+    size_t num = trie_->num_words(), snum = keys.size();
+    if (snum == 0) {
+      return DictRank(key, nullptr, ctx);
+    }
+    size_t lo = 0, hi = snum; // number of samples <= key
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (keys[mid] <= key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo == 0) {
+      return 0; // key < min key
+    }
+    if (lo == snum) {
+      return keys[lo - 1] == key ? num - 1 : num; // last sample is max key
+    }
+    size_t rank0 = SampleRank(lo - 1, num, snum);
+    if (keys[lo - 1] == key) {
+      return rank0;
+    }
+    size_t rank1 = SampleRank(lo, num, snum);
+    return (rank0 + 1 + rank1) / 2;
+  }
+  // samples are min key, max key and keys evenly spaced between them
+  static size_t SampleRank(size_t i, size_t num, size_t snum) {
+    return snum > 1 ? i * (num - 1) / (snum - 1) : 0;
+  }
+  // walks go through the fsa cache if it is built
+  void BuildRankSample() {
+    size_t num = trie_->num_words();
+    size_t snum = num < max_sample_num ? num : max_sample_num;
+    fstrvec& keys = sample_;
+    keys.erase_all();
+    valvec<byte_t> word;
+    for (size_t i = 0; i < snum; ++i) {
+      size_t state = trie_->dict_rank_to_state(SampleRank(i, num, snum));
+      trie_->nth_word(trie_->state_to_word_id(state), &word);
+      keys.push_back(fstring(word.data(), word.size()));
+    }
+    keys.shrink_to_fit();
+  }
   size_t AppendMinKey(valvec<byte_t>* buffer, TerarkContext* ctx) const {
     size_t id = trie_->index_begin();
     auto key_buffer = ctx->alloc();
@@ -2056,6 +2304,10 @@ struct IndexNestLoudsTriePrefix : public VirtualPrefixBase {
     if (cacheRatio > 1e-8) {
       trie_->build_fsa_cache(cacheRatio, NULL);
     }
+    BuildRankSample();
+  }
+  size_t HeapMemSize() const override {
+    return sample_.size() != 0 ? sample_.full_mem_size() : 0;
   }
 
   bool IterSeekToFirst(size_t& id, size_t& count, void* iter_ptr) const {
@@ -2194,7 +2446,7 @@ struct IndexCBTPrefix : public VirtualPrefixBase {
       return cbt_packed.num_words();
     }
     auto& cbt = cbt_packed[cbt_index];
-    ContextBuffer mem = ctx->alloc(sizeof(uint64_t) * cbt.layer_);
+    ContextBuffer mem = ctx->alloc_raw(sizeof(uint64_t) * cbt.layer_);
     CritBitTrie::Path vec;
     vec.risk_set_data(reinterpret_cast<CritBitTrie::PathElement*>(mem.data()),
                       cbt.layer_);
@@ -2211,6 +2463,17 @@ struct IndexCBTPrefix : public VirtualPrefixBase {
     return best_match_rank;
   }
 
+  // best match of the crit bit trie without reading the key from suffix,
+  // error is bounded by the size of one trie (cbtEntryPerTrie)
+  size_t ApproxDictRank(fstring key, TerarkContext* ctx) const {
+    size_t cbt_index = FindTrie(key);
+    if (cbt_index == cbt_packed.trie_nums()) {
+      return cbt_packed.num_words();
+    }
+    return cbt_packed[cbt_index].index(key, nullptr) +
+           cbt_packed.base_rank_id(cbt_index);
+  }
+
   size_t AppendMinKey(valvec<byte_t>* buffer, TerarkContext* ctx) const {
     return 0;
   }
@@ -3451,75 +3714,103 @@ PrefixBuildInfo TerarkIndex::GetPrefixBuildInfo(const TerarkIndexOptions& opt, c
 };
 
 
-class TerarkIndexDebugBuilder {
+// compute KeyStat from sorted keys, keys are not kept
+class TerarkKeyStatBuilder {
   freq_hist_o1 freq;
   TerarkIndex::KeyStat stat;
-  fstrvec data;
+  valvec<byte_t> last;
   size_t keyCount = 0;
   size_t prevSamePrefix = 0;
+  void ProcessKey(fstring key, size_t samePrefix);
 public:
 
-  void Init(size_t count);
+  void Init();
   void Add(fstring key);
-  TerarkKeyReader* Finish(TerarkIndex::KeyStat* output);
+  void Finish(TerarkIndex::KeyStat* output);
 };
 
-void TerarkIndexDebugBuilder::Init(size_t count) {
+void TerarkKeyStatBuilder::Init() {
   freq.clear();
   stat.~KeyStat();
   ::new(&stat) TerarkIndex::KeyStat;
-  data.erase_all();
-  stat.keyCount = count;
+  last.erase_all();
   keyCount = 0;
   prevSamePrefix = 0;
 }
 
-void TerarkIndexDebugBuilder::Add(fstring key) {
+void TerarkKeyStatBuilder::ProcessKey(fstring key, size_t samePrefix) {
+  size_t prefixSize = std::min(key.size(), std::max(samePrefix, prevSamePrefix) + 1);
+  size_t suffixSize = key.size() - prefixSize;
+  stat.minKeyLen = std::min(key.size(), stat.minKeyLen);
+  stat.maxKeyLen = std::max(key.size(), stat.maxKeyLen);
+  stat.sumKeyLen += key.size();
+  stat.sumPrefixLen += prefixSize;
+  stat.minPrefixLen = std::min(stat.minPrefixLen, prefixSize);
+  stat.maxPrefixLen = std::max(stat.maxPrefixLen, prefixSize);
+  stat.minSuffixLen = std::min(stat.minSuffixLen, suffixSize);
+  stat.maxSuffixLen = std::max(stat.maxSuffixLen, suffixSize);
+  auto& diff = stat.diff;
+  if (diff.size() < samePrefix) {
+    diff.resize(samePrefix);
+  }
+  for (size_t i = 0; i < samePrefix; ++i) {
+    ++diff[i].cur;
+    ++diff[i].cnt;
+  }
+  for (size_t i = samePrefix; i < diff.size(); ++i) {
+    diff[i].max = std::max(diff[i].cur, diff[i].max);
+    diff[i].cur = 0;
+  }
+  prevSamePrefix = samePrefix;
+}
+
+void TerarkKeyStatBuilder::Add(fstring key) {
   freq.add_record(key);
-  auto processKey = [&](fstring key, size_t samePrefix) {
-    size_t prefixSize = std::min(key.size(), std::max(samePrefix, prevSamePrefix) + 1);
-    size_t suffixSize = key.size() - prefixSize;
-    stat.minKeyLen = std::min(key.size(), stat.minKeyLen);
-    stat.maxKeyLen = std::max(key.size(), stat.maxKeyLen);
-    stat.sumKeyLen += key.size();
-    stat.sumPrefixLen += prefixSize;
-    stat.minPrefixLen = std::min(stat.minPrefixLen, prefixSize);
-    stat.maxPrefixLen = std::max(stat.maxPrefixLen, prefixSize);
-    stat.minSuffixLen = std::min(stat.minSuffixLen, suffixSize);
-    stat.maxSuffixLen = std::max(stat.maxSuffixLen, suffixSize);
-    auto& diff = stat.diff;
-    if (diff.size() < samePrefix) {
-      diff.resize(samePrefix);
-    }
-    for (size_t i = 0; i < samePrefix; ++i) {
-      ++diff[i].cur;
-      ++diff[i].cnt;
-    }
-    for (size_t i = samePrefix; i < diff.size(); ++i) {
-      diff[i].max = std::max(diff[i].cur, diff[i].max);
-      diff[i].cur = 0;
-    }
-    prevSamePrefix = samePrefix;
-  };
   if (keyCount++ == 0) {
-    data.push_back(key);
     stat.minKey.assign(key);
   } else {
-    auto last = data.back();
-    processKey(last, key.commonPrefixLen(last));
-    data.push_back(key);
-    if (keyCount == stat.keyCount) {
-      processKey(key, 0);
-      stat.maxKey.assign(key);
-    }
+    ProcessKey(last, key.commonPrefixLen(last));
   }
+  last.assign(key);
 }
 
-TerarkKeyReader*
-TerarkIndexDebugBuilder::Finish(TerarkIndex::KeyStat* output) {
+void TerarkKeyStatBuilder::Finish(TerarkIndex::KeyStat* output) {
+  if (keyCount) {
+    ProcessKey(last, 0);
+    stat.maxKey.assign(last);
+  }
+  stat.keyCount = keyCount;
   freq.finish();
   stat.entropyLen = freq_hist_o1::estimate_size(freq.histogram());
   *output = std::move(stat);
+}
+
+class TerarkIndexDebugBuilder {
+  TerarkKeyStatBuilder stat;
+  fstrvec data;
+public:
+
+  void Init(size_t count);
+  void Add(fstring key);
+  TerarkKeyReader* Finish(TerarkIndex::KeyStat* output);
+};
+
+void TerarkIndexDebugBuilder::Init(size_t count) {
+  stat.Init();
+  data.erase_all();
+  data.reserve(count);
+}
+
+void TerarkIndexDebugBuilder::Add(fstring key) {
+  // keys must be sorted and unique
+  assert(data.size() == 0 || data[data.size() - 1] < key);
+  stat.Add(key);
+  data.push_back(key);
+}
+
+TerarkKeyReader*
+TerarkIndexDebugBuilder::Finish(TerarkIndex::KeyStat* output) {
+  stat.Finish(output);
   class TerarkKeyDebugReader : public TerarkKeyReader {
   public:
     fstrvec data;
@@ -3742,6 +4033,360 @@ TerarkIndex::Factory::Build(DoSortedStrVec& strVec,
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+
+struct MergeWayKey {
+  fstring key;
+  bool eof;
+};
+
+struct MergeWayKeyLess {
+  bool operator()(const MergeWayKey& x, const MergeWayKey& y) const {
+    if (y.eof) return !x.eof;
+    if (x.eof) return false;
+    return x.key < y.key;
+  }
+};
+
+// way iterator of LoserTree, the iterator is eof when index iterator is invalid
+class MergeWayIter {
+  TerarkIndex::Iterator* m_iter;
+  MergeWayKey m_key;
+  void load() {
+    m_key.eof = !m_iter->Valid();
+    m_key.key = m_key.eof ? fstring() : m_iter->key();
+  }
+public:
+  typedef std::forward_iterator_tag iterator_category;
+  typedef MergeWayKey value_type;
+  typedef ptrdiff_t difference_type;
+  typedef const MergeWayKey* pointer;
+  typedef const MergeWayKey& reference;
+
+  MergeWayIter() : m_iter(nullptr) { m_key.eof = true; }
+  explicit MergeWayIter(TerarkIndex::Iterator* iter) : m_iter(iter) {
+    m_iter->SeekToFirst();
+    load();
+  }
+  const MergeWayKey& operator*() const { return m_key; }
+  MergeWayIter& operator++() { m_iter->Next(); load(); return *this; }
+  size_t id() const { return m_iter->id(); }
+};
+
+typedef multi_way::LoserTree<MergeWayIter, MergeWayKey, true, MergeWayKeyLess>
+        MergeLoserTree;
+
+class MergeIteratorSet : boost::noncopyable {
+  valvec<std::unique_ptr<TerarkIndex::Iterator> > m_iters;
+public:
+  MergeLoserTree tree;
+  explicit MergeIteratorSet(const valvec<TerarkZipMerger::Part>& parts)
+      : tree(MergeWayKey{fstring(), true}) {
+    for (auto& part : parts) {
+      m_iters.emplace_back(part.index->NewIterator());
+      tree.m_ways.push_back(MergeWayIter(m_iters.back().get()));
+    }
+    tree.start();
+  }
+  // call on(way, recId, key) for each unique key, return num of dup keys
+  template<class OnKey>
+  size_t for_each_unique(OnKey on) {
+    size_t dup = 0;
+    valvec<byte_t> last;
+    while (!tree.empty()) {
+      size_t way = tree.current_way();
+      fstring key = tree.current_value().key;
+      on(way, tree.m_ways[way].id(), key);
+      // StableSort: same key in latter ways follows, skip them
+      last.assign(key.udata(), key.size());
+      tree.increment();
+      while (!tree.empty() && tree.current_value().key == last) {
+        tree.increment();
+        dup++;
+      }
+    }
+    return dup;
+  }
+};
+
+} // namespace
+
+bool TerarkZipMerger::CanMerge(const valvec<Part>& parts) {
+  valvec<const DictZipBlobStore*> stores(parts.size(), valvec_reserve());
+  for (auto& part : parts) {
+    stores.push_back(part.store);
+  }
+  return DictZipBlobStore::can_merge_zip_data(stores);
+}
+
+TerarkZipMerger::Stat
+TerarkZipMerger::Merge(const valvec<Part>& parts, const TerarkIndexOptions& tiopt,
+                       std::function<void(const void*, size_t)> writeIndex,
+                       std::function<void(const void*, size_t)> writeStore) {
+  valvec<const DictZipBlobStore*> stores(parts.size(), valvec_reserve());
+  size_t maxRecords = 0;
+  size_t numRecords = 0;
+  for (auto& part : parts) {
+    TERARK_VERIFY_EQ(part.index->NumKeys(), part.store->num_records());
+    stores.push_back(part.store);
+    maxRecords = std::max(maxRecords, part.store->num_records());
+    numRecords += part.store->num_records();
+  }
+  if (!DictZipBlobStore::can_merge_zip_data(stores)) {
+    THROW_STD(invalid_argument, "stores of parts are not mergeable");
+  }
+  Stat stat;
+  UintVecMin0 srcIdx(numRecords, parts.size());
+  UintVecMin0 srcRecId(numRecords, maxRecords);
+  std::unique_ptr<TerarkKeyReader> reader;
+  TerarkIndex::KeyStat ks;
+  {
+    // keys are spilled to tiopt.localTempDir beyond tiopt.smallTaskMemory
+    TerarkKeyExternalSorter sorter(tiopt);
+    MergeIteratorSet iters(parts);
+    stat.dupCount = iters.for_each_unique([&](size_t way, size_t id, fstring key) {
+      srcIdx.set_wire(stat.keyCount, way);
+      srcRecId.set_wire(stat.keyCount, id);
+      stat.keyCount++;
+      sorter.Add(key);
+    });
+    if (0 == stat.keyCount) {
+      THROW_STD(invalid_argument, "parts are all empty");
+    }
+    reader.reset(sorter.Finish(&ks));
+    TERARK_VERIFY_EQ(ks.keyCount, stat.keyCount);
+  }
+  srcIdx.resize(stat.keyCount);
+  srcRecId.resize(stat.keyCount);
+  std::unique_ptr<TerarkIndex> index(TerarkIndex::Factory::Build(reader.get(), tiopt, ks, nullptr));
+  reader.reset();
+  stat.reordered = index->NeedsReorder();
+  if (!stat.reordered) {
+    index->SaveMmap(writeIndex);
+    DictZipBlobStore::merge_zip_data(stores, srcIdx, srcRecId, writeStore);
+    return stat;
+  }
+  // ids of new index are not in key order, records are written in the
+  // order of new ids directly, so the merged store needs no reorder
+  UintVecMin0 newToOld(stat.keyCount, stat.keyCount - 1);
+  index->GetOrderMap(newToOld);
+  TempFileDeleteOnClose reorderFile;
+  reorderFile.path = tiopt.localTempDir + "/TerarkZipMerger-XXXXXX";
+  reorderFile.open_temp();
+  {
+    ZReorderMap::Builder builder(stat.keyCount, 1, reorderFile.path, "wb");
+    for (size_t i = 0; i < stat.keyCount; ++i) {
+      builder.push_back(newToOld[i]);
+    }
+    builder.finish();
+  }
+  {
+    ZReorderMap reorder(reorderFile.path);
+    AutoDeleteFile tmpFile{reorderFile.path + ".tmp"};
+    index->Reorder(reorder, writeIndex, tmpFile);
+  }
+  index.reset();
+  UintVecMin0 newIdx(stat.keyCount, parts.size());
+  UintVecMin0 newRecId(stat.keyCount, maxRecords);
+  for (size_t i = 0; i < stat.keyCount; ++i) {
+    size_t oldId = newToOld[i];
+    newIdx.set_wire(i, srcIdx[oldId]);
+    newRecId.set_wire(i, srcRecId[oldId]);
+  }
+  DictZipBlobStore::merge_zip_data(stores, newIdx, newRecId, writeStore);
+  return stat;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// a sorted run of TerarkKeyExternalSorter, keys are prefix compressed
+class SortedRunReader : boost::noncopyable {
+  TempFileDeleteOnClose* m_file;
+  NativeDataInput<InputBuffer> m_reader;
+  valvec<byte_t> m_key;
+  size_t m_keyCount;
+  size_t m_remain;
+public:
+  SortedRunReader(TempFileDeleteOnClose* file, size_t keyCount)
+      : m_file(file), m_keyCount(keyCount), m_remain(0) {}
+  void rewind() {
+    m_file->fp.rewind();
+    m_reader.resetbuf(); // drop data buffered by previous pass
+    m_reader.attach(&m_file->fp);
+    m_key.erase_all();
+    m_remain = m_keyCount;
+  }
+  bool next() {
+    if (0 == m_remain) {
+      return false;
+    }
+    var_uint64_t shared;
+    m_reader >> shared;
+    TERARK_VERIFY_LE(shared.t, m_key.size());
+    m_key.risk_set_size(shared.t);
+    m_reader.load_add(m_key);
+    m_remain--;
+    return true;
+  }
+  fstring key() const { return m_key; }
+};
+
+class SortedRunWayIter {
+  SortedRunReader* m_run;
+  MergeWayKey m_key;
+  void load(bool ok) {
+    m_key.eof = !ok;
+    m_key.key = ok ? m_run->key() : fstring();
+  }
+public:
+  typedef std::forward_iterator_tag iterator_category;
+  typedef MergeWayKey value_type;
+  typedef ptrdiff_t difference_type;
+  typedef const MergeWayKey* pointer;
+  typedef const MergeWayKey& reference;
+
+  SortedRunWayIter() : m_run(nullptr) { m_key.eof = true; }
+  explicit SortedRunWayIter(SortedRunReader* run) : m_run(run) {
+    load(m_run->next());
+  }
+  const MergeWayKey& operator*() const { return m_key; }
+  SortedRunWayIter& operator++() { load(m_run->next()); return *this; }
+};
+
+typedef multi_way::LoserTree<SortedRunWayIter, MergeWayKey, true, MergeWayKeyLess>
+        SortedRunLoserTree;
+
+// all keys fit in memory, no run was spilled
+class TerarkKeyMemSortedReader : public TerarkKeyReader {
+  SortableStrVec m_keys;
+  size_t m_pos = 0;
+public:
+  explicit TerarkKeyMemSortedReader(SortableStrVec& keys) {
+    m_keys.swap(keys);
+    m_keys.sort();
+  }
+  bool eof() const { return m_pos == m_keys.size(); }
+  fstring next() override final {
+    assert(m_pos < m_keys.size());
+    fstring key = m_keys[m_pos];
+    do ++m_pos;
+    while (m_pos < m_keys.size() && m_keys[m_pos] == key);
+    return key;
+  }
+  void rewind() override final {
+    m_pos = 0;
+  }
+};
+
+template<class Reader>
+TerarkKeyReader* ComputeKeyStat(Reader* r, TerarkIndex::KeyStat* stat) {
+  std::unique_ptr<Reader> reader(r);
+  TerarkKeyStatBuilder builder;
+  builder.Init();
+  reader->rewind();
+  while (!reader->eof()) {
+    builder.Add(reader->next());
+  }
+  builder.Finish(stat);
+  reader->rewind();
+  return reader.release();
+}
+
+} // namespace
+
+class TerarkKeyRunMergeReader : public TerarkKeyReader {
+  std::vector<TerarkKeyExternalSorter::Run> m_runs;
+  valvec<std::unique_ptr<SortedRunReader> > m_readers;
+  SortedRunLoserTree m_tree;
+  valvec<byte_t> m_last;
+public:
+  explicit TerarkKeyRunMergeReader(std::vector<TerarkKeyExternalSorter::Run>&& runs)
+      : m_runs(std::move(runs)), m_tree(MergeWayKey{fstring(), true}) {
+    for (auto& run : m_runs) {
+      m_readers.emplace_back(new SortedRunReader(run.file.get(), run.keyCount));
+    }
+  }
+  bool eof() const { return m_tree.empty(); }
+  fstring next() override final {
+    assert(!m_tree.empty());
+    m_last.assign(m_tree.current_value().key);
+    do m_tree.increment();
+    while (!m_tree.empty() && m_tree.current_value().key == m_last);
+    return m_last;
+  }
+  void rewind() override final {
+    m_tree.m_ways.clear();
+    for (auto& reader : m_readers) {
+      reader->rewind();
+      m_tree.m_ways.push_back(SortedRunWayIter(reader.get()));
+    }
+    m_tree.start();
+  }
+};
+
+TerarkKeyExternalSorter::TerarkKeyExternalSorter(const TerarkIndexOptions& tiopt)
+    : m_tempDir(tiopt.localTempDir), m_memLimit(tiopt.smallTaskMemory) {
+}
+
+TerarkKeyExternalSorter::~TerarkKeyExternalSorter() {
+}
+
+void TerarkKeyExternalSorter::Add(fstring key) {
+  m_addCount++;
+  m_keys.push_back(key);
+  if (m_keys.mem_size() >= m_memLimit) {
+    SpillRun();
+  }
+}
+
+void TerarkKeyExternalSorter::SpillRun() {
+  m_keys.sort();
+  Run run;
+  run.file.reset(new TempFileDeleteOnClose);
+  run.file->path = m_tempDir + "/TerarkKeyExternalSorter-XXXXXX";
+  run.file->open_temp();
+  auto& writer = run.file->writer;
+  fstring last;
+  size_t keyCount = 0;
+  for (size_t i = 0; i < m_keys.size(); ++i) {
+    fstring key = m_keys[i];
+    if (keyCount && key == last) {
+      continue;
+    }
+    size_t shared = key.commonPrefixLen(last);
+    writer << var_uint64_t(shared) << var_uint64_t(key.size() - shared);
+    writer.ensureWrite(key.data() + shared, key.size() - shared);
+    last = key;
+    keyCount++;
+  }
+  run.file->complete_write();
+  run.keyCount = keyCount;
+  m_runs.push_back(std::move(run));
+  // keep capacity for next run
+  m_keys.m_index.erase_all();
+  m_keys.m_strpool.erase_all();
+}
+
+TerarkKeyReader* TerarkKeyExternalSorter::Finish(TerarkIndex::KeyStat* stat) {
+  TerarkKeyReader* reader;
+  if (m_runs.empty()) {
+    reader = ComputeKeyStat(new TerarkKeyMemSortedReader(m_keys), stat);
+  } else {
+    if (m_keys.size()) {
+      SpillRun();
+    }
+    m_keys.clear();
+    reader = ComputeKeyStat(new TerarkKeyRunMergeReader(std::move(m_runs)), stat);
+  }
+  assert(m_addCount >= stat->keyCount);
+  m_dupCount = m_addCount - stat->keyCount;
+  return reader;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 unique_ptr<TerarkIndex> TerarkIndex::LoadMemory(fstring mem) {
   valvec<unique_ptr<TerarkIndex>> index_vec;
   size_t offset = 0;
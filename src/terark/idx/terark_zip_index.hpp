@@ -3,13 +3,17 @@
 #include <boost/intrusive_ptr.hpp>
 #include <boost/noncopyable.hpp>
 #include <memory>
+#include <vector>
 #include <terark/util/refcount.hpp>
 #include <terark/util/sortable_strvec.hpp>
 
 namespace terark {
 
 class TerarkContext;
+class BlobStore;
 class ZReorderMap;
+class DictZipBlobStore;
+class TempFileDeleteOnClose;
 struct FilePair;
 
 struct TERARK_DLL_EXPORT TerarkIndexOptions {
@@ -42,12 +46,35 @@ class TERARK_DLL_EXPORT TerarkKeyReader {
 
 class TERARK_DLL_EXPORT TerarkIndex : boost::noncopyable {
  public:
+  /// keys of a batch are in one arena: key i is keys[offsets[i], offsets[i+1])
+  struct TERARK_DLL_EXPORT KeyBatch {
+    valvec<byte_t> keys;
+    valvec<size_t> offsets; // size() + 1 elements, offsets[0] == 0
+    valvec<size_t> ids;
+    KeyBatch() { offsets.push_back(0); }
+    size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+    fstring key(size_t i) const {
+      assert(i < ids.size());
+      return fstring(keys.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    size_t id(size_t i) const { return ids[i]; }
+    void clear() {
+      keys.risk_set_size(0);
+      offsets.risk_set_size(1);
+      ids.risk_set_size(0);
+    }
+  };
   class Iterator : boost::noncopyable {
    protected:
     size_t m_id = size_t(-1);
 
    public:
     virtual ~Iterator();
+    /// append at most n keys to out, starting from current key, then the
+    /// iterator is positioned after the last appended key (maybe invalid)
+    /// @returns number of appended keys, 0 if iterator is invalid
+    virtual size_t NextBatch(size_t n, KeyBatch* out);
     virtual bool SeekToFirst() = 0;
     virtual bool SeekToLast() = 0;
     virtual bool Seek(fstring target) = 0;
@@ -146,11 +173,26 @@ class TERARK_DLL_EXPORT TerarkIndex : boost::noncopyable {
                        fstring tmpFile) const = 0;
   virtual size_t Find(fstring key, TerarkContext* ctx) const = 0;
   virtual size_t DictRank(fstring key, TerarkContext* ctx) const = 0;
+  /// DictRank without reading suffix keys, which are mostly in cold pages,
+  /// default is DictRank. error depends on the prefix: a few keys, about
+  /// NumKeys() / 8192 for nest louds trie after BuildCache, or keys of one
+  /// crit bit trie
+  virtual size_t ApproximateDictRank(fstring key, TerarkContext* ctx) const;
+  /// number of keys in [lo, hi), default is DictRank(hi) - DictRank(lo)
+  virtual size_t RangeCount(fstring lo, fstring hi, TerarkContext* ctx) const;
+  virtual size_t ApproximateRangeCount(fstring lo, fstring hi,
+                                       TerarkContext* ctx) const;
+  /// approximate offset of key in zip data of store, store ids are the
+  /// index ids, zip offset of record is used if ids are in key order
+  uint64_t ApproximateOffsetOf(fstring key, const BlobStore* store,
+                               TerarkContext* ctx) const;
   virtual void MinKey(valvec<byte_t>* key, TerarkContext* ctx) const = 0;
   virtual void MaxKey(valvec<byte_t>* key, TerarkContext* ctx) const = 0;
   virtual size_t NumKeys() const = 0;
   virtual size_t TotalKeySize() const = 0;
   virtual fstring Memory() const = 0;
+  /// heap memory besides Memory(), such as caches built by BuildCache
+  virtual size_t HeapMemSize() const = 0;
   virtual valvec<fstring> GetMetaData() const = 0;
   virtual void DetachMetaData(const valvec<fstring>&) = 0;
   virtual const char* Info(char* buffer, size_t size) const = 0;
@@ -164,4 +206,58 @@ class TERARK_DLL_EXPORT TerarkIndex : boost::noncopyable {
       std::function<void(fstring, fstring, fstring)>) const = 0;
 };
 
+/// Sort keys with bounded memory: keys are buffered in a SortableStrVec which
+/// is spilled as a sorted run to tiopt.localTempDir when its memory exceeds
+/// tiopt.smallTaskMemory, the runs are merged by LoserTree on reading
+class TERARK_DLL_EXPORT TerarkKeyExternalSorter : boost::noncopyable {
+ public:
+  explicit TerarkKeyExternalSorter(const TerarkIndexOptions& tiopt);
+  ~TerarkKeyExternalSorter();
+  void Add(fstring key);
+  /// compute KeyStat by one merge pass, duplicated keys are dropped
+  /// @returns reader which merges the runs again on each rewind(),
+  ///          the reader owns the run files and deletes them on destroy
+  TerarkKeyReader* Finish(TerarkIndex::KeyStat* stat);
+  size_t NumRuns() const { return m_runs.size(); }
+  /// num of keys dropped as duplicated, valid after Finish
+  size_t NumDupKeys() const { return m_dupCount; }
+
+ private:
+  struct Run {
+    std::unique_ptr<TempFileDeleteOnClose> file;
+    size_t keyCount; // keys are unique in a run
+  };
+  friend class TerarkKeyRunMergeReader;
+  void SpillRun();
+  std::string m_tempDir;
+  size_t m_memLimit;
+  SortableStrVec m_keys;
+  std::vector<Run> m_runs;
+  size_t m_addCount = 0;
+  size_t m_dupCount = 0;
+};
+
+/// Merge several sorted (TerarkIndex, DictZipBlobStore) pairs into one pair,
+/// keys are merged by LoserTree in one pass and fed to a
+/// TerarkKeyExternalSorter, zipped records are copied verbatim
+class TERARK_DLL_EXPORT TerarkZipMerger {
+ public:
+  struct Part {
+    const TerarkIndex* index;
+    const DictZipBlobStore* store;
+  };
+  struct Stat {
+    size_t keyCount = 0;
+    size_t dupCount = 0; // dropped keys which are also in a former part
+    bool reordered = false;
+  };
+  /// all stores must share same dict, see DictZipBlobStore::can_merge_zip_data
+  static bool CanMerge(const valvec<Part>& parts);
+  /// keys of each part must be in bytewise ascending order, parts are in
+  /// priority order: for a key in multiple parts, the first part wins
+  static Stat Merge(const valvec<Part>& parts, const TerarkIndexOptions& tiopt,
+                    std::function<void(const void*, size_t)> writeIndex,
+                    std::function<void(const void*, size_t)> writeStore);
+};
+
 }  // namespace terark
@@ -5,6 +5,18 @@
 #include "io/DataOutput.hpp"
 #include "fstring.hpp"
 
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE__) || defined(_MSC_VER)
+    #include <xmmintrin.h>
+#endif
+
+#if defined(__SSE__) || defined(_MSC_VER)
+	#define UintVec_prefetch(ptr) _mm_prefetch((const char*)(ptr), _MM_HINT_T0)
+#else
+	#define UintVec_prefetch(ptr)
+#endif
+
 namespace terark {
 
 void UintVecMin0Base::push_back_slow_path(size_t val) {
@@ -135,6 +147,128 @@ UintVecMin0Base::create_builder_by_max_value(size_t max_val, OutputBuffer* buffe
     return new UintVecMin0Builder(UintVecMin0::compute_uintbits(max_val), buffer);
 }
 
+// values of bits <= 58 in [lo, lo+n), data has mem_size bytes
+static void
+unpack_range(const byte_t* data, size_t mem_size, size_t bits, size_t mask,
+             size_t lo, size_t n, size_t* out) {
+    assert(bits <= 58);
+    size_t i = 0;
+    size_t bitpos = bits * lo;
+#if defined(__AVX2__)
+    // 8 values take exactly `bits` bytes, so the bit phase of k-th value in
+    // a group of 8 is same for all groups. a group is loaded as 2 x 16 bytes
+    // (4 values each), shuffled to 8 dwords, then shifted and masked.
+    // a value must fit in a dword after byte shuffle, so bits <= 25
+    if (bits && bits <= 25 && n >= 8) {
+        size_t phase = bitpos % 8;
+        size_t half1 = (phase + 4 * bits) / 8; // 2nd half byte offset
+        alignas(32) byte_t   ctrl[32];
+        alignas(32) uint32_t shift[8];
+        for (size_t k = 0; k < 8; ++k) {
+            size_t r = phase + k * bits;
+            size_t b = r / 8 - (k < 4 ? 0 : half1);
+            assert(b + 3 < 16);
+            for (size_t j = 0; j < 4; ++j)
+                ctrl[4*k + j] = byte_t(b + j);
+            shift[k] = uint32_t(r % 8);
+        }
+        const __m256i vctrl = _mm256_load_si256((const __m256i*)ctrl);
+        const __m256i vshift = _mm256_load_si256((const __m256i*)shift);
+        const __m256i vmask = _mm256_set1_epi32(int(mask));
+        size_t pos = bitpos / 8;
+        for (; i + 8 <= n && pos + half1 + 16 <= mem_size; i += 8, pos += bits) {
+            __m128i x0 = _mm_loadu_si128((const __m128i*)(data + pos));
+            __m128i x1 = _mm_loadu_si128((const __m128i*)(data + pos + half1));
+            __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(x0), x1, 1);
+            v = _mm256_shuffle_epi8(v, vctrl);
+            v = _mm256_and_si256(_mm256_srlv_epi32(v, vshift), vmask);
+            _mm256_storeu_si256((__m256i*)(out + i + 0),
+                    _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+            _mm256_storeu_si256((__m256i*)(out + i + 4),
+                    _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+        }
+        bitpos = bits * (lo + i);
+    }
+#endif
+    for (; i < n; ++i, bitpos += bits) {
+        size_t val = unaligned_load<size_t>(data + bitpos / 8);
+        out[i] = (val >> bitpos % 8) & mask;
+    }
+}
+
+static const size_t UintVecPrefetchDistance = 32;
+
+void UintVecMin0::get_range(size_t lo, size_t n, size_t* out) const {
+    assert(lo <= m_size);
+    assert(n <= m_size - lo);
+    unpack_range(m_data.data(), m_data.size(), m_bits, m_mask, lo, n, out);
+}
+
+void UintVecMin0::gather(const size_t* idx, size_t n, size_t* out) const {
+    const byte_t* data = m_data.data();
+    const size_t  bits = m_bits;
+    const size_t  mask = m_mask;
+    assert(bits <= 58);
+    for (size_t i = 0; i < n; ++i) {
+        if (i + UintVecPrefetchDistance < n)
+            UintVec_prefetch(data + bits * idx[i + UintVecPrefetchDistance] / 8);
+        assert(idx[i] < m_size);
+        out[i] = fast_get(data, bits, mask, idx[i]);
+    }
+}
+
+void UintVecMin0::gather2(const size_t* idx, size_t n, size_t* out) const {
+    const byte_t* data = m_data.data();
+    const size_t  bits = m_bits;
+    const size_t  mask = m_mask;
+    assert(bits <= 58);
+    for (size_t i = 0; i < n; ++i) {
+        if (i + UintVecPrefetchDistance < n)
+            UintVec_prefetch(data + bits * idx[i + UintVecPrefetchDistance] / 8);
+        assert(idx[i] + 1 < m_size);
+        out[2*i + 0] = fast_get(data, bits, mask, idx[i] + 0);
+        out[2*i + 1] = fast_get(data, bits, mask, idx[i] + 1);
+    }
+}
+
+void BigUintVecMin0::get_range(size_t lo, size_t n, size_t* out) const {
+    assert(lo <= m_size);
+    assert(n <= m_size - lo);
+    const size_t bits = m_bits;
+    if (bits <= 58) {
+        unpack_range(m_data.data(), m_data.size(), bits, m_mask, lo, n, out);
+        return;
+    }
+    const size_t* data = (const size_t*)m_data.data();
+    for (size_t i = 0; i < n; ++i)
+        out[i] = febitvec::s_get_uint(data, bits * (lo + i), bits);
+}
+
+void BigUintVecMin0::gather(const size_t* idx, size_t n, size_t* out) const {
+    const byte_t* data = m_data.data();
+    const size_t  bits = m_bits;
+    assert(bits <= 64);
+    for (size_t i = 0; i < n; ++i) {
+        if (i + UintVecPrefetchDistance < n)
+            UintVec_prefetch(data + bits * idx[i + UintVecPrefetchDistance] / 8);
+        assert(idx[i] < m_size);
+        out[i] = fast_get(data, bits, idx[i]);
+    }
+}
+
+void BigUintVecMin0::gather2(const size_t* idx, size_t n, size_t* out) const {
+    const byte_t* data = m_data.data();
+    const size_t  bits = m_bits;
+    assert(bits <= 64);
+    for (size_t i = 0; i < n; ++i) {
+        if (i + UintVecPrefetchDistance < n)
+            UintVec_prefetch(data + bits * idx[i + UintVecPrefetchDistance] / 8);
+        assert(idx[i] + 1 < m_size);
+        out[2*i + 0] = fast_get(data, bits, idx[i] + 0);
+        out[2*i + 1] = fast_get(data, bits, idx[i] + 1);
+    }
+}
+
 terark_flatten
 std::pair<size_t, size_t>
 UintVecMin0::equal_range(size_t lo, size_t hi, size_t key) const noexcept {
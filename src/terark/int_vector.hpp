@@ -235,6 +235,13 @@ public:
   size_t back() const { assert(m_size > 0); return get(m_size-1); }
   size_t operator[](size_t idx) const { return get(idx); }
 
+  /// out[i] = get(lo + i) for i in [0, n), vectorized bit unpacking
+  void get_range(size_t lo, size_t n, size_t* out) const;
+  /// out[i] = get(idx[i]) for i in [0, n), prefetch ahead for random idx
+  void gather(const size_t* idx, size_t n, size_t* out) const;
+  /// get2(idx[i], out + 2*i) for i in [0, n), such as [begin, end) offsets
+  void gather2(const size_t* idx, size_t n, size_t* out) const;
+
   std::pair<size_t, size_t>
          equal_range(size_t lo, size_t hi, size_t key) const noexcept;
   size_t lower_bound(size_t lo, size_t hi, size_t key) const noexcept;
@@ -276,6 +283,13 @@ public:
   size_t back() const { assert(m_size > 0); return get(m_size-1); }
   size_t operator[](size_t idx) const { return get(idx); }
 
+  /// out[i] = get(lo + i) for i in [0, n), vectorized bit unpacking
+  void get_range(size_t lo, size_t n, size_t* out) const;
+  /// out[i] = get(idx[i]) for i in [0, n), prefetch ahead for random idx
+  void gather(const size_t* idx, size_t n, size_t* out) const;
+  /// get2(idx[i], out + 2*i) for i in [0, n), such as [begin, end) offsets
+  void gather2(const size_t* idx, size_t n, size_t* out) const;
+
   std::pair<size_t, size_t>
          equal_range(size_t lo, size_t hi, size_t key) const noexcept;
   size_t lower_bound(size_t lo, size_t hi, size_t key) const noexcept;
@@ -18,6 +18,7 @@
 #include <boost/predef/other/endian.h>
 #include <algorithm>
 #include "var_int.hpp"
+#include "var_int_simd.hpp"
 
 namespace terark {
 
@@ -848,6 +849,22 @@ template class SeekableBufferBase<OutputBufferBase<InputBuffer> >;
 #define STREAM_WRITER OutputBuffer
 #include "var_int_io.hpp"
 
+void InputBuffer::read_var_uint64_batch(uint64_t* out, size_t n)
+{
+	size_t i = 0;
+	while (i < n) {
+		// a var_uint64 has at most 10 bytes, k values are all in buffer
+		size_t k = std::min(n - i, size_t(m_end - m_pos) / 10);
+		if (k) {
+			m_pos = (byte*)load_var_uint64_batch(m_pos, m_end, k, out + i);
+			i += k;
+		}
+		else {
+			out[i++] = read_var_uint64(); // refill buffer
+		}
+	}
+}
+
 /*
  //! 功能和效率类似于 AutoGrownMemIO
  //!
@@ -200,6 +200,10 @@ public:
 
 	#include "var_int_declare_read.hpp"
 
+	//! read n var_uint64, equal to n calls of read_var_uint64, values
+	//! fully in buffer are decoded by load_var_uint64_batch
+	void read_var_uint64_batch(uint64_t* out, size_t n);
+
 protected:
 	size_t fill_and_read(void* vbuf, size_t length);
 	void   fill_and_ensureRead(void* vbuf, size_t length);
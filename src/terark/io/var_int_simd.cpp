@@ -0,0 +1,115 @@
+#include "var_int_simd.hpp"
+#include <terark/bitmanip.hpp>
+#include <boost/current_function.hpp>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define TERARK_VAR_INT_SIMD_DISPATCH
+    #define TERARK_TARGET_SSE41_BMI2 __attribute__((target("sse4.1,bmi2")))
+#endif
+
+namespace terark {
+
+template<class Uint>
+static inline
+Uint load_var_uint_bounded(const byte_t*& p, const byte_t* end, const char* func) {
+    const int maxshift = sizeof(Uint) == 4 ? 28 : 63;
+    Uint x = 0;
+    for (int shift = 0; shift <= maxshift && p < end; shift += 7) {
+        Uint b = *p++;
+        x |= (b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            return x;
+    }
+    throw std::runtime_error(func);
+}
+
+template<class Uint>
+static const byte_t*
+load_var_uint_batch_scalar(const byte_t* p, const byte_t* end, size_t n,
+                           Uint* out, const char* func) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = load_var_uint_bounded<Uint>(p, end, func);
+    }
+    return p;
+}
+
+#if defined(TERARK_VAR_INT_SIMD_DISPATCH)
+template<class Uint>
+TERARK_TARGET_SSE41_BMI2 static const byte_t*
+load_var_uint_batch_simd(const byte_t* p, const byte_t* end, size_t n,
+                         Uint* out, const char* func) {
+    const size_t maxbytes = sizeof(Uint) == 4 ? 5 : 8; // pext handles 8
+    size_t i = 0;
+    while (n - i >= 16 && end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned m = unsigned(_mm_movemask_epi8(v)); // continue bits
+        // widen all 16 bytes, then keep the leading 1 byte values
+        if (sizeof(Uint) == 4) {
+            for (size_t j = 0; j < 4; ++j) {
+                _mm_storeu_si128((__m128i*)(out + i + 4*j),
+                                 _mm_cvtepu8_epi32(v));
+                v = _mm_srli_si128(v, 4);
+            }
+        } else {
+            for (size_t j = 0; j < 8; ++j) {
+                _mm_storeu_si128((__m128i*)(out + i + 2*j), _mm_cvtepu8_epi64(v));
+                v = _mm_srli_si128(v, 2);
+            }
+        }
+        if (0 == m) {
+            p += 16, i += 16;
+            continue;
+        }
+        size_t k = fast_ctz32(m);
+        p += k, i += k;
+        // out[i] is a multi byte value
+        uint64_t w = end - p >= 8 ? unaligned_load<uint64_t>(p) : 0;
+        uint64_t stop = ~w & 0x8080808080808080ULL;
+        if (end - p < 8 || 0 == stop) { // longer than 8 bytes or near end
+            out[i++] = load_var_uint_bounded<Uint>(p, end, func);
+            continue;
+        }
+        size_t bytes = fast_ctz64(stop) / 8 + 1;
+        if (bytes > maxbytes)
+            throw std::runtime_error(func);
+        out[i++] = Uint(_pext_u64(w, 0x7F7F7F7F7F7F7F7FULL >> (64 - 8*bytes)));
+        p += bytes;
+    }
+    return load_var_uint_batch_scalar(p, end, n - i, out + i, func);
+}
+
+static bool cpu_has_sse41_bmi2() {
+    __builtin_cpu_init(); // may run before cpu model is initialized
+    return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("bmi2");
+}
+static const bool g_has_simd = cpu_has_sse41_bmi2();
+#else
+static const bool g_has_simd = false;
+#endif
+
+bool var_uint_batch_has_simd() { return g_has_simd; }
+
+template<class Uint>
+static inline const byte_t*
+load_var_uint_batch(const byte_t* p, const byte_t* end, size_t n, Uint* out,
+                    const char* func) {
+#if defined(TERARK_VAR_INT_SIMD_DISPATCH)
+    if (g_has_simd)
+        return load_var_uint_batch_simd(p, end, n, out, func);
+#endif
+    return load_var_uint_batch_scalar(p, end, n, out, func);
+}
+
+const byte_t* load_var_uint32_batch(const byte_t* buf, const byte_t* end,
+                                    size_t n, uint32_t* out) {
+    return load_var_uint_batch(buf, end, n, out, BOOST_CURRENT_FUNCTION);
+}
+
+const byte_t* load_var_uint64_batch(const byte_t* buf, const byte_t* end,
+                                    size_t n, uint64_t* out) {
+    return load_var_uint_batch(buf, end, n, out, BOOST_CURRENT_FUNCTION);
+}
+
+} // namespace terark
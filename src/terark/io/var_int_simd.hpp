@@ -0,0 +1,22 @@
+#pragma once
+#include <terark/config.hpp>
+#include <terark/stdtypes.hpp>
+
+namespace terark {
+
+/// decode n consecutive var uint of the layout of gg_load_var_uint, from
+/// buf[0, end - buf), runs of 1 byte values are widened by SSE, others
+/// are extracted by BMI2 pext, with mask from stop bits (Masked VByte).
+/// SIMD path is selected at runtime by cpuid, else scalar.
+/// @returns end of decoded bytes, throw runtime_error on bad/truncated data
+TERARK_DLL_EXPORT
+const byte_t* load_var_uint32_batch(const byte_t* buf, const byte_t* end,
+                                    size_t n, uint32_t* out);
+TERARK_DLL_EXPORT
+const byte_t* load_var_uint64_batch(const byte_t* buf, const byte_t* end,
+                                    size_t n, uint64_t* out);
+
+/// true if load_var_uint{32,64}_batch use the SIMD path on this cpu
+TERARK_DLL_EXPORT bool var_uint_batch_has_simd();
+
+} // namespace terark
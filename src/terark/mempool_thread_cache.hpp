@@ -1,5 +1,6 @@
 #pragma once
 #include "valvec.hpp"
+#include <terark/fstring.hpp> // for getEnvBool
 #include <terark/util/atomic.hpp>
 #include <terark/util/function.hpp>
 #include <terark/thread/instance_tls_owner.hpp>
@@ -52,6 +53,15 @@ public:
         link_size_t head;
         link_size_t cnt;
     };
+    /// blocks freed by a thread other than the owner of the arena are
+    /// batched in a magazine, a full magazine is pushed to the owner's
+    /// lock free m_remote_in, owner drains it when its thread cache misses
+    static const size_t remote_magazine_cap = 62; // sizeof = 1KB
+    struct remote_magazine_t {
+        remote_magazine_t* next;
+        size_t cnt;
+        struct { size_t pos, len; } items[remote_magazine_cap];
+    };
     size_t         fragment_size;
     intptr_t       m_frag_inc;
     huge_link_t    huge_list; // huge_list.size is max height of skiplist
@@ -62,10 +72,25 @@ public:
     TCMemPoolOneThread* m_next_free;
     size_t  m_hot_end; // only be accessed by tls
     size_t  m_hot_pos; // only be accessed by tls, frequently changing
+    size_t  m_tc_id;   // index of m_remote_out of other threads
+    valvec<remote_magazine_t*> m_remote_out; // indexed by owner m_tc_id
+    remote_magazine_t* m_remote_in; // pushed by other threads
+    bool    m_exited; // owner thread exited, pushers reclaim m_remote_in
+    size_t  m_remote_free_cnt;  // frees sent to other threads
+    size_t  m_remote_free_size;
+    size_t  m_remote_drain_cnt; // frees received from other threads
+    size_t  m_remote_drain_size;
 
     explicit TCMemPoolOneThread(ThreadCacheMemPool<AlignSize>* mp) {
         m_mempool = mp;
         m_next_free = nullptr;
+        m_tc_id = as_atomic(mp->m_tc_num).fetch_add(1, std::memory_order_relaxed);
+        m_remote_in = nullptr;
+        m_exited = false;
+        m_remote_free_cnt = 0;
+        m_remote_free_size = 0;
+        m_remote_drain_cnt = 0;
+        m_remote_drain_size = 0;
         m_freelist_head.resize(mp->m_fastbin_max_size / AlignSize);
         fragment_size = 0;
         m_frag_inc = 0;
@@ -77,6 +102,14 @@ public:
         m_hot_end = 0;
     }
     virtual ~TCMemPoolOneThread() {
+        // pool is being destroyed, blocks in magazines need not be freed
+        for (remote_magazine_t* mag : m_remote_out)
+            delete mag;
+        for (auto mag = m_remote_in; mag; ) {
+            auto next = mag->next;
+            delete mag;
+            mag = next;
+        }
     }
 
     TCMemPoolTlsHolder<AlignSize>* tls_owner() const;
@@ -422,6 +455,81 @@ public:
         }
     }
 
+    void remote_free(byte_t* base, TCMemPoolOneThread* owner,
+                     size_t pos, size_t len) {
+        if (terark_unlikely(owner->m_tc_id >= m_remote_out.size()))
+            m_remote_out.resize(owner->m_tc_id + 1, nullptr);
+        remote_magazine_t*& mag = m_remote_out[owner->m_tc_id];
+        if (nullptr == mag) {
+            mag = new remote_magazine_t;
+            mag->cnt = 0;
+        }
+        mag->items[mag->cnt].pos = pos;
+        mag->items[mag->cnt].len = len;
+        m_remote_free_cnt++;
+        m_remote_free_size += len;
+        if (++mag->cnt == remote_magazine_cap) {
+            owner->remote_push(mag);
+            mag = nullptr;
+            remote_reclaim(base, owner);
+        }
+    }
+
+    void remote_push(remote_magazine_t* mag) {
+        auto& head = as_atomic(m_remote_in);
+        auto old = head.load(std::memory_order_relaxed);
+        // seq_cst: pairs with m_exited, see remote_reclaim
+        do mag->next = old;
+        while (!head.compare_exchange_weak(old, mag,
+                    std::memory_order_seq_cst, std::memory_order_relaxed));
+    }
+
+    /// owner may have exited after it drained m_remote_in for the last
+    /// time, take the magazines back, else they are kept until the owner
+    /// tc is reused by another thread, which may never happen
+    void remote_reclaim(byte_t* base, TCMemPoolOneThread* owner) {
+        if (as_atomic(owner->m_exited).load(std::memory_order_seq_cst))
+            owner->remote_drain(base, this);
+    }
+
+    /// push partial magazines to their owners
+    void remote_flush(byte_t* base) {
+        std::lock_guard<std::mutex> lock(m_mempool->m_tc_by_id_mtx);
+        for (size_t id = 0; id < m_remote_out.size(); ++id) {
+            remote_magazine_t* mag = m_remote_out[id];
+            if (mag) {
+                TCMemPoolOneThread* owner = m_mempool->m_tc_by_id[id];
+                owner->remote_push(mag);
+                m_remote_out[id] = nullptr;
+                remote_reclaim(base, owner);
+            }
+        }
+    }
+
+    bool remote_drain(byte_t* base) { return remote_drain(base, this); }
+
+    /// frees blocks pushed to this thread cache into tc, tc is this or the
+    /// caller of remote_reclaim. whole list is taken, so no ABA problem
+    /// @returns whether any block is freed
+    bool remote_drain(byte_t* base, TCMemPoolOneThread* tc) {
+        if (terark_likely(nullptr == as_atomic(m_remote_in).load(std::memory_order_relaxed)))
+            return false;
+        auto mag = as_atomic(m_remote_in).exchange(nullptr, std::memory_order_seq_cst);
+        while (mag) {
+            for (size_t i = 0; i < mag->cnt; ++i) {
+                size_t pos = mag->items[i].pos;
+                size_t len = mag->items[i].len;
+                tc->sfree(base, pos, len);
+                tc->m_remote_drain_size += len;
+            }
+            tc->m_remote_drain_cnt += mag->cnt;
+            auto next = mag->next;
+            delete mag;
+            mag = next;
+        }
+        return true;
+    }
+
     void set_hot_area(byte_t* base, size_t pos, size_t len) {
         if (m_hot_end == pos) {
             // do not need to change m_hot_pos
@@ -456,7 +564,10 @@ class TCMemPoolTlsHolder :
     public instance_tls_owner<TCMemPoolTlsHolder<AlignSize>,
                               TCMemPoolOneThread<AlignSize> > {
 public:
-    void reuse(TCMemPoolOneThread<AlignSize>* t) { t->reuse(); }
+    void reuse(TCMemPoolOneThread<AlignSize>* t) {
+        t->m_mempool->remote_thread_exit(t);
+        t->reuse();
+    }
 };
 
 /// mempool which alloc mem block identified by
@@ -479,6 +590,12 @@ class ThreadCacheMemPool : public valvec<byte_t>, boost::noncopyable {
     static const size_t ArenaSize = 2 * 1024 * 1024;
 
     typedef typename TCMemPoolOneThread<AlignSize>::link_t link_t;
+    typedef TCMemPoolOneThread<AlignSize> tc_t;
+
+    static bool default_remote_free() {
+        static bool val = getEnvBool("TCMemPoolRemoteFree", false);
+        return val;
+    }
 
 protected:
     size_t  fragment_size; // for compatible with MemPool_Lock(Free|None|Mutex)
@@ -486,6 +603,32 @@ protected:
     typedef valvec<unsigned char> mem;
     TCMemPoolTlsHolder<AlignSize> m_tls;
     size_t        m_fastbin_max_size;
+    size_t        m_tc_num;
+    bool          m_remote_free;
+    // owner thread cache of each ArenaSize arena(by absolute address), set
+    // when a chunk is assigned to a thread, frees of other threads are
+    // returned to the owner
+    valvec<tc_t*> m_arena_owner;
+    valvec<tc_t*> m_tc_by_id;
+    std::mutex    m_tc_by_id_mtx;
+
+    size_t arena_idx(size_t pos) const {
+        return (size_t(mem::p) + pos) / ArenaSize - size_t(mem::p) / ArenaSize;
+    }
+    void set_arena_owner(size_t pos, size_t len, tc_t* tc) {
+        if (0 == len)
+            return;
+        size_t beg = arena_idx(pos);
+        size_t end = std::min(arena_idx(pos + len - 1) + 1, m_arena_owner.size());
+        for (size_t i = beg; i < end; ++i)
+            as_atomic(m_arena_owner[i]).store(tc, std::memory_order_relaxed);
+    }
+    tc_t* get_arena_owner(size_t pos) const {
+        size_t i = arena_idx(pos);
+        if (i < m_arena_owner.size())
+            return as_atomic(m_arena_owner.data()[i]).load(std::memory_order_relaxed);
+        return nullptr;
+    }
 
 public:
     using mem::data;
@@ -512,6 +655,52 @@ public:
         fragment_size = 0;
         m_fastbin_max_size = pow2_align_up(fastbin_max_size, AlignSize);
         m_new_tc = &default_new_tc;
+        m_tc_num = 0;
+        m_remote_free = default_remote_free();
+    }
+
+    /// route frees of other threads' arenas back to the owner threads,
+    /// should be set before any alloc
+    void set_remote_free(bool val) { m_remote_free = val; }
+    bool get_remote_free() const { return m_remote_free; }
+
+    struct RemoteFreeStat {
+        size_t free_cnt;   // blocks freed to other threads
+        size_t free_size;
+        size_t drain_cnt;  // blocks returned to owner thread caches
+        size_t drain_size;
+    };
+    void get_remote_free_stat(RemoteFreeStat* st) const {
+        memset(st, 0, sizeof(*st));
+        m_tls.for_each_tls([st](tc_t* tc) {
+            st->free_cnt   += tc->m_remote_free_cnt;
+            st->free_size  += tc->m_remote_free_size;
+            st->drain_cnt  += tc->m_remote_drain_cnt;
+            st->drain_size += tc->m_remote_drain_size;
+        });
+    }
+
+    /// push pending remote frees of calling thread to their owners, they
+    /// are pushed in batch, call this when the thread will not free more
+    void flush_remote_free() {
+        if (m_remote_free)
+            tls()->remote_flush(mem::p);
+    }
+
+    /// called on thread exit, tc is put into free list and may never be
+    /// reused: pending frees of tc are pushed to their owners, arenas of
+    /// tc are disowned, so later frees of them are kept by the freeing
+    /// threads, and frees already pushed to tc are drained into tc
+    void remote_thread_exit(tc_t* tc) {
+        if (!m_remote_free)
+            return;
+        tc->remote_flush(mem::p);
+        for (size_t i = 0; i < m_arena_owner.size(); ++i) {
+            if (as_atomic(m_arena_owner[i]).load(std::memory_order_relaxed) == tc)
+                as_atomic(m_arena_owner[i]).store(nullptr, std::memory_order_relaxed);
+        }
+        as_atomic(tc->m_exited).store(true, std::memory_order_seq_cst);
+        tc->remote_drain(mem::p);
     }
 
     ~ThreadCacheMemPool() {
@@ -576,6 +765,7 @@ public:
         size_t oldsize = mem::n;
         use_hugepage_resize_no_init(this, cap);
         mem::n = oldsize;
+        m_arena_owner.resize(arena_idx(mem::c) + 1, nullptr);
         ASAN_POISON_MEMORY_REGION(mem::p + oldsize, mem::c - oldsize);
         MSAN_POISON_MEMORY_REGION(mem::p + oldsize, mem::c - oldsize);
     }
@@ -617,6 +807,8 @@ public:
             assert(oldn + chunk_len <= cap);
         } while (!cas_weak(mem::n, oldn, oldn + chunk_len));
 
+        as_atomic(tc->m_exited).store(false, std::memory_order_relaxed);
+        set_arena_owner(oldn, chunk_len, tc);
         tc->set_hot_area(base, oldn, chunk_len);
         return true;
     }
@@ -626,8 +818,21 @@ public:
         return new TCMemPoolOneThread<AlignSize>(mp);
     }
 
+    // m_new_tc may be customized, so register tc here
+    terark_no_inline
+    TCMemPoolOneThread<AlignSize>* new_tc() {
+        tc_t* tc = m_new_tc(this);
+        if (tc) {
+            std::lock_guard<std::mutex> lock(m_tc_by_id_mtx);
+            if (tc->m_tc_id >= m_tc_by_id.size())
+                m_tc_by_id.resize(tc->m_tc_id + 1, nullptr);
+            m_tc_by_id[tc->m_tc_id] = tc;
+        }
+        return tc;
+    }
+
     TCMemPoolOneThread<AlignSize>* tls() {
-        return m_tls.get_tls(bind(&m_new_tc, this));
+        return m_tls.get_tls(bind(&ThreadCacheMemPool::new_tc, this));
     }
 
     TCMemPoolTlsHolder<AlignSize>& alltls() { return m_tls; }
@@ -635,7 +840,7 @@ public:
     // param request must be aligned by AlignSize
     size_t alloc(size_t request) {
         assert(request > 0);
-        auto tc = m_tls.get_tls(bind(&m_new_tc, this));
+        auto tc = m_tls.get_tls(bind(&ThreadCacheMemPool::new_tc, this));
         if (terark_unlikely(nullptr == tc)) {
             return size_t(-1); // fail
         }
@@ -649,6 +854,8 @@ public:
             request = std::max(sizeof(link_t), request);
         }
         request = pow2_align_up(request, AlignSize);
+        if (m_remote_free)
+            tc->remote_drain(mem::p); // reuse returned blocks first
         size_t res = tc->alloc(mem::p, request);
         if (terark_likely(size_t(-1) != res))
             return res;
@@ -666,7 +873,7 @@ public:
     size_t alloc3(size_t oldpos, size_t oldlen, size_t newlen) {
         assert(newlen > 0);
         assert(oldlen > 0);
-        auto tc = m_tls.get_tls(bind(&m_new_tc, this));
+        auto tc = m_tls.get_tls(bind(&ThreadCacheMemPool::new_tc, this));
         return alloc3(oldpos, oldlen, newlen, tc);
     }
     size_t alloc3(size_t oldpos, size_t oldlen, size_t newlen,
@@ -676,6 +883,8 @@ public:
         if (AlignSize < sizeof(link_t)) { // const expression
             newlen = std::max(sizeof(link_t), newlen);
         }
+        if (m_remote_free)
+            tc->remote_drain(mem::p);
         size_t res = tc->alloc3(mem::p, oldpos, oldlen, newlen);
         if (terark_unlikely(size_t(-1) == res)) {
             assert(oldlen < newlen);
@@ -694,7 +903,7 @@ public:
         assert(len > 0);
         assert(pos < mem::n);
         assert(pos % AlignSize == 0);
-        auto tc = m_tls.get_tls(bind(&m_new_tc, this));
+        auto tc = m_tls.get_tls(bind(&ThreadCacheMemPool::new_tc, this));
         sfree(pos, len, tc);
     }
     terark_forceinline
@@ -707,6 +916,13 @@ public:
         }
         len = pow2_align_up(len, AlignSize);
         assert(pos + len <= mem::n);
+        if (m_remote_free) {
+            tc_t* owner = get_arena_owner(pos);
+            if (owner && owner != tc) {
+                tc->remote_free(mem::p, owner, pos, len);
+                return;
+            }
+        }
         tc->sfree(mem::p, pos, len);
     }
 
@@ -728,7 +944,9 @@ public:
             assert(oldn + chunk_len <= cap);
         } while (!cas_weak(mem::n, oldn, oldn + chunk_len));
 
-        auto tc = m_tls.get_tls(bind(&m_new_tc, this));
+        auto tc = m_tls.get_tls(bind(&ThreadCacheMemPool::new_tc, this));
+        as_atomic(tc->m_exited).store(false, std::memory_order_relaxed);
+        set_arena_owner(oldn, chunk_len, tc);
         tc->set_hot_area(base, oldn, chunk_len);
         //tc->populate_hot_area(base, ArenaSize);
         tc->populate_hot_area(base, 4*1024);
@@ -8,6 +8,10 @@
 
 #include <stddef.h>
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include "config.hpp"
 #include "valvec.hpp"
@@ -221,6 +225,239 @@ namespace terark {
 		}
 	}
 
+	namespace parallel_radix_sort_impl {
+		template<class Value, class GetData, class GetSize>
+		class Sorter {
+			GetData getData;
+			GetSize getSize;
+			size_t  threads;
+			struct Job { size_t beg, num, depth; };
+			valvec<Job> jobs;
+
+			// 0 for end of key, so shorter keys go first
+			size_t charAt(const Value& x, size_t depth) const {
+				size_t len = getSize(x);
+				return depth < len ? size_t(getData(x)[depth]) + 1 : 0;
+			}
+			// x and y have same prefix of length 'depth'
+			bool lessFrom(const Value& x, const Value& y, size_t depth) const {
+				size_t xn = getSize(x), yn = getSize(y);
+				size_t n = std::min(xn, yn);
+				assert(depth <= n);
+				int ret = memcmp(getData(x) + depth, getData(y) + depth, n - depth);
+				return ret ? ret < 0 : xn < yn;
+			}
+			void insertion_sort(Value* a, size_t n, size_t depth) const {
+				for (size_t i = 1; i < n; ++i) {
+					Value x = a[i];
+					size_t j = i;
+					for (; j > 0 && lessFrom(x, a[j-1], depth); --j)
+						a[j] = a[j-1];
+					a[j] = x;
+				}
+			}
+			// multikey quicksort, for small buckets
+			void mkqsort(Value* a, size_t n, size_t depth) const {
+				using std::swap;
+				while (n > 1) {
+					if (n < 16) {
+						insertion_sort(a, n, depth);
+						return;
+					}
+					size_t c1 = charAt(a[0], depth);
+					size_t c2 = charAt(a[n/2], depth);
+					size_t c3 = charAt(a[n-1], depth);
+					size_t pivot = std::max(std::min(c1, c2), std::min(std::max(c1, c2), c3));
+					size_t lt = 0, i = 0, gt = n;
+					while (i < gt) {
+						size_t c = charAt(a[i], depth);
+						if (c < pivot)
+							swap(a[lt++], a[i++]);
+						else if (c > pivot)
+							swap(a[i], a[--gt]);
+						else
+							i++;
+					}
+					mkqsort(a, lt, depth);
+					mkqsort(a + gt, n - gt, depth);
+					if (0 == pivot)
+						return; // keys in middle are all ended, they are equal
+					a += lt, n = gt - lt, depth++;
+				}
+			}
+
+			template<class Func>
+			void run_threads(Func func) const {
+				std::vector<std::thread> thr;
+				thr.reserve(threads - 1);
+				for (size_t tid = 1; tid < threads; ++tid)
+					thr.emplace_back(func, tid);
+				func(0);
+				for (auto& t : thr)
+					t.join();
+			}
+
+			// when cnt has just one non-empty bucket, all keys have a
+			// common char at depth, return the bucket, else return 257
+			static size_t single_bucket(const size_t cnt[257], size_t n) {
+				for (size_t c = 0; c < 257; ++c) {
+					if (cnt[c]) return cnt[c] == n ? c : 257;
+				}
+				return 257;
+			}
+
+		public:
+			static const size_t MinRadixNum = 64;
+
+			Sorter(GetData gd, GetSize gs, size_t threads1)
+				: getData(gd), getSize(gs), threads(threads1) {}
+
+			void seq_sort(Value* a, Value* t, size_t n, size_t depth) const {
+				while (n >= MinRadixNum) {
+					size_t cnt[257] = {0};
+					for (size_t i = 0; i < n; ++i)
+						cnt[charAt(a[i], depth)]++;
+					size_t c0 = single_bucket(cnt, n);
+					if (c0 < 257) { // skip common prefix
+						if (0 == c0)
+							return; // all keys are equal
+						depth++;
+						continue;
+					}
+					size_t pos[257], maxc = 0;
+					for (size_t c = 0, sum = 0; c < 257; ++c) {
+						pos[c] = sum;
+						sum += cnt[c];
+						if (cnt[c] > cnt[maxc]) maxc = c;
+					}
+					for (size_t i = 0; i < n; ++i)
+						t[pos[charAt(a[i], depth)]++] = a[i];
+					std::copy(t, t + n, a);
+					// recursive on smaller buckets, loop on the largest,
+					// so recursion depth is bounded by log2(n)
+					for (size_t c = 1; c < 257; ++c) {
+						if (c != maxc && cnt[c] > 1) {
+							size_t beg = pos[c] - cnt[c];
+							seq_sort(a + beg, t + beg, cnt[c], depth + 1);
+						}
+					}
+					if (0 == maxc)
+						return;
+					size_t beg = pos[maxc] - cnt[maxc];
+					a += beg, t += beg, n = cnt[maxc], depth++;
+				}
+				mkqsort(a, n, depth);
+			}
+
+			// split [a, a+n) into buckets with all threads, buckets smaller
+			// than minParNum are deferred to jobs which run by run_jobs()
+			void par_split(Value* a, Value* t, size_t n, size_t depth,
+						   size_t base, size_t minParNum) {
+				valvec<size_t> cnt(257 * threads);
+				while (n >= minParNum) {
+					const size_t chunk = (n + threads - 1) / threads;
+					cnt.fill(0);
+					run_threads([&](size_t tid) {
+						size_t* tcnt = &cnt[257 * tid];
+						size_t end = std::min(n, chunk * (tid + 1));
+						for (size_t i = chunk * tid; i < end; ++i)
+							tcnt[charAt(a[i], depth)]++;
+					});
+					size_t total[257] = {0};
+					for (size_t tid = 0; tid < threads; ++tid)
+						for (size_t c = 0; c < 257; ++c)
+							total[c] += cnt[257 * tid + c];
+					size_t c0 = single_bucket(total, n);
+					if (c0 < 257) {
+						if (0 == c0)
+							return;
+						depth++;
+						continue;
+					}
+					// cnt[tid][c] become start pos of thread tid in bucket c
+					size_t bucketBeg[257], maxc = 0;
+					for (size_t c = 0, sum = 0; c < 257; ++c) {
+						bucketBeg[c] = sum;
+						for (size_t tid = 0; tid < threads; ++tid) {
+							size_t num = cnt[257 * tid + c];
+							cnt[257 * tid + c] = sum;
+							sum += num;
+						}
+						if (total[c] > total[maxc]) maxc = c;
+					}
+					run_threads([&](size_t tid) {
+						size_t* tpos = &cnt[257 * tid];
+						size_t end = std::min(n, chunk * (tid + 1));
+						for (size_t i = chunk * tid; i < end; ++i)
+							t[tpos[charAt(a[i], depth)]++] = a[i];
+					});
+					run_threads([&](size_t tid) {
+						size_t end = std::min(n, chunk * (tid + 1));
+						size_t beg = std::min(n, chunk * tid);
+						std::copy(t + beg, t + end, a + beg);
+					});
+					for (size_t c = 1; c < 257; ++c) {
+						if (c == maxc || total[c] < 2)
+							continue;
+						size_t beg = bucketBeg[c];
+						if (total[c] >= minParNum)
+							par_split(a + beg, t + beg, total[c], depth + 1,
+									  base + beg, minParNum);
+						else
+							jobs.push_back({base + beg, total[c], depth + 1});
+					}
+					if (0 == maxc)
+						return;
+					size_t beg = bucketBeg[maxc];
+					a += beg, t += beg, base += beg, n = total[maxc], depth++;
+				}
+				if (n > 1)
+					jobs.push_back({base, n, depth});
+			}
+
+			void run_jobs(Value* a, Value* t) {
+				// larger jobs first for better load balance
+				std::sort(jobs.begin(), jobs.end(),
+					[](const Job& x, const Job& y) { return x.num > y.num; });
+				std::atomic<size_t> next(0);
+				run_threads([&](size_t) {
+					for (size_t i; (i = next++) < jobs.size(); ) {
+						const Job& j = jobs[i];
+						seq_sort(a + j.beg, t + j.beg, j.num, j.depth);
+					}
+				});
+				jobs.clear();
+			}
+		};
+	}
+
+	/// MSD radix sort, buckets are split by all threads until they are small
+	/// enough, then each bucket is sorted by one thread, small buckets are
+	/// sorted by multikey quicksort.
+	/// const unsigned char* getData(const Value&)
+	/// size_t getSize(const Value&)
+	template<class Value, class GetData, class GetSize>
+	void parallel_radix_sort_tpl(Value* vec, size_t vlen,
+								 GetData getData,
+								 GetSize getSize,
+								 size_t threads)
+	{
+		using namespace parallel_radix_sort_impl;
+		if (vlen < 2)
+			return;
+		threads = std::max<size_t>(threads, 1);
+		valvec<Value> tmp(vlen, valvec_no_init());
+		Sorter<Value, GetData, GetSize> sorter(getData, getSize, threads);
+		if (threads == 1 || vlen < 4 * sorter.MinRadixNum * threads) {
+			sorter.seq_sort(vec, tmp.data(), vlen, 0);
+		}
+		else {
+			size_t minParNum = std::max<size_t>(vlen / (4 * threads), 64 * 1024);
+			sorter.par_split(vec, tmp.data(), vlen, 0, 0, minParNum);
+			sorter.run_jobs(vec, tmp.data());
+		}
+	}
+
 } // namespace terark
 
 #endif
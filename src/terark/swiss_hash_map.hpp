@@ -0,0 +1,563 @@
+#pragma once
+
+#include "gold_hash_map.hpp" // for DEFAULT_HASH_FUNC, terark_identity...
+#include <terark/bitmanip.hpp>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define TERARK_SWISS_HASH_USE_SSE2 1
+#else
+	#define TERARK_SWISS_HASH_USE_SSE2 0
+#endif
+
+namespace terark {
+
+/// Open addressing hash table with a separated 1 byte control array, as
+/// the swiss table: each control byte is kEmpty, kDeleted, or the low 7
+/// bits(h2) of the hash of a full slot. A probe loads 16 control bytes
+/// and compares them with h2 by SSE2, so most lookups touch just one
+/// control group and one slot, vs bucket -> link -> data of gold_hash_tab.
+///
+/// Index returned by insert_i/find_i is the slot position, it is stable
+/// until rehash(grow, reserve, or insert when too many kDeleted), and
+/// end_i() == capacity(), valid indexes are not contiguous, iterate them
+/// by beg_i/next_i.
+template< class Key
+		, class Elem = Key
+		, class HashEqual = hash_and_equal<Key, DEFAULT_HASH_FUNC<Key>, std::equal_to<Key> >
+		, class KeyExtractor = terark_identity<Elem>
+		>
+class swiss_hash_tab : HashEqual, KeyExtractor
+{
+protected:
+	static const size_t Group = 16;
+	static const size_t MinCap = 16;
+	static const unsigned char kEmpty   = 0x80;
+	static const unsigned char kDeleted = 0xFE;
+
+	Elem*          m_slots;
+	unsigned char* m_ctrl;    // m_cap + Group - 1, first Group-1 cloned at tail
+	size_t         m_cap;     // 0 or power of 2, >= MinCap
+	size_t         m_size;
+	size_t         m_deleted;
+
+public:
+	typedef ptrdiff_t difference_type;
+	typedef size_t  size_type;
+	typedef Elem  value_type;
+	typedef Elem& reference;
+	typedef const Key key_type;
+
+	explicit swiss_hash_tab(size_t cap = 0) {
+		init();
+		if (cap)
+			reserve(cap);
+	}
+	explicit swiss_hash_tab(const HashEqual& he, size_t cap = 0)
+	  : HashEqual(he) {
+		init();
+		if (cap)
+			reserve(cap);
+	}
+	swiss_hash_tab(const swiss_hash_tab& y)
+	  : HashEqual(y), KeyExtractor(y) {
+		init();
+		if (0 == y.m_size)
+			return;
+		alloc(y.m_cap);
+		size_t i = 0;
+		try {
+			for (; i < y.m_cap; ++i)
+				if (is_full(y.m_ctrl[i]))
+					new(&m_slots[i])Elem(y.m_slots[i]);
+		}
+		catch (...) {
+			for (size_t j = 0; j < i; ++j) // destroy copied
+				if (is_full(y.m_ctrl[j]))
+					m_slots[j].~Elem();
+			::free(m_slots);
+			init();
+			throw;
+		}
+		memcpy(m_ctrl, y.m_ctrl, m_cap + Group - 1);
+		m_size = y.m_size;
+		m_deleted = y.m_deleted;
+	}
+	swiss_hash_tab& operator=(const swiss_hash_tab& y) {
+		if (this != &y) {
+			swiss_hash_tab(y).swap(*this);
+		}
+		return *this;
+	}
+#if defined(HSM_HAS_MOVE)
+	swiss_hash_tab(swiss_hash_tab&& y) noexcept
+	  : HashEqual(y), KeyExtractor(y) {
+		init();
+		this->swap(y);
+	}
+	swiss_hash_tab& operator=(swiss_hash_tab&& y) noexcept {
+		swiss_hash_tab(std::move(y)).swap(*this);
+		return *this;
+	}
+#endif
+	~swiss_hash_tab() { clear(); }
+
+	void swap(swiss_hash_tab& y) {
+		std::swap(m_slots  , y.m_slots);
+		std::swap(m_ctrl   , y.m_ctrl);
+		std::swap(m_cap    , y.m_cap);
+		std::swap(m_size   , y.m_size);
+		std::swap(m_deleted, y.m_deleted);
+	}
+
+	const HashEqual& getHashEqual() const { return *this; }
+	const KeyExtractor& getKeyExtractor() const { return *this; }
+
+	/// free all memory
+	void clear() {
+		destroy_all();
+		if (m_slots)
+			::free(m_slots);
+		init();
+	}
+	/// destroy all elements, keep memory
+	void erase_all() {
+		destroy_all();
+		if (m_cap)
+			memset(m_ctrl, kEmpty, m_cap + Group - 1);
+		m_size = 0;
+		m_deleted = 0;
+	}
+
+	size_t size() const { return m_size; }
+	bool  empty() const { return 0 == m_size; }
+	size_t capacity() const { return m_cap; }
+	size_t delcnt() const { return m_deleted; }
+	double load_factor() const { return 0.875; } // fixed 7/8
+
+	void reserve(size_t cap) {
+		size_t newcap = cap_for(cap);
+		if (newcap > m_cap)
+			rehash_i(newcap);
+	}
+	/// rehash to fit max(cap, size()), drop all kDeleted
+	void rehash(size_t cap) {
+		rehash_i(cap_for(std::max(cap, m_size)));
+	}
+	void shrink_to_fit() { rehash(0); }
+
+	size_t beg_i() const { return next_full(0); }
+	size_t end_i() const { return m_cap; }
+	size_t next_i(size_t idx) const {
+		assert(idx < m_cap);
+		return next_full(idx + 1);
+	}
+
+	/// @returns pair(idx, isInserted)
+	std::pair<size_t, bool> insert_i(const Elem& obj) {
+		const Key& key = getKeyExtractor()(obj);
+		size_t h = hash_mix(HashEqual::hash(key));
+		size_t idx = m_size ? find_h(key, h) : m_cap;
+		if (idx != m_cap)
+			return std::make_pair(idx, false);
+		idx = prepare_insert(h);
+		// ctrl and counters are changed after construct, so nothing
+		// is changed if copy constructor throws
+		new(&m_slots[idx])Elem(obj);
+		set_full(idx, h);
+		return std::make_pair(idx, true);
+	}
+
+	size_t find_i(const Key& key) const {
+		if (0 == m_size)
+			return m_cap;
+		return find_h(key, hash_mix(HashEqual::hash(key)));
+	}
+	bool exists(const Key& key) const { return find_i(key) != m_cap; }
+	size_t count(const Key& key) const { return find_i(key) != m_cap ? 1 : 0; }
+
+	size_t erase(const Key& key) {
+		size_t idx = find_i(key);
+		if (idx == m_cap)
+			return 0;
+		erase_i(idx);
+		return 1;
+	}
+	void erase_i(size_t idx) {
+		assert(idx < m_cap);
+		assert(is_full(m_ctrl[idx]));
+		m_slots[idx].~Elem();
+		// if every 16 bytes window covering idx has an kEmpty, no probe
+		// has passed idx, so it can be kEmpty instead of kDeleted
+		unsigned after  = match_empty(m_ctrl + idx);
+		unsigned before = match_empty(m_ctrl + ((idx - Group) & (m_cap - 1)));
+		if (after && before &&
+				size_t(fast_ctz32(after) + fast_clz32(before) - 16) < Group) {
+			set_ctrl(idx, kEmpty);
+		} else {
+			set_ctrl(idx, kDeleted);
+			m_deleted++;
+		}
+		m_size--;
+	}
+
+	bool is_deleted(size_t idx) const {
+		assert(idx < m_cap);
+		return !is_full(m_ctrl[idx]);
+	}
+
+	const Key& key(size_t idx) const {
+		assert(idx < m_cap);
+		assert(is_full(m_ctrl[idx]));
+		return getKeyExtractor()(m_slots[idx]);
+	}
+	      Elem& elem_at(size_t idx)       {
+		assert(idx < m_cap);
+		assert(is_full(m_ctrl[idx]));
+		return m_slots[idx];
+	}
+	const Elem& elem_at(size_t idx) const {
+		assert(idx < m_cap);
+		assert(is_full(m_ctrl[idx]));
+		return m_slots[idx];
+	}
+
+	template<class OP>
+	void for_each(OP op) {
+		for (size_t i = 0; i < m_cap; ++i)
+			if (is_full(m_ctrl[i]))
+				op(m_slots[i]);
+	}
+	template<class OP>
+	void for_each(OP op) const {
+		for (size_t i = 0; i < m_cap; ++i)
+			if (is_full(m_ctrl[i]))
+				op(m_slots[i]);
+	}
+
+// DataIO support
+	/// same format as gold_hash_tab::dio_save_fast/dio_load_fast,
+	/// so the two can load each other's data
+	template<class DataIO> void dio_load_fast(DataIO& dio) {
+		typename DataIO::my_var_uint64_t size;
+		double loadFactor;
+		unsigned char cacheHash;
+		dio >> size;
+		dio >> loadFactor;
+		dio >> cacheHash;
+		erase_all();
+		reserve(size_t(size.t));
+		Elem e;
+		for (size_t i = 0, n = size.t; i < n; ++i) {
+			dio >> e;
+			insert_i(e);
+		}
+	}
+	template<class DataIO> void dio_save_fast(DataIO& dio) const {
+		dio << typename DataIO::my_var_uint64_t(m_size);
+		dio << load_factor();
+		dio << (unsigned char)(0); // no cached hash
+		for (size_t i = 0; i < m_cap; ++i)
+			if (is_full(m_ctrl[i]))
+				dio << m_slots[i];
+	}
+
+	// compatible format
+	template<class DataIO> void dio_load(DataIO& dio) {
+		typename DataIO::my_var_uint64_t size;
+		dio >> size;
+		erase_all();
+		reserve(size_t(size.t));
+		Elem e;
+		for (size_t i = 0, n = size.t; i < n; ++i) {
+			dio >> e;
+			insert_i(e);
+		}
+	}
+	template<class DataIO> void dio_save(DataIO& dio) const {
+		dio << typename DataIO::my_var_uint64_t(m_size);
+		for (size_t i = 0; i < m_cap; ++i)
+			if (is_full(m_ctrl[i]))
+				dio << m_slots[i];
+	}
+
+	template<class DataIO>
+	friend void DataIO_loadObject(DataIO& dio, swiss_hash_tab& x) {
+		x.dio_load(dio);
+	}
+	template<class DataIO>
+	friend void DataIO_saveObject(DataIO& dio, const swiss_hash_tab& x) {
+		x.dio_save(dio);
+	}
+
+protected:
+	void init() {
+		m_slots = NULL;
+		m_ctrl = NULL;
+		m_cap = 0;
+		m_size = 0;
+		m_deleted = 0;
+	}
+
+	static bool is_full(unsigned char c) { return c < 0x80; }
+
+	// std::hash of integers is identity, mix it to make h1/h2 independent
+	static size_t hash_mix(size_t h) {
+	#if defined(__SIZEOF_INT128__)
+		__uint128_t p = __uint128_t(uint64_t(h)) * 0x9E3779B97F4A7C15ULL;
+		return size_t(uint64_t(p) ^ uint64_t(p >> 64));
+	#else
+		uint64_t x = h;
+		x ^= x >> 33; x *= 0xFF51AFD7ED558CCDULL;
+		x ^= x >> 33; x *= 0xC4CEB9FE1A85EC53ULL;
+		x ^= x >> 33;
+		return size_t(x);
+	#endif
+	}
+	static size_t h1(size_t h) { return h >> 7; }
+	static unsigned char h2(size_t h) { return (unsigned char)(h & 0x7F); }
+
+	// bit i is set if g[i] == c
+	static unsigned match_byte(const unsigned char* g, unsigned char c) {
+	#if TERARK_SWISS_HASH_USE_SSE2
+		__m128i v = _mm_loadu_si128((const __m128i*)g);
+		return unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(char(c)))));
+	#else
+		unsigned m = 0;
+		for (size_t i = 0; i < Group; ++i)
+			m |= unsigned(g[i] == c) << i;
+		return m;
+	#endif
+	}
+	static unsigned match_empty(const unsigned char* g) {
+		return match_byte(g, kEmpty);
+	}
+	// kEmpty or kDeleted, the high bit is set
+	static unsigned match_empty_or_deleted(const unsigned char* g) {
+	#if TERARK_SWISS_HASH_USE_SSE2
+		return unsigned(_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g)));
+	#else
+		unsigned m = 0;
+		for (size_t i = 0; i < Group; ++i)
+			m |= unsigned(g[i] >> 7) << i;
+		return m;
+	#endif
+	}
+
+	// triangular probing on groups, visits every group when m_cap is
+	// power of 2, and terminates because there is always an kEmpty
+	size_t find_h(const Key& key, size_t h) const {
+		const size_t mask = m_cap - 1;
+		const unsigned char c = h2(h);
+		size_t pos = h1(h) & mask;
+		for (size_t step = Group; ; step += Group) {
+			const unsigned char* g = m_ctrl + pos;
+			for (unsigned m = match_byte(g, c); m; m &= m - 1) {
+				size_t idx = (pos + fast_ctz32(m)) & mask;
+				if (HashEqual::equal(key, getKeyExtractor()(m_slots[idx])))
+					return idx;
+			}
+			if (match_empty(g))
+				return m_cap;
+			pos = (pos + step) & mask;
+		}
+	}
+	size_t find_slot(size_t h) const {
+		const size_t mask = m_cap - 1;
+		size_t pos = h1(h) & mask;
+		for (size_t step = Group; ; step += Group) {
+			unsigned m = match_empty_or_deleted(m_ctrl + pos);
+			if (m)
+				return (pos + fast_ctz32(m)) & mask;
+			pos = (pos + step) & mask;
+		}
+	}
+	size_t prepare_insert(size_t h) {
+		if (m_size + m_deleted >= max_load(m_cap)) {
+			// rehash in place if live elements just take half of max load
+			if (m_size + 1 <= max_load(m_cap) / 2)
+				rehash_i(m_cap);
+			else
+				rehash_i(m_cap ? m_cap * 2 : MinCap);
+		}
+		return find_slot(h);
+	}
+	void set_full(size_t idx, size_t h) {
+		if (kDeleted == m_ctrl[idx])
+			m_deleted--;
+		set_ctrl(idx, h2(h));
+		m_size++;
+	}
+	void set_ctrl(size_t idx, unsigned char c) {
+		m_ctrl[idx] = c;
+		if (idx < Group - 1)
+			m_ctrl[m_cap + idx] = c;
+	}
+
+	static size_t max_load(size_t cap) { return cap - cap / 8; }
+	static size_t cap_for(size_t n) {
+		size_t cap = MinCap;
+		while (max_load(cap) < n)
+			cap *= 2;
+		return n ? cap : 0;
+	}
+
+	size_t next_full(size_t idx) const {
+		while (idx < m_cap && !is_full(m_ctrl[idx]))
+			++idx;
+		return idx;
+	}
+
+	void alloc(size_t cap) {
+		assert(cap >= MinCap && (cap & (cap - 1)) == 0);
+		size_t bytes = sizeof(Elem) * cap + cap + Group - 1;
+		Elem* slots = (Elem*)malloc(bytes);
+		if (NULL == slots)
+			throw std::bad_alloc();
+		m_slots = slots;
+		m_ctrl = (unsigned char*)(slots + cap);
+		m_cap = cap;
+		memset(m_ctrl, kEmpty, cap + Group - 1);
+	}
+
+	void destroy_all() {
+		if (!boost::has_trivial_destructor<Elem>::value && m_size) {
+			for (size_t i = 0; i < m_cap; ++i)
+				if (is_full(m_ctrl[i]))
+					m_slots[i].~Elem();
+		}
+	}
+
+	// elements are relocated by move construct, which should not throw
+	void rehash_i(size_t newcap) {
+		Elem* old_slots = m_slots;
+		unsigned char* old_ctrl = m_ctrl;
+		size_t old_cap = m_cap;
+		if (0 == newcap) {
+			assert(0 == m_size);
+			if (old_slots)
+				::free(old_slots);
+			init();
+			return;
+		}
+		alloc(newcap);
+		for (size_t i = 0; i < old_cap; ++i) {
+			if (is_full(old_ctrl[i])) {
+				Elem& e = old_slots[i];
+				size_t h = hash_mix(HashEqual::hash(getKeyExtractor()(e)));
+				size_t idx = find_slot(h);
+				new(&m_slots[idx])Elem(std::move(e));
+				e.~Elem();
+				set_ctrl(idx, h2(h));
+			}
+		}
+		m_deleted = 0;
+		if (old_slots)
+			::free(old_slots);
+	}
+};
+
+template< class Key
+		, class Value
+		, class HashFunc = DEFAULT_HASH_FUNC<Key>
+		, class KeyEqual = std::equal_to<Key>
+		>
+class swiss_hash_map : public
+	swiss_hash_tab<Key, std::pair<Key, Value>
+		, hash_and_equal<Key, HashFunc, KeyEqual>, terark_get_first<Key>
+		>
+{
+	typedef
+	swiss_hash_tab<Key, std::pair<Key, Value>
+		, hash_and_equal<Key, HashFunc, KeyEqual>, terark_get_first<Key>
+		>
+	super;
+public:
+	typedef Key   key_type;
+	typedef Value mapped_type;
+	typedef std::pair<Key, Value> value_type;
+
+	explicit swiss_hash_map(size_t cap = 0) : super(cap) {}
+
+	using super::insert_i;
+	std::pair<size_t, bool> insert_i(const Key& key, const Value& val = Value()) {
+		return this->insert_i(value_type(key, val));
+	}
+
+	Value& operator[](const Key& key) {
+		size_t idx = this->find_i(key);
+		if (idx == this->end_i())
+			idx = this->insert_i(value_type(key, Value())).first;
+		return this->m_slots[idx].second;
+	}
+
+	      Value& val(size_t idx)       { return this->elem_at(idx).second; }
+	const Value& val(size_t idx) const { return this->elem_at(idx).second; }
+
+	template<class DataIO>
+	friend void DataIO_loadObject(DataIO& dio, swiss_hash_map& x) {
+		x.dio_load(dio);
+	}
+	template<class DataIO>
+	friend void DataIO_saveObject(DataIO& dio, const swiss_hash_map& x) {
+		x.dio_save(dio);
+	}
+};
+
+template< class Key
+		, class HashFunc = DEFAULT_HASH_FUNC<Key>
+		, class KeyEqual = std::equal_to<Key>
+		>
+class swiss_hash_set : public
+	swiss_hash_tab<Key, Key
+		, hash_and_equal<Key, HashFunc, KeyEqual>, terark_identity<Key>
+		>
+{
+	typedef
+	swiss_hash_tab<Key, Key
+		, hash_and_equal<Key, HashFunc, KeyEqual>, terark_identity<Key>
+		>
+	super;
+public:
+	explicit swiss_hash_set(size_t cap = 0) : super(cap) {}
+
+	template<class DataIO>
+	friend void DataIO_loadObject(DataIO& dio, swiss_hash_set& x) {
+		x.dio_load(dio);
+	}
+	template<class DataIO>
+	friend void DataIO_saveObject(DataIO& dio, const swiss_hash_set& x) {
+		x.dio_save(dio);
+	}
+};
+
+} // namespace terark
+
+namespace std { // for std::swap
+
+template<class Key, class Elem, class HashEqual, class KeyExtractor>
+void
+swap(terark::swiss_hash_tab<Key, Elem, HashEqual, KeyExtractor>& x,
+	 terark::swiss_hash_tab<Key, Elem, HashEqual, KeyExtractor>& y)
+{
+	x.swap(y);
+}
+
+template<class Key, class Value, class HashFunc, class KeyEqual>
+void
+swap(terark::swiss_hash_map<Key, Value, HashFunc, KeyEqual>& x,
+	 terark::swiss_hash_map<Key, Value, HashFunc, KeyEqual>& y)
+{
+	x.swap(y);
+}
+
+template<class Key, class HashFunc, class KeyEqual>
+void
+swap(terark::swiss_hash_set<Key, HashFunc, KeyEqual>& x,
+	 terark::swiss_hash_set<Key, HashFunc, KeyEqual>& y)
+{
+	x.swap(y);
+}
+
+} // namespace std
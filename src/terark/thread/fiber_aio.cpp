@@ -7,6 +7,21 @@
 
 #if BOOST_OS_LINUX
   #include <libaio.h> // linux native aio
+  #include <sys/syscall.h>
+  #if defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+      #include <linux/io_uring.h>
+    #endif
+  #endif
+  // IO_URING_OP_SUPPORTED is defined since linux 5.6, which has
+  // IORING_OP_READ/WRITE/MADVISE, liburing is not needed, we use syscalls
+  #if defined(IO_URING_OP_SUPPORTED) && defined(__NR_io_uring_setup)
+    #define TERARK_FIBER_AIO_URING 1
+    #include <sys/uio.h>
+    #include <unistd.h>
+  #else
+    #define TERARK_FIBER_AIO_URING 0
+  #endif
 #endif
 
 #if BOOST_OS_WINDOWS
@@ -25,6 +40,7 @@
 #include <terark/fstring.hpp>
 #include <terark/util/atomic.hpp>
 #include <terark/util/throw.hpp>
+#include <terark/valvec.hpp>
 #include <boost/fiber/all.hpp>
 #include <boost/lockfree/queue.hpp>
 
@@ -39,8 +55,9 @@ namespace terark {
 ///@returns
 //  0: posix aio
 //  1: linux aio(default)
-//  2: io uring (not supported now)
-static int g_aio_method = (int)getEnvLong("aio_method", 1);
+//  2: io uring, fallback to linux aio if kernel does not support it
+static int probe_aio_method(int method);
+static int g_aio_method = probe_aio_method((int)getEnvLong("aio_method", 1));
 
 static std::atomic<size_t> g_ft_num;
 
@@ -281,7 +298,431 @@ io_queue_t* dt_io_queue() {
   return q;
 }
 
+#if TERARK_FIBER_AIO_URING
+
+static bool g_uring_sqpoll = getEnvBool("aio_uring_sqpoll", false);
+static unsigned g_uring_entries = (unsigned)getEnvLong("aio_uring_entries", 256);
+// max yields of fiber_aio_need waiting for the first page to be resident
+static int g_uring_need_yields = (int)getEnvLong("aio_uring_need_yields", 64);
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+static int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// io_uring counterpart of io_fiber_context, a fiber only fills sqe then
+// waits, the io fiber submits all sqe filled in a scheduling round by one
+// io_uring_enter, and reaps cqe from shared memory without syscall.
+// with SQPOLL, the kernel thread fetches sqe, io_uring_enter is called only
+// when the kernel thread is idle and needs wakeup.
+// buffered(non O_DIRECT) io is also async, it is executed by kernel workers
+class io_uring_fiber_context {
+  enum class state {
+    ready,
+    running,
+    stopping,
+    stopped,
+  };
+  FiberYield           m_fy;
+  volatile state       m_state;
+  size_t               ft_num;
+  unsigned long long   counter;
+  boost::fibers::fiber io_fiber;
+  int                  ring_fd = -1;
+  bool                 sqpoll = false;
+  unsigned             sq_entries = 0;
+  unsigned             sq_local_tail = 0; // sqe filled
+  unsigned             sq_submitted = 0;  // sqe passed to io_uring_enter
+  unsigned*            sq_head = NULL;
+  unsigned*            sq_tail = NULL;
+  unsigned*            sq_mask = NULL;
+  unsigned*            sq_flags = NULL;
+  unsigned*            sq_array = NULL;
+  unsigned*            cq_head = NULL;
+  unsigned*            cq_tail = NULL;
+  unsigned*            cq_mask = NULL;
+  struct io_uring_sqe* sqes = NULL;
+  struct io_uring_cqe* cqes = NULL;
+  void*                sq_ring = MAP_FAILED;
+  void*                cq_ring = MAP_FAILED;
+  size_t               sq_ring_len = 0;
+  size_t               cq_ring_len = 0;
+  size_t               sqes_len = 0;
+  volatile size_t      io_reqnum = 0;
+  valvec<int>          fixed_files; // fd -> registered index, -1 if not
+  valvec<struct iovec> fixed_bufs;
+
+  static unsigned load_acquire(const unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+  }
+  static void store_release(unsigned* p, unsigned val) {
+    __atomic_store_n(p, val, __ATOMIC_RELEASE);
+  }
+
+  void fiber_proc() {
+    m_state = state::running;
+    while (state::running == m_state) {
+      io_submit_pending();
+      io_reap();
+      yield();
+      counter++;
+    }
+    assert(state::stopping == m_state);
+    m_state = state::stopped;
+  }
+
+  void io_submit_pending() {
+    if (sqpoll) {
+      // kernel thread may have gone idle, full barrier between tail store
+      // and flags load, see io_uring_enter(2)
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sq_submitted != sq_local_tail &&
+          (load_acquire(sq_flags) & IORING_SQ_NEED_WAKEUP)) {
+        sys_io_uring_enter(ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+      }
+      sq_submitted = sq_local_tail;
+      return;
+    }
+    unsigned pending = sq_local_tail - sq_submitted;
+    if (0 == pending)
+      return;
+    int ret = sys_io_uring_enter(ring_fd, pending, 0, 0);
+    if (ret < 0) {
+      int err = errno;
+      if (EAGAIN != err && EBUSY != err && EINTR != err) {
+        fprintf(stderr, "ERROR: ft_num = %zd, io_uring_enter(to_submit=%u) = %s\n", ft_num, pending, strerror(err));
+        fail_pending(err);
+      }
+    }
+    else {
+      sq_submitted += ret;
+    }
+  }
+
+  // io_uring_enter failed with a non-retryable error, take back the sqe
+  // which are not consumed by kernel and fail them, else waiting fibers
+  // would hang forever
+  void fail_pending(int err) {
+    unsigned head = load_acquire(sq_head);
+    unsigned mask = *sq_mask;
+    for (unsigned i = head; i != sq_local_tail; ++i) {
+      io_return* ior = (io_return*)(uintptr_t)(sqes[sq_array[i & mask]].user_data);
+      ior->len = -1;
+      ior->err = err;
+      ior->done = true;
+      m_fy.unchecked_notify(&ior->fctx);
+      io_reqnum--;
+    }
+    store_release(sq_tail, head);
+    sq_local_tail = sq_submitted = head;
+  }
+
+  void io_reap() {
+    unsigned head = *cq_head;
+    unsigned tail = load_acquire(cq_tail);
+    if (head == tail)
+      return;
+    unsigned mask = *cq_mask;
+    for (; head != tail; ++head) {
+      struct io_uring_cqe* cqe = &cqes[head & mask];
+      io_return* ior = (io_return*)(uintptr_t)(cqe->user_data);
+      if (cqe->res < 0) {
+        ior->len = -1;
+        ior->err = -cqe->res;
+      } else {
+        ior->len = cqe->res;
+        ior->err = 0;
+      }
+      ior->done = true;
+      m_fy.unchecked_notify(&ior->fctx);
+      io_reqnum--;
+    }
+    store_release(cq_head, head);
+  }
+
+  struct io_uring_sqe* get_sqe() {
+    for (;;) {
+      unsigned head = load_acquire(sq_head);
+      if (sq_local_tail - head < sq_entries) {
+        auto sqe = &sqes[sq_local_tail & *sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+      }
+      io_submit_pending(); // sq is full
+      yield();
+    }
+  }
+
+  void commit_sqe() {
+    unsigned idx = sq_local_tail & *sq_mask;
+    sq_array[idx] = idx;
+    store_release(sq_tail, ++sq_local_tail);
+    io_reqnum++;
+  }
+
+  int find_fixed_buf(const void* buf, size_t len) const {
+    for (size_t i = 0; i < fixed_bufs.size(); ++i) {
+      const char* beg = (const char*)fixed_bufs[i].iov_base;
+      const char* end = beg + fixed_bufs[i].iov_len;
+      if ((const char*)buf >= beg && (const char*)buf + len <= end)
+        return int(i);
+    }
+    return -1;
+  }
+
+  intptr_t wait_sqe(struct io_uring_sqe* sqe) {
+    io_return io_ret = {nullptr, 0, -1, false};
+    sqe->user_data = (uintptr_t)&io_ret;
+    commit_sqe();
+    m_fy.unchecked_wait(&io_ret.fctx);
+    assert(io_ret.done);
+    if (io_ret.err) {
+      errno = io_ret.err;
+    }
+    return io_ret.len;
+  }
+
+  void unmap_rings() {
+    if (MAP_FAILED != sqes) munmap(sqes, sqes_len);
+    if (MAP_FAILED != cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_len);
+    if (MAP_FAILED != sq_ring) munmap(sq_ring, sq_ring_len);
+  }
+
+  intptr_t exec_io_1(int fd, void* buf, size_t len, off_t offset, bool write) {
+    assert(len <= MaxSqeLen);
+    auto sqe = get_sqe();
+    int bi = find_fixed_buf(buf, len);
+    if (bi >= 0) {
+      sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe->buf_index = (unsigned short)bi;
+    } else {
+      sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    if (size_t(fd) < fixed_files.size() && fixed_files[fd] >= 0) {
+      sqe->fd = fixed_files[fd];
+      sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+      sqe->fd = fd;
+    }
+    sqe->addr = (uintptr_t)buf;
+    sqe->len = (unsigned)len;
+    sqe->off = offset;
+    return wait_sqe(sqe);
+  }
+
+public:
+  // sqe->len is 32 bits, larger io is split
+  static const size_t MaxSqeLen = size_t(1) << 30;
+
+  void yield() { m_fy.unchecked_yield(); }
+
+  /// @returns bytes of io, stops at first short io, returns bytes done
+  ///          before an error if any, else -1 with errno
+  intptr_t exec_io(int fd, void* buf, size_t len, off_t offset, bool write) {
+    intptr_t done = 0;
+    for (;;) {
+      size_t n = std::min(len, MaxSqeLen);
+      intptr_t ret = exec_io_1(fd, buf, n, offset, write);
+      if (ret < 0)
+        return done ? done : ret;
+      done += ret;
+      if (size_t(ret) < n || n == len)
+        return done;
+      buf = (char*)buf + n;
+      len -= n;
+      offset += n;
+    }
+  }
+
+  /// madvise is executed by kernel worker, the fiber is resumed after it,
+  /// for MADV_WILLNEED, the madvise just starts readahead
+  int exec_madvise(void* addr, size_t len, int advice) {
+    do {
+      size_t n = std::min(len, MaxSqeLen);
+      auto sqe = get_sqe();
+      sqe->opcode = IORING_OP_MADVISE;
+      sqe->fd = -1;
+      sqe->addr = (uintptr_t)addr;
+      sqe->len = (unsigned)n;
+      sqe->fadvise_advice = advice;
+      if (wait_sqe(sqe) < 0)
+        return -1;
+      addr = (char*)addr + n;
+      len -= n;
+    } while (len);
+    return 0;
+  }
+
+  int register_buffers(const struct iovec* iov, size_t num) {
+    if (!fixed_bufs.empty()) {
+      if (sys_io_uring_register(ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0) < 0)
+        return -1;
+      fixed_bufs.clear();
+    }
+    if (num) {
+      if (sys_io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, iov, (unsigned)num) < 0)
+        return -1;
+      fixed_bufs.assign(iov, num);
+    }
+    return 0;
+  }
+
+  int register_files(const int* fds, size_t num) {
+    if (!fixed_files.empty()) {
+      if (sys_io_uring_register(ring_fd, IORING_UNREGISTER_FILES, NULL, 0) < 0)
+        return -1;
+      fixed_files.clear();
+    }
+    if (num) {
+      if (sys_io_uring_register(ring_fd, IORING_REGISTER_FILES, fds, (unsigned)num) < 0)
+        return -1;
+      int maxfd = *std::max_element(fds, fds + num);
+      fixed_files.resize(maxfd + 1, -1);
+      for (size_t i = 0; i < num; ++i)
+        if (fds[i] >= 0)
+          fixed_files[fds[i]] = int(i);
+    }
+    return 0;
+  }
+
+  io_uring_fiber_context(boost::fibers::context** pp)
+    : m_fy(pp)
+  {
+    ft_num = g_ft_num++;
+    aio_debug("ft_num = %zd", ft_num);
+    sqes = (struct io_uring_sqe*)MAP_FAILED;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if (g_uring_sqpoll) {
+      p.flags |= IORING_SETUP_SQPOLL;
+      p.sq_thread_idle = 1000; // ms
+      ring_fd = sys_io_uring_setup(g_uring_entries, &p);
+      if (ring_fd < 0) {
+        // SQPOLL needs privilege on old kernels, run without it
+        fprintf(stderr, "WARN: io_uring_setup(SQPOLL) = %s, disable SQPOLL\n", strerror(errno));
+        memset(&p, 0, sizeof(p));
+      }
+    }
+    if (ring_fd < 0) {
+      ring_fd = sys_io_uring_setup(g_uring_entries, &p);
+      if (ring_fd < 0)
+        TERARK_DIE("io_uring_setup(entries=%u) = %s", g_uring_entries, strerror(errno));
+    }
+    sqpoll = (p.flags & IORING_SETUP_SQPOLL) != 0;
+    sq_entries = p.sq_entries;
+    sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      sq_ring_len = cq_ring_len = std::max(sq_ring_len, cq_ring_len);
+    sq_ring = mmap(NULL, sq_ring_len, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == sq_ring)
+      TERARK_DIE("mmap(io_uring sq ring, len=%zd) = %s", sq_ring_len, strerror(errno));
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      cq_ring = sq_ring;
+    else {
+      cq_ring = mmap(NULL, cq_ring_len, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+      if (MAP_FAILED == cq_ring)
+        TERARK_DIE("mmap(io_uring cq ring, len=%zd) = %s", cq_ring_len, strerror(errno));
+    }
+    sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (struct io_uring_sqe*)mmap(NULL, sqes_len, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == (void*)sqes)
+      TERARK_DIE("mmap(io_uring sqes, len=%zd) = %s", sqes_len, strerror(errno));
+    char* sq = (char*)sq_ring;
+    char* cq = (char*)cq_ring;
+    sq_head  = (unsigned*)(sq + p.sq_off.head);
+    sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    sq_flags = (unsigned*)(sq + p.sq_off.flags);
+    sq_array = (unsigned*)(sq + p.sq_off.array);
+    cq_head  = (unsigned*)(cq + p.cq_off.head);
+    cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    sq_local_tail = sq_submitted = *sq_tail;
+    m_state = state::ready;
+    counter = 0;
+    io_fiber = boost::fibers::fiber(std::bind(&io_uring_fiber_context::fiber_proc, this));
+  }
+
+  ~io_uring_fiber_context() {
+    aio_debug("ft_num = %zd, counter = %llu ...", ft_num, counter);
+    m_state = state::stopping;
+    while (state::stopping == m_state) {
+      yield();
+    }
+    TERARK_VERIFY(state::stopped == m_state);
+    io_fiber.join();
+    TERARK_VERIFY(0 == io_reqnum);
+    unmap_rings();
+    ::close(ring_fd);
+  }
+};
+
+static io_uring_fiber_context& tls_io_uring_fiber() {
+  using boost::fibers::context;
+  static thread_local io_uring_fiber_context io_fiber(context::active_pp());
+  return io_fiber;
+}
+
+static int probe_aio_method(int method) {
+  if (2 != method)
+    return method;
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = sys_io_uring_setup(2, &p);
+  if (fd < 0) {
+    fprintf(stderr, "WARN: aio_method = 2: io_uring_setup = %s, use linux aio\n", strerror(errno));
+    return 1;
+  }
+  const unsigned maxops = 256;
+  valvec<char> buf(sizeof(struct io_uring_probe) + maxops * sizeof(struct io_uring_probe_op), '\0');
+  auto probe = (struct io_uring_probe*)buf.data();
+  int ret = sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, maxops);
+  int err = errno;
+  ::close(fd);
+  auto supported = [probe](unsigned op) {
+    return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  };
+  if (ret < 0 || !supported(IORING_OP_READ) || !supported(IORING_OP_WRITE) ||
+      !supported(IORING_OP_MADVISE)) {
+    fprintf(stderr, "WARN: aio_method = 2: io_uring does not support read/write/madvise(%s), use linux aio\n",
+            ret < 0 ? strerror(err) : "ops");
+    return 1;
+  }
+  return 2;
+}
+
+#else
+
+static int probe_aio_method(int method) {
+  if (2 == method) {
+    fprintf(stderr, "WARN: aio_method = 2: io_uring is not built in, use linux aio\n");
+    return 1;
+  }
+  return method;
+}
+
+#endif // TERARK_FIBER_AIO_URING
+
+#endif
+
+TERARK_DLL_EXPORT
+int fiber_aio_method() {
+#if BOOST_OS_LINUX
+  return g_aio_method;
+#else
+  return 0;
 #endif
+}
 
 TERARK_DLL_EXPORT
 intptr_t fiber_aio_read(int fd, void* buf, size_t len, off_t offset) {
@@ -289,6 +730,11 @@ intptr_t fiber_aio_read(int fd, void* buf, size_t len, off_t offset) {
   if (1 == g_aio_method) {
     return tls_io_fiber().exec_io(fd, buf, len, offset, IO_CMD_PREAD);
   }
+#if TERARK_FIBER_AIO_URING
+  if (2 == g_aio_method) {
+    return tls_io_uring_fiber().exec_io(fd, buf, len, offset, false);
+  }
+#endif
 #endif
 #if BOOST_OS_WINDOWS
   TERARK_DIE("Not Supported for Windows");
@@ -338,9 +784,28 @@ void fiber_aio_need(const void* buf, size_t len) {
     int err = mincore((void*)buf, len2, uv.vec);
     if (0 == err) {
         if (0x0101010101010101ULL != uv.val) {
+          #if TERARK_FIBER_AIO_URING
+            // page fault of mmap is sync, let kernel worker start readahead,
+            // other fibers run meanwhile
+            if (2 == g_aio_method) {
+                tls_io_uring_fiber().exec_madvise((void*)buf, len, MADV_WILLNEED);
+            } else
+          #endif
             posix_madvise((void*)buf, len, POSIX_MADV_WILLNEED);
         }
         if (0 == uv.vec[0]) {
+          #if TERARK_FIBER_AIO_URING
+            // readahead is async, yield until the first page is resident,
+            // bounded by aio_uring_need_yields
+            if (2 == g_aio_method) {
+                for (int i = 0; i < g_uring_need_yields; ++i) {
+                    boost::this_fiber::yield();
+                    if (0 == mincore((void*)buf, 1, uv.vec) && (uv.vec[0] & 1))
+                        break;
+                }
+                return;
+            }
+          #endif
             boost::this_fiber::yield(); // just yield once
         }
     }
@@ -353,6 +818,11 @@ intptr_t fiber_aio_write(int fd, const void* buf, size_t len, off_t offset) {
   if (1 == g_aio_method) {
     return tls_io_fiber().exec_io(fd, (void*)buf, len, offset, IO_CMD_PWRITE);
   }
+#if TERARK_FIBER_AIO_URING
+  if (2 == g_aio_method) {
+    return tls_io_uring_fiber().exec_io(fd, (void*)buf, len, offset, true);
+  }
+#endif
 #endif
 #if BOOST_OS_WINDOWS
   TERARK_DIE("Not Supported for Windows");
@@ -384,10 +854,38 @@ intptr_t fiber_put_write(int fd, const void* buf, size_t len, off_t offset) {
   if (1 == g_aio_method) {
     return tls_io_fiber().dt_exec_io(fd, (void*)buf, len, offset, IO_CMD_PWRITE);
   }
+#if TERARK_FIBER_AIO_URING
+  if (2 == g_aio_method) {
+    // io_uring submission does not block, no dedicated thread is needed
+    return tls_io_uring_fiber().exec_io(fd, (void*)buf, len, offset, true);
+  }
+#endif
   TERARK_DIE("Not Supported aio_method = %d", g_aio_method);
 #else
   TERARK_DIE("Not Supported platform");
 #endif
 }
 
+TERARK_DLL_EXPORT
+int fiber_aio_register_buffers(const struct iovec* iov, size_t num) {
+#if BOOST_OS_LINUX && TERARK_FIBER_AIO_URING
+  if (2 == g_aio_method) {
+    return tls_io_uring_fiber().register_buffers(iov, num);
+  }
+#endif
+  errno = ENOTSUP;
+  return -1;
+}
+
+TERARK_DLL_EXPORT
+int fiber_aio_register_files(const int* fds, size_t num) {
+#if BOOST_OS_LINUX && TERARK_FIBER_AIO_URING
+  if (2 == g_aio_method) {
+    return tls_io_uring_fiber().register_files(fds, num);
+  }
+#endif
+  errno = ENOTSUP;
+  return -1;
+}
+
 } // namespace terark
@@ -8,8 +8,15 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+struct iovec;
+
 namespace terark {
 
+/// aio method in use after probing kernel support of env aio_method:
+/// 0: posix aio, 1: linux aio, 2: io_uring
+TERARK_DLL_EXPORT
+int fiber_aio_method();
+
 TERARK_DLL_EXPORT
 intptr_t fiber_aio_read(int fd, void* buf, size_t len, off_t offset);
 
@@ -23,5 +30,17 @@ intptr_t fiber_aio_write(int fd, const void* buf, size_t len, off_t offset);
 TERARK_DLL_EXPORT
 intptr_t fiber_put_write(int fd, const void* buf, size_t len, off_t offset);
 
+/// only for io_uring(env aio_method=2), register to io_uring of calling
+/// thread, replaces previous registration, num = 0 to unregister.
+/// later fiber_aio_read/write of this thread use fixed buffer if buf is in
+/// a registered buffer, and fixed file if fd is registered
+/// @returns 0 on success, -1 with errno on fail, errno is ENOTSUP if
+///          io_uring is not used
+TERARK_DLL_EXPORT
+int fiber_aio_register_buffers(const struct iovec* iov, size_t num);
+
+TERARK_DLL_EXPORT
+int fiber_aio_register_files(const int* fds, size_t num);
+
 
 } // namespace terark
@@ -0,0 +1,305 @@
+#include "fiber_core_pool.hpp"
+#include <terark/util/function.hpp>
+#include <terark/util/mpmc_queue.hpp>
+#include <boost/context/detail/exception.hpp>
+#include <boost/fiber/all.hpp>
+#include <boost/predef.h>
+#include <deque>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if BOOST_OS_LINUX
+  #include <sched.h>
+  #include <pthread.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #ifndef MPOL_PREFERRED
+    #define MPOL_PREFERRED 1
+  #endif
+#endif
+
+namespace terark {
+
+static thread_local PerCoreFiberPool::Core* tls_core = NULL;
+
+class PerCoreFiberPool::Core {
+public:
+    PerCoreFiberPool* m_owner;
+    size_t            m_index;
+    int               m_cpu;
+    std::atomic<int>  m_node; // -2: worker not started
+    size_t            m_stack_size;
+    size_t            m_max_fibers;
+    size_t            m_live = 0; // only accessed by worker thread
+    bool              m_pin;
+    std::atomic<bool> m_stop{false}; // set by ~Core, read by worker
+    valvec<void*>     m_free_stacks;
+    valvec<void*>     m_all_stacks;
+    // tasks submitted by fibers of this core to full queues, a fiber never
+    // blocks on a full queue, else cores may wait for each other forever
+    std::deque<std::pair<Core*, task_t> > m_overflow;
+    util::mpmc_queue<task_t> m_queue;
+    std::thread       m_thread;
+
+    // stack is reused by later fibers of this core, fibers are created and
+    // destroyed in worker thread, so no lock
+    class PooledStack {
+        Core* m_core;
+    public:
+        explicit PooledStack(Core* c) : m_core(c) {}
+        boost::context::stack_context allocate() {
+            void* vp = m_core->alloc_stack();
+            boost::context::stack_context sctx;
+            sctx.size = m_core->m_stack_size;
+            sctx.sp = static_cast<char*>(vp) + sctx.size;
+            return sctx;
+        }
+        void deallocate(boost::context::stack_context& sctx) noexcept {
+            void* vp = static_cast<char*>(sctx.sp) - sctx.size;
+            m_core->m_free_stacks.push_back(vp);
+        }
+    };
+
+    Core(PerCoreFiberPool* owner, size_t idx, int cpu, const Options& opt)
+      : m_queue(opt.queue_size) {
+        m_owner = owner;
+        m_index = idx;
+        m_cpu = cpu;
+        m_node = -2;
+        m_stack_size = opt.stack_size;
+        m_max_fibers = opt.fibers_per_core;
+        m_pin = opt.pin_cpu;
+        m_thread = std::thread(&Core::run, this);
+    }
+    ~Core() {
+        m_stop = true;
+        m_thread.join();
+        for (void* vp : m_all_stacks)
+            free_stack(vp);
+    }
+
+    static size_t guard_size() {
+    #if BOOST_OS_LINUX
+        static const size_t page = sysconf(_SC_PAGESIZE);
+        return page;
+    #else
+        return 0;
+    #endif
+    }
+
+    void* alloc_stack() {
+        if (!m_free_stacks.empty())
+            return m_free_stacks.pop_val();
+    #if BOOST_OS_LINUX
+        size_t guard = guard_size();
+        size_t len = m_stack_size + guard;
+        void* mem = mmap(NULL, len, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == mem)
+            TERARK_DIE("mmap(fiber stack, len = %zd) = %s", len, strerror(errno));
+        mprotect(mem, guard, PROT_NONE); // stack grows down
+        int node = m_node.load(std::memory_order_relaxed);
+        if (node >= 0 && node < 64) {
+            // best effort, first touch by pinned worker is also node local
+            unsigned long mask = 1UL << node;
+            syscall(__NR_mbind, mem, len, MPOL_PREFERRED, &mask, 64, 0);
+        }
+        void* vp = (char*)mem + guard;
+    #else
+        void* vp = malloc(m_stack_size);
+        if (!vp)
+            TERARK_DIE("malloc(fiber stack, len = %zd) failed", m_stack_size);
+    #endif
+        m_all_stacks.push_back(vp);
+        return vp;
+    }
+
+    void free_stack(void* vp) {
+    #if BOOST_OS_LINUX
+        size_t guard = guard_size();
+        munmap((char*)vp - guard, m_stack_size + guard);
+    #else
+        free(vp);
+    #endif
+    }
+
+    void pin_self() {
+        int node = -1;
+    #if BOOST_OS_LINUX
+        if (m_pin) {
+            cpu_set_t cs;
+            CPU_ZERO(&cs);
+            CPU_SET(m_cpu, &cs);
+            int err = pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs);
+            if (err)
+                fprintf(stderr, "WARN: PerCoreFiberPool: pin core %zd to cpu %d = %s\n",
+                        m_index, m_cpu, strerror(err));
+            unsigned cpu = 0, nd = 0;
+            if (syscall(SYS_getcpu, &cpu, &nd, NULL) == 0)
+                node = int(nd);
+        }
+    #endif
+        m_node.store(node, std::memory_order_release);
+    }
+
+    void launch(task_t&& fn) {
+        m_live++;
+        boost::fibers::fiber(std::allocator_arg, PooledStack(this),
+        [this, f = std::move(fn)]() {
+            // on every path, else wait_idle() never returns
+            TERARK_SCOPE_EXIT(m_live--; m_owner->task_done());
+            try {
+                f();
+            }
+            catch (const boost::context::detail::forced_unwind&) {
+                throw; // fiber is being unwound, must not be swallowed
+            }
+            catch (const std::exception& ex) {
+                fprintf(stderr, "ERROR: PerCoreFiberPool: core %zd: task exception: %s\n",
+                        m_index, ex.what());
+            }
+            catch (...) {
+                fprintf(stderr, "ERROR: PerCoreFiberPool: core %zd: task unknown exception\n",
+                        m_index);
+            }
+        }).detach();
+    }
+
+    void flush_overflow() {
+        while (!m_overflow.empty()) {
+            auto& x = m_overflow.front();
+            if (!x.first->m_queue.try_push(x.second))
+                break;
+            m_overflow.pop_front();
+        }
+    }
+
+    void run() {
+        pin_self();
+        tls_core = this;
+        task_t fn;
+        for (;;) {
+            flush_overflow();
+            while (m_live < m_max_fibers && m_queue.try_pop(fn))
+                launch(std::move(fn));
+            if (m_live || !m_overflow.empty()) {
+                // task fibers run, main fiber polls the queue each round
+                boost::this_fiber::yield();
+                continue;
+            }
+            if (m_stop && m_queue.peekEmpty())
+                break;
+            if (m_queue.pop_front(fn, 10))
+                launch(std::move(fn));
+        }
+        tls_core = NULL;
+    }
+};
+
+PerCoreFiberPool::PerCoreFiberPool() {
+    start(Options());
+}
+
+PerCoreFiberPool::PerCoreFiberPool(const Options& opt) {
+    start(opt);
+}
+
+void PerCoreFiberPool::start(const Options& opt) {
+    TERARK_VERIFY_F(opt.stack_size >= 16*1024, "%zd", opt.stack_size);
+    TERARK_VERIFY_F(opt.fibers_per_core > 0, "%zd", opt.fibers_per_core);
+    m_pending = 0;
+    m_round_robin = 0;
+    valvec<int> cpus;
+#if BOOST_OS_LINUX
+    cpu_set_t cs;
+    CPU_ZERO(&cs);
+    if (sched_getaffinity(0, sizeof(cs), &cs) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+            if (CPU_ISSET(i, &cs))
+                cpus.push_back(i);
+    }
+#endif
+    if (cpus.empty()) {
+        size_t n = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+        for (size_t i = 0; i < n; ++i)
+            cpus.push_back(int(i));
+    }
+    size_t num = opt.cores ? opt.cores : cpus.size();
+    m_cores.reserve(num);
+    for (size_t i = 0; i < num; ++i) {
+        m_cores.emplace_back(new Core(this, i, cpus[i % cpus.size()], opt));
+    }
+    for (auto& c : m_cores) { // wait workers to know their nodes
+        while (-2 == c->m_node.load(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+}
+
+PerCoreFiberPool::~PerCoreFiberPool() {
+    wait_idle();
+    m_cores.clear();
+}
+
+int PerCoreFiberPool::core_cpu(size_t core) const {
+    return m_cores[core]->m_cpu;
+}
+
+int PerCoreFiberPool::core_node(size_t core) const {
+    return m_cores[core]->m_node.load(std::memory_order_relaxed);
+}
+
+bool PerCoreFiberPool::try_submit(size_t core, task_t& fn) {
+    Core* c = m_cores[core % m_cores.size()].get();
+    m_pending++;
+    if (c->m_queue.try_push(fn))
+        return true;
+    task_done();
+    return false;
+}
+
+void PerCoreFiberPool::submit(size_t core, task_t fn) {
+    Core* c = m_cores[core % m_cores.size()].get();
+    m_pending++;
+    if (tls_core) {
+        // a worker must not block its thread, keep order of the submitter
+        if (!tls_core->m_overflow.empty() || !c->m_queue.try_push(fn))
+            tls_core->m_overflow.emplace_back(c, std::move(fn));
+    }
+    else {
+        c->m_queue.push_back(fn);
+    }
+}
+
+void PerCoreFiberPool::submit(task_t fn) {
+    size_t core;
+    if (tls_core && tls_core->m_owner == this)
+        core = tls_core->m_index;
+    else
+        core = m_round_robin.fetch_add(1, std::memory_order_relaxed);
+    submit(core, std::move(fn));
+}
+
+void PerCoreFiberPool::task_done() {
+    if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(m_idle_mtx);
+        m_idle_cond.notify_all();
+    }
+}
+
+void PerCoreFiberPool::wait_idle() {
+    TERARK_VERIFY(NULL == tls_core || tls_core->m_owner != this);
+    std::unique_lock<std::mutex> lock(m_idle_mtx);
+    m_idle_cond.wait(lock, [this]{ return 0 == m_pending.load(); });
+}
+
+size_t PerCoreFiberPool::current_core() {
+    return tls_core ? tls_core->m_index : size_t(-1);
+}
+
+PerCoreFiberPool* PerCoreFiberPool::current_pool() {
+    return tls_core ? tls_core->m_owner : NULL;
+}
+
+} // namespace terark
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <terark/config.hpp>
+#include <terark/stdtypes.hpp>
+#include <terark/valvec.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace terark {
+
+/// multi core fiber runtime: one worker thread pinned on each cpu, each
+/// worker runs its own boost::fibers scheduler, a task runs in a fiber of
+/// the core it is submitted to.
+///
+///  - tasks are submitted to a core by a lock free queue from any thread,
+///    so work can be routed to the core which owns the data
+///  - fiber stacks are pooled per core, allocated and touched by the pinned
+///    worker and bound to its NUMA node, so stacks are node local
+///  - fiber_aio_read/write in tasks only switch fibers, not os threads
+///
+/// RunOnceFiberPool switches raw boost::context fibers, FiberYield used by
+/// fiber_aio and fiber_mutex can not switch away from them, so this pool
+/// is built on boost::fibers
+class TERARK_DLL_EXPORT PerCoreFiberPool {
+    DECLARE_NONE_MOVEABLE_CLASS(PerCoreFiberPool);
+public:
+    typedef std::function<void()> task_t;
+    struct Options {
+        size_t cores = 0;            ///< 0 for all cpus in affinity mask
+        size_t stack_size = 128*1024;
+        size_t fibers_per_core = 256;///< max living task fibers of a core
+        size_t queue_size = 4096;    ///< per core submission queue
+        bool   pin_cpu = true;       ///< pin worker to cpu and bind stacks
+    };
+    class Core;
+
+    PerCoreFiberPool();
+    explicit PerCoreFiberPool(const Options&);
+    ~PerCoreFiberPool(); ///< wait all tasks then stop workers
+
+    size_t cores() const { return m_cores.size(); }
+    int core_cpu(size_t core) const;
+    int core_node(size_t core) const; ///< -1 if unknown
+
+    /// run fn in a fiber of core, core is taken mod cores().
+    /// if queue is full, in a worker the task is kept by the calling core
+    /// and retried by it, in other threads it blocks the thread
+    void submit(size_t core, task_t fn);
+    bool try_submit(size_t core, task_t& fn); ///< false if queue is full
+
+    /// current core if called from a worker, else round robin
+    void submit(task_t fn);
+
+    /// block until all submitted tasks are finished, must not be called
+    /// in a worker
+    void wait_idle();
+
+    size_t pending() const { return m_pending.load(std::memory_order_relaxed); }
+
+    /// core index of calling thread in its pool, -1 if not a worker
+    static size_t current_core();
+    static PerCoreFiberPool* current_pool();
+
+private:
+    void task_done();
+    void start(const Options&);
+    std::vector<std::unique_ptr<Core> > m_cores;
+    std::atomic<size_t>     m_pending;
+    std::atomic<size_t>     m_round_robin;
+    std::mutex              m_idle_mtx;
+    std::condition_variable m_idle_cond;
+};
+
+} // namespace terark
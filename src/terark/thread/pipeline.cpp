@@ -9,14 +9,21 @@
 #include "pipeline.hpp"
 #include <terark/circular_queue.hpp>
 #include <terark/num_to_str.hpp>
+#include <terark/fstring.hpp>
 //#include <terark/util/compare.hpp>
 #include <terark/valvec.hpp>
 //#include <deque>
 //#include <boost/circular_buffer.hpp>
 #include <terark/util/atomic.hpp>
 #include <terark/util/concurrent_queue.hpp>
+#include <terark/util/mpmc_queue.hpp>
 #include <stdio.h>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 
 #include <boost/fiber/all.hpp>
 #include "fiber_yield.hpp"
@@ -48,6 +55,8 @@ namespace terark {
 
 using namespace std;
 
+static bool g_lockFreeQueue = getEnvBool("Terark_pipelineLockFreeQueue", false);
+
 PipelineTask::~PipelineTask()
 {
 	// do nothing...
@@ -87,6 +96,24 @@ public:
     size_t peekSize() const final { return q.peekSize(); }
 };
 
+class LockFreeQueue : public PipelineStage::queue_t {
+    util::mpmc_queue<PipelineQueueItem> q;
+public:
+	LockFreeQueue(size_t size) : q(std::max<size_t>(size, 2)) {}
+	void push_back(const PipelineQueueItem& x, FiberYield*) final {
+	    q.push_back(x);
+	}
+    bool push_back(const PipelineQueueItem& x, int timeout, FiberYield*) final {
+	    return q.push_back(x, timeout);
+	}
+    bool pop_front(PipelineQueueItem& x, int timeout, FiberYield*) final {
+        return q.pop_front(x, timeout);
+    }
+    bool empty() final {return q.empty(); }
+    size_t size() final { return q.size(); }
+    size_t peekSize() const final { return q.peekSize(); }
+};
+
 class FiberQueue : public PipelineStage::queue_t {
     circular_queue<PipelineQueueItem> q;
 public:
@@ -156,12 +183,17 @@ public:
 
 static
 PipelineStage::queue_t*
-NewQueue(PipelineProcessor::EUType euType, size_t size) {
-	switch (euType) {
+NewQueue(const PipelineProcessor& owner, size_t size) {
+	switch (owner.getEUType()) {
 	default: abort();
 	case PipelineProcessor::EUType::fiber : return new FiberQueue(size);
-	case PipelineProcessor::EUType::thread: return new BlockQueue(size);
+	case PipelineProcessor::EUType::thread:
+		if (owner.getLockFreeQueue())
+			return new LockFreeQueue(size);
+		else
+			return new BlockQueue(size);
 	case PipelineProcessor::EUType::mixed : return new MixedQueue(size);
+	case PipelineProcessor::EUType::steal : return new BlockQueue(size); // input feed
 	}
 }
 
@@ -273,7 +305,9 @@ PipelineStage::~PipelineStage()
 	delete m_out_queue;
 	for (size_t threadno = 0; threadno != m_threads.size(); ++threadno)
 	{
-		assert(!m_threads[threadno].m_thread->joinable());
+		// m_thread is NULL for EUType::steal
+		assert(NULL == m_threads[threadno].m_thread ||
+			  !m_threads[threadno].m_thread->joinable());
 	}
 }
 
@@ -290,7 +324,7 @@ size_t PipelineStage::getOutputQueueSize() const {
 void PipelineStage::createOutputQueue(size_t size) {
 	if (size > 0) {
 		assert(NULL == this->m_out_queue);
-		this->m_out_queue = NewQueue(m_owner->m_EUType, size);
+		this->m_out_queue = NewQueue(*m_owner, size);
 	}
 }
 
@@ -340,7 +374,7 @@ void PipelineStage::start(int queue_size)
 
 	if (this != m_owner->m_head->m_prev) { // is not last step
 		if (NULL == m_out_queue)
-			m_out_queue = NewQueue(euType, queue_size);
+			m_out_queue = NewQueue(*m_owner, queue_size);
 	}
 	if (m_step_name.empty()) {
 		m_step_name.reserve(15);
@@ -814,6 +848,321 @@ void FunPipelineStage::process(int threadno, PipelineQueueItem* task)
 
 //////////////////////////////////////////////////////////////////////////
 
+// EUType::steal: stages have no exec units and no queues between them, a
+// job is (stage, item), workers pop jobs from back of own deque, then from
+// front of the input deque, then steal from front of other workers' deques.
+// a job which outputs an item pushes the job of next stage to back of own
+// deque, so an item usually goes through the pipeline on one worker.
+//
+// threadno passed to process() is a slot of the stage, a stage has
+// thread_count slots, so at most thread_count workers run a stage, and
+// a threadno is never used concurrently. jobs which get no slot are parked
+// in the stage, the worker which releases a slot runs the parked jobs.
+//
+// keepSerial stages reorder items by plserial in a heap, and the worker
+// which finds the expected item drains the heap by slot 0.
+//
+// there are min(sum of thread_count, cpu count) workers, producers (enqueue
+// or the generator stage) are blocked when items in the pipeline exceeds
+// queue_size * total_steps, workers never block.
+class PipelineProcessor::StealPool {
+	struct Job {
+		PipelineStage* stage;
+		PipelineQueueItem item;
+	};
+	struct Worker {
+		std::mutex mtx;
+		std::deque<Job> jobs;
+		std::thread thr;
+	};
+	struct StageState {
+		PipelineStage* stage;
+		std::mutex mtx;
+		valvec<int> freeSlots;
+		std::deque<PipelineQueueItem> parked;
+		valvec<PipelineQueueItem> heap; // for ple_keep
+		uintptr_t expect = 1;           // for ple_keep
+		bool draining = false;          // for ple_keep
+		std::atomic<bool> failed{false}; // runOne() is out of mtx
+	};
+	PipelineProcessor* m_owner;
+	std::unique_ptr<Worker[]> m_workers;
+	size_t m_workerNum;
+	std::unique_ptr<StageState[]> m_stages;
+	std::thread m_source; // generator stage, when not compile()'ed
+	std::mutex m_inputMtx;
+	std::deque<Job> m_input;
+	std::mutex m_mtx;
+	std::condition_variable m_workCond;
+	std::condition_variable m_spaceCond;
+	std::atomic<size_t> m_queued;   // jobs in deques
+	std::atomic<size_t> m_inflight; // items in pipeline
+	std::atomic<int> m_sleepers;
+	std::atomic<int> m_sourceLive;
+	size_t m_maxInflight;
+
+	StageState& state(PipelineStage* stage) {
+		return m_stages[stage->step_ordinal()];
+	}
+	void notifyWork() {
+		if (m_sleepers.load(std::memory_order_acquire)) {
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_workCond.notify_one();
+		}
+	}
+	void pushLocal(size_t wi, const Job& job) {
+		Worker& w = m_workers[wi];
+		{
+			std::lock_guard<std::mutex> lock(w.mtx);
+			w.jobs.push_back(job);
+		}
+		m_queued++;
+		notifyWork();
+	}
+	bool popJob(size_t wi, Job* job) {
+		{
+			Worker& w = m_workers[wi];
+			std::lock_guard<std::mutex> lock(w.mtx);
+			if (!w.jobs.empty()) {
+				*job = w.jobs.back();
+				w.jobs.pop_back();
+				m_queued--;
+				return true;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_inputMtx);
+			if (!m_input.empty()) {
+				*job = m_input.front();
+				m_input.pop_front();
+				m_queued--;
+				return true;
+			}
+		}
+		for (size_t i = 1; i < m_workerNum; ++i) {
+			Worker& v = m_workers[(wi + i) % m_workerNum];
+			std::lock_guard<std::mutex> lock(v.mtx);
+			if (!v.jobs.empty()) {
+				*job = v.jobs.front();
+				v.jobs.pop_front();
+				m_queued--;
+				return true;
+			}
+		}
+		return false;
+	}
+	void finishOne() {
+		if (m_inflight.fetch_sub(1) == m_maxInflight) {
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_spaceCond.notify_all();
+		}
+	}
+	void forward(size_t wi, PipelineStage* stage, const PipelineQueueItem& item) {
+		PipelineProcessor* owner = m_owner;
+		if (stage == owner->m_head->m_prev) { // last stage
+			if (item.task)
+				owner->destroyTask(item.task);
+			finishOne();
+		}
+		else if (item.task || owner->m_keepSerial) {
+			pushLocal(wi, Job{stage->m_next, item});
+		}
+		else {
+			finishOne();
+		}
+	}
+	void runOne(size_t wi, StageState& st, int threadno, PipelineQueueItem& item) {
+		PipelineStage* stage = st.stage;
+		if (PipelineStage::ple_generate == stage->m_pl_enum)
+			item.plserial = ++stage->m_plserial; // only 1 slot
+		if (item.task) {
+			if (st.failed.load(std::memory_order_relaxed)) {
+				m_owner->destroyTask(item.task);
+				item.task = NULL;
+			}
+			else try {
+				stage->process(threadno, &item);
+			}
+			catch (const std::exception& exp) {
+				stage->onException(threadno, exp);
+				st.failed.store(true, std::memory_order_relaxed);
+				m_owner->stop();
+				if (item.task) {
+					m_owner->destroyTask(item.task);
+					item.task = NULL;
+				}
+			}
+		}
+		forward(wi, stage, item);
+	}
+	void runJob(size_t wi, Job& job) {
+		StageState& st = state(job.stage);
+		if (PipelineStage::ple_keep == job.stage->m_pl_enum) {
+			std::unique_lock<std::mutex> lock(st.mtx);
+			st.heap.push_back(job.item);
+			std::push_heap(st.heap.begin(), st.heap.end(), plserial_greater());
+			if (st.draining)
+				return;
+			st.draining = true;
+			while (!st.heap.empty() && st.heap[0].plserial == st.expect) {
+				PipelineQueueItem item = st.heap[0];
+				std::pop_heap(st.heap.begin(), st.heap.end(), plserial_greater());
+				st.heap.pop_back();
+				st.expect++;
+				lock.unlock();
+				runOne(wi, st, 0, item);
+				lock.lock();
+			}
+			st.draining = false;
+			return;
+		}
+		int threadno;
+		{
+			std::lock_guard<std::mutex> lock(st.mtx);
+			if (st.freeSlots.empty()) {
+				st.parked.push_back(job.item);
+				return;
+			}
+			threadno = st.freeSlots.pop_val();
+		}
+		PipelineQueueItem item = job.item;
+		for (;;) {
+			runOne(wi, st, threadno, item);
+			std::lock_guard<std::mutex> lock(st.mtx);
+			if (st.parked.empty()) {
+				st.freeSlots.push_back(threadno);
+				break;
+			}
+			item = st.parked.front();
+			st.parked.pop_front();
+		}
+	}
+	bool isDone() const {
+		return !m_owner->m_run && 0 == m_sourceLive && 0 == m_inflight;
+	}
+	void workerProc(size_t wi) {
+		const auto timeout = std::chrono::milliseconds(m_owner->m_queue_timeout);
+		Job job;
+		for (;;) {
+			if (popJob(wi, &job)) {
+				runJob(wi, job);
+				continue;
+			}
+			if (isDone())
+				break;
+			std::unique_lock<std::mutex> lock(m_mtx);
+			m_sleepers++;
+			if (0 == m_queued)
+				m_workCond.wait_for(lock, timeout);
+			m_sleepers--;
+		}
+	}
+	void sourceProc(PipelineStage* stage) {
+		while (m_owner->m_run) {
+			PipelineQueueItem item;
+			try {
+				stage->process(0, &item);
+			}
+			catch (const std::exception& exp) {
+				stage->onException(0, exp);
+				m_owner->stop();
+				if (item.task) {
+					m_owner->destroyTask(item.task);
+					item.task = NULL;
+				}
+			}
+			if (item.task) {
+				if (PipelineStage::ple_generate == stage->m_pl_enum)
+					item.plserial = ++stage->m_plserial;
+				input(stage->m_next, item);
+			}
+		}
+		m_sourceLive--;
+	}
+
+public:
+	explicit StealPool(PipelineProcessor* owner) : m_owner(owner) {
+		const bool selfDriven = NULL == owner->m_head->m_out_queue;
+		const int steps = owner->total_steps();
+		size_t workers = 0;
+		m_stages.reset(new StageState[steps]);
+		int nth = 0;
+		for (PipelineStage* s = owner->m_head->m_next; s != owner->m_head; s = s->m_next, nth++) {
+			StageState& st = m_stages[nth];
+			st.stage = s;
+			for (int i = int(s->m_threads.size()); i > 0; --i)
+				st.freeSlots.push_back(i - 1);
+			if (!(selfDriven && 0 == nth))
+				workers += s->m_threads.size();
+		}
+		// need not more workers than cpus, a worker can run any stage
+		workers = std::min<size_t>(workers, std::max(sysCpuCount(), 1));
+		m_workerNum = std::max<size_t>(workers, 1);
+		m_workers.reset(new Worker[m_workerNum]);
+		m_queued = 0;
+		m_inflight = 0;
+		m_sleepers = 0;
+		m_sourceLive = selfDriven ? 1 : 0;
+		m_maxInflight = std::max<size_t>(owner->m_queue_size, 1) * steps;
+	}
+	~StealPool() {
+		assert(!m_source.joinable());
+		for (size_t i = 0; i < m_workerNum; ++i)
+			assert(!m_workers[i].thr.joinable());
+	}
+	void start() {
+		PipelineProcessor* owner = m_owner;
+		for (PipelineStage* s = owner->m_head->m_next; s != owner->m_head; s = s->m_next) {
+			for (size_t i = 0; i < s->m_threads.size(); ++i)
+				s->setup(int(i));
+		}
+		for (size_t i = 0; i < m_workerNum; ++i)
+			m_workers[i].thr = std::thread(&StealPool::workerProc, this, i);
+		if (m_sourceLive)
+			m_source = std::thread(&StealPool::sourceProc, this, owner->m_head->m_next);
+	}
+	size_t inflight() const { return m_inflight; }
+	/// wait for room, then feed item to stage
+	void input(PipelineStage* stage, const PipelineQueueItem& item) {
+		if (m_inflight.load(std::memory_order_relaxed) >= m_maxInflight) {
+			const auto timeout = std::chrono::milliseconds(m_owner->m_queue_timeout);
+			std::unique_lock<std::mutex> lock(m_mtx);
+			while (m_inflight >= m_maxInflight) {
+				if (!m_spaceCond.wait_for(lock, timeout, [this]{
+						return m_inflight < m_maxInflight; })
+					&& m_owner->m_logLevel >= 3) {
+					fprintf(stderr, "Pipeline: steal input: wait push timeout, serial = %lld, retry ...\n",
+							(llong)item.plserial);
+				}
+			}
+		}
+		m_inflight++;
+		{
+			std::lock_guard<std::mutex> lock(m_inputMtx);
+			m_input.push_back(Job{stage, item});
+		}
+		m_queued++;
+		notifyWork();
+	}
+	void wait() {
+		if (m_source.joinable())
+			m_source.join();
+		for (size_t i = 0; i < m_workerNum; ++i) {
+			if (m_workers[i].thr.joinable())
+				m_workers[i].thr.join();
+		}
+		PipelineProcessor* owner = m_owner;
+		int nth = 0;
+		for (PipelineStage* s = owner->m_head->m_next; s != owner->m_head; s = s->m_next, nth++) {
+			// all items are done, no item is held in reorder heap
+			assert(m_stages[nth].heap.empty());
+			assert(m_stages[nth].parked.empty());
+			for (size_t i = 0; i < s->m_threads.size(); ++i)
+				s->clean(int(i));
+		}
+	}
+};
+
 class Null_PipelineStage : public PipelineStage
 {
 public:
@@ -849,15 +1198,18 @@ PipelineProcessor::PipelineProcessor()
 	m_mutex = NULL;
 	m_is_mutex_owner = false;
 	m_keepSerial = false;
+	m_lockFreeQueue = g_lockFreeQueue;
 	m_run = false;
 	m_logLevel = 1;
 	m_EUType = EUType::thread;
+	m_stealPool = NULL;
 }
 
 PipelineProcessor::~PipelineProcessor()
 {
 	clear();
 
+	delete m_stealPool;
 	delete m_head;
 	if (m_is_mutex_owner)
 		delete m_mutex;
@@ -882,13 +1234,14 @@ void PipelineProcessor::setMutex(mutex* pmutex)
 }
 
 const char* PipelineProcessor::euTypeName() const {
-	if (m_EUType > EUType::mixed) {
+	if (m_EUType > EUType::steal) {
 		return "invalid";
 	}
 	const char* names[] = {
 			"thread",
 			"fiber",
 			"mixed",
+			"steal",
 	};
 	return names[int(m_EUType)];
 }
@@ -896,6 +1249,10 @@ const char* PipelineProcessor::euTypeName() const {
 std::string PipelineProcessor::queueInfo()
 {
 	string_appender<> oss;
+	if (m_stealPool) {
+		oss << "Inflight: " << m_stealPool->inflight();
+		return std::move(oss);
+	}
 	const PipelineStage* p = m_head->m_next;
 	oss << "QueueSize: ";
 	while (p != m_head->m_prev) {
@@ -975,6 +1332,12 @@ void PipelineProcessor::start()
 	if (-1 != plkeep)
 		this->m_keepSerial = true;
 
+	if (EUType::steal == m_EUType) {
+		TERARK_RT_assert(NULL == m_stealPool, std::invalid_argument);
+		m_stealPool = new StealPool(this);
+		m_stealPool->start();
+		return;
+	}
 	for (PipelineStage* s = m_head->m_next; s != m_head; s = s->m_next)
 		s->start(m_queue_size);
 }
@@ -1001,7 +1364,7 @@ void PipelineProcessor::compile(int input_feed_queue_size)
 		}
 	}
 // End check for double start
-	m_head->m_out_queue = NewQueue(m_EUType, input_feed_queue_size);
+	m_head->m_out_queue = NewQueue(*this, input_feed_queue_size);
 	start();
 }
 
@@ -1019,6 +1382,10 @@ void PipelineProcessor::enqueue(PipelineTask* task)
 void PipelineProcessor::enqueue_impl(PipelineTask* task) {
     FiberYield fy;
 	PipelineQueueItem item(++m_head->m_plserial, task);
+    if (m_stealPool) {
+        m_stealPool->input(m_head->m_next, item);
+        return;
+    }
     if (m_logLevel >= 3) {
         while (!m_head->m_out_queue->push_back(item, m_queue_timeout, &fy)) {
             fprintf(stderr,
@@ -1044,7 +1411,12 @@ void PipelineProcessor::enqueue_impl(PipelineTask** tasks, size_t num) {
     FiberYield fy;
 	uintptr_t plserial = m_head->m_plserial;
 	auto queue = m_head->m_out_queue;
-    if (m_logLevel >= 3) {
+    if (m_stealPool) {
+        for (size_t i = 0; i < num; ++i) {
+            m_stealPool->input(m_head->m_next, PipelineQueueItem(++plserial, tasks[i]));
+        }
+    }
+    else if (m_logLevel >= 3) {
         for (size_t i = 0; i < num; ++i) {
             PipelineQueueItem item(++plserial, tasks[i]);
             while (!queue->push_back(item, m_queue_timeout, &fy)) {
@@ -1067,6 +1439,12 @@ void PipelineProcessor::wait()
 	if (NULL != m_head->m_out_queue) {
 		assert(!this->m_run); // user must call stop() before wait
 	}
+	if (m_stealPool) {
+		m_stealPool->wait();
+		delete m_stealPool;
+		m_stealPool = NULL;
+		return;
+	}
 	for (PipelineStage* s = m_head->m_next; s != m_head; s = s->m_next)
 		s->wait();
 }
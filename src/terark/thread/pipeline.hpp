@@ -166,9 +166,12 @@ public:
 		thread,
 		fiber,
 		mixed,
+		steal, // all stages share a work stealing thread pool
 	};
+	class StealPool;
 private:
 	friend class PipelineStage;
+	friend class StealPool;
 
 	PipelineStage *m_head;
 	int m_queue_size;
@@ -179,8 +182,10 @@ private:
 	volatile size_t m_run; // size_t is CPU word, should be bool
 	bool m_is_mutex_owner;
 	bool m_keepSerial;
+	bool m_lockFreeQueue;
 	signed char m_logLevel;
 	EUType m_EUType;
+	StealPool* m_stealPool;
 
 protected:
 	static void defaultDestroyTask(PipelineTask* task);
@@ -209,6 +214,11 @@ public:
 
 	const char* euTypeName() const;
 
+	/// use util::mpmc_queue between stages, only for EUType::thread,
+	/// default is env Terark_pipelineLockFreeQueue
+	void setLockFreeQueue(bool val) { m_lockFreeQueue = val; }
+	bool getLockFreeQueue() const { return m_lockFreeQueue; }
+
 	void setQueueSize(int queue_size) { m_queue_size = queue_size; }
 	int  getQueueSize() const { return m_queue_size; }
 	void setQueueTimeout(int queue_timeout) { m_queue_timeout = queue_timeout; }
@@ -1,4 +1,8 @@
 #include "crc.hpp"
+#include <terark/valvec.hpp>
+#include <algorithm>
+#include <thread>
+#include <vector>
 
 #if defined(__GNUC__) && __GNUC__ * 1000 + __GNUC_MINOR__ >= 4005 || defined(__clang__)
   #if defined(__amd64__) || defined(__amd64) || \
@@ -669,6 +673,116 @@ uint32_t crc32c_sse42(uint32_t running_crc, const unsigned char* p_buf,
 }
 #endif
 
+// GF(2) arithmetic modulo the reflected crc32c polynomial, bit 31 is x^0,
+// derived from zlib's crc32_combine
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+
+static uint32_t crc32c_multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = uint32_t(1) << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^(2^k) mod p for k in [0, 32)
+struct Crc32cX2nTable {
+    uint32_t tab[32];
+    Crc32cX2nTable() {
+        uint32_t p = uint32_t(1) << 30; // x^1
+        tab[0] = p;
+        for (int k = 1; k < 32; k++)
+            tab[k] = p = crc32c_multmodp(p, p);
+    }
+};
+// function local static, Crc32c_update may be called in static init of
+// other modules
+static const Crc32cX2nTable& crc32c_x2n() {
+    static const Crc32cX2nTable tab;
+    return tab;
+}
+
+// x^(n * 2^k) mod p
+static uint32_t crc32c_x2nmodp(uint64_t n, unsigned k) {
+    const uint32_t* tab = crc32c_x2n().tab;
+    uint32_t p = uint32_t(1) << 31; // x^0
+    while (n) {
+        if (n & 1)
+            p = crc32c_multmodp(tab[k & 31], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+#if defined(__SSE4_2__) && defined(__PCLMUL__) && TERARK_WORD_BITS == 64
+
+// crc32 instruction has 3 cycle latency and 1 cycle throughput, so 3
+// independent streams keep the pipeline full, stream crcs are combined by
+// one carry-less multiply and one crc32 instruction per stream
+static const size_t CRC32C_LONG  = 8192; // bytes per stream
+static const size_t CRC32C_SHORT = 256;
+
+struct Crc32cShiftConst {
+    uint64_t k_long, k_short;
+    Crc32cShiftConst() {
+        // clmul of 2 reflected 32 bit values is multiplied by x, and
+        // crc32_u64(0, v) multiplies by x^32, so shift n bytes is x^(8n-33)
+        k_long  = crc32c_x2nmodp(8 * CRC32C_LONG  - 33, 0);
+        k_short = crc32c_x2nmodp(8 * CRC32C_SHORT - 33, 0);
+    }
+};
+
+// crc * x^(8n) mod p, n is implied by k
+static really_inline uint32_t crc32c_shift_clmul(uint32_t crc, uint64_t k) {
+    __m128i t = _mm_clmulepi64_si128(_mm_cvtsi32_si128(int(crc)),
+                                     _mm_cvtsi64_si128(llong(k)), 0);
+    return uint32_t(_mm_crc32_u64(0, uint64_t(_mm_cvtsi128_si64(t))));
+}
+
+template<size_t Len>
+static really_inline
+uint32_t crc32c_3way_block(uint32_t crc0, const unsigned char* p, uint64_t k) {
+    uint64_t c0 = crc0, c1 = 0, c2 = 0;
+    for (size_t i = 0; i < Len; i += 8) {
+        c0 = _mm_crc32_u64(c0, *(const uint64_t*)(p + i));
+        c1 = _mm_crc32_u64(c1, *(const uint64_t*)(p + i + Len));
+        c2 = _mm_crc32_u64(c2, *(const uint64_t*)(p + i + Len * 2));
+    }
+    uint32_t crc = crc32c_shift_clmul(uint32_t(c0), k) ^ uint32_t(c1);
+    return crc32c_shift_clmul(crc, k) ^ uint32_t(c2);
+}
+
+static
+uint32_t crc32c_sse42_3way(uint32_t crc, const unsigned char* p_buf,
+                           size_t length) {
+    if (length < 3 * CRC32C_SHORT)
+        return crc32c_sse42(crc, p_buf, length);
+    static const Crc32cShiftConst k;
+    const unsigned char *aligned_buf = (const unsigned char *)ROUNDUP_PTR(p_buf, 8);
+    while (p_buf < aligned_buf) {
+        crc = _mm_crc32_u8(crc, *p_buf++);
+        length--;
+    }
+    for (; length >= 3 * CRC32C_LONG; length -= 3 * CRC32C_LONG) {
+        crc = crc32c_3way_block<CRC32C_LONG>(crc, p_buf, k.k_long);
+        p_buf += 3 * CRC32C_LONG;
+    }
+    for (; length >= 3 * CRC32C_SHORT; length -= 3 * CRC32C_SHORT) {
+        crc = crc32c_3way_block<CRC32C_SHORT>(crc, p_buf, k.k_short);
+        p_buf += 3 * CRC32C_SHORT;
+    }
+    return crc32c_sse42(crc, p_buf, length);
+}
+
+#endif // __SSE4_2__ && __PCLMUL__
+
 } // namespace terark
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -679,7 +793,9 @@ uint32_t crc32c_sse42(uint32_t running_crc, const unsigned char* p_buf,
 namespace terark {
 // Externally visible function
 uint32_t Crc32c_update(uint32_t inCrc32, const void *buf, size_t bufLen) {
-#ifdef __SSE4_2__
+#if defined(__SSE4_2__) && defined(__PCLMUL__) && TERARK_WORD_BITS == 64
+    uint32_t crc = crc32c_sse42_3way(inCrc32, (const unsigned char *)buf, bufLen);
+#elif defined(__SSE4_2__)
     uint32_t crc = crc32c_sse42(inCrc32, (const unsigned char *)buf, bufLen);
 #else
     uint32_t crc = crc32c_sb8_64_bit(inCrc32, (const unsigned char *)buf, bufLen);
@@ -692,6 +808,41 @@ uint32_t Crc32c_update(uint32_t inCrc32, const void *buf, size_t bufLen) {
     return crc;
 }
 
+uint32_t Crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+    return crc32c_multmodp(crc32c_x2nmodp(len2, 3), crc1) ^ crc2;
+}
+
+uint32_t Crc32c_update_parallel(uint32_t inCrc32, const void *buf,
+                                size_t bufLen, size_t threads) {
+    const size_t MinChunk = size_t(4) << 20;
+    if (0 == threads) {
+        threads = std::min<size_t>(std::thread::hardware_concurrency(), 8);
+    }
+    threads = std::min(threads, bufLen / MinChunk);
+    if (threads <= 1) {
+        return Crc32c_update(inCrc32, buf, bufLen);
+    }
+    const size_t chunk = (bufLen + threads - 1) / threads;
+    auto pBuf = (const byte_t*)buf;
+    valvec<uint32_t> crcs(threads, valvec_no_init());
+    std::vector<std::thread> thr;
+    thr.reserve(threads - 1);
+    for (size_t i = 1; i < threads; ++i) {
+        size_t beg = chunk * i, len = std::min(chunk, bufLen - beg);
+        thr.emplace_back([&crcs,pBuf,i,beg,len]() {
+            crcs[i] = Crc32c_update(0, pBuf + beg, len);
+        });
+    }
+    uint32_t crc = Crc32c_update(inCrc32, pBuf, chunk);
+    for (auto& t : thr) {
+        t.join();
+    }
+    for (size_t i = 1; i < threads; ++i) {
+        crc = Crc32c_combine(crc, crcs[i], std::min(chunk, bufLen - chunk * i));
+    }
+    return crc;
+}
+
 /* CRC16 implementation according to CCITT standards.
  *
  * Note by @antirez: this is actually the XMODEM CRC 16 algorithm, using the
@@ -8,6 +8,18 @@ namespace terark {
 TERARK_DLL_EXPORT
 uint32_t Crc32c_update(uint32_t inCrc32, const void *buf, size_t bufLen);
 
+/// crc of concatenation A+B, crc1 is crc of A, crc2 is Crc32c_update(0, B)
+/// and len2 is length of B
+TERARK_DLL_EXPORT
+uint32_t Crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+/// same as Crc32c_update, buf is split into chunks which are computed
+/// on multiple threads and then combined, for verifying large mmap regions
+/// @param threads 0 for auto
+TERARK_DLL_EXPORT
+uint32_t Crc32c_update_parallel(uint32_t inCrc32, const void *buf,
+                                size_t bufLen, size_t threads = 0);
+
 TERARK_DLL_EXPORT
 uint16_t Crc16c_update(uint16_t inCrc16, const void *buf, size_t bufLen);
 
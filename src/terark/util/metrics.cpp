@@ -0,0 +1,167 @@
+#include "metrics.hpp"
+#include <terark/fstring.hpp>
+#include <terark/bitmanip.hpp>
+#include <mutex>
+#include <vector>
+#include <string.h>
+
+namespace terark {
+
+bool g_enableMetrics = getEnvBool("Terark_enableMetrics", false);
+
+namespace {
+
+struct MetricsShard {
+    std::atomic<uint64_t> count[Metrics::kMetricsNum];
+    std::atomic<uint64_t> sum[Metrics::kMetricsNum];
+    std::atomic<uint64_t> buckets[Metrics::kMetricsNum][Metrics::kBuckets];
+
+    MetricsShard() { clear(); }
+    void clear() {
+        for (size_t i = 0; i < Metrics::kMetricsNum; ++i) {
+            count[i].store(0, std::memory_order_relaxed);
+            sum[i].store(0, std::memory_order_relaxed);
+            for (size_t j = 0; j < Metrics::kBuckets; ++j)
+                buckets[i][j].store(0, std::memory_order_relaxed);
+        }
+    }
+    // only owner thread writes, so plain load + store is enough
+    static void bump(std::atomic<uint64_t>& x, uint64_t n) {
+        x.store(x.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void add_to(Metrics::Snapshot& s) const {
+        for (size_t i = 0; i < Metrics::kMetricsNum; ++i) {
+            Metrics::Item& it = s.items[i];
+            it.count += count[i].load(std::memory_order_relaxed);
+            it.sum += sum[i].load(std::memory_order_relaxed);
+            for (size_t j = 0; j < Metrics::kBuckets; ++j)
+                it.buckets[j] += buckets[i][j].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+struct MetricsRegistry {
+    std::mutex mtx;
+    std::vector<MetricsShard*> live;
+    Metrics::Snapshot retired; // sum of exited threads
+    MetricsRegistry() { memset(&retired, 0, sizeof(retired)); }
+};
+
+// never destroyed, thread_local dtors may run after static dtors
+MetricsRegistry& registry() {
+    static MetricsRegistry* r = new MetricsRegistry;
+    return *r;
+}
+
+struct MetricsShardHolder {
+    MetricsShard* shard;
+    MetricsShardHolder() {
+        shard = new MetricsShard;
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.mtx);
+        r.live.push_back(shard);
+    }
+    ~MetricsShardHolder() {
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.mtx);
+        shard->add_to(r.retired);
+        for (size_t i = 0; i < r.live.size(); ++i) {
+            if (r.live[i] == shard) {
+                r.live[i] = r.live.back();
+                r.live.pop_back();
+                break;
+            }
+        }
+        delete shard;
+    }
+};
+
+MetricsShard& tls_shard() {
+    static thread_local MetricsShardHolder holder;
+    return *holder.shard;
+}
+
+} // namespace
+
+const char* Metrics::name(Id id) {
+    switch (id) {
+    case kBlobStoreGetRecord:   return "blob_store.get_record";
+    case kBlobStorePreadRecord: return "blob_store.pread_record";
+    case kEntropyDecode:        return "entropy.decode";
+    case kIndexFind:            return "index.find";
+    case kIndexDictRank:        return "index.dict_rank";
+    case kCacheHit:             return "cache.hit";
+    case kCacheMiss:            return "cache.miss";
+    case kCycleOffsetDecode:    return "cycles.offset_decode";
+    case kCycleCopy:            return "cycles.copy";
+    case kCycleChecksum:        return "cycles.checksum";
+    case kCycleEntropyDecode:   return "cycles.entropy_decode";
+    case kCycleDictExpand:      return "cycles.dict_expand";
+    case kCycleIndexDescent:    return "cycles.index_descent";
+    case kCycleSuffixDecode:    return "cycles.suffix_decode";
+    default:                    return "unknown";
+    }
+}
+
+void Metrics::add(Id id, uint64_t value) {
+    MetricsShard& s = tls_shard();
+    size_t b = value ? std::min<size_t>(terark_bsr_u64(value) + 1, kBuckets - 1) : 0;
+    MetricsShard::bump(s.count[id], 1);
+    MetricsShard::bump(s.sum[id], value);
+    MetricsShard::bump(s.buckets[id][b], 1);
+}
+
+void Metrics::inc(Id id, uint64_t n) {
+    MetricsShard::bump(tls_shard().count[id], n);
+}
+
+Metrics::Snapshot Metrics::snapshot() {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    Snapshot s = r.retired;
+    for (MetricsShard* shard : r.live)
+        shard->add_to(s);
+    return s;
+}
+
+/// counters of running threads are cleared by a racy store, an increment
+/// concurrent with reset may be lost or kept
+void Metrics::reset() {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    memset(&r.retired, 0, sizeof(r.retired));
+    for (MetricsShard* shard : r.live)
+        shard->clear();
+}
+
+uint64_t Metrics::Item::percentile(double q) const {
+    if (0 == count)
+        return 0;
+    uint64_t rank = uint64_t(q * count);
+    uint64_t acc = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        acc += buckets[i];
+        if (acc > rank)
+            return i ? uint64_t(1) << std::min<size_t>(i, 63) : 0;
+    }
+    return uint64_t(-1);
+}
+
+void Metrics::Snapshot::print(FILE* fp) const {
+    for (size_t i = 0; i < kMetricsNum; ++i) {
+        const Item& it = items[i];
+        if (0 == it.count)
+            continue;
+        if (0 == it.sum) { // counter
+            fprintf(fp, "%-24s count = %llu\n", name(Id(i)), ullong(it.count));
+        } else {
+            fprintf(fp,
+                "%-24s count = %llu, avg = %.1f, p50 < %llu, p99 < %llu, p999 < %llu\n",
+                name(Id(i)), ullong(it.count), it.avg(),
+                ullong(it.percentile(0.50)), ullong(it.percentile(0.99)),
+                ullong(it.percentile(0.999)));
+        }
+    }
+}
+
+} // namespace terark
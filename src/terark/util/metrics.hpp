@@ -0,0 +1,156 @@
+#pragma once
+
+#include <terark/config.hpp>
+#include <terark/preproc.hpp>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+// compile time switch, runtime switch is Metrics::enable() or env
+// Terark_enableMetrics, which is off by default
+#if !defined(TERARK_ENABLE_METRICS)
+  #define TERARK_ENABLE_METRICS 1
+#endif
+
+// cycle attribution of hot path components, each probe is an rdtsc plus a
+// shard update, so it is compiled out by default, and also needs the
+// runtime switch of metrics
+#if !defined(TERARK_ENABLE_CYCLE_PROFILE)
+  #define TERARK_ENABLE_CYCLE_PROFILE 0
+#endif
+
+namespace terark {
+
+/// cpu timestamp counter, cheap enough to attribute sub-microsecond
+/// code sections, it is nanoseconds where rdtsc is not available
+inline unsigned long long cpu_cycles() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+            steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+TERARK_DLL_EXPORT extern bool g_enableMetrics;
+
+/// process wide read path metrics, each thread writes its own shard without
+/// atomic rmw, snapshot() sums all shards
+class TERARK_DLL_EXPORT Metrics {
+public:
+    enum Id : uint8_t {
+        kBlobStoreGetRecord,   // latency ns
+        kBlobStorePreadRecord, // latency ns
+        kEntropyDecode,        // latency ns, including dict unzip
+        kIndexFind,            // latency ns
+        kIndexDictRank,        // latency ns
+        kCacheHit,             // counter
+        kCacheMiss,            // counter
+        kCycleOffsetDecode,    // cycles, DictZipBlobStore record offsets
+        kCycleCopy,            // cycles, fetch zipped data: mmap or pread
+        kCycleChecksum,        // cycles, per record crc
+        kCycleEntropyDecode,   // cycles, huffman/fse, excluding dict unzip
+        kCycleDictExpand,      // cycles, dict match expansion (m_unzip)
+        kCycleIndexDescent,    // cycles, TerarkIndex prefix (LOUDS) search
+        kCycleSuffixDecode,    // cycles, TerarkIndex suffix search/decode
+        kMetricsNum
+    };
+    /// bucket[0] is value 0, bucket[i] is value in [2^(i-1), 2^i)
+    static const size_t kBuckets = 64;
+    struct TERARK_DLL_EXPORT Item {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t buckets[kBuckets];
+        double   avg() const { return count ? double(sum) / count : 0; }
+        /// upper bound of the bucket which holds quantile q in [0, 1]
+        uint64_t percentile(double q) const;
+    };
+    struct TERARK_DLL_EXPORT Snapshot {
+        Item items[kMetricsNum];
+        const Item& operator[](Id id) const { return items[id]; }
+        void print(FILE*) const;
+    };
+    static const char* name(Id);
+
+    static bool enabled() { return g_enableMetrics; }
+    static void enable(bool val) { g_enableMetrics = val; }
+
+    /// latency or size, also counts
+    static void add(Id, uint64_t value);
+    /// counter only
+    static void inc(Id, uint64_t n = 1);
+    static Snapshot snapshot();
+    static void reset();
+
+    static uint64_t now_ns() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(
+                steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+class CycleTimer {
+    Metrics::Id m_id;
+    uint64_t    m_start;
+public:
+    explicit CycleTimer(Metrics::Id id) : m_id(id) {
+        m_start = Metrics::enabled() ? cpu_cycles() : 0;
+    }
+    ~CycleTimer() {
+        if (m_start)
+            Metrics::add(m_id, cpu_cycles() - m_start);
+    }
+};
+
+class MetricsTimer {
+    Metrics::Id m_id;
+    uint64_t    m_start;
+public:
+    explicit MetricsTimer(Metrics::Id id) : m_id(id) {
+        m_start = Metrics::enabled() ? Metrics::now_ns() : 0;
+    }
+    ~MetricsTimer() {
+        if (m_start)
+            Metrics::add(m_id, Metrics::now_ns() - m_start);
+    }
+};
+
+} // namespace terark
+
+#if TERARK_ENABLE_METRICS
+  #define TERARK_METRICS_TIMER(id) \
+    terark::MetricsTimer TERARK_PP_CAT2(terark_metrics_timer_, __LINE__)(terark::Metrics::id)
+  #define TERARK_METRICS_INC(id) \
+    do { if (terark::Metrics::enabled()) terark::Metrics::inc(terark::Metrics::id); } while (0)
+#else
+  #define TERARK_METRICS_TIMER(id)
+  #define TERARK_METRICS_INC(id) do {} while (0)
+#endif
+
+// TERARK_CYCLE_SCOPE(id) attributes cycles to end of scope, for sequential
+// sections, TERARK_CYCLE_START(tsc) then TERARK_CYCLE_LAP(tsc, id) after
+// each section attributes cycles since previous lap
+#if TERARK_ENABLE_METRICS && TERARK_ENABLE_CYCLE_PROFILE
+  #define TERARK_CYCLE_SCOPE(id) \
+    terark::CycleTimer TERARK_PP_CAT2(terark_cycle_timer_, __LINE__)(terark::Metrics::id)
+  #define TERARK_CYCLE_START(tsc) \
+    uint64_t tsc = terark::Metrics::enabled() ? terark::cpu_cycles() : 0
+  #define TERARK_CYCLE_LAP(tsc, id) \
+    do { if (tsc) { \
+      uint64_t terark_cycle_now_ = terark::cpu_cycles(); \
+      terark::Metrics::add(terark::Metrics::id, terark_cycle_now_ - tsc); \
+      tsc = terark_cycle_now_; \
+    } } while (0)
+#else
+  #define TERARK_CYCLE_SCOPE(id)
+  #define TERARK_CYCLE_START(tsc)
+  #define TERARK_CYCLE_LAP(tsc, id) do {} while (0)
+#endif
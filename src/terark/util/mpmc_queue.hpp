@@ -0,0 +1,222 @@
+/* vim: set tabstop=4 : */
+#ifndef __terark_mpmc_queue_hpp__
+#define __terark_mpmc_queue_hpp__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+# pragma once
+#endif
+
+#include <terark/config.hpp>
+#include <terark/stdtypes.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#include <immintrin.h>
+	#define TERARK_MPMC_CPU_RELAX() _mm_pause()
+#else
+	#define TERARK_MPMC_CPU_RELAX() std::this_thread::yield()
+#endif
+
+namespace terark { namespace util {
+
+/**
+ @ingroup util
+ @brief lock free bounded multi producer multi consumer queue
+
+  - Vyukov's array queue: each cell has a sequence number, producers and
+    consumers claim a position by CAS on enqueue/dequeue counters, which
+    are on separated cache lines, a cell is published by its sequence
+
+  - try_push/try_pop never block, push/pop spin a while then park on a
+    condition variable, producers/consumers only touch the mutex when
+    there are parked peers
+
+  - method names follow concurrent_queue, so it can replace
+    concurrent_queue<circular_queue<T> > in producer-consumer code
+
+ @note capacity is rounded up to power of 2
+ */
+template<class T>
+class mpmc_queue {
+	struct Cell {
+		std::atomic<size_t> seq;
+		T data;
+	};
+	enum { CacheLine = 64 };
+	static const int SpinLoops  = 128;
+	static const int YieldLoops = 8;
+
+	char m_pad0[CacheLine];
+	std::atomic<size_t> m_enq;
+	char m_pad1[CacheLine - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_deq;
+	char m_pad2[CacheLine - sizeof(std::atomic<size_t>)];
+	std::unique_ptr<Cell[]> m_cells;
+	size_t m_mask;
+	std::atomic<int> m_pushWaiters;
+	std::atomic<int> m_popWaiters;
+	std::mutex m_mtx;
+	std::condition_variable m_pushCond;
+	std::condition_variable m_popCond;
+
+	// cell seq is published by seq_cst store, waiters is increased by
+	// seq_cst rmw, then by the single total order, a parking peer either
+	// sees the cell we just published, or we see it in waiters
+	void wake(std::atomic<int>& waiters, std::condition_variable& cond) {
+		if (waiters.load(std::memory_order_seq_cst)) {
+			std::lock_guard<std::mutex> lock(m_mtx);
+			cond.notify_one();
+		}
+	}
+	bool can_push() const {
+		size_t pos = m_enq.load(std::memory_order_relaxed);
+		return m_cells[pos & m_mask].seq.load(std::memory_order_seq_cst) == pos;
+	}
+	bool can_pop() const {
+		size_t pos = m_deq.load(std::memory_order_relaxed);
+		return m_cells[pos & m_mask].seq.load(std::memory_order_seq_cst) == pos + 1;
+	}
+	/// timeout < 0 for infinite, op is not called under m_mtx, because
+	/// op calls wake() of the peer side
+	template<class TryOp, class Ready>
+	bool wait_for(TryOp op, Ready ready, std::atomic<int>& waiters,
+				  std::condition_variable& cond, int timeout) {
+		for (int i = 0; i < SpinLoops; ++i) {
+			if (op())
+				return true;
+			TERARK_MPMC_CPU_RELAX();
+		}
+		for (int i = 0; i < YieldLoops; ++i) {
+			if (op())
+				return true;
+			std::this_thread::yield();
+		}
+		using namespace std::chrono;
+		auto deadline = steady_clock::now() + milliseconds(timeout);
+		for (;;) {
+			if (op())
+				return true;
+			std::unique_lock<std::mutex> lock(m_mtx);
+			waiters.fetch_add(1, std::memory_order_seq_cst);
+			bool timedout = false;
+			if (!ready()) {
+				if (timeout < 0)
+					cond.wait(lock);
+				else
+					timedout = cond.wait_until(lock, deadline) == std::cv_status::timeout;
+			}
+			waiters.fetch_sub(1, std::memory_order_relaxed);
+			if (timedout) {
+				lock.unlock();
+				return op();
+			}
+		}
+	}
+
+public:
+	typedef T      value_type;
+	typedef size_t size_type;
+
+	explicit mpmc_queue(size_t capacity) {
+		TERARK_VERIFY_F(capacity >= 2, "%zd", capacity);
+		size_t cap = 2;
+		while (cap < capacity)
+			cap *= 2;
+		m_cells.reset(new Cell[cap]);
+		for (size_t i = 0; i < cap; ++i)
+			m_cells[i].seq.store(i, std::memory_order_relaxed);
+		m_mask = cap - 1;
+		m_enq.store(0, std::memory_order_relaxed);
+		m_deq.store(0, std::memory_order_relaxed);
+		m_pushWaiters.store(0, std::memory_order_relaxed);
+		m_popWaiters.store(0, std::memory_order_relaxed);
+	}
+
+	size_t capacity() const { return m_mask + 1; }
+
+	bool try_push(const T& x) {
+		size_t pos = m_enq.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& c = m_cells[pos & m_mask];
+			size_t seq = c.seq.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(seq) - intptr_t(pos);
+			if (0 == diff) {
+				if (m_enq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					c.data = x;
+					c.seq.store(pos + 1, std::memory_order_seq_cst);
+					wake(m_popWaiters, m_popCond);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false; // full
+			else
+				pos = m_enq.load(std::memory_order_relaxed);
+		}
+	}
+
+	bool try_pop(T& x) {
+		size_t pos = m_deq.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& c = m_cells[pos & m_mask];
+			size_t seq = c.seq.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+			if (0 == diff) {
+				if (m_deq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					x = std::move(c.data);
+					c.seq.store(pos + m_mask + 1, std::memory_order_seq_cst);
+					wake(m_pushWaiters, m_pushCond);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false; // empty
+			else
+				pos = m_deq.load(std::memory_order_relaxed);
+		}
+	}
+
+	void push_back(const T& x) {
+		wait_for([&]{ return try_push(x); }, [this]{ return can_push(); },
+				 m_pushWaiters, m_pushCond, -1);
+	}
+	/// @returns false on timeout, timeout is in milliseconds
+	bool push_back(const T& x, int timeout) {
+		return wait_for([&]{ return try_push(x); }, [this]{ return can_push(); },
+						m_pushWaiters, m_pushCond, timeout);
+	}
+	T pop_front() {
+		T x;
+		wait_for([&]{ return try_pop(x); }, [this]{ return can_pop(); },
+				 m_popWaiters, m_popCond, -1);
+		return x;
+	}
+	/// @returns false on timeout, timeout is in milliseconds
+	bool pop_front(T& x, int timeout) {
+		return wait_for([&]{ return try_pop(x); }, [this]{ return can_pop(); },
+						m_popWaiters, m_popCond, timeout);
+	}
+
+	/// approximate when there are concurrent push/pop
+	size_t peekSize() const {
+		size_t deq = m_deq.load(std::memory_order_relaxed);
+		size_t enq = m_enq.load(std::memory_order_relaxed);
+		return enq > deq ? enq - deq : 0;
+	}
+	size_t size()  const { return peekSize(); }
+	bool peekEmpty() const { return peekSize() == 0; }
+	bool peekFull()  const { return peekSize() >= capacity(); }
+	bool empty() const { return peekEmpty(); }
+	bool full()  const { return peekFull(); }
+};
+
+}} // namespace terark::util
+
+#endif // __terark_mpmc_queue_hpp__
@@ -0,0 +1,326 @@
+#include "slab_alloc.hpp"
+#include "hugepage.hpp"
+#include <terark/fstring.hpp>
+#include <terark/bitmanip.hpp>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_MSC_VER)
+#else
+	#include <sys/mman.h>
+#endif
+
+namespace terark {
+
+size_t SlabAllocator::s_base = 0;
+size_t SlabAllocator::s_size = 0;
+
+namespace {
+
+const size_t ArenaSize = hugepage_size;
+const size_t ArenaBits = 21;
+const size_t SmallClassNum = 4; // 16, 32, 48, 64
+const size_t ClassNum = SmallClassNum + 4 * 13; // (64, 128] ... (256K, 512K]
+const size_t MaxBinCap = 64;
+
+static_assert(size_t(1) << ArenaBits == ArenaSize, "ArenaSize");
+
+// 4 classes per power of 2, internal fragment is at most 25%
+inline size_t class_of(size_t size) {
+    assert(size <= SlabAllocator::max_class_size);
+    if (size <= 64)
+        return size ? (size - 1) / 16 : 0;
+    size_t k = terark_bsr_u64(size - 1); // 2^k < size <= 2^(k+1)
+    return SmallClassNum + (k - 6) * 4 + ((size - 1) >> (k - 2)) - 4;
+}
+
+inline size_t class_size(size_t cls) {
+    if (cls < SmallClassNum)
+        return 16 * (cls + 1);
+    size_t j = cls - SmallClassNum;
+    size_t k = 6 + j / 4;
+    return (size_t(1) << k) + (j % 4 + 1) * (size_t(1) << (k - 2));
+}
+
+// large blocks are not hoarded by a thread
+inline size_t bin_cap(size_t cls) {
+    size_t n = 256*1024 / class_size(cls);
+    return std::max<size_t>(2, std::min(n, MaxBinCap));
+}
+
+struct Central {
+    std::mutex    mtx;
+    valvec<void*> free_list;
+    char*         cur = NULL; // carving arena
+    char*         end = NULL;
+};
+
+struct Bin {
+    size_t n;
+    void*  items[MaxBinCap];
+};
+
+struct ThreadCache {
+    Bin bins[ClassNum];
+};
+
+// never destroyed: thread exit and static destructors of other TUs may
+// still free slab memory after static destruction of this TU
+Central* central() {
+    static Central* ce = new Central[ClassNum];
+    return ce;
+}
+unsigned char* g_arena_cls = NULL; // size class of each arena
+size_t g_region_base = 0;
+size_t g_region_size = 0;
+std::atomic<size_t> g_arena_num(0);
+std::atomic<size_t> g_fallback_num(0);
+std::atomic<size_t> g_trimmed(0);
+
+// reserved on first use, if enabled, region is never unmapped
+bool init_region() {
+#if defined(_MSC_VER) || !defined(MAP_NORESERVE)
+    return false;
+#else
+    if (!getEnvBool("Terark_slabAlloc", false))
+        return false;
+    size_t size = ParseSizeXiB(getenv("Terark_slabRegionSize"), size_t(16) << 30);
+    size = pow2_align_up(size, ArenaSize);
+    if (0 == size)
+        return false;
+    void* mem = mmap(NULL, size + ArenaSize, PROT_READ|PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == mem) {
+        fprintf(stderr, "WARN: SlabAllocator: mmap(size = %zd) = %s, disabled\n",
+                size, strerror(errno));
+        return false;
+    }
+    g_arena_cls = (unsigned char*)calloc(size / ArenaSize, 1);
+    if (NULL == g_arena_cls) {
+        munmap(mem, size + ArenaSize);
+        return false;
+    }
+    central();
+    g_region_base = pow2_align_up(size_t(mem), ArenaSize);
+    g_region_size = size;
+    return true;
+#endif
+}
+
+char* new_arena(size_t cls) {
+    size_t idx = g_arena_num.fetch_add(1, std::memory_order_relaxed);
+    if (idx >= g_region_size / ArenaSize) {
+        g_arena_num.fetch_sub(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    char* arena = (char*)(g_region_base + idx * ArenaSize);
+#if defined(MADV_HUGEPAGE)
+    madvise(arena, ArenaSize, MADV_HUGEPAGE);
+#endif
+    g_arena_cls[idx] = (unsigned char)cls;
+    return arena;
+}
+
+// fill up to cnt blocks into items, return filled num
+size_t central_alloc(size_t cls, void** items, size_t cnt) {
+    Central& ce = central()[cls];
+    size_t csize = class_size(cls);
+    std::lock_guard<std::mutex> lock(ce.mtx);
+    size_t n = std::min(cnt, ce.free_list.size());
+    memcpy(items, ce.free_list.end() - n, sizeof(void*) * n);
+    ce.free_list.risk_set_size(ce.free_list.size() - n);
+    while (n < cnt) {
+        if (ce.cur + csize > ce.end) {
+            char* arena = new_arena(cls);
+            if (NULL == arena)
+                break;
+            ce.cur = arena;
+            ce.end = arena + ArenaSize;
+        }
+        items[n++] = ce.cur;
+        ce.cur += csize;
+    }
+    return n;
+}
+
+void central_free(size_t cls, void* const* items, size_t cnt) {
+    Central& ce = central()[cls];
+    std::lock_guard<std::mutex> lock(ce.mtx);
+    ce.free_list.append(items, cnt);
+}
+
+inline size_t class_of_ptr(const void* p) {
+    return g_arena_cls[(size_t(p) - g_region_base) >> ArenaBits];
+}
+
+// cache is freed on thread exit, frees after that go to central
+ThreadCache* const DeadCache = (ThreadCache*)(1);
+thread_local ThreadCache* tls_cache = NULL;
+
+struct ThreadCacheHolder {
+    ThreadCache* tc;
+    ThreadCacheHolder() {
+        tc = (ThreadCache*)malloc(sizeof(ThreadCache));
+        if (NULL == tc) throw std::bad_alloc();
+        for (size_t cls = 0; cls < ClassNum; ++cls)
+            tc->bins[cls].n = 0;
+        tls_cache = tc;
+    }
+    ~ThreadCacheHolder() {
+        tls_cache = DeadCache;
+        for (size_t cls = 0; cls < ClassNum; ++cls) {
+            Bin& b = tc->bins[cls];
+            if (b.n)
+                central_free(cls, b.items, b.n);
+        }
+        ::free(tc);
+    }
+};
+
+inline ThreadCache* get_cache() {
+    ThreadCache* tc = tls_cache;
+    if (terark_likely(tc > DeadCache))
+        return tc;
+    if (DeadCache == tc)
+        return NULL;
+    static thread_local ThreadCacheHolder holder;
+    return holder.tc;
+}
+
+void* fallback_alloc(size_t size) {
+    g_fallback_num.fetch_add(1, std::memory_order_relaxed);
+    return ::malloc(size);
+}
+
+// release pages in runs of contiguous free blocks, list is sorted
+size_t central_trim(size_t cls) {
+    Central& ce = central()[cls];
+    size_t csize = class_size(cls);
+    size_t released = 0;
+    std::lock_guard<std::mutex> lock(ce.mtx);
+    auto& fl = ce.free_list;
+    std::sort(fl.begin(), fl.end());
+    for (size_t i = 0; i < fl.size(); ) {
+        size_t beg = size_t(fl[i]), end = beg + csize;
+        for (++i; i < fl.size() && size_t(fl[i]) == end; ++i)
+            end += csize;
+        beg = pow2_align_up(beg, 4096);
+        end = pow2_align_down(end, 4096);
+        if (beg < end) {
+        #if defined(MADV_DONTNEED)
+            if (madvise((void*)beg, end - beg, MADV_DONTNEED) == 0)
+                released += end - beg;
+        #endif
+        }
+    }
+    return released;
+}
+
+} // namespace
+
+bool SlabAllocator::enabled() {
+    static bool val = []() {
+        if (!init_region())
+            return false;
+        s_base = g_region_base;
+        s_size = g_region_size;
+        return true;
+    }();
+    return val;
+}
+
+void* SlabAllocator::alloc(size_t size) {
+    if (size > max_class_size || !enabled())
+        return ::malloc(size);
+    size_t cls = class_of(size);
+    ThreadCache* tc = get_cache();
+    if (terark_likely(NULL != tc)) {
+        Bin& b = tc->bins[cls];
+        if (terark_unlikely(0 == b.n)) {
+            b.n = central_alloc(cls, b.items, (bin_cap(cls) + 1) / 2);
+            if (0 == b.n)
+                return fallback_alloc(size);
+        }
+        return b.items[--b.n];
+    }
+    void* p = NULL;
+    if (central_alloc(cls, &p, 1))
+        return p;
+    return fallback_alloc(size);
+}
+
+void SlabAllocator::free(void* p) {
+    if (!owns(p)) {
+        ::free(p);
+        return;
+    }
+    size_t cls = class_of_ptr(p);
+    ThreadCache* tc = get_cache();
+    if (terark_likely(NULL != tc)) {
+        Bin& b = tc->bins[cls];
+        size_t cap = bin_cap(cls);
+        if (terark_unlikely(b.n == cap)) {
+            size_t keep = cap / 2;
+            central_free(cls, b.items + keep, cap - keep);
+            b.n = keep;
+        }
+        b.items[b.n++] = p;
+    }
+    else {
+        central_free(cls, &p, 1);
+    }
+}
+
+void* SlabAllocator::realloc(void* p, size_t newsize) {
+    if (!owns(p))
+        return NULL == p ? alloc(newsize) : ::realloc(p, newsize);
+    if (0 == newsize) {
+        free(p);
+        return NULL;
+    }
+    size_t oldsize = class_size(class_of_ptr(p));
+    if (newsize <= oldsize && newsize > oldsize / 2)
+        return p; // fits, and not wasting too much
+    void* q = alloc(newsize);
+    if (NULL == q)
+        return NULL; // p is not freed, same as ::realloc
+    memcpy(q, p, std::min(oldsize, newsize));
+    free(p);
+    return q;
+}
+
+size_t SlabAllocator::usable_size(const void* p) {
+    if (!owns(p))
+        return 0;
+    return class_size(class_of_ptr(p));
+}
+
+size_t SlabAllocator::trim() {
+    if (!enabled())
+        return 0;
+    size_t released = 0;
+    for (size_t cls = 0; cls < ClassNum; ++cls)
+        released += central_trim(cls);
+    g_trimmed.fetch_add(released, std::memory_order_relaxed);
+    return released;
+}
+
+SlabAllocator::Stat SlabAllocator::get_stat() {
+    Stat st;
+    st.region_size = enabled() ? g_region_size : 0;
+    st.arena_num = g_arena_num.load(std::memory_order_relaxed);
+    st.central_free = 0;
+    for (size_t cls = 0; cls < ClassNum && st.region_size; ++cls) {
+        Central& ce = central()[cls];
+        std::lock_guard<std::mutex> lock(ce.mtx);
+        st.central_free += ce.free_list.size() * class_size(cls);
+    }
+    st.fallback_num = g_fallback_num.load(std::memory_order_relaxed);
+    st.trimmed = g_trimmed.load(std::memory_order_relaxed);
+    return st;
+}
+
+} // namespace terark
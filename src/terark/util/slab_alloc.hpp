@@ -0,0 +1,86 @@
+#pragma once
+
+#include <terark/config.hpp>
+#include <stddef.h>
+#include <new>
+
+namespace terark {
+
+/// size class slab allocator for short lived buffers of read path
+///
+///  - a virtual address region is reserved on first use, it is carved into
+///    2M arenas backed by transparent huge pages, each arena serves one
+///    size class, 4 classes per power of 2 up to 512K
+///  - each thread caches free blocks of each class, central free lists
+///    are only touched in batch
+///  - it is a separate allocator, malloc/valvec are not affected: memory
+///    from SlabAllocator must be freed by SlabAllocator, realloc/free of
+///    SlabAllocator also accept malloc memory, which is recognized by
+///    address range, so a block may move between slab and malloc
+///
+/// it is opt in by env Terark_slabAlloc (default false), when disabled all
+/// requests go to malloc. region size is env Terark_slabRegionSize (default
+/// 16G, virtual only)
+class TERARK_DLL_EXPORT SlabAllocator {
+public:
+    static const size_t max_class_size = 512 * 1024;
+    static bool enabled();
+    static bool owns(const void* p) { return size_t(p) - s_base < s_size; }
+
+    /// falls back to malloc if size > max_class_size or region exhausted
+    static void* alloc(size_t size);
+    static void* realloc(void* p, size_t newsize);
+    static void  free(void* p);
+    /// size of the class of p, 0 if p is not slab memory
+    static size_t usable_size(const void* p);
+
+    /// return pages which are fully covered by free blocks in central free
+    /// lists to the OS, blocks cached by threads are not released
+    /// @returns released bytes
+    static size_t trim();
+
+    struct Stat {
+        size_t region_size;
+        size_t arena_num;     // arenas carved from region
+        size_t central_free;  // bytes in central free lists
+        size_t fallback_num;  // allocs fell back to malloc
+        size_t trimmed;       // bytes released by trim
+    };
+    static Stat get_stat();
+
+private:
+    static size_t s_base;
+    static size_t s_size; // 0 means slab is disabled or not initialized
+};
+
+/// allocator policy for std containers, such as
+/// std::vector<char, slab_allocator<char> >
+template<class T>
+class slab_allocator {
+public:
+    typedef T         value_type;
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<class Other>
+    struct rebind { typedef slab_allocator<Other> other; };
+
+    slab_allocator() noexcept {}
+    template<class Other>
+    slab_allocator(const slab_allocator<Other>&) noexcept {}
+
+    T* allocate(size_t n) {
+        T* p = (T*)SlabAllocator::alloc(sizeof(T) * n);
+        if (NULL == p)
+            throw std::bad_alloc();
+        return p;
+    }
+    void deallocate(T* p, size_t) noexcept { SlabAllocator::free(p); }
+
+    template<class Other>
+    bool operator==(const slab_allocator<Other>&) const noexcept { return true; }
+    template<class Other>
+    bool operator!=(const slab_allocator<Other>&) const noexcept { return false; }
+};
+
+} // namespace terark
@@ -30,6 +30,20 @@
 #endif
 namespace terark {
 
+/// @returns threads for parallel_radix_sort_tpl, 0 for not using it
+static size_t StrVecSortThreads(const char* envPrefix, size_t num) {
+	std::string env = envPrefix;
+	size_t minNum = getEnvLong((env + "_parallelSortMinNum").c_str(), 1<<20);
+	if (num < minNum) {
+		return 0;
+	}
+	long threads = getEnvLong((env + "_sortThreads").c_str(), -1);
+	if (threads < 0) { // auto
+		threads = std::min<long>(std::thread::hardware_concurrency(), 32);
+	}
+	return threads > 1 ? size_t(threads) : 0;
+}
+
 SortableStrVec::SortableStrVec() {
 	m_strpool_mem_type = MemType::Malloc;
 }
@@ -140,6 +154,13 @@ void SortableStrVec::sort() {
 		}
 		else
 #endif
+		if (size_t threads = StrVecSortThreads("SortableStrVec", m_index.size())) {
+			auto getData = [pool](const SEntry& x) { return pool + x.offset; };
+			auto getSize = [](const SEntry& x) { return size_t(x.length); };
+			parallel_radix_sort_tpl(m_index.data(), m_index.size(),
+									getData, getSize, threads);
+		}
+		else
 		std::sort(m_index.begin(), m_index.end(), cmp);
 	} else { // use radix sort
 		auto getChar = [pool](const SEntry& x,size_t i){return pool[x.offset+i];};
@@ -839,6 +860,13 @@ void SortThinStrVec::sort() {
 		}
 		else
 #endif
+		if (size_t threads = StrVecSortThreads("SortThinStrVec", m_index.size())) {
+			auto getData = [pool](const SEntry& x) { return pool + x.offset; };
+			auto getSize = [](const SEntry& x) { return size_t(x.length); };
+			parallel_radix_sort_tpl(m_index.data(), m_index.size(),
+									getData, getSize, threads);
+		}
+		else
 		std::sort(m_index.begin(), m_index.end(), cmp);
 	} else { // use radix sort
 		auto getChar = [pool](const SEntry& x,size_t i){return pool[x.offset+i];};
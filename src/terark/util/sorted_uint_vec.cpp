@@ -6,6 +6,10 @@
 #include <terark/util/function.hpp>
 #include <boost/intrusive_ptr.hpp>
 
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
 namespace terark {
 
 static inline size_t safe_bsr_u64(uint64_t val) {
@@ -239,9 +243,118 @@ struct SortedUintVec::ObjectHeader {
 	uint64_t  indexOffset     :48;
 	uint64_t  is_overall_full_sorted: 1;
 	uint64_t  is_samples_full_sorted: 1;
-	uint64_t  reserved : 14;
+	uint64_t  is_vertical_layout    : 1;
+	uint64_t  reserved : 13;
 };
 
+// Vertical layout, used when ObjectHeader::is_vertical_layout is set:
+//
+// each block begins with a tag byte, 0 means the legacy encoding follows,
+// else width = tag - 1 and a header written by WriteHeader (loWater) follows,
+// then the packed words.
+//
+// diff[k] = val[k+1] - val[k] - loWater (k < blockUnits-1, the last is 0) is
+// in lane k%8 of 8 x 32 bit lanes, as the (k/8)-th width-bit field of the
+// lane, the bit stream of a lane is split to 32 bit slots of consecutive
+// 256 bit words. so 8 diffs are unpacked by one shift and mask, like
+// SIMD-BP128, and decoded by a prefix sum.
+static const size_t VerticalLanes = 8;
+static const size_t VerticalMaxWidth = 32;
+
+static inline size_t vertical_words(size_t blockUnits, size_t width) {
+    return (blockUnits / VerticalLanes * width + 31) / 32;
+}
+
+// decode vals[0, 8*groups)
+static void
+vertical_decode(const byte_t* packed, size_t width, size_t loWater,
+                size_t sample0, size_t groups, size_t* vals) {
+    assert(width <= VerticalMaxWidth);
+    if (0 == width) {
+        for (size_t i = 0; i < VerticalLanes * groups; ++i)
+            vals[i] = sample0 + loWater * i;
+        return;
+    }
+    const uint32_t mask = uint32_t(uint64_t(-1) >> (64 - width));
+#if defined(__AVX2__)
+    const __m256i vmask = _mm256_set1_epi32(int(mask));
+    const __m256i lw_lo = _mm256_setr_epi64x(0, loWater, 2*loWater, 3*loWater);
+    const __m256i lw_hi = _mm256_add_epi64(lw_lo, _mm256_set1_epi64x(4*loWater));
+    const __m256i zero = _mm256_setzero_si256();
+    // inclusive prefix sum of 4 x u64
+    auto prefix_sum = [zero](__m256i x) {
+        x = _mm256_add_epi64(x, _mm256_slli_si256(x, 8));
+        __m256i t = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(1,1,1,1));
+        return _mm256_add_epi64(x, _mm256_blend_epi32(zero, t, 0xF0));
+    };
+    size_t base = sample0;
+    for (size_t g = 0; g < groups; ++g) {
+        size_t bitpos = width * g;
+        size_t shift = bitpos % 32;
+        auto   pw = (const __m256i*)(packed) + bitpos / 32;
+        __m256i v = _mm256_srl_epi32(_mm256_loadu_si256(pw),
+                                     _mm_cvtsi64_si128(shift));
+        if (shift + width > 32) {
+            __m256i h = _mm256_sll_epi32(_mm256_loadu_si256(pw + 1),
+                                         _mm_cvtsi64_si128(32 - shift));
+            v = _mm256_or_si256(v, h);
+        }
+        v = _mm256_and_si256(v, vmask);
+        __m256i d_lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v));
+        __m256i d_hi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1));
+        __m256i s_lo = prefix_sum(d_lo);
+        __m256i s_hi = prefix_sum(d_hi);
+        size_t sum_lo = _mm256_extract_epi64(s_lo, 3);
+        size_t sum_hi = _mm256_extract_epi64(s_hi, 3);
+        // vals[i] = base + i*loWater + exclusive prefix sum
+        __m256i b = _mm256_set1_epi64x(base);
+        __m256i o_lo = _mm256_add_epi64(_mm256_sub_epi64(s_lo, d_lo), _mm256_add_epi64(b, lw_lo));
+        b = _mm256_set1_epi64x(base + sum_lo);
+        __m256i o_hi = _mm256_add_epi64(_mm256_sub_epi64(s_hi, d_hi), _mm256_add_epi64(b, lw_hi));
+        _mm256_storeu_si256((__m256i*)(vals + VerticalLanes * g + 0), o_lo);
+        _mm256_storeu_si256((__m256i*)(vals + VerticalLanes * g + 4), o_hi);
+        base += sum_lo + sum_hi + VerticalLanes * loWater;
+    }
+#else
+    auto slots = (const uint32_t*)(packed);
+    size_t val = sample0;
+    for (size_t g = 0; g < groups; ++g) {
+        size_t bitpos = width * g;
+        size_t shift = bitpos % 32;
+        auto   p = slots + bitpos / 32 * VerticalLanes;
+        for (size_t j = 0; j < VerticalLanes; ++j) {
+            uint64_t w = unaligned_load<uint32_t>(p + j);
+            if (shift + width > 32)
+                w |= uint64_t(unaligned_load<uint32_t>(p + VerticalLanes + j)) << 32;
+            vals[VerticalLanes * g + j] = val;
+            val += loWater + (uint32_t(w >> shift) & mask);
+        }
+    }
+#endif
+}
+
+static void
+vertical_encode(const int64_t* ds, size_t blockUnits, int64_t loWater,
+                size_t width, valvec<byte_t>* data) {
+    size_t words = vertical_words(blockUnits, width);
+    size_t pos = data->size();
+    data->resize(pos + 32 * words, 0);
+    auto slots = (uint32_t*)(data->data() + pos);
+    for (size_t k = 0; k < blockUnits - 1; ++k) {
+        uint64_t d = uint64_t(ds[k] - loWater);
+        assert(d >> width == 0);
+        size_t lane = k % VerticalLanes;
+        size_t bitpos = width * (k / VerticalLanes);
+        size_t shift = bitpos % 32;
+        uint32_t* p = slots + bitpos / 32 * VerticalLanes + lane;
+        unaligned_save<uint32_t>(p, unaligned_load<uint32_t>(p) | uint32_t(d << shift));
+        if (shift + width > 32) {
+            p += VerticalLanes;
+            unaligned_save<uint32_t>(p, unaligned_load<uint32_t>(p) | uint32_t(d >> (32 - shift)));
+        }
+    }
+}
+
 void SortedUintVec::get2(size_t idx, size_t aVal[2]) const {
     static_assert(sizeof(ObjectHeader)==16, "sizeof(ObjectHeader) must be 16");
     assert(m_is_sorted_uint_vec);
@@ -267,6 +380,23 @@ void SortedUintVec::get2(size_t idx, size_t aVal[2]) const {
     assert(offset0 + 2 <= offset1);
     assert(sample0 <= sample1 || !m_is_samples_full_sorted);
 
+    if (m_is_vertical_layout) {
+        if (size_t tag = header[0]) {
+            size_t headerLen;
+            size_t loWater = GetLoWater_x(header + 1, &headerLen);
+            // vals[subIdx+1] is needed if it is in this block
+            size_t groups = std::min((subIdx + 1) / VerticalLanes + 1,
+                                     blockUnits / VerticalLanes);
+            size_t vals[128];
+            vertical_decode(header + 1 + headerLen, tag - 1, loWater, sample0, groups, vals);
+            aVal[0] = vals[subIdx];
+            aVal[1] = subIdx + 1 < blockUnits ? vals[subIdx + 1] : sample1;
+            return;
+        }
+        header++; // legacy block
+        offset0++;
+    }
+
     switch (GetDDWidthType(header)) {
     case 0: { // bits = 0, all diffdiff are zero
         assert(offset0 + 2 <= offset1);
@@ -427,6 +557,18 @@ void SortedUintVec::get_block(size_t blockIdx, size_t* aVals) const {
     assert(offset0 + 2 <= offset1);
     assert(sample0 <= sample1 || !m_is_samples_full_sorted);
 
+    if (m_is_vertical_layout) {
+        if (size_t tag = header[0]) {
+            size_t headerLen;
+            size_t loWater = GetLoWater_x(header + 1, &headerLen);
+            vertical_decode(header + 1 + headerLen, tag - 1, loWater, sample0,
+                            blockUnits / VerticalLanes, aVals);
+            return;
+        }
+        header++; // legacy block
+        offset0++;
+    }
+
     switch (GetDDWidthType(header)) {
     case 0: { // bits = 0, all diffdiff are zero
         assert(offset0 + 2 <= offset1);
@@ -556,6 +698,7 @@ SortedUintVec::SortedUintVec() {
 	m_is_sorted_uint_vec = true;
 	m_is_overall_full_sorted = true;
 	m_is_samples_full_sorted = true;
+	m_is_vertical_layout = false;
 #if TERARK_WORD_BITS == 64
 	m_padding = 0xCCCCCCCC;
 #endif
@@ -824,6 +967,7 @@ void SortedUintVec::risk_set_data(const void* base, size_t bytes) {
 	m_sampleWidth = byte_t(sampleWidth);
 	m_is_overall_full_sorted = oheader->is_overall_full_sorted;
 	m_is_samples_full_sorted = oheader->is_samples_full_sorted;
+	m_is_vertical_layout = oheader->is_vertical_layout;
 }
 
 void SortedUintVec::risk_release_ownership() {
@@ -846,6 +990,7 @@ void SortedUintVec::swap(SortedUintVec& y) {
 	DO_SWAP_BIT(m_is_sorted_uint_vec   , y.m_is_sorted_uint_vec);
 	DO_SWAP_BIT(m_is_overall_full_sorted, y.m_is_overall_full_sorted);
 	DO_SWAP_BIT(m_is_samples_full_sorted, y.m_is_samples_full_sorted);
+	DO_SWAP_BIT(m_is_vertical_layout   , y.m_is_vertical_layout);
 #if TERARK_WORD_BITS == 64
 	std::swap(m_padding        , y.m_padding);
 #endif
@@ -867,6 +1012,8 @@ class SortedUintVec::Builder::Impl : public SortedUintVec::Builder {
 	byte_t   m_log2_blockUnits;
 	bool     m_is_sorted;
 	bool     m_is_real_sorted;
+	bool     m_vertical;
+	valvec<byte_t> m_vblock; // vertical encoded block
 
 	// m_smallToLarge[largeCount][smallWidth][largeWidth]
 	AutoFree<unsigned[16][64]> m_smallToLarge;
@@ -889,6 +1036,7 @@ class SortedUintVec::Builder::Impl : public SortedUintVec::Builder {
 	void print_histogram() const;
 	void append_block(uint64_t nextBlockFirstValue);
 	void append_block_impl();
+	void append_block_impl_vertical();
 	void append_block_impl_lagrange(uint64_t nextBlockFirstValue);
 
     void init(size_t blockUnits);
@@ -973,8 +1121,13 @@ void SortedUintVec::Builder::Impl::append_block(uint64_t nextBlockFirstValue) {
 		}
 	}
 	if (isIncreasing) {
-		append_block_impl();
+		if (m_vertical)
+			append_block_impl_vertical();
+		else
+			append_block_impl();
 	} else {
+		if (m_vertical)
+			m_data.push_back(0); // tag of legacy block
 		append_block_impl_lagrange(nextBlockFirstValue);
 	}
 	m_indexOffset += m_data.size() - old_data_size;
@@ -1151,6 +1304,36 @@ void SortedUintVec::Builder::Impl::append_block_impl() {
 	}
 }
 
+// encode legacy block first, vertical block is used if it is not much
+// larger than legacy block, it is much faster to decode
+void SortedUintVec::Builder::Impl::append_block_impl_vertical() {
+	const size_t blockUnits = getBlockUnits();
+	const size_t blockStart = m_data.size();
+	m_data.push_back(0); // tag of legacy block
+	append_block_impl();
+	const size_t legacySize = m_data.size() - blockStart;
+	auto vals = m_block.data();
+	auto ds = m_diffvec.p;
+	int64_t loWater = vals[1] - vals[0], hiWater = loWater;
+	for (size_t i = 1; i < blockUnits; ++i) {
+		ds[i-1] = vals[i] - vals[i-1];
+		loWater = std::min(loWater, ds[i-1]);
+		hiWater = std::max(hiWater, ds[i-1]);
+	}
+	size_t width = hiWater > loWater ? 1 + terark_bsr_u64(hiWater - loWater) : 0;
+	if (width > VerticalMaxWidth) {
+		return;
+	}
+	m_vblock.erase_all();
+	m_vblock.push_back(byte_t(width + 1));
+	WriteHeader(&m_vblock, loWater, 0, 0);
+	vertical_encode(ds, blockUnits, loWater, width, &m_vblock);
+	if (m_vblock.size() <= legacySize + legacySize / 4) {
+		m_data.risk_set_size(blockStart);
+		m_data.append(m_vblock);
+	}
+}
+
 void SortedUintVec::Builder::Impl::append_block_impl_lagrange(uint64_t nextBlockFirstValue) {
     const size_t log2_range = m_log2_blockUnits;
     const size_t blockUnits = getBlockUnits();
@@ -1221,6 +1404,9 @@ void SortedUintVec::Builder::Impl::init(size_t blockUnits) {
     m_diffvec.alloc(blockUnits); // has 1 extra unit
     m_log2_blockUnits = terark_bsr_u64(blockUnits);
 
+    // readers before vertical layout ignore is_vertical_layout and would
+    // misdecode such blocks, so it is opt in until all readers know it
+    m_vertical = getEnvBool("SortedUintVec_Builder_VerticalLayout", false);
     if (getEnvBool("SortedUintVec_Builder_EnableHistogram")) {
         m_smallToLarge.alloc(blockUnits);
         memset(m_smallToLarge, 0, sizeof(*m_smallToLarge)*blockUnits);
@@ -1410,6 +1596,7 @@ SortedUintVec::Builder::Impl::finish(SortedUintVec* vec) {
     oheader->indexOffset = m_indexOffset;
     oheader->is_samples_full_sorted = is_samples_full_sorted;
     oheader->is_overall_full_sorted = m_is_real_sorted;
+    oheader->is_vertical_layout = m_vertical;
     if (m_writer) {
         // m_fp   = header + data + index
         // m_data = header        + index
@@ -1455,6 +1642,7 @@ SortedUintVec::Builder::Impl::finish(SortedUintVec* vec) {
         vec->m_sampleWidth = sampleWidth;
         vec->m_is_overall_full_sorted = m_is_real_sorted;
         vec->m_is_samples_full_sorted = is_samples_full_sorted;
+        vec->m_is_vertical_layout = m_vertical;
     }
     if (m_smallToLarge) {
         print_histogram();
@@ -23,6 +23,7 @@ class TERARK_DLL_EXPORT SortedUintVec {
 	byte_t         m_is_sorted_uint_vec    : 1;
 	byte_t         m_is_overall_full_sorted : 1;
 	byte_t         m_is_samples_full_sorted : 1;
+	byte_t         m_is_vertical_layout     : 1;
 #if TERARK_WORD_BITS == 64
 	uint32_t       m_padding;
 #else
@@ -56,6 +57,11 @@ public:
 	bool is_overall_full_sorted() const { return m_is_overall_full_sorted; }
 	bool is_samples_full_sorted() const { return m_is_samples_full_sorted; }
 
+	/// blocks may use the vertical (SIMD-BP128 like) bit packing,
+	/// it is chosen by builder (env SortedUintVec_Builder_VerticalLayout,
+	/// default false) and recorded in ObjectHeader
+	bool is_vertical_layout() const { return m_is_vertical_layout; }
+
 	size_t offset_width() const { return m_offsetWidth; }
 	size_t sample_width() const { return m_sampleWidth; }
 	size_t log2_block_units() const { return m_log2_blockUnits; }
@@ -6,6 +6,11 @@
 #include <terark/hash_strmap.hpp>
 #include <terark/gold_hash_map.hpp>
 #include <terark/zbs/xxhash_helper.hpp>
+#include <terark/util/checksum_exception.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #if defined(_WIN32) || defined(_WIN64)
 	#define WIN32_LEAN_AND_MEAN
@@ -195,9 +200,208 @@ AbstractBlobStore::AbstractBlobStore()
     m_unzipSize = 0;
 }
 AbstractBlobStore::~AbstractBlobStore() {
+    stop_checksum_verify();
+}
+
+static bool g_lazyChecksumVerify = getEnvBool("Terark_lazyChecksumVerify", false);
+
+TERARK_DLL_EXPORT bool isLazyChecksumVerifyEnabled() {
+    return g_lazyChecksumVerify;
+}
+
+TERARK_DLL_EXPORT void enableLazyChecksumVerify(bool val) {
+    g_lazyChecksumVerify = val;
+}
+
+class AbstractBlobStore::LazyChecksumVerifier {
+public:
+    typedef ChecksumVerifyStatus::State State;
+    std::string m_msg;
+    fstring     m_mem;
+    uint64_t    m_seed;
+    uint64_t    m_saved;
+    uint64_t    m_computed = 0;                // guarded by m_mtx
+    std::atomic<bool>* m_isDataCorrupted;      // of owner, guarded by m_mtx
+    std::atomic<uint64_t> m_verifiedBytes{0};
+    std::atomic<bool>  m_stop{false};
+    bool               m_active = false;       // m_mem is being read
+    State              m_state = ChecksumVerifyStatus::kRunning;
+    mutable std::mutex m_mtx;
+    mutable std::condition_variable m_cond;
+
+    void run() {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if (m_stop)
+                return; // stopped before started
+            m_active = true;
+        }
+        const size_t Chunk = size_t(4) << 20;
+        XXHash64 hash(m_seed);
+        size_t pos = 0, len = m_mem.size();
+        while (pos < len && !m_stop.load(std::memory_order_relaxed)) {
+            size_t n = std::min(Chunk, len - pos);
+            hash.update(m_mem.data() + pos, n);
+            pos += n;
+            m_verifiedBytes.store(pos, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_active = false;
+        if (pos == len) {
+            m_computed = hash.digest();
+            if (m_computed == m_saved) {
+                m_state = ChecksumVerifyStatus::kPassed;
+            } else {
+                m_state = ChecksumVerifyStatus::kFailed;
+                m_isDataCorrupted->store(true);
+                fprintf(stderr, "ERROR: %s: lazy checksum verify failed, "
+                        "saved = %016llX, computed = %016llX\n", m_msg.c_str(),
+                        llong(m_saved), llong(m_computed));
+            }
+        }
+        // else stopped, m_state keeps kRunning
+        m_cond.notify_all();
+    }
+    void wait() const {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cond.wait(lock, [this] {
+            return ChecksumVerifyStatus::kRunning != m_state ||
+                    m_stop.load(std::memory_order_relaxed);
+        });
+    }
+    /// after return, m_mem will not be read any more
+    void stop() {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_stop = true;
+        m_cond.notify_all();
+        m_cond.wait(lock, [this] { return !m_active; });
+    }
+};
+
+/// verifiers of all stores are queued to a few shared threads, the threads
+/// are started on demand and never exit, the worker is never destroyed, so
+/// it is safe for stores which are destroyed during static destruction
+class LazyChecksumWorker {
+    typedef AbstractBlobStore::LazyChecksumVerifier Verifier;
+    std::mutex m_mtx;
+    std::condition_variable m_cond;
+    std::deque<std::shared_ptr<Verifier> > m_queue;
+    size_t m_threads = 0;
+    size_t m_idle = 0;
+    size_t m_maxThreads;
+    void run() {
+        for (;;) {
+            std::shared_ptr<Verifier> v;
+            {
+                std::unique_lock<std::mutex> lock(m_mtx);
+                m_idle++;
+                m_cond.wait(lock, [this] { return !m_queue.empty(); });
+                m_idle--;
+                v = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            v->run();
+        }
+    }
+    LazyChecksumWorker() {
+        long n = getEnvLong("Terark_lazyChecksumVerifyThreads", 1);
+        m_maxThreads = size_t(std::max(n, 1L));
+    }
+public:
+    static LazyChecksumWorker& get() {
+        static LazyChecksumWorker* w = new LazyChecksumWorker();
+        return *w;
+    }
+    void push(std::shared_ptr<Verifier> v) {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_queue.push_back(std::move(v));
+        if (m_idle < m_queue.size() && m_threads < m_maxThreads) {
+            m_threads++;
+            std::thread(&LazyChecksumWorker::run, this).detach();
+        }
+        else {
+            m_cond.notify_one();
+        }
+    }
+};
+
+void AbstractBlobStore::verify_xxhash64(std::string msg, fstring mem,
+                                        uint64_t seed, uint64_t saved) {
+    stop_checksum_verify();
+    if (!isLazyChecksumVerifyEnabled()) {
+        uint64_t computed = XXHash64(seed)(mem);
+        if (computed != saved) {
+            throw BadChecksumException(msg, saved, computed);
+        }
+        return;
+    }
+    auto v = std::make_shared<LazyChecksumVerifier>();
+    v->m_msg = std::move(msg);
+    v->m_mem = mem;
+    v->m_seed = seed;
+    v->m_saved = saved;
+    v->m_isDataCorrupted = &m_isDataCorrupted;
+    m_lazyVerifier = v;
+    LazyChecksumWorker::get().push(std::move(v));
+}
+
+void AbstractBlobStore::stop_checksum_verify() {
+    if (m_lazyVerifier) {
+        m_lazyVerifier->stop();
+        m_lazyVerifier.reset();
+    }
+}
+
+AbstractBlobStore::ChecksumVerifyStatus
+AbstractBlobStore::checksum_verify_status() const {
+    ChecksumVerifyStatus st;
+    if (auto v = m_lazyVerifier.get()) {
+        std::lock_guard<std::mutex> lock(v->m_mtx);
+        st.state = v->m_state;
+        st.verifiedBytes = v->m_verifiedBytes.load(std::memory_order_relaxed);
+        st.totalBytes = v->m_mem.size();
+    }
+    return st;
+}
+
+void AbstractBlobStore::wait_checksum_verify() const {
+    if (auto v = m_lazyVerifier.get()) {
+        v->wait();
+        if (m_isDataCorrupted.load()) {
+            throw_data_corrupted();
+        }
+    }
+}
+
+void AbstractBlobStore::throw_data_corrupted() const {
+    if (auto v = m_lazyVerifier.get()) {
+        uint64_t computed;
+        {
+            std::lock_guard<std::mutex> lock(v->m_mtx);
+            computed = v->m_computed;
+        }
+        throw BadChecksumException(v->m_msg, v->m_saved, computed);
+    }
+    BlobStore::throw_data_corrupted();
 }
 
 void AbstractBlobStore::risk_swap(AbstractBlobStore& y) {
+    // verifiers set m_isDataCorrupted of their owner when they finish,
+    // swap the flags and retarget the verifiers under their locks
+    LazyChecksumVerifier* vx = m_lazyVerifier.get();
+    LazyChecksumVerifier* vy = y.m_lazyVerifier.get();
+    std::unique_lock<std::mutex> lx, ly;
+    if (vx) lx = std::unique_lock<std::mutex>(vx->m_mtx, std::defer_lock);
+    if (vy) ly = std::unique_lock<std::mutex>(vy->m_mtx, std::defer_lock);
+    if (vx && vy) std::lock(lx, ly);
+    else if (vx) lx.lock();
+    else if (vy) ly.lock();
+    m_lazyVerifier.swap(y.m_lazyVerifier);
+    if (vx) vx->m_isDataCorrupted = &y.m_isDataCorrupted;
+    if (vy) vy->m_isDataCorrupted = &m_isDataCorrupted;
+    bool isDataCorrupted = m_isDataCorrupted.load();
+    m_isDataCorrupted = y.m_isDataCorrupted.load();
+    y.m_isDataCorrupted = isDataCorrupted;
 	std::swap(m_numRecords   , y.m_numRecords   );
 	std::swap(m_unzipSize    , y.m_unzipSize    );
 	std::swap(m_fpath        , y.m_fpath        );
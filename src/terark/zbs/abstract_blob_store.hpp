@@ -1,5 +1,6 @@
 #pragma once
 #include "blob_store.hpp"
+#include <memory>
 
 namespace terark {
 
@@ -26,9 +27,40 @@ protected:
 	int             m_checksumType;
 	const struct FileHeaderBase* m_mmapBase;
 
+	class LazyChecksumVerifier;
+	friend class LazyChecksumWorker;
+	std::shared_ptr<LazyChecksumVerifier> m_lazyVerifier;
+
 	void risk_swap(AbstractBlobStore& y);
 
+	/// verify XXHash64 of mem against saved, throw BadChecksumException(msg)
+	/// on mismatch; if isLazyChecksumVerifyEnabled(), verification is queued
+	/// to shared background threads(Terark_lazyChecksumVerifyThreads, default
+	/// 1) and the store is readable immediately, a mismatch makes all later
+	/// reads throw
+	void verify_xxhash64(std::string msg, fstring mem,
+						 uint64_t seed, uint64_t saved);
+	/// must be called before unmapping the memory passed to verify_xxhash64
+	void stop_checksum_verify();
+	void throw_data_corrupted() const override;
+
 public:
+	struct ChecksumVerifyStatus {
+		enum State : uint8_t {
+			kNone,    // no lazy verification
+			kRunning,
+			kPassed,
+			kFailed,
+		};
+		State    state = kNone;
+		uint64_t verifiedBytes = 0;
+		uint64_t totalBytes = 0;
+	};
+	ChecksumVerifyStatus checksum_verify_status() const;
+	/// wait for lazy checksum verification to finish
+	/// @throws BadChecksumException if verification failed
+	void wait_checksum_verify() const;
+
 	static AbstractBlobStore* load_from_mmap(fstring fpath, bool mmapPopulate);
 	static AbstractBlobStore* load_from_user_memory(fstring dataMem);
 	static AbstractBlobStore* load_from_user_memory(fstring dataMem, Dictionary dict);
@@ -1,6 +1,7 @@
 #include "abstract_blob_store.hpp"
 #include "lru_page_cache.hpp"
 #include <terark/util/function.hpp>
+#include <terark/util/throw.hpp>
 #include <terark/thread/fiber_local.hpp>
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -21,6 +22,7 @@ BlobStore::BlobStore() {
     m_numRecords = size_t(-1);
     m_unzipSize = uint64_t(-1);
     m_mmap_aio = false;
+    m_isDataCorrupted = false;
     m_get_record_append = NULL;
     m_get_record_append_CacheOffsets = NULL;
     m_fspread_record_append = NULL;
@@ -30,6 +32,10 @@ BlobStore::BlobStore() {
 BlobStore::~BlobStore() {
 }
 
+void BlobStore::throw_data_corrupted() const {
+    THROW_STD(logic_error, "%s: data is corrupted", name());
+}
+
 BlobStore* BlobStore::load_from_mmap(fstring fpath, bool mmapPopulate) {
     return AbstractBlobStore::load_from_mmap(fpath, mmapPopulate);
 }
@@ -101,6 +107,20 @@ size_t BlobStore::lower_bound(size_t lo, size_t hi, fstring target,
   return recId;
 }
 
+uint64_t BlobStore::get_zip_offset(size_t recID) const {
+  assert(recID <= m_numRecords);
+  if (m_numRecords == 0) {
+    return 0;
+  }
+  valvec<fstring> blocks;
+  this->get_data_blocks(&blocks);
+  uint64_t zip_size = 0;
+  for (auto& b : blocks) {
+    zip_size += b.size();
+  }
+  return uint64_t(double(zip_size) * recID / m_numRecords);
+}
+
 static thread_local recycle_pool<valvec<byte_t> > tg_buf_pool;
 
 void BlobStore::pread_record_append(LruReadonlyCache* cache,
@@ -3,6 +3,8 @@
 #include <terark/fstring.hpp>
 #include <terark/util/function.hpp>
 #include <terark/util/refcount.hpp>
+#include <terark/util/metrics.hpp>
+#include <atomic>
 
 namespace terark {
 
@@ -46,15 +48,21 @@ public:
 
     terark_forceinline
     void get_record_append(size_t recID, valvec<byte_t>* recData) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStoreGetRecord);
         (this->*m_get_record_append)(recID, recData);
     }
     terark_forceinline
     void get_record(size_t recID, valvec<byte_t>* recData) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStoreGetRecord);
         recData->erase_all();
         (this->*m_get_record_append)(recID, recData);
     }
     terark_forceinline
     valvec<byte_t> get_record(size_t recID) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStoreGetRecord);
         valvec<byte_t> recData;
         (this->*m_get_record_append)(recID, &recData);
         return recData;
@@ -72,15 +80,22 @@ public:
     };
     terark_forceinline
     void get_record_append(size_t recID, CacheOffsets* co) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStoreGetRecord);
         (this->*m_get_record_append_CacheOffsets)(recID, co);
     }
     terark_forceinline
     void get_record(size_t recID, CacheOffsets* co) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStoreGetRecord);
         co->recData.erase_all();
         (this->*m_get_record_append_CacheOffsets)(recID, co);
     }
     virtual size_t lower_bound(size_t lo, size_t hi, fstring target, CacheOffsets* co) const;
     virtual size_t lower_bound(size_t lo, size_t hi, fstring target, valvec<byte_t>* recData) const;
+    /// offset of record recID in zip data, get_zip_offset(num_records()) is
+    /// the zip data size, default assumes all records are of same zip size
+    virtual uint64_t get_zip_offset(size_t recID) const;
     terark_forceinline
     bool is_offsets_zipped() const {
         return reinterpret_cast<get_record_append_func_t>
@@ -95,6 +110,8 @@ public:
                              size_t baseOffset, size_t recID,
                              valvec<byte_t>* recData,
                              valvec<byte_t>* rdbuf) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStorePreadRecord);
         (this->*m_pread_record_append)(cache, fi, baseOffset, recID, recData, rdbuf);
     }
     void pread_record_append(LruReadonlyCache*, intptr_t fi,
@@ -105,6 +122,8 @@ public:
                       size_t baseOffset, size_t recID,
                       valvec<byte_t>* recData,
                       valvec<byte_t>* rdbuf) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStorePreadRecord);
         recData->risk_set_size(0);
         (this->*m_pread_record_append)(cache, fi, baseOffset, recID, recData, rdbuf);
     }
@@ -124,6 +143,8 @@ public:
                                size_t baseOffset, size_t recID,
                                valvec<byte_t>* recData,
                                valvec<byte_t>* rdbuf) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStorePreadRecord);
         (this->*m_fspread_record_append)(fspread, lambda, baseOffset, recID, recData, rdbuf);
     }
     void fspread_record_append(pread_func_t fspread, void* lambda,
@@ -134,6 +155,8 @@ public:
                         size_t baseOffset, size_t recID,
                         valvec<byte_t>* recData,
                         valvec<byte_t>* rdbuf) const {
+        check_data_corrupted();
+        TERARK_METRICS_TIMER(kBlobStorePreadRecord);
         recData->risk_set_size(0);
         (this->*m_fspread_record_append)(fspread, lambda, baseOffset, recID, recData, rdbuf);
     }
@@ -156,6 +179,15 @@ protected:
     size_t      m_numRecords;
     uint64_t    m_unzipSize;
     bool        m_mmap_aio;
+    // set when a lazy checksum verification failed after load
+    std::atomic<bool> m_isDataCorrupted;
+
+    terark_forceinline
+    void check_data_corrupted() const {
+        if (terark_unlikely(m_isDataCorrupted.load(std::memory_order_relaxed)))
+            throw_data_corrupted();
+    }
+    [[noreturn]] virtual void throw_data_corrupted() const;
 
     typedef void (BlobStore::*get_record_append_func_t)(size_t recID, valvec<byte_t>* recData) const;
     get_record_append_func_t m_get_record_append;
@@ -11,6 +11,8 @@ namespace terark {
 #define My_bsr_size_t TERARK_IF_WORD_BITS_64(terark_bsr_u64, terark_bsr_u32)
 
 TERARK_DLL_EXPORT bool isChecksumVerifyEnabled();
+TERARK_DLL_EXPORT bool isLazyChecksumVerifyEnabled();
+TERARK_DLL_EXPORT void enableLazyChecksumVerify(bool val);
 
 template<size_t Align, class File>
 void PadzeroForAlign(File& f, size_t offset) {
@@ -19,6 +19,7 @@
 #include <terark/thread/pipeline.hpp>
 #include <terark/thread/fiber_aio.hpp>
 #include <terark/util/crc.hpp>
+#include <terark/util/metrics.hpp>
 #include <terark/util/profiling.hpp>
 #include <terark/util/sortable_strvec.hpp>
 #include <terark/util/sorted_uint_vec.hpp>
@@ -42,6 +43,7 @@
 #   endif
 #else
 #   include <unistd.h> // for usleep
+#   include <sys/mman.h>
 #endif
 
 namespace terark {
@@ -595,6 +597,7 @@ static int& g_zipThreads() {
 static bool g_isPipelineStarted = false;
 
 static int g_pipelineLogLevel = (int)getEnvLong("DictZipBlobStore_pipelineLogLevel", 1);
+static bool g_stealPipeline = getEnvBool("DictZipBlobStore_stealPipeline", false);
 static bool g_printEntropyCount = getEnvBool("DictZipBlobStore_printEntropyCount", false);
 
 TERARK_DLL_EXPORT void DictZipBlobStore_setZipThreads(int zipThreads) {
@@ -607,6 +610,62 @@ TERARK_DLL_EXPORT void DictZipBlobStore_setZipThreads(int zipThreads) {
 	}
 }
 
+static size_t g_reorderBatchBytes =
+    (size_t)getEnvLong("DictZipBlobStore_reorderBatchBytes", 1<<20);
+
+/// madvise(WILLNEED) pages of records in a reorder batch, adjacent pages
+/// are merged to one call. gather workers are plain threads, not fibers,
+/// so fiber_aio_need can not be used
+static void reorder_willneed(const byte_t* base, const valvec<size_t>& begEnd) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    const size_t pgmask = size_t(sysconf(_SC_PAGESIZE)) - 1;
+    size_t num = begEnd.size() / 2;
+    valvec<std::pair<size_t, size_t> > pages(num, valvec_reserve());
+    for (size_t i = 0; i < num; ++i) {
+        size_t beg = size_t(base + begEnd[2*i]) & ~pgmask;
+        size_t end = size_t(base + begEnd[2*i+1] + pgmask) & ~pgmask;
+        if (beg < end)
+            pages.unchecked_emplace_back(beg, end);
+    }
+    std::sort(pages.begin(), pages.end());
+    for (size_t i = 0; i < pages.size(); ) {
+        size_t beg = pages[i].first, end = pages[i].second;
+        for (++i; i < pages.size() && pages[i].first <= end; ++i)
+            end = std::max(end, pages[i].second);
+        madvise((void*)beg, end - beg, MADV_WILLNEED);
+    }
+#endif
+}
+
+static int g_reorderThreadsOpt =
+    (int)getEnvLong("DictZipBlobStore_reorderThreads", -1);
+static std::atomic<size_t> g_parallelReorderNum{0};
+
+/// threads for gathering records in reorder_zip_data, 1 for serial reorder
+static int g_reorderThreads(size_t zipDataSize) {
+    if (zipDataSize < 4 * g_reorderBatchBytes) {
+        return 1; // too small to benefit from pipeline
+    }
+    if (g_reorderThreadsOpt > 0) {
+        // not capped by cpu count, gathering may wait on page faults
+        return g_reorderThreadsOpt;
+    }
+    return std::min(PipelineProcessor::sysCpuCount(), 8);
+}
+
+/// threads <= 0 means min(cpu count, 8), as env DictZipBlobStore_reorderThreads
+/// @returns previous value
+TERARK_DLL_EXPORT int DictZipBlobStore_setReorderThreads(int threads) {
+    int old = g_reorderThreadsOpt;
+    g_reorderThreadsOpt = threads;
+    return old;
+}
+
+/// num of reorder_zip_data which gathered records by pipeline
+TERARK_DLL_EXPORT size_t DictZipBlobStore_parallelReorderNum() {
+    return g_parallelReorderNum.load(std::memory_order_relaxed);
+}
+
 TERARK_DLL_EXPORT void DictZipBlobStore_setPipelineLogLevel(int level) {
   if (g_isPipelineStarted) {
     fprintf(stderr,
@@ -686,6 +745,8 @@ class DictZipBlobStoreBuilder::MultiThread : public DictZipBlobStoreBuilder {
 				zipThreads = min(cpuCount, 8);
 			}
 			this->setLogLevel(g_pipelineLogLevel);
+			if (g_stealPipeline)
+				this->setEUType(EUType::steal);
 			this->setQueueSize(8*zipThreads);
 			this->add_step(new MyZipStage(zipThreads));
 			this->add_step(new MyWriteStage());
@@ -1534,6 +1595,7 @@ struct DictZipBlobStore::FileHeader : public FileHeaderBase {
 };
 
 void DictZipBlobStore::destroyMe() {
+    stop_checksum_verify(); // before unmapping
     if (m_isDetachMeta) {
         m_strDict.risk_release_ownership();
         m_offsets.risk_release_ownership();
@@ -1666,6 +1728,25 @@ void DictZipBlobStoreBuilder::prepare(size_t records, fstring fpath, size_t offs
     prepareZip();
 }
 
+// push offsets of count records from the var uint length stream
+// @returns end offset of the last record
+template<class OffsetBuilder>
+static size_t
+PushOffsetsByLengths(InputBuffer& input, size_t count, OffsetBuilder* builder) {
+    uint64_t lengths[1024];
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ) {
+        size_t n = std::min(count - i, sizeof(lengths)/sizeof(lengths[0]));
+        input.read_var_uint64_batch(lengths, n);
+        for (size_t j = 0; j < n; ++j) {
+            builder->push_back(offset);
+            offset += lengths[j];
+        }
+        i += n;
+    }
+    return offset;
+}
+
 static
 std::pair<bool, size_t>
 WriteDict(fstring filename, size_t offset, fstring data, bool compress) {
@@ -1958,15 +2039,10 @@ void DictZipBlobStoreBuilder::entropyStore(std::unique_ptr<terark::DictZipBlobSt
             input.attach(&m_memLengthStream);
         }
         size_t offsetBase = 0;
-        var_uint64_t delta;
         if (!isOffsetsZipped) {
             std::unique_ptr<UintVecMin0::Builder> builder(
                 UintVecMin0::create_builder_by_max_value(m_zipDataSize, &m_fpWriter));
-            for (size_t i = 0; i < m_lengthCount; ++i) {
-                builder->push_back(offsetBase);
-                input >> delta;
-                offsetBase += delta;
-            }
+            offsetBase = PushOffsetsByLengths(input, m_lengthCount, builder.get());
             builder->push_back(maxOffsetEnt = offsetBase);
             auto result = builder->finish();
             storeSize += result.mem_size;
@@ -1989,11 +2065,7 @@ void DictZipBlobStoreBuilder::entropyStore(std::unique_ptr<terark::DictZipBlobSt
         else {
             std::unique_ptr<SortedUintVec::Builder> builder(
                 SortedUintVec::createBuilder(m_opt.offsetArrayBlockUnits, &m_fpWriter));
-            for (size_t i = 0; i < m_lengthCount; ++i) {
-                builder->push_back(offsetBase);
-                input >> delta;
-                offsetBase += delta;
-            }
+            offsetBase = PushOffsetsByLengths(input, m_lengthCount, builder.get());
             builder->push_back(maxOffsetEnt = offsetBase);
             size_t fileSize = builder->finish(nullptr).mem_size;
             storeSize += fileSize;
@@ -2140,15 +2212,10 @@ void DictZipBlobStoreBuilder::finish(int flag) {
             input.attach(&m_memLengthStream);
         }
         size_t offsetBase = 0;
-        var_uint64_t delta;
         if (m_opt.offsetArrayBlockUnits) {
             std::unique_ptr<SortedUintVec::Builder> builder(
                 SortedUintVec::createBuilder(m_opt.offsetArrayBlockUnits, &m_fpWriter));
-            for (size_t i = 0; i < m_lengthCount; ++i) {
-                builder->push_back(offsetBase);
-                input >> delta;
-                offsetBase += delta;
-            }
+            offsetBase = PushOffsetsByLengths(input, m_lengthCount, builder.get());
             builder->push_back(offsetBase);
             size_t fileSize = builder->finish(nullptr).mem_size;
             finalSize += fileSize;
@@ -2172,11 +2239,7 @@ void DictZipBlobStoreBuilder::finish(int flag) {
         else {
             std::unique_ptr<UintVecMin0::Builder> builder(
                 UintVecMin0::create_builder_by_max_value(m_zipDataSize, &m_fpWriter));
-            for (size_t i = 0; i < m_lengthCount; ++i) {
-                builder->push_back(offsetBase);
-                input >> delta;
-                offsetBase += delta;
-            }
+            offsetBase = PushOffsetsByLengths(input, m_lengthCount, builder.get());
             builder->push_back(offsetBase);
             auto result = builder->finish();
             finalSize += result.mem_size;
@@ -2339,8 +2402,8 @@ void DictZipBlobStore::setDataMemory(const void* base, size_t size) {
 				mmapBase->headerCRC, hCRC);
 		}
 		if (m_dict_verified) { // only check offsetsCRC iff dictCRC is verified
-            uint32_t offsetsCRC =
-                Crc32c_update(0, m_offsets.data(), m_offsets.mem_size());
+            uint32_t offsetsCRC = Crc32c_update_parallel(0,
+                m_offsets.data(), m_offsets.mem_size());
             if (offsetsCRC != mmapBase->offsetsCRC) {
                 throw BadCrc32cException("DictZipBlobStore::offsetsCRC",
                     mmapBase->offsetsCRC, offsetsCRC);
@@ -2410,12 +2473,8 @@ void DictZipBlobStore::setDataMemory(const void* base, size_t size) {
 
 	if (m_checksumLevel >= 3 && isChecksumVerifyEnabled()) {
 		auto foot = mmapBase->getFileFooter();
-		uint64_t computed = XXHash64(g_dzbsnark_seed)(m_ptrList);
-		uint64_t saved = foot->zipDataXXHash;
-		if (saved != computed) {
-			throw BadChecksumException("DictZipBlobStore::zipDataXXHash",
-				saved, computed);
-		}
+		verify_xxhash64("DictZipBlobStore::zipDataXXHash", m_ptrList,
+						g_dzbsnark_seed, foot->zipDataXXHash);
 	}
 
     m_gOffsetBits = My_bsr_size_t(m_strDict.size() - gMinLen) + 1;
@@ -2571,6 +2630,14 @@ void DictZipBlobStore::detach_meta_blocks(const valvec<fstring>& blocks) {
     }
 }
 
+uint64_t DictZipBlobStore::get_zip_offset(size_t recID) const {
+	assert(recID <= m_numRecords);
+	if (offsetsIsSortedUintVec())
+		return m_zOffsets[recID];
+	else
+		return m_offsets[recID];
+}
+
 size_t DictZipBlobStore::mem_size() const {
     if (m_mmapBase) {
         return m_mmapBase->fileSize + m_strDict.size();
@@ -2816,6 +2883,8 @@ DictZipBlobStore::read_record_append_entropy(const byte_t* zpos, size_t zlen,
                                              valvec<byte_t>* recData)
 const {
     if (m_entropyBitmap[recId]) {
+        TERARK_METRICS_TIMER(kEntropyDecode); // entropy decode + dict unzip
+        TERARK_CYCLE_START(tsc);
         auto ctx = GetTlsTerarkContext();
         auto ctx_data = ctx->alloc();
         auto& data = ctx_data.get();
@@ -2841,11 +2910,14 @@ const {
                 THROW_STD(logic_error, "FSE_unzip() = %s", FSE_getErrorName(zlen));
             }
         }
+        TERARK_CYCLE_LAP(tsc, kCycleEntropyDecode);
         m_unzip(data.data(), data.data() + zlen, recData,
                 m_strDict.data(), m_gOffsetBits, m_reserveOutputMultiplier);
+        TERARK_CYCLE_LAP(tsc, kCycleDictExpand);
         TERARK_IF_DEBUG(zlen = zlen, ;);
     }
     else {
+        TERARK_CYCLE_SCOPE(kCycleDictExpand);
         const byte_t* dic = m_strDict.data();
         const byte_t* end = zpos + zlen;
         m_unzip(zpos, end, recData, dic, m_gOffsetBits, m_reserveOutputMultiplier);
@@ -2860,8 +2932,10 @@ inline
 void DictZipBlobStore::read_record_append_tpl(size_t recId, valvec<byte_t>* recData, ReadRaw readRaw)
 const {
 	assert(recId + 1 < m_offsets.size());
+	TERARK_CYCLE_START(tsc);
 	size_t BegEnd[2];
 	offsetGet2(recId, BegEnd, ZipOffset);
+	TERARK_CYCLE_LAP(tsc, kCycleOffsetDecode);
 	assert(BegEnd[0] <= BegEnd[1]);
 	assert(BegEnd[1] <= m_ptrList.size());
 	assert(m_ptrList.data() == (const byte_t*)((FileHeader*)m_mmapBase + 1));
@@ -2871,6 +2945,7 @@ const {
 		return;  // empty
 	}
 	const byte* pos = readRaw(offset, zipLen);
+	TERARK_CYCLE_LAP(tsc, kCycleCopy);
 	if (CheckSumLevel == 2) {
 		if (zipLen <= 4) {
 			THROW_STD(logic_error
@@ -2883,6 +2958,7 @@ const {
 		if (crc2 != crc1) {
 			THROW_STD(logic_error, "CRC check failed: recId = %zd", recId);
 		}
+		TERARK_CYCLE_LAP(tsc, kCycleChecksum);
 	}
 	TERARK_IF_DEBUG(tg_dicLen = m_strDict.size(),);
     if (Options::kNoEntropy != Entropy) {
@@ -2893,6 +2969,7 @@ const {
     	const byte_t* dic = m_strDict.data();
         const byte_t* end = pos + zipLen;
         m_unzip(pos, end, recData, dic, m_gOffsetBits, m_reserveOutputMultiplier);
+        TERARK_CYCLE_LAP(tsc, kCycleDictExpand);
     }
 }
 
@@ -2907,6 +2984,7 @@ const {
 	assert(recId + 1 < m_offsets.size());
     size_t log2 = m_zOffsets.log2_block_units(); // must be 6 or 7
     size_t mask = (size_t(1) << log2) - 1;
+    TERARK_CYCLE_START(tsc);
     if (terark_unlikely(recId >> log2 != co->blockId)) {
         // cache miss, load the block
         size_t blockIdx = recId >> log2;
@@ -2916,6 +2994,7 @@ const {
     }
     size_t inBlockID = recId & mask;
     size_t BegEnd[2] = { co->offsets[inBlockID], co->offsets[inBlockID+1] };
+    TERARK_CYCLE_LAP(tsc, kCycleOffsetDecode);
     // code below is based on copy of read_record_append_tpl
 	assert(BegEnd[0] <= BegEnd[1]);
 	assert(BegEnd[1] <= m_ptrList.size());
@@ -2923,6 +3002,7 @@ const {
 	size_t offset = sizeof(FileHeader) + BegEnd[0];
 	size_t zipLen = BegEnd[1] - BegEnd[0];
 	const byte* pos = readRaw(offset, zipLen);
+	TERARK_CYCLE_LAP(tsc, kCycleCopy);
 	if (CheckSumLevel == 2) {
         if (BegEnd[0] == BegEnd[1]) {
             return; // empty
@@ -2938,6 +3018,7 @@ const {
 		if (crc2 != crc1) {
 			THROW_STD(logic_error, "CRC check failed: recId = %zd", recId);
 		}
+		TERARK_CYCLE_LAP(tsc, kCycleChecksum);
 	}
 	TERARK_IF_DEBUG(tg_dicLen = m_strDict.size(),);
     if (Options::kNoEntropy != Entropy) {
@@ -2948,6 +3029,7 @@ const {
     	const byte_t* dic = m_strDict.data();
         const byte_t* end = pos + zipLen;
         m_unzip(pos, end, &co->recData, dic, m_gOffsetBits, m_reserveOutputMultiplier);
+        TERARK_CYCLE_LAP(tsc, kCycleDictExpand);
     }
 }
 
@@ -3197,7 +3279,83 @@ const {
         writeAppend(&h, sizeof(h));
     }
     XXHash64 xxhash64(g_dzbsnark_seed);
-    for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
+    const int reorderThreads = g_reorderThreads(offset);
+    if (reorderThreads > 1) {
+        // records are gathered into batches by reorderThreads workers,
+        // batches are hashed and written by a keep-order serial stage
+        struct ReorderTask : public PipelineTask {
+            valvec<size_t> oldIds;
+            valvec<byte_t> zdata;
+        };
+        std::exception_ptr writeErr;
+        PipelineProcessor pipeline;
+        pipeline.setLogLevel(g_pipelineLogLevel);
+        pipeline.setQueueSize(2 * reorderThreads);
+        pipeline | new FunPipelineStage(reorderThreads,
+        [&](PipelineStage*, int, PipelineQueueItem* item) {
+            auto t = static_cast<ReorderTask*>(item->task);
+            size_t num = t->oldIds.size();
+            valvec<size_t> begEnd(2 * num, valvec_no_init());
+            size_t zsize = 0;
+            for (size_t i = 0; i < num; ++i) {
+                size_t* BegEnd = &begEnd[2 * i];
+                offsetGet2(t->oldIds[i], BegEnd, isOffsetsZipped);
+                assert(BegEnd[0] <= BegEnd[1]);
+                zsize += BegEnd[1] - BegEnd[0];
+            }
+            reorder_willneed(m_ptrList.data(), begEnd);
+            t->zdata.resize_no_init(zsize);
+            byte_t* dst = t->zdata.data();
+            for (size_t i = 0; i < num; ++i) {
+                size_t zlen = begEnd[2*i+1] - begEnd[2*i];
+                memcpy(dst, m_ptrList.data() + begEnd[2*i], zlen);
+                dst += zlen;
+            }
+        }, "ReorderGather")
+        | new FunPipelineStage(0,
+        [&](PipelineStage*, int, PipelineQueueItem* item) {
+            auto t = static_cast<ReorderTask*>(item->task);
+            if (writeErr) {
+                return; // drain remaining tasks
+            }
+            try {
+                xxhash64.update(t->zdata.data(), t->zdata.size());
+                writeAppend(t->zdata.data(), t->zdata.size());
+            }
+            catch (...) {
+                writeErr = std::current_exception();
+            }
+        }, "ReorderWrite");
+        pipeline.compile();
+        // estimate records per batch by average zipped record len
+        size_t batchRecs = g_reorderBatchBytes * recNum / (maxOffsetEnt + 1);
+        batchRecs = std::max<size_t>(batchRecs, 16);
+        ReorderTask* task = NULL;
+        for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
+            size_t oldId = *newToOld;
+            if (NULL == task) {
+                task = new ReorderTask();
+                task->oldIds.reserve(batchRecs);
+            }
+            task->oldIds.unchecked_push_back(oldId);
+            if (task->oldIds.size() == batchRecs) {
+                pipeline.enqueue(task);
+                task = NULL;
+            }
+            assert(rbits.is0(oldId));
+            TERARK_IF_DEBUG(rbits.set1(oldId), ;);
+        }
+        if (task) {
+            pipeline.enqueue(task);
+        }
+        pipeline.stop();
+        pipeline.wait();
+        if (writeErr) {
+            std::rethrow_exception(writeErr);
+        }
+        g_parallelReorderNum.fetch_add(1, std::memory_order_relaxed);
+    }
+    else for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
         size_t oldId = *newToOld;
 		size_t BegEnd[2];
 		offsetGet2(oldId, BegEnd, isOffsetsZipped);
@@ -3410,4 +3568,183 @@ const {
 	writeAppend(&foot, sizeof(foot));
 }
 
+static fstring DictZipEntropyTable(const DictZipBlobStore::FileHeader* h,
+                                   const UintVecMin0& offsets) {
+    auto mem = offsets.data() + offsets.mem_size()
+             + febitvec::s_mem_size(align_up(h->records, 16 * 8));
+    return fstring(mem, h->entropyTableSize);
+}
+
+bool DictZipBlobStore::can_merge_zip_data(
+        const valvec<const DictZipBlobStore*>& srcs) {
+    if (srcs.empty()) {
+        return false;
+    }
+    const DictZipBlobStore* s0 = srcs[0];
+    auto h0 = (const FileHeader*)s0->m_mmapBase;
+    if (nullptr == h0) {
+        return false;
+    }
+    for (size_t i = 1; i < srcs.size(); ++i) {
+        const DictZipBlobStore* si = srcs[i];
+        auto hi = (const FileHeader*)si->m_mmapBase;
+        if (nullptr == hi) {
+            return false;
+        }
+        if (hi->dictXXHash != h0->dictXXHash ||
+            hi->globalDictSize != h0->globalDictSize ||
+            hi->embeddedDict != h0->embeddedDict ||
+            si->m_checksumLevel != s0->m_checksumLevel ||
+            si->m_entropyAlgo != s0->m_entropyAlgo) {
+            return false;
+        }
+        if (Options::kNoEntropy != s0->m_entropyAlgo) {
+            // entropy table is built from data of each store
+            if (hi->entropyTableNoCompress != h0->entropyTableNoCompress ||
+                si->m_entropyInterleaved != s0->m_entropyInterleaved ||
+                DictZipEntropyTable(hi, si->m_offsets) !=
+                DictZipEntropyTable(h0, s0->m_offsets)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void DictZipBlobStore::merge_zip_data(
+        const valvec<const DictZipBlobStore*>& srcs,
+        const UintVecMin0& srcIdx, const UintVecMin0& srcRecId,
+        function<void(const void* data, size_t size)> writeAppend) {
+    if (!can_merge_zip_data(srcs)) {
+        THROW_STD(invalid_argument,
+            "srcs must share same dict, checksum level and entropy table");
+    }
+    TERARK_VERIFY_EQ(srcIdx.size(), srcRecId.size());
+    const DictZipBlobStore* s0 = srcs[0];
+    auto mmapBase = (const FileHeader*)s0->m_mmapBase;
+    const bool hasEntropy = Options::kNoEntropy != s0->m_entropyAlgo;
+    const bool isOffsetsZipped = s0->offsetsIsSortedUintVec();
+    size_t recNum = srcIdx.size();
+    valvec<size_t> usedNum(srcs.size(), 0);
+    febitvec newEntropyBitmap;
+    if (hasEntropy) {
+        newEntropyBitmap.reserve(recNum);
+    }
+    // srcIdx and srcRecId are scanned 3 times, unpack them by blocks
+    auto for_each_src = [&](auto fn) {
+        size_t idxBuf[128], recBuf[128];
+        for (size_t lo = 0; lo < recNum; lo += 128) {
+            size_t n = std::min<size_t>(128, recNum - lo);
+            srcIdx.get_range(lo, n, idxBuf);
+            srcRecId.get_range(lo, n, recBuf);
+            for (size_t j = 0; j < n; ++j)
+                fn(lo + j, idxBuf[j], recBuf[j]);
+        }
+    };
+    size_t offset = 0;
+    for_each_src([&](size_t, size_t idx, size_t oldId) {
+        TERARK_VERIFY_LT(idx, srcs.size());
+        const DictZipBlobStore* src = srcs[idx];
+        TERARK_VERIFY_LT(oldId, src->m_numRecords);
+        size_t BegEnd[2];
+        src->offsetGet2(oldId, BegEnd, src->offsetsIsSortedUintVec());
+        assert(BegEnd[0] <= BegEnd[1]);
+        offset += BegEnd[1] - BegEnd[0];
+        usedNum[idx]++;
+        if (hasEntropy) {
+            newEntropyBitmap.push_back(src->m_entropyBitmap[oldId]);
+        }
+    });
+    size_t maxOffsetEnt = offset;
+    UintVecMin0 newOffsets;
+    SortedUintVec newZipOffsets;
+    std::unique_ptr<SortedUintVec::Builder> zipOffsetBuilder;
+    if (isOffsetsZipped) {
+        zipOffsetBuilder.reset(SortedUintVec::createBuilder(
+            s0->m_zOffsets.block_units()));
+    }
+    else {
+        newOffsets.resize_with_wire_max_val(recNum + 1, maxOffsetEnt);
+    }
+    offset = 0;
+    for_each_src([&](size_t newId, size_t idx, size_t oldId) {
+        const DictZipBlobStore* src = srcs[idx];
+        size_t BegEnd[2];
+        src->offsetGet2(oldId, BegEnd, src->offsetsIsSortedUintVec());
+        if (isOffsetsZipped)
+            zipOffsetBuilder->push_back(offset);
+        else
+            newOffsets.set_wire(newId, offset);
+        offset += BegEnd[1] - BegEnd[0];
+    });
+    if (isOffsetsZipped) {
+        zipOffsetBuilder->push_back(maxOffsetEnt);
+        zipOffsetBuilder->finish(&newZipOffsets);
+        zipOffsetBuilder.reset();
+    }
+    else {
+        newOffsets.set_wire(recNum, maxOffsetEnt);
+    }
+    const UintVecMin0& offsets = isOffsetsZipped
+        // UintVecMin0 & SortedUintVec have same layout ...
+        ? reinterpret_cast<const UintVecMin0&>(newZipOffsets) : newOffsets;
+
+    // records are not unzipped, estimate unzipSize by proportion
+    double unzipSize = 0;
+    for (size_t i = 0; i < srcs.size(); ++i) {
+        if (srcs[i]->m_numRecords) {
+            unzipSize += double(srcs[i]->m_unzipSize) * usedNum[i]
+                       / srcs[i]->m_numRecords;
+        }
+    }
+    fstring entropy("");
+    fstring entropyBitmap("");
+    if (hasEntropy) {
+        newEntropyBitmap.resize(align_up(recNum, 16 * 8));
+        entropy = DictZipEntropyTable(mmapBase, s0->m_offsets);
+        entropyBitmap = fstring((char*)newEntropyBitmap.data(),
+                                newEntropyBitmap.mem_size());
+    }
+    Dictionary dict(s0->m_strDict.size(), mmapBase->dictXXHash);
+    FileHeader h(s0, maxOffsetEnt, dict, offsets, entropyBitmap, entropy,
+                 mmapBase->entropyTableNoCompress, maxOffsetEnt);
+    h.unzipSize = uint64_t(unzipSize + 0.5);
+    h.headerCRC = Crc32c_update(0, &h, sizeof(h) - 4);
+    if (mmapBase->embeddedDict != (uint8_t)EmbeddedDictType::kExternal) {
+        h.setEmbeddedDictType(mmapBase->getEmbeddedDict().size(),
+                              (EmbeddedDictType)mmapBase->embeddedDict);
+    }
+    writeAppend(&h, sizeof(h));
+
+    XXHash64 xxhash64(g_dzbsnark_seed);
+    for_each_src([&](size_t, size_t idx, size_t oldId) {
+        const DictZipBlobStore* src = srcs[idx];
+        size_t BegEnd[2];
+        src->offsetGet2(oldId, BegEnd, src->offsetsIsSortedUintVec());
+        size_t zippedLen = BegEnd[1] - BegEnd[0];
+        const byte* beg = src->m_ptrList.data() + BegEnd[0];
+        xxhash64.update(beg, zippedLen);
+        writeAppend(beg, zippedLen);
+    });
+    static const byte zeros[16] = { 0 };
+    if (maxOffsetEnt % 16 != 0) {
+        xxhash64.update(zeros, 16 - maxOffsetEnt % 16);
+        writeAppend(zeros, 16 - maxOffsetEnt % 16);
+    }
+    writeAppend(offsets.data(), offsets.mem_size());
+    if (hasEntropy) {
+        writeAppend(newEntropyBitmap.data(), newEntropyBitmap.mem_size());
+        writeAppend(entropy.data(), align_up(entropy.size(), 16));
+    }
+    if (mmapBase->embeddedDict != (uint8_t)EmbeddedDictType::kExternal) {
+        fstring embeddedDict = mmapBase->getEmbeddedDict();
+        writeAppend(embeddedDict.data(), embeddedDict.size());
+        if (embeddedDict.size() % 16 != 0)
+            writeAppend(zeros, 16 - embeddedDict.size() % 16);
+    }
+    BlobStoreFileFooter foot;
+    foot.zipDataXXHash = xxhash64.digest();
+    writeAppend(&foot, sizeof(foot));
+}
+
 } // namespace terark
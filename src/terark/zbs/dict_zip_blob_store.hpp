@@ -181,6 +181,7 @@ public:
     void detach_meta_blocks(const valvec<fstring>& blocks) override;
 
 	size_t mem_size() const override;
+	uint64_t get_zip_offset(size_t recID) const override;
 
 private:
     template<bool ZipOffset, int CheckSumLevel, EntropyAlgo Entropy, int EntropyInterLeave>
@@ -218,6 +219,18 @@ public:
 	void purge_zip_data(function<bool(size_t id)> isDel,
 			function<void(const void* data, size_t size)> writeAppend
 		 ) const;
+
+	/// zipped records of srcs can be copied verbatim into one store iff
+	/// all srcs share same dict, checksum level and entropy table
+	static bool can_merge_zip_data(const valvec<const DictZipBlobStore*>& srcs);
+
+	/// merge records of srcs without unzip, only offsets are rebuilt
+	/// @param srcIdx   srcIdx[newId] is index of srcs
+	/// @param srcRecId srcRecId[newId] is recId in srcs[srcIdx[newId]]
+	/// @note unzipSize in new header is estimated if some records are dropped
+	static void merge_zip_data(const valvec<const DictZipBlobStore*>& srcs,
+			const UintVecMin0& srcIdx, const UintVecMin0& srcRecId,
+			function<void(const void* data, size_t size)> writeAppend);
 private:
 	template<class IsDel>
 	void purge_zip_data_impl(IsDel isDel,
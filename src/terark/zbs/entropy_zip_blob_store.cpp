@@ -134,14 +134,11 @@ void EntropyZipBlobStore::init_from_memory(fstring dataMem, Dictionary/*dict*/)
     m_checksumLevel = mmapBase->checksumLevel;
     m_checksumType = mmapBase->checksumType;
     if (m_checksumLevel == 3 && isChecksumVerifyEnabled()) {
-        XXHash64 hash(g_debsnark_seed);
-        hash.update(mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter));
-        const uint64_t hashVal = hash.digest();
-        auto &footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase) + mmapBase->fileSize))[-1];
-        if (hashVal != footer.fileXXHash) {
-            std::string msg = "EntropyZipBlobStore::load_mmap(\"" + m_fpath + "\")";
-            throw BadChecksumException(msg, footer.fileXXHash, hashVal);
-        }
+        auto& footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase) + mmapBase->fileSize))[-1];
+        std::string msg = "EntropyZipBlobStore::load_mmap(\"" + m_fpath + "\")";
+        verify_xxhash64(std::move(msg),
+            fstring((const char*)mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter)),
+            g_debsnark_seed, footer.fileXXHash);
     }
     m_content.risk_set_data((byte_t*)(mmapBase + 1), (mmapBase->contentBits + 7) / 8);
     m_table.risk_set_data(m_content.data() + m_content.size(), mmapBase->tableBytes);
@@ -295,6 +292,7 @@ EntropyZipBlobStore::EntropyZipBlobStore() {
 }
 
 EntropyZipBlobStore::~EntropyZipBlobStore() {
+    stop_checksum_verify(); // before unmapping
     if (m_isDetachMeta) {
         m_offsets.risk_release_ownership();
         m_decoder_o0 = nullptr;
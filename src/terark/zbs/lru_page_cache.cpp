@@ -14,6 +14,7 @@
 //#include <terark/io/byte_swap.hpp>
 #include <terark/util/byte_swap_impl.hpp>
 #include <terark/util/function.hpp>
+#include <terark/util/metrics.hpp>
 #include <terark/bitmap.hpp>
 #include <terark/num_to_str.hpp>
 #include <atomic>
@@ -649,6 +650,7 @@ SingleLruReadonlyCache::alloc_page(size_t hpos, uint64_t fi_offset_key,
 			curr_fp->pgcnt++;
 			m_busypage_num++;
 			m_stat_cnt[Buffer::dropped_free]++;
+			TERARK_METRICS_INC(kCacheMiss);
 			*cache_type = Buffer::dropped_free;
 			assert_list_len((*curr_fp));
 		}
@@ -666,6 +668,7 @@ SingleLruReadonlyCache::alloc_page(size_t hpos, uint64_t fi_offset_key,
         }
 		if (uint64_t(-1) != nodes[p].fi_offset) {
 			m_stat_cnt[Buffer::evicted_others]++;
+			TERARK_METRICS_INC(kCacheMiss);
 			*cache_type = Buffer::evicted_others;
 			size_t swap_hpos = MyHash(nodes[p].fi_offset) % m_bucket_size;
 			size_t swap_fi = nodes[p].get_fi();
@@ -694,6 +697,7 @@ SingleLruReadonlyCache::alloc_page(size_t hpos, uint64_t fi_offset_key,
 		else {
 			assert(nodes[p].ref_count == 0);
 			m_stat_cnt[Buffer::initial_free]++;
+			TERARK_METRICS_INC(kCacheMiss);
 			*cache_type = Buffer::initial_free;
 			m_busypage_num++;
 			LOCK_FILE_VECTOR_ELEM;
@@ -769,6 +773,7 @@ SingleLruReadonlyCache::pread(intptr_t fi, size_t offset, size_t len, Buffer* b)
                     }
 					if (terark_likely(nodes[p].is_loaded)) {
 						m_stat_cnt[Buffer::hit]++;
+						TERARK_METRICS_INC(kCacheHit);
 						byte_t* bufptr = m_bufmem + PAGE_SIZE*(p-1) + pg_offset;
                         b->index = p;
                         assert(p > 0);
@@ -796,6 +801,7 @@ SingleLruReadonlyCache::pread(intptr_t fi, size_t offset, size_t len, Buffer* b)
 			ScopeLock lock(m_mutex);
 			assert(nodes[p].fi_offset == fi_offset_key);
 			m_stat_cnt[Buffer::hit_others_load]++;
+			TERARK_METRICS_INC(kCacheHit);
             b->cache_type = Buffer::hit_others_load;
             b->index = p;
             assert(p > 0);
@@ -854,6 +860,7 @@ SingleLruReadonlyCache::pread(intptr_t fi, size_t offset, size_t len, Buffer* b)
 						    Node::lru_remove(nodes, p);
                         }
 						m_stat_cnt[Buffer::hit]++;
+						TERARK_METRICS_INC(kCacheHit);
 						pgvec[pg - first_page].alloc_by_me = false;
 						m_histogram.ensure_get(conflict_len)++;
 						goto CrossPageNext;
@@ -888,6 +895,7 @@ SingleLruReadonlyCache::pread(intptr_t fi, size_t offset, size_t len, Buffer* b)
 					}
 					ScopeLock lock(m_mutex);
 					this->m_stat_cnt[Buffer::hit_others_load]++;
+					TERARK_METRICS_INC(kCacheHit);
 				}
 			}
 			assert(((fi << 32) | fpg) == nodes[p].fi_offset);
@@ -110,6 +110,7 @@ MixedLenBlobStoreTpl<rank_select_t>::MixedLenBlobStoreTpl() {
 
 template<class rank_select_t>
 MixedLenBlobStoreTpl<rank_select_t>::~MixedLenBlobStoreTpl() {
+    stop_checksum_verify(); // before unmapping
     if (m_isDetachMeta) {
         m_isFixedLen.risk_release_ownership();
         m_varLenOffsets.risk_release_ownership();
@@ -350,14 +351,11 @@ void MixedLenBlobStoreTpl<rank_select_t>::init_from_memory(fstring dataMem, Dict
                  : m_fixedLen);
         m_fixedNum = mmapBase->fixedNum;
 	if (m_checksumLevel == 3 && isChecksumVerifyEnabled()) {
-		XXHash64 hash(g_dmbsnark_seed);
-		hash.update(mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter));
-		const uint64_t hashVal = hash.digest();
 		auto &footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase)+mmapBase->fileSize))[-1];
-		if (hashVal != footer.fileXXHash) {
-			std::string msg = "MixedLenBlobStore::load_mmap(\"" + m_fpath + "\")";
-			throw BadChecksumException(msg, footer.fileXXHash, hashVal);
-		}
+		std::string msg = "MixedLenBlobStore::load_mmap(\"" + m_fpath + "\")";
+		verify_xxhash64(std::move(msg),
+			fstring((const char*)mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter)),
+			g_dmbsnark_seed, footer.fileXXHash);
 	}
 	byte_t* curr = (byte_t*)(mmapBase + 1);
 	if (m_fixedNum) {
@@ -89,14 +89,11 @@ void PlainBlobStore::init_from_memory(fstring dataMem, Dictionary/*dict*/) {
     m_checksumLevel = mmapBase->checksumLevel;
     m_checksumType = mmapBase->checksumType;
     if (m_checksumLevel == 3 && isChecksumVerifyEnabled()) {
-        XXHash64 hash(g_dpbsnark_seed);
-        hash.update(mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter));
-        const uint64_t hashVal = hash.digest();
         auto& footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase) + mmapBase->fileSize))[-1];
-        if (hashVal != footer.fileXXHash) {
-            std::string msg = "PlainBlobStore::load_mmap(\"" + m_fpath + "\")";
-            throw BadChecksumException(msg, footer.fileXXHash, hashVal);
-        }
+        std::string msg = "PlainBlobStore::load_mmap(\"" + m_fpath + "\")";
+        verify_xxhash64(std::move(msg),
+            fstring((const char*)mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter)),
+            g_dpbsnark_seed, footer.fileXXHash);
     }
     assert(mmapBase->offsetsUintBits == UintVecMin0::compute_uintbits(mmapBase->contentBytes));
     m_content.risk_set_data((byte_t*)(mmapBase + 1), mmapBase->contentBytes);
@@ -168,6 +165,7 @@ PlainBlobStore::PlainBlobStore() {
 }
 
 PlainBlobStore::~PlainBlobStore() {
+    stop_checksum_verify(); // before unmapping
     if (m_isDetachMeta) {
         m_offsets.risk_release_ownership();
     }
@@ -204,6 +202,11 @@ size_t PlainBlobStore::mem_size() const {
     return m_content.size() + m_offsets.mem_size();
 }
 
+uint64_t PlainBlobStore::get_zip_offset(size_t recID) const {
+    assert(recID < m_offsets.size());
+    return m_offsets[recID];
+}
+
 void
 PlainBlobStore::get_record_append_imp(size_t recID, valvec<byte_t>* recData)
 const {
@@ -289,22 +292,25 @@ const {
     xxhash64.update(&header, sizeof header);
     buffer.ensureWrite(&header, sizeof header);
 
-    for (assert(newToOld.size() == recNum); !newToOld.eof(); ++newToOld) {
-        size_t oldId = *newToOld;
-        assert(oldId < recNum);
-        size_t offsetBeg = m_offsets[oldId + 0];
-        size_t offsetEnd = m_offsets[oldId + 1];
-        size_t len = offsetEnd - offsetBeg;
-        assert(offsetBeg <= offsetEnd);
-        offset += len;
-        const  byte* beg = m_content.data() + offsetBeg;
-        xxhash64.update(beg, len);
-        buffer.ensureWrite(beg, len);
+    static const size_t offset_flush_size = 128;
+    size_t oldIds[offset_flush_size];
+    size_t begEnd[offset_flush_size * 2];
+    assert(newToOld.size() == recNum);
+    while (size_t cnt = newToOld.read(oldIds, offset_flush_size)) {
+        m_offsets.gather2(oldIds, cnt, begEnd);
+        for (size_t i = 0; i < cnt; ++i) {
+            assert(oldIds[i] < recNum);
+            size_t len = begEnd[2*i + 1] - begEnd[2*i + 0];
+            assert(begEnd[2*i + 0] <= begEnd[2*i + 1]);
+            offset += len;
+            const  byte* beg = m_content.data() + begEnd[2*i + 0];
+            xxhash64.update(beg, len);
+            buffer.ensureWrite(beg, len);
+        }
     }
     PadzeroForAlign<16>(buffer, xxhash64, offset);
     assert(offset == maxOffsetEnt);
 
-    static const size_t offset_flush_size = 128;
     UintVecMin0 newOffsets(offset_flush_size, maxOffsetEnt);
     size_t flush_count = 0;
     offset = 0;
@@ -314,22 +320,18 @@ const {
         buffer.ensureWrite(newOffsets.data(), byte_count);
         flush_count += offset_flush_size;
     };
-    for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
-        size_t newId = newToOld.index() - flush_count;
-        size_t oldId = *newToOld;
-        if (newId == offset_flush_size) {
+    newToOld.rewind();
+    while (size_t cnt = newToOld.read(oldIds, offset_flush_size)) {
+        m_offsets.gather2(oldIds, cnt, begEnd);
+        for (size_t i = 0; i < cnt; ++i) {
+            newOffsets.set_wire(i, offset);
+            offset += begEnd[2*i + 1] - begEnd[2*i + 0];
+        }
+        if (cnt == offset_flush_size) {
             flush_offset();
-            newId = 0;
         }
-        size_t offsetBeg = m_offsets[oldId + 0];
-        size_t offsetEnd = m_offsets[oldId + 1];
-        newOffsets.set_wire(newId, offset);
-        offset += offsetEnd - offsetBeg;
     }
     assert(offset == maxOffsetEnt);
-    if (recNum - flush_count == offset_flush_size) {
-        flush_offset();
-    }
     newOffsets.set_wire(recNum - flush_count, offset);
     newOffsets.resize(recNum - flush_count + 1);
     newOffsets.shrink_to_fit();
@@ -39,6 +39,7 @@ public:
     void take(fstrvec& vec);
 
     size_t mem_size() const override;
+    uint64_t get_zip_offset(size_t recID) const override;
     void reorder_zip_data(ZReorderMap& newToOld,
         function<void(const void* data, size_t size)> writeAppend,
         fstring tmpFile) const override;
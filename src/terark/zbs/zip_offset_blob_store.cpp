@@ -88,14 +88,11 @@ void ZipOffsetBlobStore::init_from_memory(fstring dataMem, Dictionary/*dict*/) {
     m_checksumType = mmapBase->checksumType;
     m_compressLevel = mmapBase->compressLevel;
     if (m_checksumLevel == 3 && isChecksumVerifyEnabled()) {
-        XXHash64 hash(g_dpbsnark_seed);
-        hash.update(mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter));
-        const uint64_t hashVal = hash.digest();
-        auto &footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase) + mmapBase->fileSize))[-1];
-        if (hashVal != footer.fileXXHash) {
-            std::string msg = "ZipOffsetBlobStore::load_mmap(\"" + m_fpath + "\")";
-            throw BadChecksumException(msg, footer.fileXXHash, hashVal);
-        }
+        auto& footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase) + mmapBase->fileSize))[-1];
+        std::string msg = "ZipOffsetBlobStore::load_mmap(\"" + m_fpath + "\")";
+        verify_xxhash64(std::move(msg),
+            fstring((const char*)mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter)),
+            g_dpbsnark_seed, footer.fileXXHash);
     }
     m_content.risk_set_data((byte_t*)(mmapBase + 1), mmapBase->contentBytes);
     m_offsets.risk_set_data(m_content.data() + align_up(m_content.size(), 16), mmapBase->offsetsBytes);
@@ -176,6 +173,7 @@ ZipOffsetBlobStore::ZipOffsetBlobStore() {
 }
 
 ZipOffsetBlobStore::~ZipOffsetBlobStore() {
+    stop_checksum_verify(); // before unmapping
     if (m_isDetachMeta) {
         m_offsets.risk_release_ownership();
     }
@@ -207,6 +205,11 @@ size_t ZipOffsetBlobStore::mem_size() const {
     return m_content.size() + m_offsets.mem_size();
 }
 
+uint64_t ZipOffsetBlobStore::get_zip_offset(size_t recID) const {
+    assert(recID < m_offsets.size());
+    return m_offsets[recID];
+}
+
 static void ZipOffsetBlobStore_AppendDecompress(size_t id, const byte_t* data, size_t size, valvec<byte_t>* output) {
     unsigned long long raw_size = ZSTD_getDecompressedSize(data, size);
     size_t curr_size = output->size();
@@ -355,15 +358,18 @@ const {
 #if !defined(NDEBUG)
     size_t maxOffsetEnt = m_offsets[recNum];
 #endif
-    for (assert(newToOld.size() == recNum); !newToOld.eof(); ++newToOld) {
-        //size_t newId = newToOld.index();
-        size_t oldId = *newToOld;
-        assert(oldId < recNum);
-        size_t BegEnd[2];
-        m_offsets.get2(oldId, BegEnd);
-        zipOffsetBuilder->push_back(offset);
-        assert(BegEnd[0] <= BegEnd[1]);
-        offset += BegEnd[1] - BegEnd[0];
+    size_t oldIds[128];
+    assert(newToOld.size() == recNum);
+    while (size_t cnt = newToOld.read(oldIds, 128)) {
+        for (size_t i = 0; i < cnt; ++i) {
+            size_t oldId = oldIds[i];
+            assert(oldId < recNum);
+            size_t BegEnd[2];
+            m_offsets.get2(oldId, BegEnd);
+            zipOffsetBuilder->push_back(offset);
+            assert(BegEnd[0] <= BegEnd[1]);
+            offset += BegEnd[1] - BegEnd[0];
+        }
     }
     assert(offset == maxOffsetEnt);
     zipOffsetBuilder->push_back(offset);
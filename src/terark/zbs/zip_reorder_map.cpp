@@ -3,6 +3,24 @@
 
 namespace terark {
 
+size_t ZReorderMap::read(size_t* out, size_t n) {
+    size_t cnt = 0;
+    while (cnt < n && i_ < size_) {
+        assert(seq_length_ > 0);
+        size_t len = std::min(seq_length_, n - cnt);
+        intptr_t val = intptr_t(current_value_), sign = sign_;
+        for (size_t j = 0; j < len; ++j)
+            out[cnt + j] = size_t(val + intptr_t(j) * sign);
+        cnt += len;
+        i_ += len;
+        current_value_ = size_t(val + intptr_t(len) * sign);
+        seq_length_ -= len;
+        if (seq_length_ == 0 && i_ < size_) {
+            read_();
+        }
+    }
+    return cnt;
+}
 
 ZReorderMap::Builder::~Builder() {
 }
@@ -62,6 +62,9 @@ public:
         }
         return *this;
     }
+    /// read at most n values into out, expanding runs of the map,
+    /// @returns values read, 0 if eof
+    size_t read(size_t* out, size_t n);
     void rewind() {
         if (file_.size < 16) {
             THROW_STD(out_of_range, "ZReorderMap rewind out_of_range");
@@ -0,0 +1,52 @@
+#include <terark/concurrent_hash_strmap.hpp>
+#include <terark/util/throw.hpp>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace terark;
+
+int main(int argc, char* argv[]) {
+    const size_t threads = 8, uniq = 20000, loop = 3;
+    concurrent_hash_strmap<size_t> freq;
+    concurrent_hash_strmap<> cset(4);
+    std::vector<std::thread> thr;
+    for (size_t t = 0; t < threads; ++t) {
+        thr.emplace_back([&,t]() {
+            char buf[32];
+            for (size_t l = 0; l < loop; ++l) {
+                for (size_t i = t % (threads / 2); i < uniq; i += threads / 2) {
+                    int len = snprintf(buf, sizeof buf, "key-%zd", i);
+                    freq.upsert(fstring(buf, len), 1, [](size_t& c) { c++; });
+                    cset.insert(fstring(buf, len));
+                }
+            }
+        });
+    }
+    for (auto& t : thr) t.join();
+    // each key is inserted by 2 threads, loop times each
+    TERARK_VERIFY_EQ(freq.size(), uniq);
+    TERARK_VERIFY_EQ(cset.size(), uniq);
+    std::atomic<size_t> sum(0);
+    freq.for_each([&](const typename concurrent_hash_strmap<size_t>::shard_t::iterator::value_type& kv) {
+        TERARK_VERIFY_EQ(kv.second, 2 * loop);
+        sum += kv.second;
+    }, 4);
+    TERARK_VERIFY_EQ(sum.load(), 2 * loop * uniq);
+    TERARK_VERIFY(freq.exists("key-0"));
+    TERARK_VERIFY(!freq.exists("key-x"));
+
+    freq.sort_fast(4);
+    std::string prev;
+    size_t cnt = 0;
+    freq.for_each_sorted([&](fstring key, size_t shard, size_t idx) {
+        TERARK_VERIFY_EQ(freq.shard(shard).val(idx), 2 * loop);
+        TERARK_VERIFY(cnt == 0 || fstring(prev) < key);
+        prev.assign(key.data(), key.size());
+        cnt++;
+    });
+    TERARK_VERIFY_EQ(cnt, uniq);
+    printf("%s done\n", argv[0]);
+    return 0;
+}
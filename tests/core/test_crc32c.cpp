@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <terark/util/crc.hpp>
+#include <terark/util/profiling.hpp>
+#include <terark/fstring.hpp>
+#include <terark/valvec.hpp>
+
+using namespace terark;
+profiling pf;
+const char* prog = NULL;
+
+// bitwise crc32c, without pre/post inversion, same as Crc32c_update
+static uint32_t crc32c_bitwise(uint32_t crc, const byte_t* p, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        crc ^= p[i];
+        for (int k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+    }
+    return crc;
+}
+
+static uint32_t crc32c_std(const void* p, size_t n) {
+    return ~Crc32c_update(~uint32_t(0), p, n);
+}
+
+// check values of RFC 3720 (iSCSI) B.4 and the common "123456789"
+static void test_known_vectors() {
+    byte_t buf[32];
+    TERARK_VERIFY_EQ(crc32c_std("123456789", 9), 0xE3069283u);
+    memset(buf, 0, 32);
+    TERARK_VERIFY_EQ(crc32c_std(buf, 32), 0x8A9136AAu);
+    memset(buf, 0xFF, 32);
+    TERARK_VERIFY_EQ(crc32c_std(buf, 32), 0x62A8AB43u);
+    for (int i = 0; i < 32; ++i) buf[i] = byte_t(i);
+    TERARK_VERIFY_EQ(crc32c_std(buf, 32), 0x46DD794Eu);
+    for (int i = 0; i < 32; ++i) buf[i] = byte_t(31 - i);
+    TERARK_VERIFY_EQ(crc32c_std(buf, 32), 0x113FDB5Cu);
+    TERARK_VERIFY_EQ(Crc32c_update(12345, buf, 0), 12345u);
+}
+
+int main(int, char* argv[]) {
+    prog = argv[0];
+    test_known_vectors();
+    size_t size = (size_t)getEnvLong("size", 40 << 20);
+    std::mt19937_64 rnd(1);
+    valvec<byte_t> buf(size + 64, valvec_no_init());
+    for (auto& c : buf) c = byte_t(rnd());
+    // unaligned starts and lengths around the 3-way block sizes
+    for (size_t len : {0, 1, 7, 8, 255, 256, 767, 768, 769, 8191, 8192,
+                       24575, 24576, 24577, 100003}) {
+        for (size_t off = 0; off < 9; ++off) {
+            uint32_t init = uint32_t(rnd());
+            TERARK_VERIFY_F(Crc32c_update(init, buf.data() + off, len) ==
+                            crc32c_bitwise(init, buf.data() + off, len),
+                            "len = %zd, off = %zd", len, off);
+        }
+    }
+    for (size_t t = 0; t < 1000; ++t) {
+        size_t n = rnd() % 100000, k = n ? rnd() % n : 0, off = rnd() % 64;
+        uint32_t init = uint32_t(rnd());
+        uint32_t a = Crc32c_update(init, buf.data() + off, k);
+        uint32_t b = Crc32c_update(0, buf.data() + off + k, n - k);
+        TERARK_VERIFY_F(Crc32c_combine(a, b, n - k) ==
+                        Crc32c_update(init, buf.data() + off, n),
+                        "n = %zd, k = %zd", n, k);
+    }
+    uint32_t whole = crc32c_bitwise(7, buf.data() + 3, size);
+    TERARK_VERIFY_EQ(Crc32c_update(7, buf.data() + 3, size), whole);
+    for (size_t threads : {0, 1, 2, 3, 8})
+        TERARK_VERIFY_EQ(Crc32c_update_parallel(7, buf.data() + 3, size, threads), whole);
+    fprintf(stderr, "%s: passed\n", prog);
+    auto t0 = pf.now();
+    uint32_t x = Crc32c_update(0, buf.data(), size);
+    auto t1 = pf.now();
+    fprintf(stderr, "%s: Crc32c_update %6.3f GB/s, crc = %08X\n",
+            prog, double(size) / pf.ns(t0, t1), x);
+    return 0;
+}
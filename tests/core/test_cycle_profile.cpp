@@ -0,0 +1,56 @@
+#define TERARK_ENABLE_CYCLE_PROFILE 1
+#include <stdio.h>
+#include <terark/stdtypes.hpp>
+#include <terark/util/metrics.hpp>
+
+using namespace terark;
+const char* prog = NULL;
+
+static volatile size_t g_sink = 0;
+static void spin(size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        g_sink = g_sink + i;
+}
+
+static void probes() {
+    TERARK_CYCLE_SCOPE(kCycleIndexDescent);
+    TERARK_CYCLE_START(tsc);
+    spin(1000);
+    TERARK_CYCLE_LAP(tsc, kCycleOffsetDecode);
+    spin(100000);
+    TERARK_CYCLE_LAP(tsc, kCycleEntropyDecode);
+}
+
+int main(int, char* argv[]) {
+    prog = argv[0];
+    unsigned long long c0 = cpu_cycles();
+    spin(1000);
+    TERARK_VERIFY_GT(cpu_cycles(), c0);
+
+    // probes honor the runtime switch
+    Metrics::enable(false);
+    Metrics::reset();
+    probes();
+    auto snap = Metrics::snapshot();
+    TERARK_VERIFY_EQ(snap[Metrics::kCycleIndexDescent].count, 0);
+    TERARK_VERIFY_EQ(snap[Metrics::kCycleOffsetDecode].count, 0);
+
+    Metrics::enable(true);
+    const size_t num = 100;
+    for (size_t i = 0; i < num; ++i)
+        probes();
+    Metrics::enable(false);
+    snap = Metrics::snapshot();
+    const auto& scope = snap[Metrics::kCycleIndexDescent];
+    const auto& lap1 = snap[Metrics::kCycleOffsetDecode];
+    const auto& lap2 = snap[Metrics::kCycleEntropyDecode];
+    TERARK_VERIFY_EQ(scope.count, num);
+    TERARK_VERIFY_EQ(lap1.count, num);
+    TERARK_VERIFY_EQ(lap2.count, num);
+    // laps are consecutive sections of the scope
+    TERARK_VERIFY_GE(scope.sum, lap1.sum + lap2.sum);
+    TERARK_VERIFY_GT(lap2.sum, lap1.sum);
+    snap.print(stderr);
+    fprintf(stderr, "%s: passed\n", prog);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <terark/thread/fiber_aio.hpp>
+#include <terark/stdtypes.hpp>
+#include <boost/fiber/all.hpp>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace terark;
+const char* prog = NULL;
+
+static const char* fname = "fiber_aio_uring.test.bin";
+static const size_t N = 64, B = 4096;
+static char wbuf[N][B], rbuf[N][B];
+
+// concurrent reads of many fibers are submitted by one io_uring_enter
+static void test_read_write(int fd) {
+    for (size_t i = 0; i < N; ++i) {
+        memset(wbuf[i], 'a' + i % 26, B);
+        TERARK_VERIFY_EQ(fiber_aio_write(fd, wbuf[i], B, i*B), intptr_t(B));
+    }
+    std::vector<boost::fibers::fiber> fv;
+    size_t bad = 0;
+    for (size_t i = 0; i < N; ++i) {
+        fv.emplace_back([&,i] {
+            memset(rbuf[i], 0, B);
+            intptr_t n = fiber_aio_read(fd, rbuf[i], B, i*B);
+            if (n != intptr_t(B) || memcmp(rbuf[i], wbuf[i], B) != 0)
+                bad++;
+        });
+    }
+    for (auto& f : fv) f.join();
+    TERARK_VERIFY_EQ(bad, 0);
+    // read beyond eof is short
+    TERARK_VERIFY_EQ(fiber_aio_read(fd, rbuf[0], 2*B, (N-1)*B), intptr_t(B));
+    TERARK_VERIFY_EQ(fiber_aio_read(fd, rbuf[0], B, N*B), 0);
+}
+
+// errors of io_uring are reported by cqe
+static void test_error(int method) {
+    errno = 0;
+    TERARK_VERIFY_EQ(fiber_aio_read(-1, rbuf[0], B, 0), -1);
+    if (2 == method)
+        TERARK_VERIFY_EQ(errno, EBADF);
+}
+
+static void test_registered(int fd) {
+    struct iovec iov = { rbuf, sizeof(rbuf) };
+    TERARK_VERIFY_EQ(fiber_aio_register_buffers(&iov, 1), 0);
+    TERARK_VERIFY_EQ(fiber_aio_register_files(&fd, 1), 0);
+    for (size_t i = 0; i < N; ++i) {
+        memset(rbuf[i], 0, B);
+        TERARK_VERIFY_EQ(fiber_aio_read(fd, rbuf[i], B, i*B), intptr_t(B));
+        TERARK_VERIFY(memcmp(rbuf[i], wbuf[i], B) == 0);
+    }
+    TERARK_VERIFY_EQ(fiber_aio_register_buffers(NULL, 0), 0);
+    TERARK_VERIFY_EQ(fiber_aio_register_files(NULL, 0), 0);
+}
+
+// length >= 4G must not be truncated to 32 bits: a read of 4G + B from a
+// file of N*B bytes returns N*B, truncated len would return just B
+static void test_large_len(int fd) {
+    size_t len = (size_t(1) << 32) + B;
+    void* mem = mmap(NULL, len, PROT_READ|PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == mem) {
+        fprintf(stderr, "%s: skip large len test: mmap = %s\n", prog, strerror(errno));
+        return;
+    }
+    TERARK_VERIFY_EQ(fiber_aio_read(fd, mem, len, 0), intptr_t(N*B));
+    TERARK_VERIFY(memcmp(mem, wbuf, N*B) == 0);
+    munmap(mem, len);
+}
+
+// fiber_aio_need on pages dropped from page cache
+static void test_need(int fd) {
+    fsync(fd);
+    posix_fadvise(fd, 0, N*B, POSIX_FADV_DONTNEED);
+    void* mem = mmap(NULL, N*B, PROT_READ, MAP_SHARED, fd, 0);
+    TERARK_VERIFY(MAP_FAILED != mem);
+    std::vector<boost::fibers::fiber> fv;
+    for (size_t i = 0; i < N; i += 8) {
+        fv.emplace_back([=] { fiber_aio_need((char*)mem + i*B, 8*B); });
+    }
+    for (auto& f : fv) f.join();
+    TERARK_VERIFY(memcmp(mem, wbuf, N*B) == 0);
+    munmap(mem, N*B);
+}
+
+int main(int, char* argv[]) {
+    prog = argv[0];
+    // aio method is probed at load, run again with io_uring
+    if (NULL == getenv("aio_method")) {
+        setenv("aio_method", "2", 1);
+        execv(argv[0], argv);
+        fprintf(stderr, "%s: execv = %s\n", prog, strerror(errno));
+        return 1;
+    }
+    int method = fiber_aio_method();
+    if (atoi(getenv("aio_method")) == 2 && 2 != method) {
+        // probe fell back to linux aio, kernel has no usable io_uring
+        TERARK_VERIFY_EQ(method, 1);
+        fprintf(stderr, "%s: io_uring is not supported, skipped\n", prog);
+        return 0;
+    }
+    int fd = open(fname, O_CLOEXEC|O_CREAT|O_RDWR|O_TRUNC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: open(%s) = %s\n", fname, strerror(errno));
+        return 1;
+    }
+    test_read_write(fd);
+    test_error(method);
+    if (2 == method)
+        test_registered(fd);
+    else
+        TERARK_VERIFY_EQ(fiber_aio_register_files(&fd, 1), -1);
+    test_large_len(fd);
+    test_need(fd);
+    close(fd);
+    remove(fname);
+    fprintf(stderr, "%s: aio_method = %d passed\n", prog, method);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <terark/thread/fiber_core_pool.hpp>
+#include <terark/util/profiling.hpp>
+#include <boost/fiber/operations.hpp>
+#include <atomic>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace terark;
+
+int main(int argc, char* argv[]) {
+	size_t num = argc >= 2 ? strtoul(argv[1], NULL, 10) : 100000;
+	PerCoreFiberPool::Options opt;
+	opt.cores = argc >= 3 ? strtoul(argv[2], NULL, 10) : 4;
+	opt.fibers_per_core = 64;
+	opt.queue_size = 256;
+	PerCoreFiberPool pool(opt);
+	for (size_t i = 0; i < pool.cores(); ++i)
+		printf("core %zd: cpu = %d, node = %d\n", i, pool.core_cpu(i), pool.core_node(i));
+	std::atomic<size_t> runs(0), forwards(0), bad(0);
+	profiling pf;
+	long long t0 = pf.now();
+	for (size_t i = 0; i < num; ++i) {
+		size_t core = i % pool.cores();
+		pool.submit(core, [&,core,i]() {
+			if (PerCoreFiberPool::current_core() != core)
+				bad++;
+			boost::this_fiber::yield(); // other fibers of this core run
+			runs++;
+			// route to the core owning the "data"
+			size_t dest = (core + 1 + i) % pool.cores();
+			PerCoreFiberPool::current_pool()->submit(dest, [&,dest]() {
+				if (PerCoreFiberPool::current_core() != dest)
+					bad++;
+				forwards++;
+			});
+		});
+	}
+	pool.wait_idle();
+	long long t1 = pf.now();
+	if (runs != num || forwards != num || bad || pool.pending()) {
+		fprintf(stderr, "error: runs = %zd, forwards = %zd, bad = %zd, pending = %zd\n",
+				runs.load(), forwards.load(), bad.load(), pool.pending());
+		return 1;
+	}
+	if (PerCoreFiberPool::current_core() != size_t(-1)) {
+		fprintf(stderr, "error: main thread is not a worker\n");
+		return 1;
+	}
+	printf("tasks = %zd, %8.3f M tasks/sec\n", 2*num, 2*num / pf.uf(t0, t1));
+	// throwing tasks, wait_idle() must still return
+	std::atomic<size_t> thrown(0);
+	for (size_t i = 0; i < 100; ++i) {
+		pool.submit(i % pool.cores(), [&,i]() {
+			thrown++;
+			if (i % 2)
+				throw std::runtime_error("test std exception");
+			throw int(i); // not a std::exception
+		});
+	}
+	pool.wait_idle();
+	if (thrown != 100 || pool.pending()) {
+		fprintf(stderr, "error: thrown = %zd, pending = %zd\n",
+				thrown.load(), pool.pending());
+		return 1;
+	}
+	printf("passed\n");
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <random>
+#include <terark/gold_hash_map_parallel.hpp>
+#include <terark/fstring.hpp>
+#include <terark/valvec.hpp>
+#include <terark/util/profiling.hpp>
+
+using namespace terark;
+profiling pf;
+const char* prog = NULL;
+
+typedef gold_hash_map<size_t, size_t> map_t;
+
+static void verify(const map_t& m, const valvec<size_t>& keys) {
+    TERARK_VERIFY_EQ(m.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        size_t idx = m.find_i(keys[i]);
+        TERARK_VERIFY_F(idx < m.end_i(), "i = %zd, key = %zd", i, keys[i]);
+        TERARK_VERIFY_EQ(m.elem_at(idx).second, i);
+    }
+    TERARK_VERIFY_EQ(m.find_i(size_t(-1)), m.end_i());
+}
+
+int main(int, char* argv[]) {
+    prog = argv[0];
+    size_t num = (size_t)getEnvLong("size", TERARK_IF_DEBUG(200000, 20000000));
+    size_t nthr = (size_t)getEnvLong("threads", 4);
+    std::mt19937_64 rnd(num);
+    valvec<size_t> keys(num, valvec_no_init());
+    for (size_t i = 0; i < num; ++i)
+        keys[i] = rnd() >> 1;
+    std::sort(keys.begin(), keys.end());
+    keys.trim(std::unique(keys.begin(), keys.end()));
+    std::shuffle(keys.begin(), keys.end(), rnd);
+    num = keys.size();
+    valvec<std::pair<size_t, size_t> > kv(num, valvec_no_init());
+    for (size_t i = 0; i < num; ++i)
+        kv[i] = std::make_pair(keys[i], i);
+
+    map_t m1;
+    auto t0 = pf.now();
+    for (size_t i = 0; i < num; ++i)
+        m1.insert_i(kv[i]);
+    auto t1 = pf.now();
+    verify(m1, keys);
+
+    map_t m2;
+    auto t2 = pf.now();
+    TERARK_VERIFY_EQ(m2.bulk_insert(kv.data(), num), num);
+    auto t3 = pf.now();
+    verify(m2, keys);
+    TERARK_VERIFY_EQ(m2.bulk_insert(kv.data(), num / 2), 0); // all exist
+
+    // pre-hashed, half exist
+    valvec<size_t> hashes(num, valvec_no_init());
+    for (size_t i = 0; i < num; ++i)
+        hashes[i] = m2.hash_v(kv[i]);
+    map_t m3;
+    m3.bulk_insert(kv.data(), num / 2, hashes.data());
+    TERARK_VERIFY_EQ(m3.bulk_insert(kv.data(), num, hashes.data()), num - num / 2);
+    verify(m3, keys);
+
+    fprintf(stderr, "%s: num = %zd, insert %6.3f, bulk_insert %6.3f ns per key\n",
+            prog, num, pf.nf(t0, t1) / num, pf.nf(t2, t3) / num);
+
+    // rehash, with erased elements in freelist
+    m3.enable_freelist();
+    for (size_t i = 0; i < num; i += 7)
+        m3.erase(keys[i]);
+    for (size_t thr : {size_t(1), size_t(2), nthr}) {
+        size_t nb = m1.bucket_size();
+        auto t4 = pf.now();
+        gold_hash_rehash_parallel(m1, nb * 2, thr);
+        auto t5 = pf.now();
+        verify(m1, keys);
+        gold_hash_rehash_parallel(m1, nb, thr);
+        verify(m1, keys);
+        gold_hash_rehash_parallel(m3, m3.bucket_size() * 2, thr);
+        for (size_t i = 0; i < num; ++i) {
+            size_t idx = m3.find_i(keys[i]);
+            if (i % 7 == 0)
+                TERARK_VERIFY_EQ(idx, m3.end_i());
+            else
+                TERARK_VERIFY_EQ(m3.elem_at(idx).second, i);
+        }
+        fprintf(stderr, "%s: rehash threads = %zd, %6.3f ns per key\n",
+                prog, thr, pf.nf(t4, t5) / num);
+    }
+    fprintf(stderr, "%s: passed\n", prog);
+    return 0;
+}
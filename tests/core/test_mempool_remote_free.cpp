@@ -0,0 +1,192 @@
+#include <terark/util/hugepage.hpp>
+#include <terark/mempool_thread_cache.hpp>
+#include <terark/stdtypes.hpp>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace terark;
+const char* prog = NULL;
+
+typedef ThreadCacheMemPool<8> MemPool;
+typedef std::pair<size_t, size_t> Block; // (pos, len)
+
+static void fill(MemPool& mp, Block b, size_t tag) {
+    size_t* p = (size_t*)(mp.data() + b.first);
+    for (size_t i = 0; i < b.second / 8; ++i)
+        p[i] = tag;
+}
+static void check(MemPool& mp, Block b, size_t tag) {
+    const size_t* p = (const size_t*)(mp.data() + b.first);
+    for (size_t i = 0; i < b.second / 8; ++i)
+        TERARK_VERIFY_EQ(p[i], tag);
+}
+
+static std::vector<Block> alloc_blocks(MemPool& mp, size_t num, size_t tag) {
+    std::vector<Block> v;
+    for (size_t i = 0; i < num; ++i) {
+        Block b(0, 8 * (1 + i % 64));
+        b.first = mp.alloc(b.second);
+        TERARK_VERIFY_NE(b.first, size_t(-1));
+        fill(mp, b, tag);
+        v.push_back(b);
+    }
+    return v;
+}
+
+static MemPool::RemoteFreeStat stat(MemPool& mp) {
+    MemPool::RemoteFreeStat st;
+    mp.get_remote_free_stat(&st);
+    return st;
+}
+
+// blocks freed by main thread are returned to the live owner
+static void test_remote_drain() {
+    MemPool mp(1024);
+    mp.set_remote_free(true);
+    mp.reserve(64 << 20);
+    const size_t num = 1000;
+    std::vector<Block> blocks;
+    std::atomic<int> phase(0);
+    std::thread owner([&] {
+        blocks = alloc_blocks(mp, num, 1);
+        phase = 1;
+        while (phase != 2) std::this_thread::yield();
+        size_t pos = mp.alloc(8); // drains returned blocks first
+        mp.sfree(pos, 8);
+        phase = 3;
+        while (phase != 4) std::this_thread::yield();
+    });
+    while (phase != 1) std::this_thread::yield();
+    size_t sum = 0;
+    for (auto b : blocks) {
+        check(mp, b, 1);
+        mp.sfree(b.first, b.second);
+        sum += b.second;
+    }
+    auto st = stat(mp);
+    TERARK_VERIFY_EQ(st.free_cnt, num);
+    TERARK_VERIFY_EQ(st.free_size, sum);
+    TERARK_VERIFY_EQ(st.drain_cnt, 0);
+    mp.flush_remote_free(); // push the partial magazine
+    phase = 2;
+    while (phase != 3) std::this_thread::yield();
+    st = stat(mp);
+    TERARK_VERIFY_EQ(st.drain_cnt, num);
+    TERARK_VERIFY_EQ(st.drain_size, sum);
+    phase = 4;
+    owner.join();
+}
+
+// blocks pushed to an exited owner are not kept by its thread cache
+static void test_owner_exit() {
+    MemPool mp(1024);
+    mp.set_remote_free(true);
+    mp.reserve(64 << 20);
+    const size_t num = 1000;
+    std::vector<Block> blocks;
+    std::atomic<int> phase(0);
+    std::thread owner([&] {
+        blocks = alloc_blocks(mp, num, 2);
+        phase = 1;
+        while (phase != 2) std::this_thread::yield();
+    });
+    while (phase != 1) std::this_thread::yield();
+    // full magazines are pushed, the last partial one is pending
+    for (size_t i = 0; i < num / 2; ++i)
+        mp.sfree(blocks[i].first, blocks[i].second);
+    TERARK_VERIFY_EQ(stat(mp).free_cnt, num / 2);
+    phase = 2;
+    owner.join(); // exit drains pushed magazines
+    const size_t cap = TCMemPoolOneThread<8>::remote_magazine_cap;
+    TERARK_VERIFY_EQ(stat(mp).drain_cnt, num / 2 / cap * cap);
+    mp.flush_remote_free(); // owner exited, taken back by main thread
+    TERARK_VERIFY_EQ(stat(mp).drain_cnt, num / 2);
+    // arenas of exited owner are disowned, frees are not remote
+    for (size_t i = num / 2; i < num; ++i) {
+        check(mp, blocks[i], 2);
+        mp.sfree(blocks[i].first, blocks[i].second);
+    }
+    auto st = stat(mp);
+    TERARK_VERIFY_EQ(st.free_cnt, num / 2);
+    TERARK_VERIFY_EQ(st.drain_cnt, num / 2);
+    // exited tc is reused, it owns new arenas again
+    std::thread reuser([&] {
+        size_t n0 = mp.size();
+        auto v = alloc_blocks(mp, num, 3);
+        TERARK_VERIFY_EQ(mp.size(), n0); // freed blocks are reused
+        blocks.swap(v);
+    });
+    reuser.join();
+    for (auto b : blocks) {
+        check(mp, b, 3);
+        mp.sfree(b.first, b.second);
+    }
+}
+
+// threads alloc and free blocks of each other, then exit in random order
+static void test_multi_thread(size_t nthr, size_t loop) {
+    MemPool mp(1024);
+    mp.set_remote_free(true);
+    mp.reserve(size_t(256) << 20);
+    std::mutex mtx;
+    std::vector<std::pair<Block, size_t> > shared;
+    std::vector<std::thread> thr;
+    for (size_t t = 0; t < nthr; ++t) {
+        thr.emplace_back([&,t] {
+            std::mt19937_64 rnd(t);
+            for (size_t i = 0; i < loop; ++i) {
+                size_t tag = (t << 32) | i;
+                Block b(0, 8 * (1 + rnd() % 128));
+                b.first = mp.alloc(b.second);
+                TERARK_VERIFY_NE(b.first, size_t(-1));
+                fill(mp, b, tag);
+                std::pair<Block, size_t> x(b, tag);
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    if (!shared.empty() && rnd() % 2) {
+                        std::swap(x, shared[rnd() % shared.size()]);
+                        // free a random block, may be of another thread
+                    } else {
+                        shared.push_back(x);
+                        continue;
+                    }
+                }
+                check(mp, x.first, x.second);
+                mp.sfree(x.first.first, x.first.second);
+            }
+            if (t % 2)
+                mp.flush_remote_free();
+        });
+    }
+    for (auto& t : thr) t.join();
+    for (auto& x : shared) {
+        check(mp, x.first, x.second);
+        mp.sfree(x.first.first, x.first.second);
+    }
+    mp.flush_remote_free();
+    // all owners exited, nothing is left in magazines
+    auto st = stat(mp);
+    TERARK_VERIFY_EQ(st.drain_cnt, st.free_cnt);
+    TERARK_VERIFY_EQ(st.drain_size, st.free_size);
+    fprintf(stderr, "%s: threads = %zd, remote free = %zd\n", prog, nthr, st.free_cnt);
+}
+
+int main(int, char* argv[]) {
+    prog = argv[0];
+    if (NULL == getenv("TCMemPoolRemoteFree"))
+        TERARK_VERIFY(!MemPool(1024).get_remote_free()); // default off
+    test_remote_drain();
+    test_owner_exit();
+    size_t loop = (size_t)getEnvLong("loop", 100000);
+    test_multi_thread(2, loop);
+    test_multi_thread(8, loop / 4);
+    fprintf(stderr, "%s: passed\n", prog);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <terark/util/metrics.hpp>
+#include <terark/zbs/plain_blob_store.hpp>
+
+using namespace terark;
+const char* prog = NULL;
+
+static void test_disabled() {
+    Metrics::enable(false);
+    Metrics::reset();
+    TERARK_METRICS_INC(kCacheHit);
+    { TERARK_METRICS_TIMER(kIndexFind); }
+    auto snap = Metrics::snapshot();
+    TERARK_VERIFY_EQ(snap[Metrics::kCacheHit].count, 0);
+    TERARK_VERIFY_EQ(snap[Metrics::kIndexFind].count, 0);
+}
+
+// shards of running and exited threads are summed
+static void test_threads() {
+    Metrics::enable(true);
+    Metrics::reset();
+    const size_t nthr = 4, num = 10000;
+    std::vector<std::thread> thr;
+    for (size_t t = 0; t < nthr; ++t) {
+        thr.emplace_back([=] {
+            for (size_t i = 0; i < num; ++i) {
+                Metrics::add(Metrics::kIndexFind, i < num / 2 ? 3 : 1000);
+                TERARK_METRICS_INC(kCacheHit);
+            }
+            Metrics::inc(Metrics::kCacheMiss, 5);
+        });
+    }
+    for (auto& t : thr) t.join();
+    Metrics::add(Metrics::kIndexFind, 0); // main thread is still live
+    auto snap = Metrics::snapshot();
+    const auto& find = snap[Metrics::kIndexFind];
+    TERARK_VERIFY_EQ(find.count, nthr * num + 1);
+    TERARK_VERIFY_EQ(find.sum, nthr * num / 2 * (3 + 1000));
+    TERARK_VERIFY_EQ(find.buckets[0], 1);
+    TERARK_VERIFY_EQ(find.buckets[2], nthr * num / 2); // 3 in [2, 4)
+    TERARK_VERIFY_EQ(find.buckets[10], nthr * num / 2); // 1000 in [512, 1024)
+    TERARK_VERIFY_EQ(find.percentile(0.25), 4);
+    TERARK_VERIFY_EQ(find.percentile(0.99), 1024);
+    TERARK_VERIFY_EQ(snap[Metrics::kCacheHit].count, nthr * num);
+    TERARK_VERIFY_EQ(snap[Metrics::kCacheHit].sum, 0);
+    TERARK_VERIFY_EQ(snap[Metrics::kCacheMiss].count, nthr * 5);
+    snap.print(stderr);
+    Metrics::reset();
+    snap = Metrics::snapshot();
+    TERARK_VERIFY_EQ(snap[Metrics::kIndexFind].count, 0);
+    TERARK_VERIFY_EQ(snap[Metrics::kCacheMiss].count, 0);
+    Metrics::enable(false);
+}
+
+// BlobStore::get_record is wired to kBlobStoreGetRecord
+static void test_blob_store() {
+    const char* path = "/tmp/test_metrics.plain";
+    const size_t num = 1000;
+    std::string rec(100, 'x');
+    {
+        PlainBlobStore::MyBuilder builder(num * rec.size(), num, path, 0, 1);
+        for (size_t i = 0; i < num; ++i)
+            builder.addRecord(rec);
+        builder.finish();
+    }
+    std::unique_ptr<AbstractBlobStore> store(AbstractBlobStore::load_from_mmap(path, false));
+    Metrics::reset();
+    valvec<byte_t> r;
+    store->get_record(0, &r); // disabled
+    Metrics::enable(true);
+    for (size_t i = 0; i < num; ++i)
+        store->get_record(i, &r);
+    Metrics::enable(false);
+    TERARK_VERIFY_EQ(Metrics::snapshot()[Metrics::kBlobStoreGetRecord].count, num);
+    store.reset();
+    ::remove(path);
+}
+
+int main(int, char* argv[]) {
+    prog = argv[0];
+    test_disabled();
+    test_threads();
+    test_blob_store();
+    fprintf(stderr, "%s: passed\n", prog);
+    return 0;
+}
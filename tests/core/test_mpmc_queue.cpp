@@ -0,0 +1,101 @@
+#include <terark/util/mpmc_queue.hpp>
+#include <terark/util/concurrent_queue.hpp>
+#include <terark/circular_queue.hpp>
+#include <terark/util/profiling.hpp>
+#include <terark/valvec.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+using namespace terark;
+
+// item is (producer << 32 | seq), each consumer checks seq of a producer is
+// increasing, and the sum of all popped items must be the sum of all pushed
+template<class Queue>
+void run(const char* name, Queue& q, size_t producers, size_t consumers, size_t num) {
+	std::atomic<uint64_t> sum(0), cnt(0);
+	std::vector<std::thread> thr;
+	profiling pf;
+	long long t0 = pf.now();
+	for (size_t p = 0; p < producers; ++p) {
+		thr.emplace_back([&,p]() {
+			for (size_t i = 0; i < num; ++i)
+				q.push_back(uint64_t(p) << 32 | i);
+		});
+	}
+	for (size_t c = 0; c < consumers; ++c) {
+		thr.emplace_back([&]() {
+			valvec<int64_t> last(producers, -1);
+			uint64_t mysum = 0;
+			while (cnt < producers * num) {
+				uint64_t x;
+				if (!q.pop_front(x, 10))
+					continue;
+				size_t p = size_t(x >> 32);
+				int64_t i = int64_t(x & 0xFFFFFFFF);
+				if (i <= last[p]) {
+					fprintf(stderr, "%s: order error: producer %zd: %lld after %lld\n",
+							name, p, (long long)i, (long long)last[p]);
+					exit(1);
+				}
+				last[p] = i;
+				mysum += x;
+				cnt++;
+			}
+			sum += mysum;
+		});
+	}
+	for (auto& t : thr) t.join();
+	long long t1 = pf.now();
+	uint64_t expect = 0;
+	for (size_t p = 0; p < producers; ++p)
+		for (size_t i = 0; i < num; ++i)
+			expect += uint64_t(p) << 32 | i;
+	if (sum != expect || !q.peekEmpty()) {
+		fprintf(stderr, "%s: sum error: %llu != %llu\n", name,
+				(unsigned long long)sum.load(), (unsigned long long)expect);
+		exit(1);
+	}
+	printf("%-16s P=%zd C=%zd: %8.3f M ops/sec\n", name, producers, consumers,
+		   producers * num / pf.uf(t0, t1));
+}
+
+int main(int argc, char* argv[]) {
+	size_t num = argc >= 2 ? strtoul(argv[1], NULL, 10) : TERARK_IF_DEBUG(100000, 1000000);
+	{
+		util::mpmc_queue<uint64_t> q(1000);
+		uint64_t x;
+		if (q.capacity() != 1024 || q.try_pop(x)) {
+			fprintf(stderr, "init error\n");
+			return 1;
+		}
+		for (uint64_t i = 0; i < 1024; ++i) q.try_push(i);
+		if (q.try_push(0) || !q.peekFull()) {
+			fprintf(stderr, "full error\n");
+			return 1;
+		}
+		for (uint64_t i = 0; i < 1024; ++i) {
+			if (!q.try_pop(x) || x != i) {
+				fprintf(stderr, "fifo error\n");
+				return 1;
+			}
+		}
+		if (q.pop_front(x, 1)) {
+			fprintf(stderr, "timeout error\n");
+			return 1;
+		}
+	}
+	size_t pc[][2] = { {1,1}, {4,1}, {1,4}, {4,4} };
+	for (auto& x : pc) {
+		util::mpmc_queue<uint64_t> q(256);
+		run("mpmc_queue", q, x[0], x[1], num);
+	}
+	for (auto& x : pc) {
+		util::concurrent_queue<circular_queue<uint64_t> > q(256);
+		q.queue().init(257);
+		run("concurrent_queue", q, x[0], x[1], num);
+	}
+	printf("passed\n");
+	return 0;
+}
@@ -13,6 +13,7 @@ using namespace terark;
 using namespace std::placeholders;
 
 int G_bPrint;
+int G_work; // cpu burn loops per item in step2, makes step2 the slow stage
 
 class MyTask : public PipelineTask
 {
@@ -65,12 +66,18 @@ public:
 
 	void step2(PipelineStage* step, int threadno, PipelineQueueItem* task)
 	{
+		volatile unsigned long h = task->plserial;
+		for (int i = 0; i < G_work; ++i)
+			h = h * 31 + i;
 		if (!G_bPrint) return;
 		PipelineLockGuard lock(*step->getMutex());
 		printf("step2: threadno=%d plserial=%06lu\n", threadno, task->plserial);
 	}
+	unsigned long serial3;
 	void step3(PipelineStage* step, int threadno, PipelineQueueItem* task)
 	{
+		// step3 is keepSerial
+		TERARK_RT_assert(++serial3 == task->plserial, std::runtime_error);
 		if (!G_bPrint) return;
 		PipelineLockGuard lock(*step->getMutex());
 		printf("step3: threadno=%d plserial=%06lu\n", threadno, task->plserial);
@@ -117,17 +124,22 @@ public:
 		G_bPrint = argc >= 2 ? atoi(argv[1]) : 0;
 		maxNum = argc >= 3 ? atoi(argv[2]) : TERARK_IF_DEBUG(10000, 50000);
 		int bcompile = argc >= 4 ? atoi(argv[3]) : 1;
+		G_work = argc >= 5 ? atoi(argv[4]) : 1000;
 		int err1 = run_test(EUType::thread, 3, bcompile);
 		int err2 = run_test(EUType::fiber , 0, bcompile);
 		int err3 = run_test(EUType::mixed , 3, bcompile);
-		return err1 + err2 + err3;
+		int err4 = run_test(EUType::steal , 3, bcompile);
+		int err5 = run_test(EUType::thread, 3, bcompile, true);
+		return err1 + err2 + err3 + err4 + err5;
     }
-    int run_test(EUType euType, int logLevel, int bcompile) {
+    int run_test(EUType euType, int logLevel, int bcompile, bool lockFree = false) {
 		PipelineProcessor pipeline;
+		serial3 = 0;
 		pipeline.setLogLevel(logLevel);
 		pipeline.setQueueTimeout(1);
 		pipeline.setQueueSize(4); // small queue is likely full
 		pipeline.setEUType(euType);
+		pipeline.setLockFreeQueue(lockFree);
 
 		std::vector<int> bindArg1;
 		// use the UNIX shell pipe denotation
@@ -149,7 +161,7 @@ public:
 		| PPL_STAGE(this, Main, step5, 1, 2.0, std::string("abcd"))
 		;
 		terark::profiling pf;
-		const char* modeName = pipeline.euTypeName();
+		const char* modeName = lockFree ? "lock-free thread" : pipeline.euTypeName();
 		long long t0 = pf.now();
 		if (bcompile) {
     		fprintf(stderr, "%s pipeline test with compile\n", modeName);
@@ -174,8 +186,10 @@ public:
 			pipeline.wait();
 		}
 		long long t1 = pf.now();
-		fprintf(stderr, "%s pipeline test passed, time=%ld'us, average=%f'us\n",
-		        modeName, (long)pf.us(t0, t1), (double)pf.ns(t0, t1)/1000/maxNum);
+		TERARK_RT_assert(serial3 == maxNum, std::runtime_error);
+		fprintf(stderr, "%s pipeline test passed, time=%ld'us, average=%f'us, QPS=%.1fK\n",
+		        modeName, (long)pf.us(t0, t1), (double)pf.ns(t0, t1)/1000/maxNum,
+		        maxNum / pf.mf(t0, t1));
 		return 0;
 	}
 };
@@ -0,0 +1,142 @@
+#include <terark/util/slab_alloc.hpp>
+#include <terark/stdtypes.hpp>
+#include <terark/valvec.hpp>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace terark;
+const char* prog = NULL;
+
+static void test_classes() {
+    size_t sizes[] = { 1, 16, 17, 64, 65, 100, 129, 4097, 512*1024 };
+    for (size_t sz : sizes) {
+        void* p = SlabAllocator::alloc(sz);
+        TERARK_VERIFY(SlabAllocator::owns(p));
+        size_t usable = SlabAllocator::usable_size(p);
+        TERARK_VERIFY_F(usable >= sz && usable <= sz * 2 + 16, "%zd %zd", sz, usable);
+        memset(p, 0xAB, sz);
+        SlabAllocator::free(p);
+    }
+}
+
+// realloc/free route blocks between slab and malloc by address
+static void test_routing() {
+    const size_t big = SlabAllocator::max_class_size + 1;
+    char* p = (char*)SlabAllocator::realloc(NULL, 100);
+    TERARK_VERIFY(SlabAllocator::owns(p));
+    memset(p, 'a', 100);
+    p = (char*)SlabAllocator::realloc(p, 1000); // to larger class
+    TERARK_VERIFY(SlabAllocator::owns(p));
+    TERARK_VERIFY_EQ(SlabAllocator::usable_size(p) >= 1000, true);
+    memset(p + 100, 'b', 900);
+    p = (char*)SlabAllocator::realloc(p, big); // slab -> malloc
+    TERARK_VERIFY(!SlabAllocator::owns(p));
+    TERARK_VERIFY_EQ(SlabAllocator::usable_size(p), 0);
+    for (size_t i = 0; i < 1000; ++i)
+        TERARK_VERIFY_EQ(p[i], i < 100 ? 'a' : 'b');
+    p = (char*)SlabAllocator::realloc(p, 50); // malloc stays malloc
+    TERARK_VERIFY(!SlabAllocator::owns(p));
+    TERARK_VERIFY(memcmp(p, std::string(50, 'a').data(), 50) == 0);
+    SlabAllocator::free(p);
+
+    p = (char*)malloc(10); // malloc memory freed by slab
+    TERARK_VERIFY(!SlabAllocator::owns(p));
+    SlabAllocator::free(p);
+    SlabAllocator::free(NULL);
+    p = (char*)SlabAllocator::alloc(big);
+    TERARK_VERIFY(!SlabAllocator::owns(p));
+    SlabAllocator::free(p);
+    p = (char*)SlabAllocator::alloc(100);
+    TERARK_VERIFY_EQ(SlabAllocator::realloc(p, 0), (void*)NULL);
+
+    // plain valvec is never slab memory
+    valvec<char> v(100, 'x');
+    TERARK_VERIFY(!SlabAllocator::owns(v.data()));
+}
+
+// allocated by one thread, grown and freed by others
+static void test_threads() {
+    typedef std::vector<char, slab_allocator<char> > SlabStr;
+    std::vector<SlabStr> bufs(10000);
+    for (auto& b : bufs) {
+        b.reserve(100);
+        TERARK_VERIFY(SlabAllocator::owns(b.data()));
+        b.insert(b.end(), "hello", "hello" + 5);
+    }
+    std::vector<std::thread> thr;
+    for (size_t t = 0; t < 4; ++t) {
+        thr.emplace_back([&,t]() {
+            for (size_t i = t; i < bufs.size(); i += 4) {
+                for (int j = 0; j < 200; ++j)
+                    bufs[i].push_back('x');
+                TERARK_VERIFY(memcmp(bufs[i].data(), "hello", 5) == 0);
+                SlabStr().swap(bufs[i]);
+            }
+            for (size_t i = 0; i < 100000; ++i) {
+                std::vector<byte_t, slab_allocator<byte_t> > b(i % 20000, byte_t(i));
+                b.reserve(64 + i % 10000);
+            }
+        });
+    }
+    for (auto& th : thr) th.join();
+}
+
+// blocks of exited threads are in central free lists, trim releases them
+static void test_trim() {
+    std::thread([] {
+        std::vector<void*> v;
+        for (size_t i = 0; i < 1000; ++i) {
+            v.push_back(SlabAllocator::alloc(8192));
+            memset(v.back(), 1, 8192);
+        }
+        for (void* p : v)
+            SlabAllocator::free(p);
+    }).join();
+    auto st0 = SlabAllocator::get_stat();
+    size_t released = SlabAllocator::trim();
+    TERARK_VERIFY_GE(released, 512 * 8192);
+    auto st1 = SlabAllocator::get_stat();
+    TERARK_VERIFY_EQ(st1.trimmed, st0.trimmed + released);
+    TERARK_VERIFY_EQ(st1.central_free, st0.central_free); // blocks are kept
+    for (size_t i = 0; i < 1000; ++i) { // released pages are usable
+        void* p = SlabAllocator::alloc(8192);
+        memset(p, 2, 8192);
+        SlabAllocator::free(p);
+    }
+}
+
+int main(int, char* argv[]) {
+    prog = argv[0];
+    if (NULL == getenv("Terark_slabAlloc")) {
+        // default off, all requests go to malloc
+        TERARK_VERIFY(!SlabAllocator::enabled());
+        void* p = SlabAllocator::alloc(100);
+        TERARK_VERIFY(!SlabAllocator::owns(p));
+        SlabAllocator::free(p);
+        TERARK_VERIFY_EQ(SlabAllocator::trim(), 0);
+        // region is reserved on first use, run again with slab enabled
+        setenv("Terark_slabAlloc", "1", 1);
+        execv(argv[0], argv);
+        fprintf(stderr, "%s: execv = %s\n", prog, strerror(errno));
+        return 1;
+    }
+    if (!SlabAllocator::enabled()) {
+        fprintf(stderr, "%s: slab is disabled, skipped\n", prog);
+        return 0;
+    }
+    test_classes();
+    test_routing();
+    test_threads();
+    test_trim();
+    auto st = SlabAllocator::get_stat();
+    fprintf(stderr, "%s: arenas = %zd, central_free = %zd, fallback = %zd, trimmed = %zd\n",
+            prog, st.arena_num, st.central_free, st.fallback_num, st.trimmed);
+    fprintf(stderr, "%s: passed\n", prog);
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <terark/swiss_hash_map.hpp>
+#include <terark/gold_hash_map.hpp>
+#include <terark/fstring.hpp>
+#include <terark/valvec.hpp>
+#include <terark/io/DataIO.hpp>
+#include <terark/io/MemStream.hpp>
+#include <terark/util/profiling.hpp>
+
+using namespace terark;
+profiling pf;
+const char* prog = NULL;
+
+typedef swiss_hash_map<size_t, size_t> map_t;
+struct gold_map_t : gold_hash_map<size_t, size_t> {
+    using gold_hash_map<size_t, size_t>::dio_save_fast;
+    using gold_hash_map<size_t, size_t>::dio_load_fast;
+};
+
+template<class Map>
+static void verify(const Map& m, const std::unordered_map<size_t, size_t>& ref) {
+    TERARK_VERIFY_EQ(m.size(), ref.size());
+    for (auto& kv : ref) {
+        size_t idx = m.find_i(kv.first);
+        TERARK_VERIFY_F(idx < m.end_i(), "key = %zd", kv.first);
+        TERARK_VERIFY_EQ(m.val(idx), kv.second);
+    }
+}
+
+static void unit_test(size_t num, std::mt19937_64& rnd) {
+    std::unordered_map<size_t, size_t> ref;
+    map_t m;
+    for (size_t i = 0; i < num; ++i) {
+        size_t key = rnd() % (num * 2);
+        auto ib = m.insert_i(key, i);
+        TERARK_VERIFY_EQ(ib.second, ref.emplace(key, i).second);
+        TERARK_VERIFY_EQ(m.key(ib.first), key);
+    }
+    verify(m, ref);
+    // erase and reinsert, leaves kDeleted slots
+    for (size_t round = 0; round < 4; ++round) {
+        for (size_t i = 0; i < num; ++i) {
+            size_t key = rnd() % (num * 2);
+            if (rnd() % 2) {
+                TERARK_VERIFY_EQ(m.erase(key), ref.erase(key));
+            } else {
+                m[key] = i;
+                ref[key] = i;
+            }
+        }
+        verify(m, ref);
+    }
+    size_t cnt = 0;
+    for (size_t i = m.beg_i(); i < m.end_i(); i = m.next_i(i)) {
+        TERARK_VERIFY_EQ(ref.count(m.key(i)), 1);
+        cnt++;
+    }
+    TERARK_VERIFY_EQ(cnt, ref.size());
+    {
+        map_t m2(m);
+        verify(m2, ref);
+        m2.rehash(0);
+        TERARK_VERIFY_EQ(m2.delcnt(), 0);
+        verify(m2, ref);
+    }
+    // dio_save_fast is interchangeable with gold_hash_map
+    NativeDataOutput<AutoGrownMemIO> out;
+    m.dio_save_fast(out);
+    {
+        gold_map_t g;
+        NativeDataInput<MemIO> in; in.set(out.begin(), out.tell());
+        g.dio_load_fast(in);
+        TERARK_VERIFY_EQ(g.size(), ref.size());
+        for (auto& kv : ref)
+            TERARK_VERIFY_EQ(g.val(g.find_i(kv.first)), kv.second);
+        out.rewind();
+        g.dio_save_fast(out);
+    }
+    map_t m3;
+    NativeDataInput<MemIO> in; in.set(out.begin(), out.tell());
+    m3.dio_load_fast(in);
+    verify(m3, ref);
+    m3.erase_all();
+    TERARK_VERIFY(m3.empty());
+    TERARK_VERIFY_EQ(m3.beg_i(), m3.end_i());
+    TERARK_VERIFY_EQ(m3.find_i(0), m3.end_i());
+
+    swiss_hash_set<std::string> s;
+    for (size_t i = 0; i < num; ++i)
+        s.insert_i(std::to_string(i % 100));
+    TERARK_VERIFY_EQ(s.size(), std::min<size_t>(num, 100));
+}
+
+// copy constructor throws when g_throw_on_copy, move never throws
+static bool g_throw_on_copy = false;
+struct ThrowOnCopy {
+    size_t key;
+    explicit ThrowOnCopy(size_t k) : key(k) {}
+    ThrowOnCopy(const ThrowOnCopy& y) : key(y.key) {
+        if (g_throw_on_copy)
+            throw std::runtime_error("ThrowOnCopy");
+    }
+    ThrowOnCopy(ThrowOnCopy&& y) noexcept : key(y.key) {}
+};
+struct ThrowOnCopyKey {
+    size_t operator()(const ThrowOnCopy& x) const { return x.key; }
+};
+
+// a failed insert must not change size, delcnt and ctrl bytes
+static void exception_test() {
+    swiss_hash_tab<size_t, ThrowOnCopy,
+        hash_and_equal<size_t, std::hash<size_t>, std::equal_to<size_t> >,
+        ThrowOnCopyKey> m;
+    const size_t num = 896; // max load of capacity 1024, to get kDeleted
+    for (size_t i = 0; i < num; ++i)
+        m.insert_i(ThrowOnCopy(i));
+    for (size_t i = 0; i < num; i += 2)
+        m.erase(i);
+    TERARK_VERIFY_GT(m.delcnt(), 0);
+    g_throw_on_copy = true;
+    for (size_t i = 0; i < num; ++i) {
+        size_t size = m.size(), delcnt = m.delcnt();
+        bool thrown = false;
+        try { m.insert_i(ThrowOnCopy(num + i)); }
+        catch (const std::runtime_error&) { thrown = true; }
+        TERARK_VERIFY(thrown);
+        TERARK_VERIFY_EQ(m.size(), size);
+        TERARK_VERIFY_EQ(m.delcnt(), delcnt);
+        TERARK_VERIFY_EQ(m.find_i(num + i), m.end_i());
+    }
+    g_throw_on_copy = false;
+    for (size_t i = 0; i < num; ++i)
+        m.insert_i(ThrowOnCopy(num + i));
+    TERARK_VERIFY_EQ(m.size(), num + num / 2);
+    size_t cnt = 0;
+    for (size_t i = m.beg_i(); i < m.end_i(); i = m.next_i(i))
+        cnt++;
+    TERARK_VERIFY_EQ(cnt, m.size());
+    for (size_t i = 0; i < 2 * num; ++i)
+        TERARK_VERIFY_EQ(m.exists(i), (i >= num || i % 2 == 1));
+}
+
+template<class Map>
+static void bench(const char* name, const valvec<size_t>& keys,
+                  const valvec<size_t>& probe) {
+    Map m;
+    auto t0 = pf.now();
+    for (size_t i = 0; i < keys.size(); ++i)
+        m.insert_i(keys[i], i);
+    auto t1 = pf.now();
+    size_t sum = 0;
+    for (size_t i = 0; i < probe.size(); ++i) {
+        size_t idx = m.find_i(probe[i]);
+        if (idx != m.end_i())
+            sum += m.val(idx);
+    }
+    auto t2 = pf.now();
+    fprintf(stderr, "%s: %s: num = %zd, insert %6.3f, find %6.3f ns per key, sum = %zd\n",
+            prog, name, keys.size(), pf.nf(t0, t1) / keys.size(),
+            pf.nf(t1, t2) / probe.size(), sum);
+}
+
+int main(int, char* argv[]) {
+    prog = argv[0];
+    std::mt19937_64 rnd(1);
+    for (size_t num : {0, 1, 15, 16, 17, 100, 1000, 100000})
+        unit_test(num, rnd);
+    exception_test();
+    fprintf(stderr, "%s: passed\n", prog);
+
+    size_t num = (size_t)getEnvLong("size", TERARK_IF_DEBUG(100000, 10000000));
+    valvec<size_t> keys(num, valvec_no_init());
+    valvec<size_t> probe(num, valvec_no_init());
+    for (size_t i = 0; i < num; ++i)
+        keys[i] = rnd();
+    for (size_t i = 0; i < num; ++i) // about half hit
+        probe[i] = rnd() % 2 ? keys[rnd() % num] : rnd();
+    bench<gold_hash_map<size_t, size_t> >("gold_hash_map ", keys, probe);
+    bench<map_t>("swiss_hash_map", keys, probe);
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <random>
+#include <terark/fstring.hpp>
+#include <terark/int_vector.hpp>
+#include <terark/util/profiling.hpp>
+
+using namespace terark;
+profiling pf;
+const char* prog = NULL;
+
+template<class UintVec>
+void unit_test(size_t maxbits) {
+    std::mt19937_64 rnd(maxbits);
+    valvec<size_t> out, idx;
+    for (size_t bits = 0; bits <= maxbits; ++bits) {
+        size_t mask = 64 == bits ? size_t(-1) : (size_t(1) << bits) - 1;
+        for (size_t size : {0, 1, 7, 8, 9, 63, 64, 65, 1000}) {
+            UintVec uv;
+            uv.resize_with_uintbits(size, bits);
+            for (size_t i = 0; i < size; ++i)
+                uv.set_wire(i, rnd() & mask);
+            out.resize_no_init(size);
+            for (size_t lo = 0; lo <= std::min<size_t>(size, 17); ++lo) {
+                size_t n = size - lo;
+                uv.get_range(lo, n, out.data());
+                for (size_t i = 0; i < n; ++i)
+                    TERARK_VERIFY_F(out[i] == uv[lo + i],
+                        "bits = %zd, size = %zd, lo = %zd, i = %zd",
+                        bits, size, lo, i);
+            }
+            idx.resize_no_init(size);
+            for (size_t i = 0; i < size; ++i)
+                idx[i] = rnd() % size;
+            uv.gather(idx.data(), size, out.data());
+            for (size_t i = 0; i < size; ++i)
+                TERARK_VERIFY_F(out[i] == uv[idx[i]],
+                    "bits = %zd, size = %zd, i = %zd", bits, size, i);
+            if (size >= 2) {
+                for (size_t i = 0; i < size; ++i)
+                    idx[i] = rnd() % (size - 1);
+                out.resize_no_init(2 * size);
+                uv.gather2(idx.data(), size, out.data());
+                for (size_t i = 0; i < size; ++i)
+                    TERARK_VERIFY_F(out[2*i] == uv[idx[i]] &&
+                                    out[2*i+1] == uv[idx[i]+1],
+                        "bits = %zd, size = %zd, i = %zd", bits, size, i);
+            }
+        }
+    }
+    fprintf(stderr, "%s: %s: passed\n", prog, BOOST_CURRENT_FUNCTION);
+}
+
+template<class UintVec>
+void bench(size_t size, size_t bits, size_t loop) {
+    std::mt19937_64 rnd(bits);
+    size_t mask = (size_t(1) << bits) - 1;
+    UintVec uv;
+    uv.resize_with_uintbits(size, bits);
+    for (size_t i = 0; i < size; ++i)
+        uv.set_wire(i, rnd() & mask);
+    valvec<size_t> out(size, valvec_no_init());
+    valvec<size_t> idx(size, valvec_no_init());
+    for (size_t i = 0; i < size; ++i)
+        idx[i] = rnd() % size;
+    size_t sum = 0;
+    auto t0 = pf.now();
+    for (size_t l = 0; l < loop; ++l)
+        for (size_t i = 0; i < size; ++i)
+            sum += uv[i];
+    auto t1 = pf.now();
+    for (size_t l = 0; l < loop; ++l) {
+        uv.get_range(0, size, out.data());
+        sum += out[l % size];
+    }
+    auto t2 = pf.now();
+    for (size_t l = 0; l < loop; ++l)
+        for (size_t i = 0; i < size; ++i)
+            sum += uv[idx[i]];
+    auto t3 = pf.now();
+    for (size_t l = 0; l < loop; ++l) {
+        uv.gather(idx.data(), size, out.data());
+        sum += out[l % size];
+    }
+    auto t4 = pf.now();
+    double n = double(size * loop);
+    fprintf(stderr,
+        "%s: bits = %2zd: get %6.3f, get_range %6.3f, "
+        "random get %6.3f, gather %6.3f ns per op, sum = %zX\n",
+        BOOST_CURRENT_FUNCTION, bits, pf.nf(t0, t1) / n, pf.nf(t1, t2) / n,
+        pf.nf(t2, t3) / n, pf.nf(t3, t4) / n, sum);
+}
+
+int main(int argc, char* argv[]) {
+    prog = argv[0];
+    size_t size = (size_t)getEnvLong("size", TERARK_IF_DEBUG(100000, 10000000));
+    size_t loop = (size_t)getEnvLong("loop", TERARK_IF_DEBUG(1, 5));
+    unit_test<   UintVecMin0>(58);
+    unit_test<BigUintVecMin0>(64);
+    for (size_t bits : {7, 13, 20, 25, 32, 45})
+        bench<UintVecMin0>(size, bits, loop);
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <random>
+#include <terark/fstring.hpp>
+#include <terark/io/DataIO.hpp>
+#include <terark/io/var_int.hpp>
+#include <terark/io/var_int_simd.hpp>
+#include <terark/io/FileStream.hpp>
+#include <terark/io/StreamBuffer.hpp>
+#include <terark/util/profiling.hpp>
+#include <terark/valvec.hpp>
+
+using namespace terark;
+profiling pf;
+const char* prog = NULL;
+
+// values of mixed byte length, p1 is the ratio of 1 byte values
+template<class Uint>
+void gen(valvec<Uint>& v, size_t n, double p1, std::mt19937_64& rnd) {
+    v.resize_no_init(n);
+    std::uniform_real_distribution<double> u;
+    for (size_t i = 0; i < n; ++i) {
+        if (u(rnd) < p1)
+            v[i] = Uint(rnd() % 128);
+        else
+            v[i] = Uint(rnd() >> (rnd() % (8 * sizeof(Uint))));
+    }
+}
+
+template<class Uint>
+void test_var_uint(size_t n, double p1, std::mt19937_64& rnd) {
+    valvec<Uint> v, d(n + 1, valvec_no_init());
+    gen(v, n, p1, rnd);
+    valvec<byte_t> buf(10 * n, valvec_no_init());
+    byte_t* p = buf.data();
+    for (size_t i = 0; i < n; ++i)
+        p = sizeof(Uint) == 4 ? save_var_uint32(p, uint32_t(v[i]))
+                              : save_var_uint64(p, uint64_t(v[i]));
+    const byte_t* end = sizeof(Uint) == 4
+        ? load_var_uint32_batch(buf.data(), p, n, (uint32_t*)d.data())
+        : load_var_uint64_batch(buf.data(), p, n, (uint64_t*)d.data());
+    TERARK_VERIFY_EQ(end, p);
+    for (size_t i = 0; i < n; ++i)
+        TERARK_VERIFY_F(v[i] == d[i], "n = %zd, i = %zd", n, i);
+    if (n) {
+        try {
+            if (sizeof(Uint) == 4)
+                load_var_uint32_batch(buf.data(), p - 1, n, (uint32_t*)d.data());
+            else
+                load_var_uint64_batch(buf.data(), p - 1, n, (uint64_t*)d.data());
+            TERARK_DIE("truncated var uint is not detected, n = %zd", n);
+        }
+        catch (const std::runtime_error&) {}
+    }
+}
+
+// small buffer, values cross buffer boundaries
+void test_input_buffer(size_t n, size_t bufsize, std::mt19937_64& rnd) {
+    valvec<uint64_t> v, d(n, valvec_no_init());
+    gen(v, n, 0.5, rnd);
+    const char* fname = "test_var_int_simd.tmp";
+    {
+        FileStream fp(fname, "wb");
+        NativeDataOutput<OutputBuffer> out(&fp);
+        for (size_t i = 0; i < n; ++i)
+            out << var_uint64_t(v[i]);
+        out << var_uint64_t(12345); // tail is still readable
+    }
+    FileStream fp(fname, "rb");
+    InputBuffer in(&fp);
+    in.set_bufsize(bufsize);
+    for (size_t i = 0; i < n; ) {
+        size_t k = std::min<size_t>(n - i, rnd() % 300);
+        in.read_var_uint64_batch(d.data() + i, k);
+        i += k;
+    }
+    for (size_t i = 0; i < n; ++i)
+        TERARK_VERIFY_F(v[i] == d[i], "n = %zd, bufsize = %zd, i = %zd",
+                        n, bufsize, i);
+    TERARK_VERIFY_EQ(in.read_var_uint64(), 12345u);
+    fp.close();
+    ::remove(fname);
+}
+
+void bench(size_t n, double p1) {
+    std::mt19937_64 rnd(n);
+    valvec<uint32_t> v, d(n, valvec_no_init());
+    gen(v, n, p1, rnd);
+    valvec<byte_t> leb(5 * n, valvec_no_init());
+    byte_t* p = leb.data();
+    for (size_t i = 0; i < n; ++i)
+        p = save_var_uint32(p, v[i]);
+    size_t sum = 0;
+    auto t0 = pf.now();
+    const byte_t* q = leb.data();
+    for (size_t i = 0; i < n; ++i)
+        d[i] = load_var_uint32(q, &q);
+    sum += d[n-1];
+    auto t1 = pf.now();
+    load_var_uint32_batch(leb.data(), p, n, d.data());
+    sum += d[n-1];
+    auto t2 = pf.now();
+    fprintf(stderr,
+        "%s: p1 = %4.2f: var_uint one by one %6.3f, batch %6.3f ns per value, "
+        "simd = %d, sum = %zd\n", prog, p1, pf.nf(t0, t1) / n,
+        pf.nf(t1, t2) / n, var_uint_batch_has_simd(), sum);
+}
+
+int main(int argc, char* argv[]) {
+    prog = argv[0];
+    std::mt19937_64 rnd(1);
+    for (size_t n : {0, 1, 3, 4, 15, 16, 17, 100, 1000, 10000}) {
+        for (double p1 : {0.0, 0.5, 0.9, 1.0}) {
+            test_var_uint<uint32_t>(n, p1, rnd);
+            test_var_uint<uint64_t>(n, p1, rnd);
+        }
+    }
+    for (size_t bufsize : {16, 37, 256, 64*1024})
+        test_input_buffer(20000, bufsize, rnd);
+    fprintf(stderr, "%s: passed\n", prog);
+    size_t n = (size_t)getEnvLong("size", TERARK_IF_DEBUG(100000, 10000000));
+    for (double p1 : {0.5, 0.9, 1.0})
+        bench(n, p1);
+    return 0;
+}
@@ -115,7 +115,54 @@ void unit_test_binary_search() {
     printf("done unit_test_binary_search!\n");
 }
 
+void unit_test_vertical(size_t blockUnits) {
+    std::mt19937_64 random;
+    valvec<size_t> truth;
+    size_t curVal = 0;
+    for (size_t width = 0; width <= 40; ++width) {
+        for (size_t i = 0; i < 3*blockUnits + 7; ++i) {
+            truth.push_back(curVal);
+            curVal += 5 + (width ? random() % (size_t(1) << width) : 0);
+        }
+    }
+    if (NULL == getenv("SortedUintVec_Builder_VerticalLayout")) {
+        SortedUintVec szip; // legacy layout by default
+        szip.build_from(truth, blockUnits);
+        assert(!szip.is_vertical_layout());
+    }
+    for (bool vertical : {false, true}) {
+        setenv("SortedUintVec_Builder_VerticalLayout", vertical ? "1" : "0", 1);
+        SortedUintVec szip;
+        szip.build_from(truth, blockUnits);
+        unsetenv("SortedUintVec_Builder_VerticalLayout");
+        assert(szip.is_vertical_layout() == vertical);
+        valvec<size_t> block(blockUnits);
+        for (size_t i = 0; i < truth.size(); ++i) {
+            size_t z[2];
+            szip.get2(i, z);
+            assert(z[0] == truth[i]);
+            assert(i + 1 == truth.size() || z[1] == truth[i+1]);
+            if (i % blockUnits == 0) {
+                szip.get_block(i / blockUnits, block.data());
+                for (size_t j = 0; j < blockUnits && i + j < truth.size(); ++j)
+                    assert(block[j] == truth[i+j]);
+            }
+            assert(szip.lower_bound(0, truth.size(), truth[i]) == i);
+        }
+        SortedUintVec copy;
+        copy.risk_set_data(szip.data(), szip.mem_size());
+        assert(copy.is_vertical_layout() == vertical);
+        assert(copy[truth.size()/2] == truth[truth.size()/2]);
+        copy.risk_release_ownership();
+        printf("vertical = %d, blockUnits = %zd, mem_size = %zd\n",
+               vertical, blockUnits, szip.mem_size());
+    }
+    printf("done unit_test_vertical!\n");
+}
+
 int main(int argc, char* argv[]) {
+	unit_test_vertical(64);
+	unit_test_vertical(128);
 	unit_test_bug1();
 	unit_test_small();
 	unit_test_binary_search();
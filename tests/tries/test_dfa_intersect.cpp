@@ -0,0 +1,158 @@
+#include <terark/fsa/cspptrie.inl>
+#include <terark/fsa/dfa_intersect.hpp>
+#include <terark/fsa/nest_trie_dawg.hpp>
+#include <terark/util/profiling.hpp>
+#include <random>
+#include <regex>
+#include <vector>
+
+using namespace terark;
+
+// sorted: unique sorted keys, match[i] is whether sorted[i] matches
+void check(const MatchingDFA& dfa, const ByteAutomaton& au,
+           const std::vector<std::string>& sorted, const valvec<bool>& match,
+           std::mt19937& rnd) {
+    DFA_IntersectIterator iter(&dfa, &au);
+    const BaseDAWG* dawg = dfa.get_dawg();
+    size_t i = 0;
+    for (bool ok = iter.seek_begin(); ok; ok = iter.incr(), ++i) {
+        while (i < sorted.size() && !match[i]) i++;
+        TERARK_VERIFY_LT(i, sorted.size());
+        TERARK_VERIFY(iter.word() == sorted[i]);
+        if (dawg)
+            TERARK_VERIFY_EQ(iter.word_id(), dawg->index(sorted[i]));
+    }
+    while (i < sorted.size() && !match[i]) i++;
+    TERARK_VERIFY_EQ(i, sorted.size());
+    for (size_t j = 0; j < 2000; ++j) {
+        std::string target = sorted[rnd() % sorted.size()];
+        switch (rnd() % 3) {
+        case 0: break;
+        case 1: target.resize(rnd() % (target.size() + 1)); break;
+        case 2: target.push_back('a' + rnd() % 8); break;
+        }
+        size_t k = std::lower_bound(sorted.begin(), sorted.end(), target) - sorted.begin();
+        while (k < sorted.size() && !match[k]) k++;
+        bool ok = iter.seek_lower_bound(target);
+        TERARK_VERIFY_EQ(ok, (k < sorted.size()));
+        for (size_t n = 0; ok && n < 3; ++n) {
+            TERARK_VERIFY(iter.word() == sorted[k]);
+            ok = iter.incr();
+            for (k++; k < sorted.size() && !match[k]; ) k++;
+            TERARK_VERIFY_EQ(ok, (k < sorted.size()));
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t num = argc >= 2 ? strtoul(argv[1], NULL, 10) : 20000;
+    std::mt19937 rnd(4321);
+    SortableStrVec strVec;
+    std::string word;
+    const char* prefixes[] = { "user:", "item:", "usr:", "" };
+    for (size_t i = 0; i < num; ++i) {
+        if (rnd() % 8 == 0) {
+            word = "user:";
+            word.push_back('a' + rnd() % 3);
+            word += ":2024-";
+            word.push_back('0' + rnd() % 10);
+            strVec.push_back(word);
+            continue;
+        }
+        word = prefixes[rnd() % 4];
+        size_t len = rnd() % 10;
+        for (size_t j = 0; j < len; ++j)
+            word.push_back("abc:-2024"[rnd() % 9]);
+        strVec.push_back(word);
+    }
+    std::vector<std::string> sorted;
+    for (size_t i = 0; i < strVec.size(); ++i)
+        sorted.push_back(strVec[i].str());
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    NestLoudsTrieDAWG_SE_512 nlt;
+    {
+        SortableStrVec tmp = strVec;
+        NestLoudsTrieConfig conf;
+        nlt.build_from(tmp, conf);
+    }
+    MainPatricia pt(sizeof(size_t), 64<<20);
+    {
+        Patricia::WriterTokenPtr token(new Patricia::WriterToken());
+        token->acquire(&pt);
+        for (size_t i = 0; i < strVec.size(); ++i)
+            pt.insert(strVec[i], &i, &*token);
+        token->release();
+    }
+    const char* regexes[] = {
+        "user:.*:2024-.*", "(user|item):[abc]+", "u?s.r:a*", "[^u].*", "",
+        ".*0.*2", "item:(ab|c:)*", "x.*", "user:[a-c]?[-:]?.?",
+    };
+    for (const char* re : regexes) {
+        std::unique_ptr<RegexAutomaton> au(RegexAutomaton::compile_regex(re));
+        std::regex sre(re);
+        valvec<bool> match(sorted.size());
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            match[i] = std::regex_match(sorted[i], sre);
+            TERARK_VERIFY_EQ(match[i], au->match(sorted[i]));
+        }
+        check(nlt, *au, sorted, match, rnd);
+        check(pt , *au, sorted, match, rnd);
+    }
+    {
+        std::unique_ptr<RegexAutomaton> au(RegexAutomaton::compile_glob("user:*:2024-*"));
+        std::unique_ptr<RegexAutomaton> re(RegexAutomaton::compile_regex("user:.*:2024-.*"));
+        valvec<bool> match(sorted.size());
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            match[i] = re->match(sorted[i]);
+            TERARK_VERIFY_EQ(match[i], au->match(sorted[i]));
+        }
+        check(nlt, *au, sorted, match, rnd);
+
+        // user supplied dfa: all keys of len <= 3 on "abc:", no zpath
+        NestLoudsTrieDAWG_SE_512 nlt2;
+        SortableStrVec tmp;
+        std::string w;
+        for (size_t len = 0; len <= 3; ++len) {
+            for (size_t x = 0; x < (size_t(1) << 2*len); ++x) {
+                w.resize(len);
+                for (size_t j = 0; j < len; ++j)
+                    w[j] = "abc:"[x >> 2*j & 3];
+                tmp.push_back(w);
+            }
+        }
+        NestLoudsTrieConfig conf;
+        nlt2.build_from(tmp, conf);
+        TERARK_VERIFY_EQ(nlt2.num_zpath_states(), 0);
+        BaseDFA_Automaton dau(&nlt2);
+        for (size_t i = 0; i < sorted.size(); ++i)
+            match[i] = sorted[i].size() <= 3 &&
+                sorted[i].find_first_not_of("abc:") == std::string::npos;
+        check(nlt, dau, sorted, match, rnd);
+    }
+    bool bad = false;
+    try { RegexAutomaton::compile_regex("(ab"); } catch (const std::invalid_argument&) { bad = true; }
+    TERARK_VERIFY(bad);
+    {
+        // chain of ~9000 states, dead state pruning must be linear
+        std::string lit(9000, 'a');
+        for (size_t i = 0; i < lit.size(); ++i) lit[i] = 'a' + i % 26;
+        profiling pf;
+        long long t0 = pf.now();
+        std::unique_ptr<RegexAutomaton> chain(RegexAutomaton::compile_glob(lit + "*"));
+        printf("compile glob of %zd chars: %.3f ms\n", lit.size(), pf.mf(t0, pf.now()));
+        TERARK_VERIFY(chain->match(lit + "xyz"));
+        TERARK_VERIFY(!chain->match(lit.substr(0, lit.size() - 1)));
+    }
+
+    std::unique_ptr<RegexAutomaton> au(RegexAutomaton::compile_glob("user:*:2024-*"));
+    DFA_IntersectIterator iter(&nlt, au.get());
+    profiling pf;
+    long long t0 = pf.now();
+    size_t cnt = 0;
+    for (bool ok = iter.seek_begin(); ok; ok = iter.incr()) cnt++;
+    printf("glob scan: %zd matches of %zd keys, %.3f ms\n", cnt, nlt.num_words(), pf.mf(t0, pf.now()));
+    printf("passed\n");
+    return 0;
+}
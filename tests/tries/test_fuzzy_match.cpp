@@ -0,0 +1,105 @@
+#include <terark/fsa/cspptrie.inl>
+#include <terark/fsa/fuzzy_match.hpp>
+#include <terark/fsa/nest_trie_dawg.hpp>
+#include <terark/util/profiling.hpp>
+#include <random>
+
+using namespace terark;
+
+// plain O(m*n) optimal string alignment distance
+size_t osa_distance(fstring a, fstring b, bool damerau) {
+    size_t m = a.size(), n = b.size();
+    valvec<size_t> d((m+1)*(n+1));
+    auto D = [&](size_t i, size_t j) -> size_t& { return d[i*(n+1) + j]; };
+    for (size_t i = 0; i <= m; ++i) D(i, 0) = i;
+    for (size_t j = 0; j <= n; ++j) D(0, j) = j;
+    for (size_t i = 1; i <= m; ++i) {
+        for (size_t j = 1; j <= n; ++j) {
+            size_t x = D(i-1, j-1) + (a[i-1] != b[j-1]);
+            x = std::min(x, D(i-1, j) + 1);
+            x = std::min(x, D(i, j-1) + 1);
+            if (damerau && i > 1 && j > 1 && a[i-1] == b[j-2] && a[i-2] == b[j-1])
+                x = std::min(x, D(i-2, j-2) + 1);
+            D(i, j) = x;
+        }
+    }
+    return D(m, n);
+}
+
+void check(const MatchingDFA& dfa, const SortableStrVec& sorted,
+           fstring pattern, size_t k, bool damerau, size_t limit) {
+    valvec<FuzzyMatchResult> res;
+    SortableStrVec keys;
+    dfa_fuzzy_match(&dfa, pattern, k, limit, &res, &keys, damerau);
+    LevenshteinAutomaton la(pattern, k, damerau);
+    size_t nth = 0;
+    for (size_t i = 0; i < sorted.size() && nth < limit; ++i) {
+        fstring key = sorted[i];
+        if (i && key == sorted[i-1])
+            continue;
+        size_t dist = osa_distance(key, pattern, damerau);
+        TERARK_VERIFY_EQ(std::min(dist, k+1), la.distance(key));
+        if (dist > k)
+            continue;
+        TERARK_VERIFY_LT(nth, res.size());
+        TERARK_VERIFY(keys[nth] == key);
+        TERARK_VERIFY_EQ(res[nth].distance, dist);
+        nth++;
+    }
+    TERARK_VERIFY_EQ(nth, res.size());
+    if (const BaseDAWG* dawg = dfa.get_dawg()) {
+        for (size_t i = 0; i < res.size(); ++i)
+            TERARK_VERIFY_EQ(dawg->index(keys[i]), res[i].word_id);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t num = argc >= 2 ? strtoul(argv[1], NULL, 10) : 20000;
+    std::mt19937 rnd(1234);
+    SortableStrVec strVec;
+    std::string word;
+    for (size_t i = 0; i < num; ++i) {
+        word.resize(1 + rnd() % 12);
+        for (char& c : word)
+            c = 'a' + rnd() % 6;
+        strVec.push_back(word);
+    }
+    SortableStrVec sorted = strVec;
+    sorted.sort();
+
+    NestLoudsTrieDAWG_SE_512 nlt;
+    {
+        SortableStrVec tmp = strVec;
+        NestLoudsTrieConfig conf;
+        nlt.build_from(tmp, conf);
+    }
+    MainPatricia pt(sizeof(size_t), 64<<20);
+    {
+        Patricia::WriterTokenPtr token(new Patricia::WriterToken());
+        token->acquire(&pt);
+        for (size_t i = 0; i < strVec.size(); ++i)
+            pt.insert(strVec[i], &i, &*token);
+        token->release();
+    }
+    const char* patterns[] = { "", "a", "abc", "fedcba", "abcdefabcdef", "bacd", "zzzz" };
+    for (fstring pattern : patterns) {
+        for (size_t k = 0; k <= 3; ++k) {
+            for (bool damerau : {false, true}) {
+                check(nlt, sorted, pattern, k, damerau, size_t(-1));
+                check(nlt, sorted, pattern, k, damerau, 7);
+                check(pt , sorted, pattern, k, damerau, size_t(-1));
+            }
+        }
+    }
+    profiling pf;
+    long long t0 = pf.now();
+    size_t cnt = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+        valvec<FuzzyMatchResult> res;
+        dfa_fuzzy_match(&nlt, sorted[i * 7 % sorted.size()], 1, 100, &res);
+        cnt += res.size();
+    }
+    printf("k = 1: %8.3f us per query, %zd results\n", pf.uf(t0, pf.now()) / 1000, cnt);
+    printf("passed\n");
+    return 0;
+}
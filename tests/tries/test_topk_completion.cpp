@@ -0,0 +1,129 @@
+#include <terark/fsa/topk_completion.hpp>
+#include <terark/io/DataIO.hpp>
+#include <terark/io/MemStream.hpp>
+#include <terark/util/profiling.hpp>
+#include <map>
+#include <random>
+
+using namespace terark;
+
+// brute force: weights of all keys with prefix, descending
+void check(const TopkCompletionTrie& tc, const std::map<std::string, uint64_t>& dict,
+           fstring prefix, size_t k) {
+    valvec<uint64_t> expected;
+    for (auto& kv : dict) {
+        if (fstring(kv.first).startsWith(prefix))
+            expected.push_back(kv.second);
+    }
+    std::sort(expected.begin(), expected.end(), std::greater<uint64_t>());
+    expected.risk_set_size(std::min(expected.size(), k));
+
+    valvec<TopkCompletionTrie::Item> res;
+    SortableStrVec keys;
+    tc.topk(prefix, k, &res, &keys);
+    TERARK_VERIFY_EQ(res.size(), expected.size());
+    for (size_t i = 0; i < res.size(); ++i) {
+        // ties may come in any order, weights must be the same
+        TERARK_VERIFY_EQ(res[i].weight, expected[i]);
+        fstring key = keys[i];
+        TERARK_VERIFY(key.startsWith(prefix));
+        TERARK_VERIFY_EQ(dict.at(key.str()), res[i].weight);
+        TERARK_VERIFY_EQ(tc.trie().index(key), res[i].word_id);
+        TERARK_VERIFY_EQ(tc.word_weight(res[i].word_id), res[i].weight);
+    }
+}
+
+// ranks of the saved data are out of the saved weights
+struct TopkDropWeights : TopkCompletionTrie {
+    size_t weights_size() const { return m_weights.size(); }
+    void drop_weights(size_t n) { m_weights.trim(m_weights.size() - n); }
+};
+
+int main(int argc, char* argv[]) {
+    size_t num = argc >= 2 ? strtoul(argv[1], NULL, 10) : 50000;
+    std::mt19937 rnd(1234);
+    SortableStrVec strVec;
+    valvec<uint64_t> weights;
+    std::map<std::string, uint64_t> dict;
+    std::string word;
+    for (size_t i = 0; i < num; ++i) {
+        word.resize(1 + rnd() % 12);
+        for (char& c : word)
+            c = 'a' + rnd() % 6;
+        uint64_t w = rnd() % 1000 * (rnd() % 1000);
+        strVec.push_back(word);
+        weights.push_back(w);
+        uint64_t& dw = dict[word];
+        dw = std::max(dw, w);
+    }
+    TopkCompletionTrie tc;
+    {
+        SortableStrVec tmp = strVec;
+        NestLoudsTrieConfig conf;
+        tc.build_from(tmp, weights, conf);
+        TERARK_VERIFY_EQ(tmp.size(), 0); // consumed
+    }
+    TERARK_VERIFY_EQ(tc.num_words(), dict.size());
+    const char* prefixes[] = { "", "a", "ab", "abc", "fedc", "bacdef", "zz", "aaaaaaaaaaaaa" };
+    for (fstring prefix : prefixes) {
+        for (size_t k : {0, 1, 5, 10, 100}) {
+            check(tc, dict, prefix, k);
+        }
+    }
+    {
+        NativeDataOutput<AutoGrownMemIO> out;
+        out << tc;
+        TopkCompletionTrie tc2;
+        NativeDataInput<MemIO> in; in.set(out.begin(), out.tell());
+        in >> tc2;
+        TERARK_VERIFY(in.eof());
+        TERARK_VERIFY_EQ(tc2.num_words(), dict.size());
+        TERARK_VERIFY_EQ(tc2.mem_size(), tc.mem_size());
+        for (fstring prefix : prefixes) {
+            for (size_t k : {1, 10, 100}) {
+                check(tc2, dict, prefix, k);
+            }
+        }
+        // corrupted data is rejected
+        out.begin()[1] ^= 0x55;
+        TopkCompletionTrie tc3;
+        in.set(out.begin(), out.tell());
+        bool thrown = false;
+        try { in >> tc3; } catch (const std::exception&) { thrown = true; }
+        TERARK_VERIFY(thrown);
+    }
+    for (int drop_all : {0, 1}) {
+        // drop 1: max rank is out of weights, drop all: no weights
+        TopkDropWeights bad;
+        {
+            SortableStrVec tmp = strVec;
+            NestLoudsTrieConfig conf;
+            bad.build_from(tmp, weights, conf);
+        }
+        bad.drop_weights(drop_all ? bad.weights_size() : 1);
+        NativeDataOutput<AutoGrownMemIO> out;
+        out << static_cast<const TopkCompletionTrie&>(bad);
+        TopkCompletionTrie tc4;
+        NativeDataInput<MemIO> in; in.set(out.begin(), out.tell());
+        bool thrown = false;
+        try { in >> tc4; } catch (const DataFormatException&) { thrown = true; }
+        TERARK_VERIFY(thrown);
+    }
+    for (size_t i = 0; i < 300; ++i) {
+        fstring key = strVec[rnd() % strVec.size()];
+        check(tc, dict, key.substr(0, rnd() % (key.size() + 1)), 1 + rnd() % 20);
+    }
+    profiling pf;
+    long long t0 = pf.now();
+    size_t cnt = 0;
+    for (size_t i = 0; i < 10000; ++i) {
+        valvec<TopkCompletionTrie::Item> res;
+        fstring key = strVec[i * 7 % strVec.size()];
+        tc.topk(key.substr(0, std::min<size_t>(2, key.size())), 10, &res);
+        cnt += res.size();
+    }
+    printf("k = 10: %8.3f us per query, %zd results, mem_size = %zd\n",
+           pf.uf(t0, pf.now()) / 10000, cnt, tc.mem_size());
+    printf("passed\n");
+    return 0;
+}
@@ -728,6 +728,10 @@ GetoptDone:
         , ms.lazy_free_sum / 1e6
         , 100.0* ms.lazy_free_sum / ms.used_size
     );
+    fprintf(stderr
+        , " remote free   |   mem_cnt  | %10.6f M | drain %10.6f M |\n"
+        , ms.remote_free_cnt / 1e6, ms.remote_drain_cnt / 1e6
+    );
     fprintf(stderr
         , " fragments     |   mem_sum  | %10.6f M | %9.2f%% |\n"
         , pt->mem_frag_size() / 1e6
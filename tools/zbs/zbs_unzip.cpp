@@ -9,6 +9,7 @@
 #include <terark/zbs/dict_zip_blob_store.hpp>
 #include <terark/util/sortable_strvec.hpp>
 #include <terark/util/profiling.hpp>
+#include <terark/util/metrics.hpp>
 #include <getopt.h>
 //#include <thread> // weired complition error in vs2015, so move to first inlcude
 #include <random>
@@ -28,6 +29,8 @@ void usage(const char* prog) {
 		"    -b Bench mark loop, this will not output unzipped data\n"
 		"    -B Output as binary, do not append newline for each record\n"
 		"    -T thread num, when benchmark, use multi thread\n"
+		"    -m Show read path metrics, cycles.* are available when built with\n"
+		"       -DTERARK_ENABLE_CYCLE_PROFILE=1\n"
 		, prog);
 	exit(1);
 }
@@ -40,7 +43,7 @@ int main(int argc, char* argv[]) {
 	int benchmarkLoop = false;
 	int threads = 0;
 	for (;;) {
-		int opt = getopt(argc, argv, "b:BhtrpT:");
+		int opt = getopt(argc, argv, "b:BhtrpT:m");
 		switch (opt) {
 		case -1:
 			goto GetoptDone;
@@ -62,6 +65,9 @@ int main(int argc, char* argv[]) {
 		case 'T':
 			threads = atoi(optarg);
 			break;
+		case 'm':
+			Metrics::enable(true);
+			break;
 		case '?':
 		case 'h':
 		default:
@@ -202,6 +208,9 @@ GetoptDone:
 		fprintf(stderr, "unzip time: %12.3f, QPS: %9.3f K,  through-put: %9.3f MB/s\n",
 			pf.sf(t2,t3), benchmarkLoop*num/pf.mf(t2,t3), bytes*benchmarkLoop/pf.uf(t2,t3));
 	}
+	if (Metrics::enabled()) {
+		Metrics::snapshot().print(stderr);
+	}
 	return 0;
 }
 